@@ -0,0 +1,134 @@
+// Block compression benchmark: encodes the textures given on the command
+// line (the bundled ones by default) with every format & encoder level and
+// prints encode time on one thread and on all cores next to the PSNR of
+// the decoded result. The PSNR comes from the module's own decoder, so a few
+// known-answer blocks check that decoder against the format specs first.
+
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <thread>
+#include <vector>
+#include <lodepng/lodepng.h>
+#include "BlockCompress/BlockCompress.hpp"
+
+const char *default_paths[] = {"./data/cell.png", "./data/dot.png", "./data/sanic.png"};
+const int runs = 5; // encodes measured per format & level
+
+// Block bytes and the texels the BC1/BC3 (S3TC) and BC7 (BPTC) specs decode
+// them to, worked out by hand. Interpolated values are exact fractions, so
+// any decoder within the specs' rounding must give the same texels.
+struct KnownBlock {
+  BlockFormat format;
+  const char *name;
+  unsigned char bytes[16];
+  unsigned char texels[16][4];
+};
+const KnownBlock known_blocks[] = {
+  // red c0 > green c1, indices 0 1 2 3 in every row
+  {BLOCK_BC1, "BC1 four colors", {0x00, 0xf8, 0xe0, 0x07, 0xe4, 0xe4, 0xe4, 0xe4},
+   {{255, 0, 0, 255}, {0, 255, 0, 255}, {170, 85, 0, 255}, {85, 170, 0, 255},
+    {255, 0, 0, 255}, {0, 255, 0, 255}, {170, 85, 0, 255}, {85, 170, 0, 255},
+    {255, 0, 0, 255}, {0, 255, 0, 255}, {170, 85, 0, 255}, {85, 170, 0, 255},
+    {255, 0, 0, 255}, {0, 255, 0, 255}, {170, 85, 0, 255}, {85, 170, 0, 255}}},
+  // black c0 <= c1, index 3 is transparent black
+  {BLOCK_BC1, "BC1 three colors", {0x00, 0x00, 0x82, 0x10, 0xe4, 0xe4, 0xe4, 0xe4},
+   {{0, 0, 0, 255}, {16, 16, 16, 255}, {8, 8, 8, 255}, {0, 0, 0, 0},
+    {0, 0, 0, 255}, {16, 16, 16, 255}, {8, 8, 8, 255}, {0, 0, 0, 0},
+    {0, 0, 0, 255}, {16, 16, 16, 255}, {8, 8, 8, 255}, {0, 0, 0, 0},
+    {0, 0, 0, 255}, {16, 16, 16, 255}, {8, 8, 8, 255}, {0, 0, 0, 0}}},
+  // alpha 70 > 0, codes 0..7 in sevenths; color indices 3 2 1 0 in every row
+  {BLOCK_BC3, "BC3 eight alphas", {0x46, 0x00, 0x88, 0xc6, 0xfa, 0x88, 0xc6, 0xfa, 0x00, 0xf8, 0x1f, 0x00, 0x1b, 0x1b, 0x1b, 0x1b},
+   {{85, 0, 170, 70}, {170, 0, 85, 0}, {0, 0, 255, 60}, {255, 0, 0, 50},
+    {85, 0, 170, 40}, {170, 0, 85, 30}, {0, 0, 255, 20}, {255, 0, 0, 10},
+    {85, 0, 170, 70}, {170, 0, 85, 0}, {0, 0, 255, 60}, {255, 0, 0, 50},
+    {85, 0, 170, 40}, {170, 0, 85, 30}, {0, 0, 255, 20}, {255, 0, 0, 10}}},
+  // alpha 0 <= 50, codes 6 & 7 are 0 & 255; c0 < c1 keeps four colors in BC3
+  {BLOCK_BC3, "BC3 six alphas", {0x00, 0x32, 0x98, 0xc3, 0xab, 0x98, 0xc3, 0xab, 0x1f, 0x00, 0x00, 0xf8, 0x00, 0x55, 0xaa, 0xff},
+   {{0, 0, 255, 0}, {0, 0, 255, 20}, {0, 0, 255, 0}, {0, 0, 255, 50},
+    {255, 0, 0, 30}, {255, 0, 0, 255}, {255, 0, 0, 10}, {255, 0, 0, 40},
+    {85, 0, 170, 0}, {85, 0, 170, 20}, {85, 0, 170, 0}, {85, 0, 170, 50},
+    {170, 0, 85, 30}, {170, 0, 85, 255}, {170, 0, 85, 10}, {170, 0, 85, 40}}},
+  // p-bits 1 & 0, endpoints R0 R1 G0 G1 B0 B1 A0 A1, anchor index 5
+  {BLOCK_BC7, "BC7 mode 6", {0xc0, 0x02, 0x1c, 0x0a, 0xf9, 0x03, 0xfe, 0xc0, 0xfa, 0x80, 0xe1, 0xd2, 0xc3, 0xb4, 0xa6, 0x97},
+   {{81, 119, 171, 213}, {224, 32, 0, 128}, {11, 161, 255, 255}, {124, 92, 120, 188},
+    {24, 153, 239, 247}, {211, 40, 16, 136}, {41, 143, 219, 237}, {194, 50, 36, 146},
+    {54, 135, 203, 229}, {181, 58, 52, 154}, {68, 127, 187, 221}, {167, 66, 68, 162},
+    {98, 109, 151, 203}, {154, 74, 84, 170}, {111, 101, 135, 195}, {137, 84, 104, 180}}},
+  // p-bits 0 & 1, anchor index 7 with its high bit implicit
+  {BLOCK_BC7, "BC7 mode 6 swapped p-bits", {0xc0, 0x3f, 0x00, 0xf0, 0x57, 0x55, 0xab, 0x2a, 0x0f, 0x1f, 0x2e, 0x3d, 0x4c, 0x5b, 0x6a, 0x89},
+   {{135, 120, 125, 130}, {254, 0, 84, 170}, {1, 255, 171, 85}, {238, 16, 89, 165},
+    {17, 239, 166, 90}, {218, 36, 96, 158}, {37, 219, 159, 97}, {203, 52, 102, 153},
+    {52, 203, 153, 102}, {187, 68, 107, 147}, {68, 187, 148, 108}, {171, 84, 113, 142},
+    {84, 171, 142, 113}, {151, 104, 119, 135}, {104, 151, 136, 120}, {120, 135, 130, 125}}}
+};
+
+// decodes the known blocks, false if any texel differs
+bool checkKnownBlocks() {
+  bool ok = true;
+  for (const KnownBlock &block : known_blocks) {
+    unsigned char texels[16][4];
+    decompressImage(block.bytes, 4, 4, block.format, &texels[0][0]);
+    if (memcmp(texels, block.texels, sizeof(texels)) != 0) {
+      std::cout << "known-answer block \"" << block.name << "\" decodes wrong" << std::endl;
+      ok = false;
+    }
+  }
+  return ok;
+}
+
+// peak signal to noise ratio over the channels the format keeps
+double psnr(const std::vector<unsigned char> &a, const std::vector<unsigned char> &b, int channels) {
+  double sum = 0;
+  size_t count = 0;
+  for (size_t i = 0; i < a.size(); i += 4) {
+    for (int c = 0; c < channels; ++c) {
+      double d = (double)a[i + c] - b[i + c];
+      sum += d * d;
+    }
+    count += channels;
+  }
+  if (sum == 0) return INFINITY;
+  return 10.0 * std::log10(255.0 * 255.0 / (sum / count));
+}
+
+double encodeMs(const std::vector<unsigned char> &image, unsigned w, unsigned h, BlockFormat format, int level,
+                std::vector<unsigned char> &blocks, int threads) {
+  auto start = std::chrono::steady_clock::now();
+  for (int r = 0; r < runs; ++r) compressImage(image.data(), w, h, format, level, blocks.data(), threads);
+  std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+  return elapsed.count() / runs;
+}
+
+int main(int argc, char **argv) {
+  std::vector<std::string> paths(default_paths, default_paths + 3);
+  if (argc > 1) paths.assign(argv + 1, argv + argc);
+  const BlockFormat formats[] = {BLOCK_BC1, BLOCK_BC3, BLOCK_BC7};
+  unsigned cores = std::thread::hardware_concurrency();
+  if (!checkKnownBlocks()) return 1;
+  std::cout << sizeof(known_blocks) / sizeof(known_blocks[0]) << " known-answer blocks decode as specified" << std::endl;
+
+  std::cout << "texture\tformat\tlevel\t1 thread ms\t" << cores << " threads ms\tMpixels/s\tPSNR dB" << std::endl;
+  for (size_t p = 0; p < paths.size(); ++p) {
+    std::vector<unsigned char> image;
+    unsigned w, h;
+    unsigned error = lodepng::decode(image, w, h, paths[p]);
+    if (error) {
+      std::cout << paths[p] << ": " << lodepng_error_text(error) << std::endl;
+      return 1;
+    }
+    for (BlockFormat format : formats) {
+      for (int level = 0; level < BLOCK_LEVELS; ++level) {
+        std::vector<unsigned char> blocks(compressedSize(format, w, h)), decoded(image.size());
+        double single_ms = encodeMs(image, w, h, format, level, blocks, 1);
+        double threaded_ms = encodeMs(image, w, h, format, level, blocks, 0);
+        decompressImage(blocks.data(), w, h, format, decoded.data());
+        std::cout << paths[p] << "\t" << blockFormatName(format) << "\t" << level << "\t" << single_ms << "\t"
+                  << threaded_ms << "\t" << w * h / threaded_ms / 1000.0 << "\t"
+                  << psnr(image, decoded, format == BLOCK_BC1 ? 3 : 4) << std::endl;
+      }
+    }
+  }
+  return 0;
+}
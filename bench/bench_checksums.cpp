@@ -0,0 +1,91 @@
+// Checksum benchmark: CRC32 (PNG chunks) and Adler32 (zlib streams) throughput of
+// lodepng against the byte at a time loops it used before, on one large buffer and
+// split in IDAT sized pieces. Also checks both give the same results.
+
+#include <chrono>
+#include <iostream>
+#include <vector>
+#include <lodepng/lodepng.h>
+
+const size_t buffer_size = 64 << 20; // bytes checksummed per run
+const size_t chunk_size = 8192;      // IDAT chunk size lodepng writes
+const int runs = 5;                  // best of
+
+unsigned crcTable[256];
+
+// the previous lodepng_crc32: one table lookup per byte
+unsigned referenceCrc32(const unsigned char *data, size_t length) {
+  unsigned r = 0xffffffffu;
+  for (size_t i = 0; i < length; ++i) r = crcTable[(r ^ data[i]) & 0xffu] ^ (r >> 8u);
+  return r ^ 0xffffffffu;
+}
+
+// the previous update_adler32 from 1
+unsigned referenceAdler32(const unsigned char *data, size_t length) {
+  unsigned s1 = 1, s2 = 0;
+  while (length != 0) {
+    size_t amount = length > 5552 ? 5552 : length;
+    length -= amount;
+    for (size_t i = 0; i != amount; ++i) {
+      s1 += *data++;
+      s2 += s1;
+    }
+    s1 %= 65521u;
+    s2 %= 65521u;
+  }
+  return (s2 << 16u) | s1;
+}
+
+// best time of a few runs over the buffer in pieces of step bytes, in MB/s
+template <typename F> double throughput(F checksum, const std::vector<unsigned char> &buffer, size_t step) {
+  double best = 1e30;
+  volatile unsigned sink = 0;
+  for (int r = 0; r < runs; ++r) {
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < buffer.size(); i += step)
+      sink = sink + checksum(buffer.data() + i, step < buffer.size() - i ? step : buffer.size() - i);
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    if (elapsed.count() < best) best = elapsed.count();
+  }
+  return buffer.size() / 1048576.0 / best;
+}
+
+int main() {
+  for (unsigned n = 0; n < 256; ++n) {
+    unsigned c = n;
+    for (int k = 0; k < 8; ++k) c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+    crcTable[n] = c;
+  }
+  std::vector<unsigned char> buffer(buffer_size);
+  unsigned seed = 12345u;
+  for (size_t i = 0; i < buffer.size(); ++i) {
+    seed = seed * 1664525u + 1013904223u;
+    buffer[i] = (unsigned char)(seed >> 24);
+  }
+
+  // same results for every length up to a few blocks and at every alignment
+  int mismatches = 0;
+  for (size_t length = 0; length < 4096; ++length) {
+    const unsigned char *data = buffer.data() + length % 61;
+    if (lodepng_crc32(data, length) != referenceCrc32(data, length)) ++mismatches;
+    if (lodepng_adler32(data, length) != referenceAdler32(data, length)) ++mismatches;
+  }
+  std::vector<unsigned char> ones(100000, 255); // largest sums between two reductions
+  if (lodepng_adler32(ones.data(), ones.size()) != referenceAdler32(ones.data(), ones.size())) ++mismatches;
+  if (lodepng_crc32(buffer.data(), buffer.size()) != referenceCrc32(buffer.data(), buffer.size())) ++mismatches;
+  if (lodepng_adler32(buffer.data(), buffer.size()) != referenceAdler32(buffer.data(), buffer.size())) ++mismatches;
+  if (mismatches) {
+    std::cout << mismatches << " checksums differ from the reference" << std::endl;
+    return 1;
+  }
+
+  std::cout << "checksum\tpieces\treference MB/s\tlodepng MB/s" << std::endl;
+  const size_t steps[2] = {buffer_size, chunk_size};
+  for (int s = 0; s < 2; ++s) {
+    std::cout << "crc32\t" << steps[s] << "\t" << throughput(referenceCrc32, buffer, steps[s]) << "\t"
+              << throughput(lodepng_crc32, buffer, steps[s]) << std::endl;
+    std::cout << "adler32\t" << steps[s] << "\t" << throughput(referenceAdler32, buffer, steps[s]) << "\t"
+              << throughput(lodepng_adler32, buffer, steps[s]) << std::endl;
+  }
+  return 0;
+}
@@ -0,0 +1,125 @@
+// Color conversion benchmark: lodepng_convert to the RGBA8 textures are uploaded as, from every
+// color type a PNG commonly has, against a plain pixel at a time loop. MB/s counts the RGBA8 bytes
+// written. Also checks both give the same pixels.
+
+#include <chrono>
+#include <iostream>
+#include <vector>
+#include <lodepng/lodepng.h>
+
+const unsigned image_width = 2048; // pixels converted per run
+const unsigned image_height = 1024;
+const int runs = 5; // best of
+
+struct Conversion {
+  const char *name;
+  LodePNGColorType colortype;
+  unsigned bitdepth;
+  bool key; // with a color key, grey and RGB only
+};
+
+const Conversion conversions[] = {
+    {"grey 8", LCT_GREY, 8, false},
+    {"grey 8 key", LCT_GREY, 8, true},
+    {"grey 16", LCT_GREY, 16, false},
+    {"grey alpha 8", LCT_GREY_ALPHA, 8, false},
+    {"grey alpha 16", LCT_GREY_ALPHA, 16, false},
+    {"rgb 8", LCT_RGB, 8, false},
+    {"rgb 8 key", LCT_RGB, 8, true},
+    {"rgb 16", LCT_RGB, 16, false},
+    {"rgba 16", LCT_RGBA, 16, false},
+    {"palette 4", LCT_PALETTE, 4, false},
+    {"palette 8", LCT_PALETTE, 8, false},
+};
+
+// the plain C conversion, one pixel per step
+void referenceConvert(unsigned char *out, const unsigned char *in, size_t pixels, const LodePNGColorMode &mode) {
+  unsigned bytes = lodepng_get_bpp(&mode) / 8;
+  for (size_t i = 0; i < pixels; ++i, out += 4) {
+    const unsigned char *p = &in[i * bytes];
+    switch (mode.colortype) {
+    case LCT_GREY:
+      out[0] = out[1] = out[2] = p[0];
+      if (mode.bitdepth == 8) out[3] = mode.key_defined && p[0] == mode.key_r ? 0 : 255;
+      else out[3] = mode.key_defined && 256u * p[0] + p[1] == mode.key_r ? 0 : 255;
+      break;
+    case LCT_GREY_ALPHA:
+      out[0] = out[1] = out[2] = p[0];
+      out[3] = p[bytes / 2];
+      break;
+    case LCT_RGB: {
+      unsigned step = bytes / 3;
+      out[0] = p[0];
+      out[1] = p[step];
+      out[2] = p[step * 2];
+      bool keyed = mode.key_defined && step == 1; // the 16-bit case has no key here
+      out[3] = keyed && p[0] == mode.key_r && p[1] == mode.key_g && p[2] == mode.key_b ? 0 : 255;
+      break;
+    }
+    case LCT_RGBA:
+      for (int c = 0; c < 4; ++c) out[c] = p[c * 2];
+      break;
+    case LCT_PALETTE: {
+      unsigned index = mode.bitdepth == 8 ? in[i] : (in[i / 2] >> (i % 2 ? 0 : 4)) & 15;
+      for (int c = 0; c < 4; ++c) out[c] = mode.palette[index * 4 + c];
+      break;
+    }
+    default:
+      break;
+    }
+  }
+}
+
+int main() {
+  size_t pixels = (size_t)image_width * image_height;
+  std::vector<unsigned char> reference(pixels * 4), converted(pixels * 4);
+  LodePNGColorMode rgba;
+  lodepng_color_mode_init(&rgba);
+  std::cout << "conversion\treference MB/s\tlodepng MB/s" << std::endl;
+  for (const Conversion &conversion : conversions) {
+    LodePNGColorMode mode;
+    lodepng_color_mode_init(&mode);
+    mode.colortype = conversion.colortype;
+    mode.bitdepth = conversion.bitdepth;
+    unsigned seed = 12345u;
+    if (conversion.colortype == LCT_PALETTE) {
+      for (unsigned i = 0; i < (1u << conversion.bitdepth); ++i) {
+        seed = seed * 1664525u + 1013904223u;
+        lodepng_palette_add(&mode, seed >> 24, seed >> 16, seed >> 8, seed);
+      }
+    }
+    if (conversion.key) {
+      mode.key_defined = 1;
+      mode.key_r = mode.key_g = mode.key_b = 0;
+    }
+    // a few values only, so the key matches some pixels
+    std::vector<unsigned char> input(lodepng_get_raw_size(image_width, image_height, &mode));
+    for (size_t i = 0; i < input.size(); ++i) {
+      seed = seed * 1664525u + 1013904223u;
+      input[i] = conversion.key ? (unsigned char)((seed >> 24) % 3) : (unsigned char)(seed >> 24);
+    }
+
+    double best[2] = {1e30, 1e30};
+    for (int r = 0; r < runs; ++r) {
+      auto start = std::chrono::steady_clock::now();
+      referenceConvert(reference.data(), input.data(), pixels, mode);
+      auto middle = std::chrono::steady_clock::now();
+      unsigned error = lodepng_convert(converted.data(), input.data(), &rgba, &mode, image_width, image_height);
+      std::chrono::duration<double> first = middle - start, second = std::chrono::steady_clock::now() - middle;
+      if (error) {
+        std::cout << conversion.name << ": " << lodepng_error_text(error) << std::endl;
+        return 1;
+      }
+      if (first.count() < best[0]) best[0] = first.count();
+      if (second.count() < best[1]) best[1] = second.count();
+    }
+    if (converted != reference) {
+      std::cout << conversion.name << ": lodepng_convert differs from the reference" << std::endl;
+      return 1;
+    }
+    std::cout << conversion.name << "\t" << pixels * 4 / 1048576.0 / best[0] << "\t"
+              << pixels * 4 / 1048576.0 / best[1] << std::endl;
+    lodepng_color_mode_cleanup(&mode);
+  }
+  return 0;
+}
@@ -0,0 +1,91 @@
+// Inflate benchmark: lodepng_zlib_decompress throughput on the IDAT streams of
+// four kinds of 2048x2048 RGBA images as lodepng encodes them by default. Only
+// API that lodepng had before the fast inflate is used, so the baseline sources
+// can be built in its place for a before/after comparison:
+//   git worktree add ../baseline <commit before the fast inflate>
+//   g++ -O2 -I../baseline/include bench/bench_inflate.cpp ../baseline/include/lodepng/lodepng.cpp
+
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+#include <lodepng/lodepng.h>
+
+const unsigned image_size = 2048; // width and height of the images
+const int runs = 15;              // best of
+
+const char *kind_names[4] = {"photo", "tiles", "noise", "xor"};
+
+// RGBA pixels of a kind, smooth with a little noise, flat tiles, noise and a xor pattern
+std::vector<unsigned char> makeImage(int kind) {
+  std::vector<unsigned char> pixels((size_t)image_size * image_size * 4);
+  unsigned seed = kind + 1;
+  for (size_t i = 0; i < pixels.size(); ++i) {
+    seed = seed * 1664525u + 1013904223u;
+    size_t p = i / 4, c = i % 4, x = p % image_size, y = p / image_size;
+    float u = (float)x / image_size, v = (float)y / image_size;
+    if (kind == 0) pixels[i] = (unsigned char)(128 + 100 * std::sin(u * 40 + c) * std::cos(v * 30) + (seed >> 29));
+    else if (kind == 1) pixels[i] = (unsigned char)((x / 64 + y / 64) % 2 * 200 + c * 10);
+    else if (kind == 2) pixels[i] = (unsigned char)(seed >> 24);
+    else pixels[i] = (unsigned char)((x ^ y) * (c + 1));
+  }
+  // opaque except for noise, the encoder then drops the alpha channel
+  if (kind != 2)
+    for (size_t i = 3; i < pixels.size(); i += 4) pixels[i] = 255;
+  return pixels;
+}
+
+// the zlib stream of a PNG file, its IDAT chunks joined
+std::vector<unsigned char> idatStream(const std::vector<unsigned char> &png) {
+  std::vector<unsigned char> stream;
+  const unsigned char *end = png.data() + png.size();
+  for (const unsigned char *chunk = png.data() + 8; chunk + 12 <= end; chunk = lodepng_chunk_next_const(chunk, end)) {
+    if (!lodepng_chunk_type_equals(chunk, "IDAT")) continue;
+    const unsigned char *data = lodepng_chunk_data_const(chunk);
+    stream.insert(stream.end(), data, data + lodepng_chunk_length(chunk));
+  }
+  return stream;
+}
+
+int main() {
+  double totalSeconds = 0;
+  size_t totalBytes = 0;
+  std::cout << "image\tzlib bytes\tinflated bytes\tms\tMB/s" << std::endl;
+  for (int kind = 0; kind < 4; ++kind) {
+    std::vector<unsigned char> png;
+    unsigned error = lodepng::encode(png, makeImage(kind), image_size, image_size);
+    if (error) {
+      std::cout << "encoder error " << error << ": " << lodepng_error_text(error) << std::endl;
+      return 1;
+    }
+    std::vector<unsigned char> stream = idatStream(png);
+
+    double best = 1e30;
+    size_t inflated = 0;
+    for (int r = 0; r < runs; ++r) {
+      LodePNGDecompressSettings settings;
+      lodepng_decompress_settings_init(&settings);
+      unsigned char *out = nullptr;
+      size_t outsize = 0;
+      auto start = std::chrono::steady_clock::now();
+      error = lodepng_zlib_decompress(&out, &outsize, stream.data(), stream.size(), &settings);
+      std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+      // heap memory with lodepng's own allocators and with PngArena's outside a scope
+      std::free(out);
+      if (error) {
+        std::cout << "decoder error " << error << ": " << lodepng_error_text(error) << std::endl;
+        return 1;
+      }
+      if (elapsed.count() < best) best = elapsed.count();
+      inflated = outsize;
+    }
+    std::cout << kind_names[kind] << "\t" << stream.size() << "\t" << inflated << "\t" << best * 1000 << "\t"
+              << inflated / 1048576.0 / best << std::endl;
+    totalSeconds += best;
+    totalBytes += inflated;
+  }
+  std::cout << "total\t\t" << totalBytes << "\t" << totalSeconds * 1000 << "\t"
+            << totalBytes / 1048576.0 / totalSeconds << std::endl;
+  return 0;
+}
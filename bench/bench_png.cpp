@@ -0,0 +1,337 @@
+// PNG codec benchmark: decode and encode throughput of lodepng on a
+// deterministic synthetic corpus of every color type & bit depth, small and
+// large, noise and flat, with and without Adam7, plus the files given on the
+// command line (e.g. data/*.png). Decoding is split into stages: CRC of the
+// chunks, inflate of the IDAT data, unfilter (a decode to the PNG's own format
+// from the already inflated data, a normal decode interleaves the two) and
+// convert to RGBA8. Encoding the image in its own format splits into filter
+// and deflate. MB/s are of the image in the PNG's own format for every stage.
+// The table goes to stdout, the same as JSON to bench_png.json or the file
+// after --json.
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <lodepng/lodepng.h>
+#include "PngArena/PngArena.hpp"
+
+const unsigned synthetic_sizes[][2] = {{64, 64}, {1024, 768}}; // width & height of synthetic images
+const unsigned flat_tile = 32;                                  // flat images are tiles of one color
+const int runs = 3;                                             // best of
+
+struct Format {
+  const char *name;
+  LodePNGColorType colortype;
+  unsigned bitdepth;
+};
+
+const Format formats[] = {
+    {"grey 1", LCT_GREY, 1},
+    {"grey 8", LCT_GREY, 8},
+    {"grey 16", LCT_GREY, 16},
+    {"grey alpha 8", LCT_GREY_ALPHA, 8},
+    {"grey alpha 16", LCT_GREY_ALPHA, 16},
+    {"rgb 8", LCT_RGB, 8},
+    {"rgb 16", LCT_RGB, 16},
+    {"rgba 8", LCT_RGBA, 8},
+    {"rgba 16", LCT_RGBA, 16},
+    {"palette 4", LCT_PALETTE, 4},
+    {"palette 8", LCT_PALETTE, 8},
+};
+
+enum Stage { DECODE, CRC, INFLATE, UNFILTER, CONVERT, ENCODE, FILTER, DEFLATE, STAGES };
+const char *stage_names[STAGES] = {"decode", "crc", "inflate", "unfilter", "convert", "encode", "filter", "deflate"};
+
+struct Image {
+  std::string name;
+  std::vector<unsigned char> png;
+  unsigned width, height;
+  LodePNGColorMode color; // of the PNG, raw bytes are in this format
+  unsigned interlace;
+  size_t rawBytes;
+  double ms[STAGES]; // best of runs
+};
+
+// the LCG's low bits repeat quickly, mixed so every bit is noise
+unsigned nextRandom(unsigned &seed) {
+  seed = seed * 1664525u + 1013904223u;
+  unsigned x = (seed ^ (seed >> 16)) * 0x45d9f3bu;
+  return x ^ (x >> 16);
+}
+
+// stores value in the low bits of pixel i, packed from the high bits of each byte as PNG does
+void setPixel(std::vector<unsigned char> &raw, size_t i, unsigned bpp, unsigned value) {
+  if (bpp < 8) {
+    size_t bit = i * bpp;
+    unsigned shift = 8 - bpp - (unsigned)(bit % 8), mask = (1u << bpp) - 1;
+    raw[bit / 8] = (unsigned char)((raw[bit / 8] & ~(mask << shift)) | ((value & mask) << shift));
+    return;
+  }
+  for (unsigned k = 0; k < bpp / 8; ++k) {
+    if (k == 4) value = nextRandom(value); // 16-bit RGB(A) has more bytes than value
+    raw[i * (bpp / 8) + k] = (unsigned char)(value >> (8 * (k % 4)));
+  }
+}
+
+// encodes a synthetic image, returns false on a lodepng error
+bool synthesize(Image &image, const Format &format, unsigned width, unsigned height, bool noise, unsigned interlace) {
+  image.name = std::string(format.name) + " " + std::to_string(width) + "x" + std::to_string(height) +
+               (noise ? " noise" : " flat") + (interlace ? " adam7" : "");
+  lodepng::State state;
+  state.info_raw.colortype = format.colortype;
+  state.info_raw.bitdepth = format.bitdepth;
+  unsigned seed = 12345u + width + format.bitdepth * 7 + (unsigned)format.colortype * 131;
+  if (format.colortype == LCT_PALETTE) {
+    for (unsigned i = 0; i < (1u << format.bitdepth); ++i) {
+      unsigned c = nextRandom(seed);
+      lodepng_palette_add(&state.info_raw, c >> 24, c >> 16, c >> 8, (c & 0x100) ? 255 : c);
+    }
+  }
+  unsigned bpp = lodepng_get_bpp(&state.info_raw);
+  std::vector<unsigned char> raw(lodepng_get_raw_size(width, height, &state.info_raw));
+  for (unsigned y = 0; y < height; ++y) {
+    for (unsigned x = 0; x < width; ++x) {
+      unsigned tile = (y / flat_tile) * 7919u + x / flat_tile, tileSeed = tile * 2654435761u;
+      unsigned value = noise ? nextRandom(seed) : nextRandom(tileSeed);
+      setPixel(raw, (size_t)y * width + x, bpp, value);
+    }
+  }
+  state.encoder.auto_convert = 0;
+  lodepng_color_mode_copy(&state.info_png.color, &state.info_raw);
+  state.info_png.interlace_method = interlace;
+  unsigned error = lodepng::encode(image.png, raw, width, height, state);
+  if (error) std::cout << image.name << ": " << lodepng_error_text(error) << std::endl;
+  return error == 0;
+}
+
+// keeps the fastest of the runs
+void keepBest(double &best, std::chrono::steady_clock::time_point start) {
+  std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+  if (elapsed.count() < best) best = elapsed.count();
+}
+
+// time spent in zlib while encoding
+unsigned timedZlib(unsigned char **out, size_t *outsize, const unsigned char *in, size_t insize,
+                   const LodePNGCompressSettings *settings) {
+  LodePNGCompressSettings plain = *settings;
+  plain.custom_zlib = 0;
+  auto start = std::chrono::steady_clock::now();
+  unsigned error = lodepng_zlib_compress(out, outsize, in, insize, &plain);
+  std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+  *(double *)settings->custom_context += elapsed.count();
+  return error;
+}
+
+// hands the decoder the IDAT data inflated beforehand, the copy is timed to be left out
+struct Inflated {
+  std::vector<unsigned char> data;
+  double copyMs;
+};
+
+unsigned inflatedZlib(unsigned char **out, size_t *outsize, const unsigned char *, size_t,
+                      const LodePNGDecompressSettings *settings) {
+  Inflated *inflated = (Inflated *)settings->custom_context;
+  auto start = std::chrono::steady_clock::now();
+  *out = (unsigned char *)lodepng_malloc(inflated->data.size());
+  if (!*out) return 83; // lodepng's alloc fail
+  std::copy(inflated->data.begin(), inflated->data.end(), *out);
+  *outsize = inflated->data.size();
+  std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+  inflated->copyMs += elapsed.count();
+  return 0;
+}
+
+// measures every stage of one image, returns false on a lodepng error
+bool measure(Image &image) {
+  lodepng::State inspect;
+  unsigned error = lodepng_inspect(&image.width, &image.height, &inspect, image.png.data(), image.png.size());
+  if (error) {
+    std::cout << image.name << ": " << lodepng_error_text(error) << std::endl;
+    return false;
+  }
+  lodepng_color_mode_init(&image.color);
+  lodepng_color_mode_copy(&image.color, &inspect.info_png.color);
+  image.interlace = inspect.info_png.interlace_method;
+  image.rawBytes = lodepng_get_raw_size(image.width, image.height, &image.color);
+
+  // the IDAT data as one zlib stream, and the chunks for their CRCs
+  const unsigned char *end = image.png.data() + image.png.size();
+  std::vector<const unsigned char *> chunks;
+  std::vector<unsigned char> idat;
+  const unsigned char *chunk = image.png.data() + 8;
+  for (; chunk + 12 <= end; chunk = lodepng_chunk_next_const(chunk, end)) {
+    chunks.push_back(chunk);
+    if (lodepng_chunk_type_equals(chunk, "IDAT")) {
+      const unsigned char *data = lodepng_chunk_data_const(chunk);
+      idat.insert(idat.end(), data, data + lodepng_chunk_length(chunk));
+    }
+    if (lodepng_chunk_type_equals(chunk, "IEND")) break;
+  }
+
+  for (int s = 0; s < STAGES; ++s) image.ms[s] = 1e30;
+  std::vector<unsigned char> raw, rgba((size_t)image.width * image.height * 4), encoded;
+  LodePNGColorMode rgbaMode;
+  lodepng_color_mode_init(&rgbaMode);
+  unsigned mismatches = 0;
+  for (int r = 0; r < runs; ++r) {
+    // the whole decode to RGBA8, as textures are loaded
+    std::vector<unsigned char> decoded;
+    unsigned w, h;
+    auto start = std::chrono::steady_clock::now();
+    error = lodepng::decode(decoded, w, h, image.png);
+    keepBest(image.ms[DECODE], start);
+    if (error) break;
+
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < chunks.size(); ++i) mismatches += lodepng_chunk_check_crc(chunks[i]);
+    keepBest(image.ms[CRC], start);
+
+    unsigned char *data = 0;
+    size_t size = 0;
+    LodePNGDecompressSettings zlib;
+    lodepng_decompress_settings_init(&zlib);
+    start = std::chrono::steady_clock::now();
+    error = lodepng_zlib_decompress(&data, &size, idat.data(), idat.size(), &zlib);
+    keepBest(image.ms[INFLATE], start);
+    Inflated inflated = {std::vector<unsigned char>(data, data + size), 0.0};
+    lodepng_free(data);
+    if (error) break;
+
+    // unfilter to the PNG's own format, CRCs are timed above
+    lodepng::State state;
+    state.decoder.color_convert = 0;
+    state.decoder.ignore_crc = 1;
+    state.decoder.zlibsettings.custom_zlib = inflatedZlib;
+    state.decoder.zlibsettings.custom_context = &inflated;
+    start = std::chrono::steady_clock::now();
+    error = lodepng::decode(raw, w, h, state, image.png);
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    image.ms[UNFILTER] = std::min(image.ms[UNFILTER], elapsed.count() - inflated.copyMs);
+    if (error) break;
+    // inspect does not read PLTE, the decoded color mode has it
+    lodepng_color_mode_copy(&image.color, &state.info_png.color);
+
+    start = std::chrono::steady_clock::now();
+    error = lodepng_convert(rgba.data(), raw.data(), &rgbaMode, &image.color, image.width, image.height);
+    keepBest(image.ms[CONVERT], start);
+    if (error) break;
+    if (rgba != decoded) mismatches += 1;
+
+    // encoding the same pixels back in the same format
+    lodepng::State encoder;
+    double deflateMs = 0;
+    encoder.encoder.auto_convert = 0;
+    encoder.encoder.zlibsettings.custom_zlib = timedZlib;
+    encoder.encoder.zlibsettings.custom_context = &deflateMs;
+    lodepng_color_mode_copy(&encoder.info_raw, &image.color);
+    lodepng_color_mode_copy(&encoder.info_png.color, &image.color);
+    encoder.info_png.interlace_method = image.interlace;
+    encoded.clear();
+    start = std::chrono::steady_clock::now();
+    error = lodepng::encode(encoded, raw, image.width, image.height, encoder);
+    keepBest(image.ms[ENCODE], start);
+    if (error) break;
+    if (deflateMs < image.ms[DEFLATE]) image.ms[DEFLATE] = deflateMs;
+  }
+  if (error || mismatches) {
+    std::cout << image.name << ": " << (error ? lodepng_error_text(error) : "stages give other pixels") << std::endl;
+    return false;
+  }
+  // the encode minus deflate
+  image.ms[FILTER] = std::max(0.0, image.ms[ENCODE] - image.ms[DEFLATE]);
+  return true;
+}
+
+double mbps(size_t bytes, double ms) { return ms > 0 ? bytes / 1048576.0 / (ms / 1000.0) : 0.0; }
+
+std::string jsonString(const std::string &text) {
+  std::string quoted = "\"";
+  for (size_t i = 0; i < text.size(); ++i) {
+    if (text[i] == '"' || text[i] == '\\') quoted += '\\';
+    quoted += text[i];
+  }
+  return quoted + "\"";
+}
+
+void writeStages(std::ostream &json, const double *ms, size_t bytes) {
+  json << "{";
+  for (int s = 0; s < STAGES; ++s) {
+    json << (s ? ", " : "") << "\"" << stage_names[s] << "\": {\"ms\": " << ms[s] << ", \"mbps\": " << mbps(bytes, ms[s])
+         << "}";
+  }
+  json << "}";
+}
+
+int main(int argc, char **argv) {
+  std::string jsonPath = "bench_png.json";
+  std::vector<Image> images;
+  for (int i = 1; i < argc; ++i) {
+    if (std::string(argv[i]) == "--json" && i + 1 < argc) {
+      jsonPath = argv[++i];
+      continue;
+    }
+    images.push_back(Image());
+    images.back().name = argv[i];
+    unsigned error = lodepng::load_file(images.back().png, argv[i]);
+    if (error) {
+      std::cout << argv[i] << ": " << lodepng_error_text(error) << std::endl;
+      return 1;
+    }
+  }
+  for (const unsigned *size : synthetic_sizes) {
+    for (const Format &format : formats) {
+      for (int noise = 0; noise < 2; ++noise) {
+        for (unsigned interlace = 0; interlace < 2; ++interlace) {
+          images.push_back(Image());
+          if (!synthesize(images.back(), format, size[0], size[1], noise != 0, interlace)) return 1;
+        }
+      }
+    }
+  }
+
+  double total[STAGES] = {0};
+  size_t rawBytes = 0, fileBytes = 0;
+  std::cout << "image\tbytes";
+  for (int s = 0; s < STAGES; ++s) std::cout << "\t" << stage_names[s] << " MB/s";
+  std::cout << std::endl;
+  for (size_t i = 0; i < images.size(); ++i) {
+    Image &image = images[i];
+    if (!measure(image)) return 1;
+    std::cout << image.name << "\t" << image.png.size();
+    for (int s = 0; s < STAGES; ++s) {
+      std::cout << "\t" << mbps(image.rawBytes, image.ms[s]);
+      total[s] += image.ms[s];
+    }
+    std::cout << std::endl;
+    rawBytes += image.rawBytes;
+    fileBytes += image.png.size();
+  }
+  std::cout << "all\t" << fileBytes;
+  for (int s = 0; s < STAGES; ++s) std::cout << "\t" << mbps(rawBytes, total[s]);
+  std::cout << std::endl;
+
+  std::ofstream json(jsonPath);
+  json << "{\n  \"runs\": " << runs << ",\n  \"images\": [\n";
+  for (size_t i = 0; i < images.size(); ++i) {
+    const Image &image = images[i];
+    json << "    {\"name\": " << jsonString(image.name) << ", \"width\": " << image.width
+         << ", \"height\": " << image.height << ", \"colortype\": " << image.color.colortype
+         << ", \"bitdepth\": " << image.color.bitdepth << ", \"interlace\": " << image.interlace
+         << ", \"png_bytes\": " << image.png.size() << ", \"raw_bytes\": " << image.rawBytes << ", \"stages\": ";
+    writeStages(json, image.ms, image.rawBytes);
+    json << "}" << (i + 1 < images.size() ? "," : "") << "\n";
+  }
+  json << "  ],\n  \"total\": {\"png_bytes\": " << fileBytes << ", \"raw_bytes\": " << rawBytes << ", \"stages\": ";
+  writeStages(json, total, rawBytes);
+  json << "}\n}\n";
+  if (!json) {
+    std::cout << jsonPath << ": could not be written" << std::endl;
+    return 1;
+  }
+  std::cout << "written to " << jsonPath << std::endl;
+  for (size_t i = 0; i < images.size(); ++i) lodepng_color_mode_cleanup(&images[i].color);
+  return 0;
+}
@@ -0,0 +1,174 @@
+// PNG encode benchmark: time and size of every compression level on frames
+// like the ones dumped from the surface, then of the band-split encoder on
+// more and more threads. Files given on the command line are decoded and
+// used, otherwise a synthetic set of rendered looking frames.
+
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <thread>
+#include <vector>
+#include <lodepng/lodepng.h>
+#include "ImageEncoder/ImageEncoder.hpp"
+
+const int synthetic_count = 4;     // frames in the synthetic set
+const int synthetic_width = 1280;  // size of synthetic frames
+const int synthetic_height = 720;
+const int runs = 3;                // best of
+
+// time spent in zlib, the rest of encoding is filtering and color conversion
+struct DeflateTimer {
+  double ms;
+};
+
+unsigned timedZlib(unsigned char **out, size_t *outsize, const unsigned char *in, size_t insize,
+                   const LodePNGCompressSettings *settings) {
+  LodePNGCompressSettings plain = *settings;
+  plain.custom_zlib = 0;
+  auto start = std::chrono::steady_clock::now();
+  unsigned error = lodepng_zlib_compress(out, outsize, in, insize, &plain);
+  std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+  ((DeflateTimer *)settings->custom_context)->ms += elapsed.count();
+  return error;
+}
+
+struct Frame {
+  std::vector<unsigned char> pixels;
+  unsigned width, height;
+};
+
+// a lit sphere over a vertical gradient with a few flat panels, about what a frame holds
+Frame synthesize(int index) {
+  Frame frame;
+  frame.width = synthetic_width;
+  frame.height = synthetic_height;
+  frame.pixels.resize((size_t)frame.width * frame.height * 4);
+  float cx = synthetic_width * (0.4f + 0.05f * index), cy = synthetic_height * 0.5f, r = synthetic_height * 0.35f;
+  for (unsigned y = 0; y < frame.height; ++y) {
+    for (unsigned x = 0; x < frame.width; ++x) {
+      unsigned char *p = &frame.pixels[((size_t)y * frame.width + x) * 4];
+      float dx = (x - cx) / r, dy = (y - cy) / r, d = dx * dx + dy * dy;
+      if (d < 1.0f) {
+        float nz = std::sqrt(1.0f - d), light = 0.2f + 0.8f * std::fmax(0.0f, -0.4f * dx - 0.5f * dy + 0.77f * nz);
+        p[0] = (unsigned char)(230 * light);
+        p[1] = (unsigned char)(120 * light);
+        p[2] = (unsigned char)(40 * light + 20);
+      } else if ((x / 160 + y / 120 + index) % 7 == 0) {
+        p[0] = p[1] = p[2] = 64;
+      } else {
+        p[0] = (unsigned char)(20 + y * 60 / frame.height);
+        p[1] = (unsigned char)(30 + y * 80 / frame.height);
+        p[2] = (unsigned char)(60 + y * 120 / frame.height);
+      }
+      p[3] = 255;
+    }
+  }
+  return frame;
+}
+
+int main(int argc, char **argv) {
+  std::vector<Frame> frames;
+  for (int i = 1; i < argc; ++i) {
+    frames.push_back(Frame());
+    unsigned error = lodepng::decode(frames.back().pixels, frames.back().width, frames.back().height, argv[i]);
+    if (error) {
+      std::cout << argv[i] << ": " << lodepng_error_text(error) << std::endl;
+      return 1;
+    }
+  }
+  if (frames.empty()) {
+    for (int i = 0; i < synthetic_count; ++i) frames.push_back(synthesize(i));
+  }
+  size_t pixelBytes = 0;
+  for (size_t i = 0; i < frames.size(); ++i) pixelBytes += frames[i].pixels.size();
+  std::cout << frames.size() << " frames, " << pixelBytes / 1048576.0 << " MB of pixels" << std::endl;
+
+  // -1 is the default, the LZ77 settings fields rather than a level
+  std::cout << "level\tms\tdeflate ms\tdeflate MB/s\tbytes\tratio" << std::endl;
+  for (int level = -1; level <= 9; ++level) {
+    double best = 1e30, bestDeflate = 1e30;
+    size_t pngBytes = 0;
+    for (int r = 0; r < runs; ++r) {
+      DeflateTimer timer = {0.0};
+      pngBytes = 0;
+      auto start = std::chrono::steady_clock::now();
+      for (size_t i = 0; i < frames.size(); ++i) {
+        lodepng::State state;
+        state.encoder.zlibsettings.level = level;
+        state.encoder.zlibsettings.custom_zlib = timedZlib;
+        state.encoder.zlibsettings.custom_context = &timer;
+        std::vector<unsigned char> png;
+        unsigned error = lodepng::encode(png, frames[i].pixels, frames[i].width, frames[i].height, state);
+        if (error) {
+          std::cout << "level " << level << ": " << lodepng_error_text(error) << std::endl;
+          return 1;
+        }
+        pngBytes += png.size();
+        if (r == 0) {
+          // must decode to the same pixels
+          std::vector<unsigned char> decoded;
+          unsigned w, h;
+          if (lodepng::decode(decoded, w, h, png) || decoded != frames[i].pixels) {
+            std::cout << "level " << level << ": frame " << i << " does not decode to its pixels" << std::endl;
+            return 1;
+          }
+        }
+      }
+      std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+      if (elapsed.count() < best) best = elapsed.count();
+      if (timer.ms < bestDeflate) bestDeflate = timer.ms;
+    }
+    std::cout << level << "\t" << best << "\t" << bestDeflate << "\t" << pixelBytes / 1048576.0 / (bestDeflate / 1000.0)
+              << "\t" << pngBytes << "\t" << (double)pngBytes / pixelBytes << std::endl;
+  }
+
+  // the auto_convert color scan alone, then with a hint for frames known to be colored and not worth a palette
+  std::cout << "color stats\tms" << std::endl;
+  for (int hinted = 0; hinted < 2; ++hinted) {
+    double best = 1e30;
+    for (int r = 0; r < runs; ++r) {
+      auto start = std::chrono::steady_clock::now();
+      for (size_t i = 0; i < frames.size(); ++i) {
+        LodePNGColorMode rgba;
+        lodepng_color_mode_init(&rgba);
+        LodePNGColorStats stats;
+        lodepng_color_stats_init(&stats);
+        if (hinted) {
+          stats.colored = 1;
+          stats.allow_palette = 0;
+          stats.bits = 8;
+        }
+        lodepng_compute_color_stats(&stats, frames[i].pixels.data(), frames[i].width, frames[i].height, &rgba);
+      }
+      std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+      if (elapsed.count() < best) best = elapsed.count();
+    }
+    std::cout << (hinted ? "hinted" : "full") << "\t" << best << std::endl;
+  }
+
+  // band-split encoding at the default level, 1 thread is the single zlib stream
+  int cores = (int)std::thread::hardware_concurrency();
+  std::cout << "threads\tms\tMB/s\tbytes" << std::endl;
+  for (int threads = 1; threads <= cores; threads = threads * 2 > cores && threads < cores ? cores : threads * 2) {
+    double best = 1e30;
+    size_t pngBytes = 0;
+    for (int r = 0; r < runs; ++r) {
+      pngBytes = 0;
+      auto start = std::chrono::steady_clock::now();
+      for (size_t i = 0; i < frames.size(); ++i) {
+        std::vector<unsigned char> png;
+        unsigned error = encodePNG(png, frames[i].pixels.data(), frames[i].width, frames[i].height, -1, threads);
+        if (error) {
+          std::cout << threads << " threads: " << lodepng_error_text(error) << std::endl;
+          return 1;
+        }
+        pngBytes += png.size();
+      }
+      std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+      if (elapsed.count() < best) best = elapsed.count();
+    }
+    std::cout << threads << "\t" << best << "\t" << pixelBytes / 1048576.0 / (best / 1000.0) << "\t" << pngBytes
+              << std::endl;
+  }
+  return 0;
+}
@@ -0,0 +1,95 @@
+// Render queue benchmark: submit, radix sort and execute per frame without a
+// GL context. Prints per-frame times and the number of state changes left
+// after sorting, and checks the radix sort against std::stable_sort.
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include "RenderQueue/RenderQueue.hpp"
+
+const size_t item_counts[] = {1000, 10000, 100000, 1000000};
+const int frames = 20; // frames measured per item count
+
+// counts calls instead of talking to GL
+class CountingHandler : public RenderQueueHandler
+{
+public:
+  CountingHandler() : changes(0), draws(0) {}
+  void setPass(unsigned) { ++changes; }
+  void setProgram(unsigned) { ++changes; }
+  void setTextures(unsigned) { ++changes; }
+  void setMesh(unsigned) { ++changes; }
+  void draw(uint32_t) { ++draws; }
+
+  size_t changes;
+  size_t draws;
+};
+
+// deterministic scene, same sequence on every run
+struct Lcg {
+  uint32_t state;
+  uint32_t next() { return state = state * 1664525u + 1013904223u; }
+};
+
+bool byKey(const RenderItem &a, const RenderItem &b) { return a.key < b.key; }
+
+int main() {
+  std::cout << "items\tsubmit ms\tsort ms\texecute ms\tstd::stable_sort ms\tstate changes\tunsorted changes" << std::endl;
+  for (size_t count : item_counts) {
+    // scene with 4 passes, 32 programs, 256 texture sets and 1024 meshes
+    std::vector<uint64_t> keys(count);
+    Lcg rng = {12345};
+    for (size_t i = 0; i < count; ++i) {
+      uint32_t r = rng.next();
+      float depth = (rng.next() >> 8) / 16777216.f;
+      keys[i] = RenderQueue::makeKey(r & 3, (r >> 2) & 31, (r >> 7) & 255, (r >> 15) & 1023, depth);
+    }
+
+    RenderQueue queue;
+    queue.reserve(count);
+    CountingHandler unsorted;
+    for (size_t i = 0; i < count; ++i) queue.submit(keys[i], (uint32_t)i);
+    queue.execute(unsorted);
+
+    double submit_ms = 0, sort_ms = 0, execute_ms = 0, reference_ms = 0;
+    CountingHandler handler;
+    for (int f = 0; f < frames; ++f) {
+      auto t0 = std::chrono::steady_clock::now();
+      queue.clear();
+      for (size_t i = 0; i < count; ++i) queue.submit(keys[i], (uint32_t)i);
+      auto t1 = std::chrono::steady_clock::now();
+      queue.sort();
+      auto t2 = std::chrono::steady_clock::now();
+      handler = CountingHandler();
+      queue.execute(handler);
+      auto t3 = std::chrono::steady_clock::now();
+
+      std::vector<RenderItem> reference;
+      reference.reserve(count);
+      for (size_t i = 0; i < count; ++i) {
+        RenderItem item = {keys[i], (uint32_t)i};
+        reference.push_back(item);
+      }
+      auto t4 = std::chrono::steady_clock::now();
+      std::stable_sort(reference.begin(), reference.end(), byKey);
+      auto t5 = std::chrono::steady_clock::now();
+
+      // both sorts are stable, so payload order must match exactly
+      const std::vector<RenderItem> &items = queue.items();
+      for (size_t i = 0; i < count; ++i) {
+        if (items[i].key != reference[i].key || items[i].payload != reference[i].payload) {
+          std::cout << "radix sort mismatch at " << i << std::endl;
+          return 1;
+        }
+      }
+      submit_ms += std::chrono::duration<double, std::milli>(t1 - t0).count();
+      sort_ms += std::chrono::duration<double, std::milli>(t2 - t1).count();
+      execute_ms += std::chrono::duration<double, std::milli>(t3 - t2).count();
+      reference_ms += std::chrono::duration<double, std::milli>(t5 - t4).count();
+    }
+    std::cout << count << "\t" << submit_ms / frames << "\t" << sort_ms / frames << "\t"
+              << execute_ms / frames << "\t" << reference_ms / frames << "\t"
+              << handler.changes << "\t" << unsorted.changes << std::endl;
+  }
+  return 0;
+}
@@ -0,0 +1,135 @@
+// Texture decode benchmark: decodes a few dozen large PNG files one after
+// another and on the decoder pool, as the surface does at startup, the pool
+// with lodepng's temporaries on the heap and in arenas. Files given on the
+// command line are used, otherwise a synthetic set is encoded.
+
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <lodepng/lodepng.h>
+#include "ImageDecoder/ImageDecoder.hpp"
+#include "PngArena/PngArena.hpp"
+
+const int synthetic_count = 32;   // files in the synthetic set
+const int synthetic_size = 2048;  // width & height of synthetic files
+const int synthetic_patterns = 4; // distinct images, the rest are copies
+const int runs = 3;               // decodes of the whole set measured
+
+// smooth gradients with noise, compresses about as well as a photo texture
+std::vector<unsigned char> synthesize(int pattern) {
+  std::vector<unsigned char> image((size_t)synthetic_size * synthetic_size * 4);
+  unsigned seed = 12345u + pattern;
+  for (int y = 0; y < synthetic_size; ++y) {
+    for (int x = 0; x < synthetic_size; ++x) {
+      seed = seed * 1664525u + 1013904223u;
+      int noise = (seed >> 24) & 15;
+      unsigned char *p = &image[((size_t)y * synthetic_size + x) * 4];
+      p[0] = (unsigned char)(128 + 100 * std::sin((x + pattern * 97) * 0.01f) + noise);
+      p[1] = (unsigned char)((x ^ y) + pattern * 40);
+      p[2] = (unsigned char)(128 + 100 * std::cos(y * 0.013f) + noise);
+      p[3] = 255;
+    }
+  }
+  return image;
+}
+
+// peak resident set size in MB, Linux only (0 elsewhere). Resetting it needs
+// Linux 4.0, or every mode after the first reports the highest peak so far.
+void resetPeakRss() { std::ofstream("/proc/self/clear_refs") << "5"; }
+
+double peakRss() {
+  std::ifstream status("/proc/self/status");
+  for (std::string line; std::getline(status, line);) {
+    if (line.compare(0, 6, "VmHWM:") == 0) return std::stod(line.substr(6)) / 1024.0;
+  }
+  return 0.0;
+}
+
+int main(int argc, char **argv) {
+  std::vector<std::vector<unsigned char> > files;
+  for (int i = 1; i < argc; ++i) {
+    files.push_back(std::vector<unsigned char>());
+    unsigned error = lodepng::load_file(files.back(), argv[i]);
+    if (error) {
+      std::cout << argv[i] << ": " << lodepng_error_text(error) << std::endl;
+      return 1;
+    }
+  }
+  if (files.empty()) {
+    std::cout << "encoding " << synthetic_count << " synthetic " << synthetic_size << "x" << synthetic_size
+              << " textures" << std::endl;
+    for (int i = 0; i < synthetic_count; ++i) {
+      files.push_back(std::vector<unsigned char>());
+      if (i < synthetic_patterns) lodepng::encode(files.back(), synthesize(i), synthetic_size, synthetic_size);
+      else files.back() = files[i % synthetic_patterns];
+    }
+  }
+  int count = (int)files.size();
+  size_t fileBytes = 0;
+  std::vector<const unsigned char *> data(count);
+  std::vector<size_t> sizes(count);
+  for (int i = 0; i < count; ++i) {
+    data[i] = files[i].data();
+    sizes[i] = files[i].size();
+    fileBytes += sizes[i];
+  }
+
+  // serial decode, as on the GL thread before the pool
+  double serialMs = 0;
+  size_t pixelBytes = 0;
+  resetPeakRss();
+  size_t heapBefore = PngArena::heapAllocations();
+  for (int r = 0; r < runs; ++r) {
+    pixelBytes = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < count; ++i) {
+      std::vector<unsigned char> image;
+      unsigned w, h;
+      lodepng::decode(image, w, h, files[i]);
+      pixelBytes += image.size();
+    }
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    serialMs += elapsed.count() / runs;
+  }
+  // lodepng heap allocations per file
+  double serialAllocations = (double)(PngArena::heapAllocations() - heapBefore) / (runs * count);
+  double serialRss = peakRss();
+
+  // pool decode, the caller only waits, with lodepng's temporaries on the heap then in arenas
+  unsigned cores = std::thread::hardware_concurrency();
+  double poolMs[2] = {0, 0}, poolAllocations[2], poolRss[2];
+  for (int arena = 0; arena < 2; ++arena) {
+    resetPeakRss();
+    heapBefore = PngArena::heapAllocations();
+    for (int r = 0; r < runs; ++r) {
+      ImageDecoder decoder;
+      auto start = std::chrono::steady_clock::now();
+      decoder.start(data.data(), sizes.data(), count, 0, arena != 0);
+      if (!decoder.wait()) {
+        std::cout << "decoder error" << std::endl;
+        return 1;
+      }
+      std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+      poolMs[arena] += elapsed.count() / runs;
+    }
+    poolAllocations[arena] = (double)(PngArena::heapAllocations() - heapBefore) / (runs * count);
+    poolRss[arena] = peakRss();
+  }
+
+  std::cout << count << " files, " << fileBytes / 1048576.0 << " MB compressed, " << pixelBytes / 1048576.0
+            << " MB decoded" << std::endl;
+  std::cout << "mode\tthreads\tms\tMB/s decoded\theap allocations/file\tpeak RSS MB" << std::endl;
+  std::cout << "serial\t1\t" << serialMs << "\t" << pixelBytes / 1048576.0 / (serialMs / 1000.0) << "\t"
+            << serialAllocations << "\t" << serialRss << std::endl;
+  const char *poolNames[2] = {"pool heap", "pool arena"};
+  for (int arena = 0; arena < 2; ++arena) {
+    std::cout << poolNames[arena] << "\t" << cores << "\t" << poolMs[arena] << "\t"
+              << pixelBytes / 1048576.0 / (poolMs[arena] / 1000.0) << "\t" << poolAllocations[arena] << "\t"
+              << poolRss[arena] << std::endl;
+  }
+  return 0;
+}
@@ -0,0 +1,493 @@
+#include "BlockCompress.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <thread>
+#include <vector>
+#if defined(__SSE2__) || defined(_M_X64)
+  #include <emmintrin.h>
+  #define BLOCKCOMPRESS_SSE
+#elif defined(__ARM_NEON)
+  #include <arm_neon.h>
+  #define BLOCKCOMPRESS_NEON
+#endif
+
+// BC7 4-bit index interpolation weights, out of 64
+static const int bc7_weights[16] = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+
+// pixels of one block, channels apart for the vector code
+struct Block {
+  float c[4][16]; // channel, pixel
+};
+
+// up to 16 palette entries, channels apart as well
+struct Palette {
+  float c[4][16]; // channel, entry
+  int count;
+};
+
+int blockBytes(BlockFormat format) { return format == BLOCK_BC1 ? 8 : 16; }
+
+size_t compressedSize(BlockFormat format, int width, int height) {
+  return (size_t)((width + 3) / 4) * ((height + 3) / 4) * blockBytes(format);
+}
+
+bool parseBlockFormat(const char *name, BlockFormat &format) {
+  if (strcmp(name, "bc1") == 0) format = BLOCK_BC1;
+  else if (strcmp(name, "bc3") == 0) format = BLOCK_BC3;
+  else if (strcmp(name, "bc7") == 0) format = BLOCK_BC7;
+  else return false;
+  return true;
+}
+
+const char *blockFormatName(BlockFormat format) {
+  return format == BLOCK_BC1 ? "BC1" : format == BLOCK_BC3 ? "BC3" : "BC7";
+}
+
+static void loadBlock(const unsigned char *rgba, int width, int height, int bx, int by, Block &block) {
+  for (int y = 0; y < 4; ++y) {
+    int sy = std::min(by * 4 + y, height - 1);
+    for (int x = 0; x < 4; ++x) {
+      int sx = std::min(bx * 4 + x, width - 1);
+      const unsigned char *p = rgba + ((size_t)sy * width + sx) * 4;
+      for (int c = 0; c < 4; ++c) block.c[c][y * 4 + x] = p[c];
+    }
+  }
+}
+
+// nearest palette entry of every pixel by weighted squared distance, returns total error
+static float fitIndices(const Block &block, const Palette &palette, const float weights[4], unsigned char indices[16]) {
+  float error = 0.f;
+#if defined(BLOCKCOMPRESS_SSE)
+  // 4 pixels per step, ties keep the lower index like the scalar code
+  for (int i = 0; i < 16; i += 4) {
+    __m128 best = _mm_set1_ps(1e30f);
+    __m128 bestIndex = _mm_setzero_ps();
+    for (int e = 0; e < palette.count; ++e) {
+      __m128 d = _mm_setzero_ps();
+      for (int c = 0; c < 4; ++c) {
+        __m128 diff = _mm_sub_ps(_mm_loadu_ps(&block.c[c][i]), _mm_set1_ps(palette.c[c][e]));
+        d = _mm_add_ps(d, _mm_mul_ps(_mm_mul_ps(diff, diff), _mm_set1_ps(weights[c])));
+      }
+      __m128 closer = _mm_cmplt_ps(d, best);
+      best = _mm_min_ps(d, best);
+      bestIndex = _mm_or_ps(_mm_and_ps(closer, _mm_set1_ps((float)e)), _mm_andnot_ps(closer, bestIndex));
+    }
+    float b[4], bi[4];
+    _mm_storeu_ps(b, best);
+    _mm_storeu_ps(bi, bestIndex);
+    for (int k = 0; k < 4; ++k) {
+      indices[i + k] = (unsigned char)bi[k];
+      error += b[k];
+    }
+  }
+#elif defined(BLOCKCOMPRESS_NEON)
+  for (int i = 0; i < 16; i += 4) {
+    float32x4_t best = vdupq_n_f32(1e30f);
+    float32x4_t bestIndex = vdupq_n_f32(0.f);
+    for (int e = 0; e < palette.count; ++e) {
+      float32x4_t d = vdupq_n_f32(0.f);
+      for (int c = 0; c < 4; ++c) {
+        float32x4_t diff = vsubq_f32(vld1q_f32(&block.c[c][i]), vdupq_n_f32(palette.c[c][e]));
+        d = vmlaq_n_f32(d, vmulq_f32(diff, diff), weights[c]);
+      }
+      uint32x4_t closer = vcltq_f32(d, best);
+      best = vminq_f32(d, best);
+      bestIndex = vbslq_f32(closer, vdupq_n_f32((float)e), bestIndex);
+    }
+    float b[4], bi[4];
+    vst1q_f32(b, best);
+    vst1q_f32(bi, bestIndex);
+    for (int k = 0; k < 4; ++k) {
+      indices[i + k] = (unsigned char)bi[k];
+      error += b[k];
+    }
+  }
+#else
+  for (int i = 0; i < 16; ++i) {
+    float best = 1e30f;
+    for (int e = 0; e < palette.count; ++e) {
+      float d = 0.f;
+      for (int c = 0; c < 4; ++c) {
+        float diff = block.c[c][i] - palette.c[c][e];
+        d += diff * diff * weights[c];
+      }
+      if (d < best) {
+        best = d;
+        indices[i] = (unsigned char)e;
+      }
+    }
+    error += best;
+  }
+#endif
+  return error;
+}
+
+static float clamp255(float v) { return v < 0.f ? 0.f : v > 255.f ? 255.f : v; }
+
+// endpoints spanning the colors of a block, first channels only
+static void fitEndpoints(const Block &block, int channels, int level, float e0[4], float e1[4]) {
+  float lo[4], hi[4];
+  for (int c = 0; c < 4; ++c) {
+    lo[c] = hi[c] = block.c[c][0];
+    for (int i = 1; i < 16; ++i) {
+      lo[c] = std::min(lo[c], block.c[c][i]);
+      hi[c] = std::max(hi[c], block.c[c][i]);
+    }
+    // inset of 1/16 of the range, the extremes are rarely the best endpoints
+    float inset = c < channels ? (hi[c] - lo[c]) / 16.f : 0.f;
+    e0[c] = hi[c] - inset;
+    e1[c] = lo[c] + inset;
+  }
+  if (level == 0) return;
+
+  // principal axis of the covariance by power iteration, from the box diagonal
+  float mean[4] = {0.f, 0.f, 0.f, 0.f}, cov[4][4] = {}, axis[4];
+  for (int c = 0; c < channels; ++c) {
+    for (int i = 0; i < 16; ++i) mean[c] += block.c[c][i];
+    mean[c] /= 16.f;
+    axis[c] = hi[c] - lo[c];
+  }
+  for (int i = 0; i < 16; ++i)
+    for (int a = 0; a < channels; ++a)
+      for (int b = 0; b < channels; ++b) cov[a][b] += (block.c[a][i] - mean[a]) * (block.c[b][i] - mean[b]);
+  for (int iteration = 0; iteration < 8; ++iteration) {
+    float next[4] = {0.f, 0.f, 0.f, 0.f}, norm = 0.f;
+    for (int a = 0; a < channels; ++a) {
+      for (int b = 0; b < channels; ++b) next[a] += cov[a][b] * axis[b];
+      norm = std::max(norm, std::fabs(next[a]));
+    }
+    // flat block, the box endpoints are as good as any
+    if (norm < 1e-6f) return;
+    for (int a = 0; a < channels; ++a) axis[a] = next[a] / norm;
+  }
+  float norm = 0.f;
+  for (int c = 0; c < channels; ++c) norm += axis[c] * axis[c];
+  norm = std::sqrt(norm);
+  float tmin = 0.f, tmax = 0.f;
+  for (int i = 0; i < 16; ++i) {
+    float t = 0.f;
+    for (int c = 0; c < channels; ++c) t += (block.c[c][i] - mean[c]) * axis[c] / norm;
+    tmin = std::min(tmin, t);
+    tmax = std::max(tmax, t);
+  }
+  for (int c = 0; c < channels; ++c) {
+    e0[c] = clamp255(mean[c] + axis[c] / norm * tmax);
+    e1[c] = clamp255(mean[c] + axis[c] / norm * tmin);
+  }
+}
+
+// least squares endpoints for fixed indices, w[i] is the weight of e1 in the palette entry of pixel i
+static bool refineEndpoints(const Block &block, int channels, const float w[16], float e0[4], float e1[4]) {
+  float alpha = 0.f, beta = 0.f, gamma = 0.f;
+  for (int i = 0; i < 16; ++i) {
+    alpha += (1.f - w[i]) * (1.f - w[i]);
+    beta += w[i] * w[i];
+    gamma += (1.f - w[i]) * w[i];
+  }
+  float det = alpha * beta - gamma * gamma;
+  if (std::fabs(det) < 1e-6f) return false;
+  for (int c = 0; c < channels; ++c) {
+    float x0 = 0.f, x1 = 0.f;
+    for (int i = 0; i < 16; ++i) {
+      x0 += (1.f - w[i]) * block.c[c][i];
+      x1 += w[i] * block.c[c][i];
+    }
+    e0[c] = clamp255((x0 * beta - x1 * gamma) / det);
+    e1[c] = clamp255((x1 * alpha - x0 * gamma) / det);
+  }
+  return true;
+}
+
+static unsigned short to565(const float c[4]) {
+  unsigned r = (unsigned)(c[0] * 31.f / 255.f + 0.5f);
+  unsigned g = (unsigned)(c[1] * 63.f / 255.f + 0.5f);
+  unsigned b = (unsigned)(c[2] * 31.f / 255.f + 0.5f);
+  return (unsigned short)(r << 11 | g << 5 | b);
+}
+
+static void from565(unsigned short v, int c[3]) {
+  int r = v >> 11, g = (v >> 5) & 63, b = v & 31;
+  c[0] = r << 3 | r >> 2;
+  c[1] = g << 2 | g >> 4;
+  c[2] = b << 3 | b >> 2;
+}
+
+// writes BC1 color block for the given endpoints, returns its error
+static float encodeColorEndpoints(const Block &block, const float e0[4], const float e1[4], unsigned char *out,
+                                  unsigned char indices[16]) {
+  static const float weights[4] = {1.f, 1.f, 1.f, 0.f};
+  unsigned short c0 = to565(e0), c1 = to565(e1);
+  // c0 > c1 selects the 4 color mode
+  if (c0 < c1) std::swap(c0, c1);
+  int p0[3], p1[3];
+  from565(c0, p0);
+  from565(c1, p1);
+  Palette palette;
+  palette.count = c0 == c1 ? 1 : 4;
+  for (int c = 0; c < 3; ++c) {
+    palette.c[c][0] = (float)p0[c];
+    palette.c[c][1] = (float)p1[c];
+    palette.c[c][2] = (float)((2 * p0[c] + p1[c]) / 3);
+    palette.c[c][3] = (float)((p0[c] + 2 * p1[c]) / 3);
+  }
+  for (int e = 0; e < 4; ++e) palette.c[3][e] = 0.f;
+  float error = fitIndices(block, palette, weights, indices);
+
+  unsigned bits = 0;
+  for (int i = 0; i < 16; ++i) bits |= (unsigned)indices[i] << (2 * i);
+  out[0] = (unsigned char)c0;
+  out[1] = (unsigned char)(c0 >> 8);
+  out[2] = (unsigned char)c1;
+  out[3] = (unsigned char)(c1 >> 8);
+  for (int i = 0; i < 4; ++i) out[4 + i] = (unsigned char)(bits >> (8 * i));
+  return error;
+}
+
+static void encodeColor(const Block &block, int level, unsigned char *out) {
+  // weight of c1 for each BC1 index
+  static const float index_weights[4] = {0.f, 1.f, 1.f / 3.f, 2.f / 3.f};
+  float e0[4], e1[4];
+  unsigned char indices[16];
+  fitEndpoints(block, 3, level, e0, e1);
+  float error = encodeColorEndpoints(block, e0, e1, out, indices);
+  for (int iteration = 0; level >= 2 && iteration < 2; ++iteration) {
+    // endpoints may have been swapped, read them back from the block
+    float w[16];
+    for (int i = 0; i < 16; ++i) w[i] = index_weights[indices[i]];
+    int p0[3], p1[3];
+    from565((unsigned short)(out[0] | out[1] << 8), p0);
+    from565((unsigned short)(out[2] | out[3] << 8), p1);
+    for (int c = 0; c < 3; ++c) {
+      e0[c] = (float)p0[c];
+      e1[c] = (float)p1[c];
+    }
+    if (!refineEndpoints(block, 3, w, e0, e1)) break;
+    unsigned char candidate[8], candidateIndices[16];
+    float candidateError = encodeColorEndpoints(block, e0, e1, candidate, candidateIndices);
+    if (candidateError >= error) break;
+    error = candidateError;
+    memcpy(out, candidate, 8);
+    memcpy(indices, candidateIndices, 16);
+  }
+}
+
+// BC4 block of the alpha channel, 8 interpolated values between max & min
+static void encodeAlpha(const Block &block, unsigned char *out) {
+  float lo = block.c[3][0], hi = block.c[3][0];
+  for (int i = 1; i < 16; ++i) {
+    lo = std::min(lo, block.c[3][i]);
+    hi = std::max(hi, block.c[3][i]);
+  }
+  int a0 = (int)hi, a1 = (int)lo;
+  unsigned long long bits = 0;
+  if (a0 != a1) {
+    for (int i = 0; i < 16; ++i) {
+      // nearest of the 8 steps, step 0 is a0 and step 7 is a1
+      int step = (int)((a0 - block.c[3][i]) * 7.f / (a0 - a1) + 0.5f);
+      static const int step_index[8] = {0, 2, 3, 4, 5, 6, 7, 1};
+      bits |= (unsigned long long)step_index[step] << (3 * i);
+    }
+  }
+  out[0] = (unsigned char)a0;
+  out[1] = (unsigned char)a1;
+  for (int i = 0; i < 6; ++i) out[2 + i] = (unsigned char)(bits >> (8 * i));
+}
+
+// 7-bit endpoint with a p-bit shared by its channels, returns the 8-bit values
+static void quantizeBC7(const float e[4], int q[4], int &p) {
+  float bestError = 1e30f;
+  for (int bit = 0; bit < 2; ++bit) {
+    int candidate[4];
+    float error = 0.f;
+    for (int c = 0; c < 4; ++c) {
+      int v = (int)((e[c] - bit) / 2.f + 0.5f);
+      v = std::max(0, std::min(127, v));
+      candidate[c] = v << 1 | bit;
+      error += (candidate[c] - e[c]) * (candidate[c] - e[c]);
+    }
+    if (error < bestError) {
+      bestError = error;
+      p = bit;
+      memcpy(q, candidate, sizeof(candidate));
+    }
+  }
+}
+
+// LSB first bit writer over a 16 byte block
+struct BitWriter {
+  unsigned char *out;
+  int position;
+  void write(unsigned value, int bits) {
+    for (int i = 0; i < bits; ++i, ++position)
+      if (value >> i & 1) out[position >> 3] |= (unsigned char)(1 << (position & 7));
+  }
+};
+
+// writes BC7 mode 6 block for the given endpoints, returns its error
+static float encodeBC7Endpoints(const Block &block, const float e0[4], const float e1[4], unsigned char *out,
+                                unsigned char indices[16]) {
+  static const float weights[4] = {1.f, 1.f, 1.f, 1.f};
+  int q0[4], q1[4], p0, p1;
+  quantizeBC7(e0, q0, p0);
+  quantizeBC7(e1, q1, p1);
+  Palette palette;
+  palette.count = 16;
+  for (int e = 0; e < 16; ++e)
+    for (int c = 0; c < 4; ++c) palette.c[c][e] = (float)(((64 - bc7_weights[e]) * q0[c] + bc7_weights[e] * q1[c] + 32) >> 6);
+  float error = fitIndices(block, palette, weights, indices);
+
+  // first index has an implicit 0 high bit, swapping endpoints flips the indices
+  if (indices[0] >= 8) {
+    std::swap(q0, q1);
+    std::swap(p0, p1);
+    for (int i = 0; i < 16; ++i) indices[i] = (unsigned char)(15 - indices[i]);
+  }
+  memset(out, 0, 16);
+  BitWriter writer = {out, 0};
+  writer.write(1 << 6, 7); // mode 6
+  for (int c = 0; c < 4; ++c) {
+    writer.write((unsigned)q0[c] >> 1, 7);
+    writer.write((unsigned)q1[c] >> 1, 7);
+  }
+  writer.write((unsigned)p0, 1);
+  writer.write((unsigned)p1, 1);
+  writer.write(indices[0], 3);
+  for (int i = 1; i < 16; ++i) writer.write(indices[i], 4);
+  return error;
+}
+
+static void encodeBC7(const Block &block, int level, unsigned char *out) {
+  float e0[4], e1[4];
+  unsigned char indices[16];
+  fitEndpoints(block, 4, level, e0, e1);
+  float error = encodeBC7Endpoints(block, e0, e1, out, indices);
+  unsigned char candidate[16], candidateIndices[16];
+  for (int iteration = 0; level >= 2 && iteration < 2; ++iteration) {
+    // indices may have been flipped, weights follow the written endpoint order
+    float w[16];
+    for (int i = 0; i < 16; ++i) w[i] = bc7_weights[indices[i]] / 64.f;
+    if (!refineEndpoints(block, 4, w, e0, e1)) break;
+    float candidateError = encodeBC7Endpoints(block, e0, e1, candidate, candidateIndices);
+    if (candidateError >= error) break;
+    error = candidateError;
+    memcpy(out, candidate, 16);
+    memcpy(indices, candidateIndices, 16);
+  }
+}
+
+void compressImage(const unsigned char *rgba, int width, int height, BlockFormat format, int level,
+                   unsigned char *blocks, int threads) {
+  const int blocksX = (width + 3) / 4, blocksY = (height + 3) / 4;
+  const int bytes = blockBytes(format);
+  // workers take block rows one at a time
+  std::atomic<int> nextRow(0);
+  auto worker = [&]() {
+    Block block;
+    for (int by; (by = nextRow++) < blocksY;) {
+      for (int bx = 0; bx < blocksX; ++bx) {
+        unsigned char *out = blocks + ((size_t)by * blocksX + bx) * bytes;
+        loadBlock(rgba, width, height, bx, by, block);
+        if (format == BLOCK_BC1) {
+          encodeColor(block, level, out);
+        } else if (format == BLOCK_BC3) {
+          encodeAlpha(block, out);
+          encodeColor(block, level, out + 8);
+        } else {
+          encodeBC7(block, level, out);
+        }
+      }
+    }
+  };
+  if (threads <= 0) threads = (int)std::thread::hardware_concurrency();
+  threads = std::max(1, std::min(threads, blocksY));
+  std::vector<std::thread> pool;
+  for (int i = 1; i < threads; ++i) pool.push_back(std::thread(worker));
+  worker();
+  for (size_t i = 0; i < pool.size(); ++i) pool[i].join();
+}
+
+// BC3 color blocks always use 4 colors, BC1 ones only when c0 > c1
+static void decodeColor(const unsigned char *in, unsigned char pixels[16][4], bool four_colors) {
+  unsigned short c0 = (unsigned short)(in[0] | in[1] << 8), c1 = (unsigned short)(in[2] | in[3] << 8);
+  int p[4][4];
+  from565(c0, p[0]);
+  from565(c1, p[1]);
+  p[0][3] = p[1][3] = p[2][3] = 255;
+  for (int c = 0; c < 3; ++c) {
+    if (c0 > c1 || four_colors) {
+      p[2][c] = (2 * p[0][c] + p[1][c]) / 3;
+      p[3][c] = (p[0][c] + 2 * p[1][c]) / 3;
+    } else {
+      // 3 color mode, last entry is transparent black
+      p[2][c] = (p[0][c] + p[1][c]) / 2;
+      p[3][c] = 0;
+    }
+  }
+  p[3][3] = c0 > c1 || four_colors ? 255 : 0;
+  unsigned bits = in[4] | in[5] << 8 | in[6] << 16 | (unsigned)in[7] << 24;
+  for (int i = 0; i < 16; ++i)
+    for (int c = 0; c < 4; ++c) pixels[i][c] = (unsigned char)p[bits >> (2 * i) & 3][c];
+}
+
+static void decodeAlpha(const unsigned char *in, unsigned char pixels[16][4]) {
+  int a[8] = {in[0], in[1]};
+  for (int k = 2; k < 8; ++k) {
+    if (a[0] > a[1]) a[k] = ((8 - k) * a[0] + (k - 1) * a[1]) / 7;
+    else a[k] = k == 6 ? 0 : k == 7 ? 255 : ((6 - k) * a[0] + (k - 1) * a[1]) / 5;
+  }
+  unsigned long long bits = 0;
+  for (int i = 0; i < 6; ++i) bits |= (unsigned long long)in[2 + i] << (8 * i);
+  for (int i = 0; i < 16; ++i) pixels[i][3] = (unsigned char)a[bits >> (3 * i) & 7];
+}
+
+static void decodeBC7(const unsigned char *in, unsigned char pixels[16][4]) {
+  int position = 0;
+  auto read = [&](int bits) {
+    unsigned value = 0;
+    for (int i = 0; i < bits; ++i, ++position) value |= (unsigned)(in[position >> 3] >> (position & 7) & 1) << i;
+    return value;
+  };
+  // other modes are never written by the encoder
+  if (read(7) != 1 << 6) {
+    memset(pixels, 0, 16 * 4);
+    return;
+  }
+  int q0[4], q1[4];
+  for (int c = 0; c < 4; ++c) {
+    q0[c] = (int)read(7) << 1;
+    q1[c] = (int)read(7) << 1;
+  }
+  int p0 = (int)read(1), p1 = (int)read(1);
+  for (int c = 0; c < 4; ++c) {
+    q0[c] |= p0;
+    q1[c] |= p1;
+  }
+  for (int i = 0; i < 16; ++i) {
+    int w = bc7_weights[read(i == 0 ? 3 : 4)];
+    for (int c = 0; c < 4; ++c) pixels[i][c] = (unsigned char)(((64 - w) * q0[c] + w * q1[c] + 32) >> 6);
+  }
+}
+
+void decompressImage(const unsigned char *blocks, int width, int height, BlockFormat format, unsigned char *rgba) {
+  const int blocksX = (width + 3) / 4, blocksY = (height + 3) / 4;
+  const int bytes = blockBytes(format);
+  unsigned char pixels[16][4];
+  for (int by = 0; by < blocksY; ++by) {
+    for (int bx = 0; bx < blocksX; ++bx) {
+      const unsigned char *in = blocks + ((size_t)by * blocksX + bx) * bytes;
+      if (format == BLOCK_BC1) {
+        decodeColor(in, pixels, false);
+      } else if (format == BLOCK_BC3) {
+        decodeColor(in + 8, pixels, true);
+        decodeAlpha(in, pixels);
+      } else {
+        decodeBC7(in, pixels);
+      }
+      for (int y = 0; y < 4 && by * 4 + y < height; ++y)
+        for (int x = 0; x < 4 && bx * 4 + x < width; ++x)
+          memcpy(rgba + ((size_t)(by * 4 + y) * width + bx * 4 + x) * 4, pixels[y * 4 + x], 4);
+    }
+  }
+}
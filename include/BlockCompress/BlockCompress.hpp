@@ -0,0 +1,28 @@
+#pragma once
+#include <cstddef>
+
+// 4x4 block compressed formats, the encoder itself needs no GL context
+enum BlockFormat {
+  BLOCK_BC1,  // RGB, 8 bytes per block
+  BLOCK_BC3,  // RGBA, BC1 color & BC4 alpha, 16 bytes per block
+  BLOCK_BC7   // RGBA, mode 6 only, 16 bytes per block
+};
+#define BLOCK_LEVELS 3 // encoder levels, 0 is the fastest
+
+int blockBytes(BlockFormat format);
+size_t compressedSize(BlockFormat format, int width, int height);
+// "bc1", "bc3" or "bc7", returns false for other names
+bool parseBlockFormat(const char *name, BlockFormat &format);
+const char *blockFormatName(BlockFormat format);
+
+// Encodes RGBA8 pixels, partial edge blocks repeat the last row & column.
+// Level 0 fits endpoints to the bounding box of a block, level 1 to its
+// principal axis, level 2 refines them by least squares. A block of at most
+// two colours is already exact at level 1, so level 2 only changes blocks
+// with gradients (the cell & dot maps come out identical, about a quarter of
+// sanic's blocks improve). Block rows are split across threads (0 uses all
+// cores), the index search runs on SSE/NEON.
+void compressImage(const unsigned char *rgba, int width, int height, BlockFormat format, int level,
+                   unsigned char *blocks, int threads = 0);
+// decodes blocks written by compressImage back into RGBA8
+void decompressImage(const unsigned char *blocks, int width, int height, BlockFormat format, unsigned char *rgba);
@@ -0,0 +1,81 @@
+#include "GLState.hpp"
+#include <cmath>
+
+GLState::GLState() {
+  resetStats();
+  invalidate();
+}
+
+void GLState::invalidate() {
+  m_program = GLSTATE_UNKNOWN;
+  m_vao = GLSTATE_UNKNOWN;
+  m_activeUnit = GLSTATE_UNKNOWN;
+  for (int i = 0; i < GLSTATE_TEXTURE_UNITS; ++i) {
+    m_textures[i].target = 0;
+    m_textures[i].texture = GLSTATE_UNKNOWN;
+  }
+  for (int i = 0; i < GLSTATE_UBO_BINDINGS; ++i) {
+    m_uniformBuffers[i].buffer = GLSTATE_UNKNOWN;
+    m_uniformBuffers[i].offset = -1;
+    m_uniformBuffers[i].size = -1;
+  }
+  for (int i = 0; i < 4; ++i) m_clearColor[i] = NAN;
+}
+
+bool GLState::changed(bool differs) {
+  if (differs) ++m_stats.issued;
+  else ++m_stats.skipped;
+  return differs;
+}
+
+void GLState::useProgram(GLuint program) {
+  if (!changed(m_program != program)) return;
+  glUseProgram(program);
+  m_program = program;
+}
+
+void GLState::bindVertexArray(GLuint vao) {
+  if (!changed(m_vao != vao)) return;
+  glBindVertexArray(vao);
+  m_vao = vao;
+}
+
+void GLState::bindTexture(GLuint unit, GLenum target, GLuint texture) {
+  // units above the tracked range always reach the driver
+  bool tracked = unit < GLSTATE_TEXTURE_UNITS;
+  if (tracked && !changed(m_textures[unit].target != target || m_textures[unit].texture != texture)) return;
+  if (changed(m_activeUnit != unit)) {
+    glActiveTexture(GL_TEXTURE0 + unit);
+    m_activeUnit = unit;
+  }
+  glBindTexture(target, texture);
+  if (tracked) {
+    m_textures[unit].target = target;
+    m_textures[unit].texture = texture;
+  } else {
+    ++m_stats.issued;
+  }
+}
+
+void GLState::bindBufferRange(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size) {
+  if (target == GL_UNIFORM_BUFFER && index < GLSTATE_UBO_BINDINGS) {
+    BufferRange &range = m_uniformBuffers[index];
+    if (!changed(range.buffer != buffer || range.offset != offset || range.size != size)) return;
+    range.buffer = buffer;
+    range.offset = offset;
+    range.size = size;
+  } else {
+    ++m_stats.issued;
+  }
+  glBindBufferRange(target, index, buffer, offset, size);
+}
+
+void GLState::clearColor(GLfloat r, GLfloat g, GLfloat b, GLfloat a) {
+  // NaN never compares equal, so unknown color is always set
+  if (!changed(!(m_clearColor[0] == r && m_clearColor[1] == g && m_clearColor[2] == b && m_clearColor[3] == a))) return;
+  glClearColor(r, g, b, a);
+  m_clearColor[0] = r;
+  m_clearColor[1] = g;
+  m_clearColor[2] = b;
+  m_clearColor[3] = a;
+}
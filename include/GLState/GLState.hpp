@@ -0,0 +1,59 @@
+#pragma once
+#ifdef __WIN32
+  #ifndef GLEW_STATIC
+    #define GLEW_STATIC
+  #endif
+#endif
+#include <GLEW/glew.h>
+
+#define GLSTATE_TEXTURE_UNITS 32 // texture units tracked by GLState
+#define GLSTATE_UBO_BINDINGS 16 // uniform buffer binding points tracked by GLState
+#define GLSTATE_UNKNOWN 0xFFFFFFFFu // object name standing for "not known"
+
+// number of GL calls passed to the driver and dropped as redundant
+struct GLStateStats {
+  unsigned issued;
+  unsigned skipped;
+};
+
+// Shadow copy of the GL state touched per draw.
+// Calls that would not change the state are skipped. State changed behind
+// the cache's back (e.g. at load time) must be followed by invalidate().
+class GLState
+{
+public:
+  GLState();
+  // forgets everything, the next call of every kind reaches the driver
+  void invalidate();
+
+  void useProgram(GLuint program);
+  void bindVertexArray(GLuint vao);
+  // activates unit only when the binding has to change
+  void bindTexture(GLuint unit, GLenum target, GLuint texture);
+  void bindBufferRange(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size);
+  void clearColor(GLfloat r, GLfloat g, GLfloat b, GLfloat a);
+
+  const GLStateStats &stats() const { return m_stats; }
+  void resetStats() { m_stats.issued = m_stats.skipped = 0; }
+
+private:
+  struct Texture {
+    GLenum target;
+    GLuint texture;
+  };
+  struct BufferRange {
+    GLuint buffer;
+    GLintptr offset;
+    GLsizeiptr size;
+  };
+  // returns true and counts the call when it has to be issued
+  bool changed(bool differs);
+
+  GLuint m_program;
+  GLuint m_vao;
+  GLuint m_activeUnit;
+  Texture m_textures[GLSTATE_TEXTURE_UNITS];
+  BufferRange m_uniformBuffers[GLSTATE_UBO_BINDINGS];
+  GLfloat m_clearColor[4]; // NaN when unknown
+  GLStateStats m_stats;
+};
@@ -0,0 +1,85 @@
+#include "ImageDecoder.hpp"
+#include <algorithm>
+#include <cstdint>
+#include "../PngArena/PngArena.hpp"
+#include "../lodepng/lodepng.h"
+
+void ImageDecoder::start(const unsigned char *const *files, const size_t *sizes, int count, int threads,
+                         bool arena, unsigned char *const *targets) {
+  wait();
+  m_files = files;
+  m_sizes = sizes;
+  if (targets != nullptr) m_targets.assign(targets, targets + count);
+  else m_targets.clear();
+  m_arena = arena;
+  m_images.assign(count, DecodedImage());
+  m_next = 0;
+  m_done.clear();
+  m_returned = 0;
+  if (threads <= 0) threads = (int)std::thread::hardware_concurrency();
+  // the calling thread does not decode, so at least one worker runs
+  threads = std::max(1, std::min(threads, count));
+  for (int i = 0; i < threads; ++i) m_pool.push_back(std::thread(&ImageDecoder::work, this));
+}
+
+void ImageDecoder::work() {
+  // the arena keeps its blocks from file to file, so the large inflate and
+  // scanline buffers are not mapped and faulted in again for each one
+  PngArena arena;
+  if (m_arena) {
+    PngArena::Scope scope(arena);
+    decodeFiles(&arena);
+  } else {
+    decodeFiles(nullptr);
+  }
+}
+
+void ImageDecoder::decodeFiles(PngArena *arena) {
+  // workers take files one at a time, large and small ones even out
+  for (int i; (i = m_next++) < (int)m_images.size();) {
+    if (arena) arena->reset(); // the previous file's lodepng::State is destroyed
+    decodeFile(i);
+    // next() hands it out while the other files are still decoding
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_done.push_back(i);
+    m_finished.notify_one();
+  }
+}
+
+void ImageDecoder::decodeFile(int index) {
+  DecodedImage &image = m_images[index];
+  image.data = nullptr;
+  lodepng::State state;
+  image.error = lodepng_inspect(&image.width, &image.height, &state, m_files[index], m_sizes[index]);
+  if (image.error) return;
+  // rows go straight into the pixels, no intermediate image of the scanlines
+  size_t stride = (size_t)image.width * 4;
+  if (image.height > SIZE_MAX / stride) {
+    image.error = 92; // lodepng's pixel count overflow
+    return;
+  }
+  unsigned char *pixels = m_targets.empty() ? nullptr : m_targets[index];
+  if (pixels == nullptr) {
+    image.pixels.resize(stride * image.height);
+    pixels = image.pixels.data();
+  }
+  image.error = lodepng_decode_into(pixels, stride * image.height, stride, &image.width, &image.height, &state,
+                                    m_files[index], m_sizes[index]);
+  if (image.error) image.pixels.clear();
+  else image.data = pixels;
+}
+
+int ImageDecoder::next() {
+  std::unique_lock<std::mutex> lock(m_mutex);
+  if (m_returned == m_images.size()) return -1;
+  while (m_done.size() == m_returned) m_finished.wait(lock);
+  return m_done[m_returned++];
+}
+
+bool ImageDecoder::wait() {
+  for (size_t i = 0; i < m_pool.size(); ++i) m_pool[i].join();
+  m_pool.clear();
+  for (size_t i = 0; i < m_images.size(); ++i)
+    if (m_images[i].error) return false;
+  return true;
+}
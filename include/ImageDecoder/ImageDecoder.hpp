@@ -0,0 +1,62 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class PngArena;
+
+// RGBA8 result of one file, error is a lodepng error code
+struct DecodedImage {
+  std::vector<unsigned char> pixels; // empty when decoded into a target
+  const unsigned char *data;         // the pixels, wherever they went
+  unsigned width, height;
+  unsigned error;
+};
+
+// Decodes PNG files on a pool of worker threads, no GL dependency.
+// start() returns at once, so the caller can set up other resources while
+// the files are decoded, then take each one as it is done with next().
+class ImageDecoder
+{
+public:
+  ImageDecoder() : m_files(nullptr), m_sizes(nullptr), m_arena(true), m_returned(0) {}
+  ~ImageDecoder() { wait(); }
+  // files are read or mapped PNG files that must stay valid until wait()
+  // returns, 0 threads uses all cores. With arena each worker takes lodepng's
+  // temporaries from a PngArena reset between files, else from the heap.
+  // A file with a target is decoded into it, width * height * 4 bytes of
+  // caller memory, instead of into DecodedImage::pixels; only the memory
+  // must outlive the decoding, not the targets array.
+  void start(const unsigned char *const *files, const size_t *sizes, int count, int threads = 0, bool arena = true,
+             unsigned char *const *targets = nullptr);
+  // blocks until another file is decoded or failed and returns its index,
+  // -1 once every file was returned
+  int next();
+  // joins the workers, returns false if a file failed to decode
+  bool wait();
+
+  int count() const { return (int)m_images.size(); }
+  DecodedImage &image(int index) { return m_images[index]; }
+
+private:
+  ImageDecoder(const ImageDecoder &) = delete;
+  ImageDecoder &operator=(const ImageDecoder &) = delete;
+  void work();
+  void decodeFiles(PngArena *arena);
+  void decodeFile(int index);
+
+  const unsigned char *const *m_files;
+  const size_t *m_sizes;
+  std::vector<unsigned char *> m_targets; // copied, empty without targets
+  bool m_arena;
+  std::vector<DecodedImage> m_images;
+  std::atomic<int> m_next; // next file to decode
+  std::vector<std::thread> m_pool;
+  std::mutex m_mutex;
+  std::condition_variable m_finished;
+  std::vector<int> m_done; // files in the order they finished
+  size_t m_returned;       // of them given out by next()
+};
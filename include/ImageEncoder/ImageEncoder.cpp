@@ -0,0 +1,33 @@
+#include "ImageEncoder.hpp"
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include "../lodepng/lodepng.h"
+
+// lodepng's parallel_for, context points to the thread count
+static void parallelFor(void (*task)(void *, size_t), void *data, size_t count, const void *context) {
+  // workers take bands one at a time, the calling thread works too
+  std::atomic<size_t> next(0);
+  auto worker = [&]() {
+    for (size_t i; (i = next++) < count;) task(data, i);
+  };
+  int threads = *(const int *)context;
+  threads = (int)std::max<size_t>(1, std::min<size_t>(threads, count));
+  std::vector<std::thread> pool;
+  for (int i = 1; i < threads; ++i) pool.push_back(std::thread(worker));
+  worker();
+  for (size_t i = 0; i < pool.size(); ++i) pool[i].join();
+}
+
+unsigned encodePNG(std::vector<unsigned char> &png, const unsigned char *rgba, unsigned width, unsigned height,
+                   int level, int threads) {
+  if (threads <= 0) threads = (int)std::thread::hardware_concurrency();
+  lodepng::State state;
+  state.encoder.zlibsettings.level = level;
+  if (threads > 1) {
+    state.encoder.zlibsettings.parallel_for = parallelFor;
+    state.encoder.zlibsettings.parallel_context = &threads;
+  }
+  png.clear();
+  return lodepng::encode(png, rgba, width, height, state);
+}
@@ -0,0 +1,9 @@
+#pragma once
+#include <vector>
+
+// Encodes RGBA8 pixels as a PNG file, no GL dependency. Rows are filtered and
+// deflated in bands on a pool of threads (0 uses all cores), joined into a
+// single zlib stream. level is a lodepng compression level, -1 for its default
+// settings. Returns a lodepng error code.
+unsigned encodePNG(std::vector<unsigned char> &png, const unsigned char *rgba, unsigned width, unsigned height,
+                   int level = -1, int threads = 0);
@@ -0,0 +1,146 @@
+#include "MeshArena.hpp"
+#include <iostream>
+
+void RangeAllocator::reset(GLsizei capacity) {
+  m_free.clear();
+  Range all = {0, capacity};
+  m_free.push_back(all);
+}
+
+GLint RangeAllocator::allocate(GLsizei size) {
+  for (size_t i = 0; i < m_free.size(); ++i) {
+    if (m_free[i].size < size) continue;
+    GLint offset = m_free[i].offset;
+    m_free[i].offset += size;
+    m_free[i].size -= size;
+    if (m_free[i].size == 0) m_free.erase(m_free.begin() + i);
+    return offset;
+  }
+  return -1;
+}
+
+void RangeAllocator::release(GLint offset, GLsizei size) {
+  // keeping ranges sorted by offset
+  size_t i = 0;
+  while (i < m_free.size() && m_free[i].offset < offset) ++i;
+  Range range = {offset, size};
+  m_free.insert(m_free.begin() + i, range);
+  // merging with the next and the previous neighbours
+  if (i + 1 < m_free.size() && m_free[i].offset + m_free[i].size == m_free[i + 1].offset) {
+    m_free[i].size += m_free[i + 1].size;
+    m_free.erase(m_free.begin() + i + 1);
+  }
+  if (i > 0 && m_free[i - 1].offset + m_free[i - 1].size == m_free[i].offset) {
+    m_free[i - 1].size += m_free[i].size;
+    m_free.erase(m_free.begin() + i);
+  }
+}
+
+MeshArena::MeshArena() : m_vbo(0), m_ibo(0), m_vertexSize(0) {}
+
+bool MeshArena::create(GLsizei vertex_capacity, GLsizei index_capacity, GLsizei vertex_size) {
+  m_vertexSize = vertex_size;
+  m_vertices.reset(vertex_capacity);
+  m_indices.reset(index_capacity);
+
+  glGenBuffers(1, &m_vbo);
+  glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
+  glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)vertex_capacity * vertex_size, NULL, GL_STATIC_DRAW);
+  // index buffer is bound through the VAO later, GL_COPY_WRITE_BUFFER keeps VAO state intact
+  glGenBuffers(1, &m_ibo);
+  glBindBuffer(GL_COPY_WRITE_BUFFER, m_ibo);
+  glBufferData(GL_COPY_WRITE_BUFFER, (GLsizeiptr)index_capacity * sizeof(GLuint), NULL, GL_STATIC_DRAW);
+  glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+  return m_vbo != 0 && m_ibo != 0;
+}
+
+void MeshArena::destroy() {
+  if (m_vbo != 0) glDeleteBuffers(1, &m_vbo);
+  if (m_ibo != 0) glDeleteBuffers(1, &m_ibo);
+  m_vbo = m_ibo = 0;
+}
+
+bool MeshArena::allocate(const void *vertices, GLsizei vertex_count, const GLuint *indices, GLsizei index_count, Mesh &mesh) {
+  GLint baseVertex = m_vertices.allocate(vertex_count);
+  if (baseVertex < 0) {
+    std::cout << "Mesh arena is out of vertex space" << std::endl;
+    return false;
+  }
+  GLint firstIndex = m_indices.allocate(index_count);
+  if (firstIndex < 0) {
+    m_vertices.release(baseVertex, vertex_count);
+    std::cout << "Mesh arena is out of index space" << std::endl;
+    return false;
+  }
+  mesh.baseVertex = baseVertex;
+  mesh.vertexCount = vertex_count;
+  mesh.firstIndex = firstIndex;
+  mesh.indexCount = index_count;
+
+  glBindBuffer(GL_COPY_WRITE_BUFFER, m_vbo);
+  glBufferSubData(GL_COPY_WRITE_BUFFER, (GLintptr)baseVertex * m_vertexSize, (GLsizeiptr)vertex_count * m_vertexSize, vertices);
+  glBindBuffer(GL_COPY_WRITE_BUFFER, m_ibo);
+  glBufferSubData(GL_COPY_WRITE_BUFFER, (GLintptr)firstIndex * sizeof(GLuint), (GLsizeiptr)index_count * sizeof(GLuint), indices);
+  glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+  return true;
+}
+
+void MeshArena::release(const Mesh &mesh) {
+  m_vertices.release(mesh.baseVertex, mesh.vertexCount);
+  m_indices.release(mesh.firstIndex, mesh.indexCount);
+}
+
+IndirectBatch::IndirectBatch() : m_buffer(0), m_capacity(0) {}
+
+bool IndirectBatch::create() {
+  // indirect commands carry baseInstance, which needs GL_ARB_base_instance
+  if (GLEW_ARB_multi_draw_indirect && GLEW_ARB_base_instance) glGenBuffers(1, &m_buffer);
+  return true;
+}
+
+void IndirectBatch::destroy() {
+  if (m_buffer != 0) glDeleteBuffers(1, &m_buffer);
+  m_buffer = 0;
+  m_capacity = 0;
+}
+
+void IndirectBatch::add(const Mesh &mesh, GLuint instance_count, GLuint base_instance) {
+  if (instance_count == 0) return;
+  DrawElementsIndirectCommand command;
+  command.count = mesh.indexCount;
+  command.instanceCount = instance_count;
+  command.firstIndex = mesh.firstIndex;
+  command.baseVertex = mesh.baseVertex;
+  command.baseInstance = base_instance;
+  m_commands.push_back(command);
+}
+
+void IndirectBatch::submit(void (*set_base_instance)(GLuint base_instance)) {
+  if (m_commands.empty()) return;
+  GLsizeiptr size = m_commands.size() * sizeof(DrawElementsIndirectCommand);
+
+  if (m_buffer != 0) {
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_buffer);
+    if (size > m_capacity) m_capacity = size * 2;
+    // orphaning storage still in use by the previous frame
+    glBufferData(GL_DRAW_INDIRECT_BUFFER, m_capacity, NULL, GL_STREAM_DRAW);
+    glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, size, m_commands.data());
+    // whole batch in one call
+    glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, NULL, (GLsizei)m_commands.size(), 0);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    return;
+  }
+
+  for (size_t i = 0; i < m_commands.size(); ++i) {
+    const DrawElementsIndirectCommand &c = m_commands[i];
+    const GLvoid *indices = (const GLvoid *)(c.firstIndex * sizeof(GLuint));
+    if (GLEW_ARB_base_instance) {
+      glDrawElementsInstancedBaseVertexBaseInstance(GL_TRIANGLES, c.count, GL_UNSIGNED_INT, indices, c.instanceCount, c.baseVertex, c.baseInstance);
+    } else {
+      set_base_instance(c.baseInstance);
+      glDrawElementsInstancedBaseVertex(GL_TRIANGLES, c.count, GL_UNSIGNED_INT, indices, c.instanceCount, c.baseVertex);
+    }
+  }
+  if (!GLEW_ARB_base_instance) set_base_instance(0);
+}
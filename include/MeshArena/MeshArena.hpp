@@ -0,0 +1,91 @@
+#pragma once
+#ifdef __WIN32
+  #ifndef GLEW_STATIC
+    #define GLEW_STATIC
+  #endif
+#endif
+#include <GLEW/glew.h>
+#include <vector>
+
+// layout of one record in GL_DRAW_INDIRECT_BUFFER, defined by the GL spec
+struct DrawElementsIndirectCommand {
+  GLuint count;         // number of indices
+  GLuint instanceCount; // number of instances
+  GLuint firstIndex;    // first index in the index buffer
+  GLint baseVertex;     // added to every index
+  GLuint baseInstance;  // first instance for instanced attributes
+};
+
+// mesh sub-allocated in the arena buffers
+struct Mesh {
+  GLint baseVertex;     // first vertex in the arena vertex buffer
+  GLsizei vertexCount;  // number of vertices
+  GLuint firstIndex;    // first index in the arena index buffer
+  GLsizei indexCount;   // number of indices
+};
+
+// first-fit allocator of element ranges, free ranges are kept sorted and merged
+class RangeAllocator
+{
+public:
+  void reset(GLsizei capacity);
+  // returns first element of the range or -1 if there is no room
+  GLint allocate(GLsizei size);
+  void release(GLint offset, GLsizei size);
+
+private:
+  struct Range {
+    GLint offset;
+    GLsizei size;
+  };
+  std::vector<Range> m_free;
+};
+
+// One vertex buffer and one index buffer shared by all meshes of a scene.
+// Meshes index their own vertices from 0, baseVertex moves them into place.
+class MeshArena
+{
+public:
+  MeshArena();
+  // creates buffers for vertex_capacity vertices of vertex_size bytes and index_capacity indices
+  bool create(GLsizei vertex_capacity, GLsizei index_capacity, GLsizei vertex_size);
+  void destroy();
+  // copies mesh data into the arena, returns false when the arena is full
+  bool allocate(const void *vertices, GLsizei vertex_count, const GLuint *indices, GLsizei index_count, Mesh &mesh);
+  // returns mesh ranges back to the arena
+  void release(const Mesh &mesh);
+
+  GLuint vbo() const { return m_vbo; }
+  GLuint ibo() const { return m_ibo; }
+
+private:
+  GLuint m_vbo;
+  GLuint m_ibo;
+  GLsizei m_vertexSize;
+  RangeAllocator m_vertices;
+  RangeAllocator m_indices;
+};
+
+// Indirect draw commands built on the CPU every frame and submitted at once.
+// Uses glMultiDrawElementsIndirect when available together with
+// GL_ARB_base_instance, which the commands' baseInstance needs, otherwise one
+// draw per command; without GL_ARB_base_instance set_base_instance re-points
+// the instanced attributes instead.
+class IndirectBatch
+{
+public:
+  IndirectBatch();
+  bool create();
+  void destroy();
+  void clear() { m_commands.clear(); }
+  void add(const Mesh &mesh, GLuint instance_count, GLuint base_instance);
+  // uploads commands and draws them, the arena VAO must be bound
+  void submit(void (*set_base_instance)(GLuint base_instance));
+
+  size_t size() const { return m_commands.size(); }
+
+private:
+  GLuint m_buffer;        // GL_DRAW_INDIRECT_BUFFER
+  GLsizeiptr m_capacity;  // bytes allocated in m_buffer
+  std::vector<DrawElementsIndirectCommand> m_commands;
+};
@@ -0,0 +1,195 @@
+#include "MipChain.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <thread>
+#if defined(__SSE2__) || defined(_M_X64)
+  #include <emmintrin.h>
+  #define MIPCHAIN_SSE
+#elif defined(__ARM_NEON)
+  #include <arm_neon.h>
+  #define MIPCHAIN_NEON
+#endif
+
+#define KAISER_ALPHA 4.f
+#define SRGB_LUT_SIZE 4096 // linear to sRGB table entries
+
+// source texels of every destination texel, count per texel, zero weights pad the rest
+struct Taps {
+  int count;
+  std::vector<int> index;
+  std::vector<float> weight;
+};
+
+bool parseMipFilter(const char *name, MipFilter &filter) {
+  if (strcmp(name, "box") == 0) filter = MIP_BOX;
+  else if (strcmp(name, "kaiser") == 0) filter = MIP_KAISER;
+  else if (strcmp(name, "lanczos") == 0) filter = MIP_LANCZOS;
+  else return false;
+  return true;
+}
+
+const char *mipFilterName(MipFilter filter) {
+  return filter == MIP_BOX ? "box" : filter == MIP_KAISER ? "Kaiser" : "Lanczos";
+}
+
+int mipLevels(int width, int height) {
+  int levels = 1;
+  for (int size = std::max(width, height); size > 1; size >>= 1) ++levels;
+  return levels;
+}
+
+static float sinc(float x) {
+  if (std::fabs(x) < 1e-6f) return 1.f;
+  x *= 3.14159265f;
+  return std::sin(x) / x;
+}
+
+// zeroth order modified Bessel function of the first kind
+static float bessel0(float x) {
+  float sum = 1.f, term = 1.f;
+  for (int k = 1; k < 20; ++k) {
+    float f = x / (2.f * k);
+    term *= f * f;
+    sum += term;
+  }
+  return sum;
+}
+
+static float filterRadius(MipFilter filter) { return filter == MIP_BOX ? 0.5f : 3.f; }
+
+static float filterWeight(MipFilter filter, float x) {
+  x = std::fabs(x);
+  if (filter == MIP_BOX) return x <= 0.5f ? 1.f : 0.f;
+  if (x >= 3.f) return 0.f;
+  if (filter == MIP_LANCZOS) return sinc(x) * sinc(x / 3.f);
+  float t = x / 3.f;
+  return sinc(x) * bessel0(KAISER_ALPHA * std::sqrt(1.f - t * t)) / bessel0(KAISER_ALPHA);
+}
+
+static Taps makeTaps(int src, int dst, MipFilter filter) {
+  float scale = (float)src / dst;
+  float support = filterRadius(filter) * scale;
+  Taps taps;
+  taps.count = (int)std::floor(2.f * support) + 2;
+  taps.index.resize((size_t)dst * taps.count);
+  taps.weight.resize((size_t)dst * taps.count);
+  for (int o = 0; o < dst; ++o) {
+    // texel centers of both levels line up at the edges
+    float center = (o + 0.5f) * scale - 0.5f;
+    int start = (int)std::floor(center - support);
+    float sum = 0.f;
+    for (int k = 0; k < taps.count; ++k) {
+      int i = start + k;
+      float w = filterWeight(filter, (i - center) / scale);
+      taps.index[o * taps.count + k] = (i % src + src) % src;
+      taps.weight[o * taps.count + k] = w;
+      sum += w;
+    }
+    for (int k = 0; k < taps.count && sum != 0.f; ++k) taps.weight[o * taps.count + k] /= sum;
+  }
+  return taps;
+}
+
+static float srgbToLinear(float c) { return c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f); }
+static float linearToSrgb(float c) { return c <= 0.0031308f ? c * 12.92f : 1.055f * std::pow(c, 1.f / 2.4f) - 0.055f; }
+
+// acc += w * row, n floats
+static void addRow(float *acc, const float *row, float w, int n) {
+  int i = 0;
+#if defined(MIPCHAIN_SSE)
+  __m128 vw = _mm_set1_ps(w);
+  for (; i + 4 <= n; i += 4) _mm_storeu_ps(acc + i, _mm_add_ps(_mm_loadu_ps(acc + i), _mm_mul_ps(vw, _mm_loadu_ps(row + i))));
+#elif defined(MIPCHAIN_NEON)
+  for (; i + 4 <= n; i += 4) vst1q_f32(acc + i, vmlaq_n_f32(vld1q_f32(acc + i), vld1q_f32(row + i), w));
+#endif
+  for (; i < n; ++i) acc[i] += w * row[i];
+}
+
+// weighted sum of RGBA texels of one row
+static void sumTexels(const float *row, const int *index, const float *weight, int count, float out[4]) {
+#if defined(MIPCHAIN_SSE)
+  __m128 sum = _mm_setzero_ps();
+  for (int k = 0; k < count; ++k) sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(weight[k]), _mm_loadu_ps(row + index[k] * 4)));
+  _mm_storeu_ps(out, sum);
+#elif defined(MIPCHAIN_NEON)
+  float32x4_t sum = vdupq_n_f32(0.f);
+  for (int k = 0; k < count; ++k) sum = vmlaq_n_f32(sum, vld1q_f32(row + index[k] * 4), weight[k]);
+  vst1q_f32(out, sum);
+#else
+  out[0] = out[1] = out[2] = out[3] = 0.f;
+  for (int k = 0; k < count; ++k)
+    for (int c = 0; c < 4; ++c) out[c] += weight[k] * row[index[k] * 4 + c];
+#endif
+}
+
+int mipReach(MipFilter filter, int level) {
+  // building level k from k - 1 reads 2 * radius texels of k - 1 on each side of
+  // a texel center, where the texel covers 1; the rest lies outside, 2^(k - 1)
+  // base texels per texel of k - 1
+  float outside = 2.f * filterRadius(filter) - 1.f;
+  return (int)std::ceil(outside * (float)((1 << level) - 1));
+}
+
+void generateMips(const unsigned char *rgba, int width, int height, int count, MipFilter filter, bool srgb,
+                  std::vector<std::vector<unsigned char> > &levels) {
+  levels.resize(std::max(0, count - 1));
+  if (count < 2) return;
+
+  // levels are filtered in linear floats, 8-bit texels are only written out
+  float toLinear[256];
+  for (int i = 0; i < 256; ++i) toLinear[i] = srgb ? srgbToLinear(i / 255.f) : i / 255.f;
+  std::vector<unsigned char> toSrgb(SRGB_LUT_SIZE);
+  for (int i = 0; i < SRGB_LUT_SIZE; ++i) {
+    float c = (float)i / (SRGB_LUT_SIZE - 1);
+    toSrgb[i] = (unsigned char)((srgb ? linearToSrgb(c) : c) * 255.f + 0.5f);
+  }
+  std::vector<float> previous((size_t)width * height * 4), current;
+  for (size_t i = 0; i < previous.size(); ++i) previous[i] = (i & 3) == 3 ? rgba[i] / 255.f : toLinear[rgba[i]];
+
+  int pw = width, ph = height;
+  for (int level = 1; level < count; ++level) {
+    int w = std::max(1, width >> level), h = std::max(1, height >> level);
+    Taps tx = makeTaps(pw, w, filter), ty = makeTaps(ph, h, filter);
+    std::vector<unsigned char> &out = levels[level - 1];
+    out.resize((size_t)w * h * 4);
+    current.resize((size_t)w * h * 4);
+
+    // workers take rows one at a time
+    std::atomic<int> nextRow(0);
+    auto worker = [&]() {
+      std::vector<float> column((size_t)pw * 4);
+      for (int y; (y = nextRow++) < h;) {
+        // vertical pass over whole rows, then horizontal pass per texel
+        std::fill(column.begin(), column.end(), 0.f);
+        for (int k = 0; k < ty.count; ++k) {
+          float weight = ty.weight[y * ty.count + k];
+          if (weight != 0.f) addRow(column.data(), &previous[(size_t)ty.index[y * ty.count + k] * pw * 4], weight, pw * 4);
+        }
+        for (int x = 0; x < w; ++x) {
+          float texel[4];
+          sumTexels(column.data(), &tx.index[x * tx.count], &tx.weight[x * tx.count], tx.count, texel);
+          float *f = &current[((size_t)y * w + x) * 4];
+          unsigned char *o = &out[((size_t)y * w + x) * 4];
+          for (int c = 0; c < 4; ++c) {
+            // negative lobes may overshoot
+            float v = std::min(std::max(texel[c], 0.f), 1.f);
+            f[c] = v;
+            o[c] = c == 3 ? (unsigned char)(v * 255.f + 0.5f) : toSrgb[(int)(v * (SRGB_LUT_SIZE - 1) + 0.5f)];
+          }
+        }
+      }
+    };
+    int threads = std::max(1, std::min((int)std::thread::hardware_concurrency(), h));
+    std::vector<std::thread> pool;
+    for (int i = 1; i < threads; ++i) pool.push_back(std::thread(worker));
+    worker();
+    for (size_t i = 0; i < pool.size(); ++i) pool[i].join();
+
+    // the next level is filtered from this one
+    previous.swap(current);
+    pw = w;
+    ph = h;
+  }
+}
@@ -0,0 +1,27 @@
+#pragma once
+#include <vector>
+
+// downsampling filters, no GL dependency
+enum MipFilter {
+  MIP_BOX,     // average of the covered texels
+  MIP_KAISER,  // Kaiser windowed sinc, width 3
+  MIP_LANCZOS  // Lanczos windowed sinc, width 3
+};
+
+// "box", "kaiser" or "lanczos", returns false for other names
+bool parseMipFilter(const char *name, MipFilter &filter);
+const char *mipFilterName(MipFilter filter);
+// number of levels down to 1x1
+int mipLevels(int width, int height);
+
+// base texels that filtering reads beyond the area a texel of the level
+// covers, 0 for the box filter
+int mipReach(MipFilter filter, int level);
+
+// Builds levels 1 .. count - 1 of an RGBA8 image into levels[0 .. count - 2].
+// Each level is filtered from the previous one, kept in linear floats, and
+// its rows are shared among threads. Rows are filtered with SSE/NEON, the
+// image wraps around like GL_REPEAT. With srgb the color channels are
+// averaged in linear space, alpha always is.
+void generateMips(const unsigned char *rgba, int width, int height, int count, MipFilter filter, bool srgb,
+                  std::vector<std::vector<unsigned char> > &levels);
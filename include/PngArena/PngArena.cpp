@@ -0,0 +1,163 @@
+#include "PngArena.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+
+namespace {
+// also the header size, so allocations are aligned as malloc's are
+const size_t alignment = 16;
+thread_local PngArena *t_arena = nullptr;
+std::atomic<size_t> g_heapAllocations(0);
+// arenas alive on all threads, the lock also guards their block lists
+std::mutex g_arenasMutex;
+std::vector<const PngArena *> g_arenas;
+
+// header and payload rounded up to the alignment, 0 if it overflows. Empty
+// allocations get a byte too, so every pointer is inside its block for owns().
+size_t footprint(size_t size) {
+  if (size > SIZE_MAX - 2 * alignment) return 0;
+  return alignment + (std::max<size_t>(size, 1) + alignment - 1) / alignment * alignment;
+}
+} // namespace
+
+PngArena::PngArena(size_t block_size) : m_blockSize(block_size), m_block(0), m_top(0), m_last(nullptr),
+                                        m_allocations(0), m_used(0), m_peak(0) {
+  std::lock_guard<std::mutex> lock(g_arenasMutex);
+  g_arenas.push_back(this);
+}
+
+PngArena::~PngArena() {
+  {
+    std::lock_guard<std::mutex> lock(g_arenasMutex);
+    g_arenas.erase(std::find(g_arenas.begin(), g_arenas.end(), this));
+  }
+  for (size_t i = 0; i < m_blocks.size(); ++i) std::free(m_blocks[i].data);
+}
+
+PngArena::Scope::Scope(PngArena &arena) : m_previous(t_arena) { t_arena = &arena; }
+
+PngArena::Scope::~Scope() { t_arena = m_previous; }
+
+void PngArena::reset() {
+  m_block = 0;
+  m_top = 0;
+  m_last = nullptr;
+  m_used = 0;
+}
+
+void *PngArena::allocate(size_t size) {
+  size_t need = footprint(size);
+  if (need == 0) return nullptr;
+  // the tail of a block too full for this one is skipped until reset()
+  while (m_block < m_blocks.size() && m_blocks[m_block].size - m_top < need) {
+    m_used += m_blocks[m_block].size - m_top;
+    ++m_block;
+    m_top = 0;
+  }
+  if (m_block == m_blocks.size()) {
+    Block block;
+    block.size = std::max(m_blockSize, need);
+    block.data = (unsigned char *)std::malloc(block.size);
+    if (!block.data) return nullptr;
+    std::lock_guard<std::mutex> lock(g_arenasMutex);
+    m_blocks.push_back(block);
+  }
+  unsigned char *header = m_blocks[m_block].data + m_top;
+  *(size_t *)header = size;
+  m_last = header;
+  m_top += need;
+  m_used += need;
+  m_peak = std::max(m_peak, m_used);
+  ++m_allocations;
+  return header + alignment;
+}
+
+void *PngArena::reallocate(void *ptr, size_t size) {
+  if (!ptr) return allocate(size);
+  unsigned char *header = (unsigned char *)ptr - alignment;
+  size_t old = *(size_t *)header;
+  if (header == m_last) {
+    // the last allocation is always in the current block
+    size_t start = header - m_blocks[m_block].data, need = footprint(size);
+    if (need != 0 && m_blocks[m_block].size - start >= need) {
+      m_used = m_used - (m_top - start) + need;
+      m_top = start + need;
+      m_peak = std::max(m_peak, m_used);
+      *(size_t *)header = size;
+      ++m_allocations;
+      return ptr;
+    }
+  }
+  // the old memory is only given back by reset()
+  void *moved = allocate(size);
+  if (moved) std::memcpy(moved, ptr, std::min(old, size));
+  return moved;
+}
+
+void PngArena::release(void *ptr) {
+  if (!ptr || (unsigned char *)ptr - alignment != m_last) return;
+  size_t start = m_last - m_blocks[m_block].data;
+  m_used -= m_top - start;
+  m_top = start;
+  m_last = nullptr;
+}
+
+bool PngArena::owns(const void *ptr) const {
+  uintptr_t p = (uintptr_t)ptr;
+  // every block, a pointer from before reset() is still ours to ignore on free
+  for (size_t i = 0; i < m_blocks.size(); ++i) {
+    uintptr_t data = (uintptr_t)m_blocks[i].data;
+    if (p >= data && p < data + m_blocks[i].size) return true;
+  }
+  return false;
+}
+
+bool PngArena::ownedByAny(const void *ptr) {
+  std::lock_guard<std::mutex> lock(g_arenasMutex);
+  for (size_t i = 0; i < g_arenas.size(); ++i)
+    if (g_arenas[i]->owns(ptr)) return true;
+  return false;
+}
+
+size_t PngArena::capacity() const {
+  size_t bytes = 0;
+  for (size_t i = 0; i < m_blocks.size(); ++i) bytes += m_blocks[i].size;
+  return bytes;
+}
+
+size_t PngArena::heapAllocations() { return g_heapAllocations; }
+
+// lodepng's allocator hooks
+
+void *lodepng_malloc(size_t size) {
+#ifdef LODEPNG_MAX_ALLOC
+  if (size > LODEPNG_MAX_ALLOC) return nullptr;
+#endif
+  if (t_arena) return t_arena->allocate(size);
+  ++g_heapAllocations;
+  return std::malloc(size);
+}
+
+void *lodepng_realloc(void *ptr, size_t new_size) {
+#ifdef LODEPNG_MAX_ALLOC
+  if (new_size > LODEPNG_MAX_ALLOC) return nullptr;
+#endif
+  // heap memory from before the scope stays on the heap
+  if (t_arena && (!ptr || t_arena->owns(ptr))) return t_arena->reallocate(ptr, new_size);
+  ++g_heapAllocations;
+  if (!ptr || !PngArena::ownedByAny(ptr)) return std::realloc(ptr, new_size);
+  // memory of an arena outside its scope is copied out, the arena keeps it
+  void *moved = std::malloc(new_size);
+  if (moved) std::memcpy(moved, ptr, std::min(*(const size_t *)((const unsigned char *)ptr - alignment), new_size));
+  return moved;
+}
+
+void lodepng_free(void *ptr) {
+  if (!ptr) return;
+  if (t_arena && t_arena->owns(ptr)) t_arena->release(ptr);
+  // memory of an arena outside its scope is given back by its reset()
+  else if (!PngArena::ownedByAny(ptr)) std::free(ptr);
+}
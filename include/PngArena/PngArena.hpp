@@ -0,0 +1,72 @@
+#pragma once
+#include <cstddef>
+#include <vector>
+
+// Bump allocator for lodepng's temporaries, no GL dependency. This module
+// defines lodepng_malloc, lodepng_realloc and lodepng_free (lodepng is built
+// with LODEPNG_NO_COMPILE_ALLOCATORS): while a Scope is alive they allocate
+// from its arena on that thread, otherwise from the heap. Only free the
+// buffers lodepng returns with lodepng_free, never with free(). Arena memory
+// freed outside its Scope is ignored, reallocated it moves to the heap.
+class PngArena
+{
+public:
+  // blocks of block_size bytes, larger allocations get a block of their own
+  explicit PngArena(size_t block_size = 1 << 20);
+  ~PngArena();
+
+  // makes the arena this thread's lodepng allocator until destroyed, scopes nest
+  class Scope
+  {
+  public:
+    explicit Scope(PngArena &arena);
+    ~Scope();
+
+  private:
+    Scope(const Scope &) = delete;
+    Scope &operator=(const Scope &) = delete;
+    PngArena *m_previous;
+  };
+
+  // forgets every allocation in O(1) and keeps the blocks for the next image,
+  // nothing allocated from the arena may be used afterwards
+  void reset();
+
+  void *allocate(size_t size);
+  // grows or shrinks in place when ptr is the last allocation
+  void *reallocate(void *ptr, size_t size);
+  // only the last allocation gives its memory back before reset()
+  void release(void *ptr);
+  bool owns(const void *ptr) const;
+  // whether any arena alive on any thread owns ptr
+  static bool ownedByAny(const void *ptr);
+
+  size_t allocations() const { return m_allocations; } // allocate & reallocate calls since construction
+  size_t peak() const { return m_peak; }               // most bytes in use at once
+  size_t capacity() const;                             // bytes held in blocks
+
+  // lodepng allocations that went to the heap, on all threads
+  static size_t heapAllocations();
+
+private:
+  PngArena(const PngArena &) = delete;
+  PngArena &operator=(const PngArena &) = delete;
+
+  struct Block {
+    unsigned char *data;
+    size_t size;
+  };
+  size_t m_blockSize;
+  std::vector<Block> m_blocks; // grows under the registry lock, read by ownedByAny()
+  size_t m_block;         // block allocations are taken from
+  size_t m_top;           // first free byte in it
+  unsigned char *m_last;  // header of the last allocation, to grow or give back
+  size_t m_allocations;
+  size_t m_used;          // bytes from the first block up to m_top
+  size_t m_peak;
+};
+
+// lodepng's allocators as defined here, lodepng.h does not declare them
+void *lodepng_malloc(size_t size);
+void *lodepng_realloc(void *ptr, size_t new_size);
+void lodepng_free(void *ptr);
@@ -0,0 +1,127 @@
+#include "ProgramCache.hpp"
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#ifdef _WIN32
+  #include <direct.h>
+  #include <process.h>
+  #include <windows.h>
+  #define make_dir(path) _mkdir(path)
+  #define process_id() _getpid()
+  #define replace_file(from, to) (MoveFileExA(from, to, MOVEFILE_REPLACE_EXISTING) != 0)
+#else
+  #include <sys/stat.h>
+  #include <unistd.h>
+  #define make_dir(path) mkdir(path, 0755)
+  #define process_id() getpid()
+  #define replace_file(from, to) (rename(from, to) == 0)
+#endif
+
+#define PROGRAM_CACHE_MAGIC 0x42504C47u // "GLPB"
+#define PROGRAM_CACHE_VERSION 1u
+
+// file header followed by the binary blob
+struct ProgramCacheHeader {
+  unsigned int magic;
+  unsigned int version;
+  unsigned long long key;  // hash of sources & driver strings
+  unsigned int format;     // binary format returned by the driver
+  unsigned int length;     // blob length in bytes
+};
+
+// 64-bit FNV-1a
+static unsigned long long hash_string(unsigned long long hash, const char *str) {
+  for (; str != nullptr && *str; ++str) {
+    hash ^= (unsigned char)*str;
+    hash *= 1099511628211ull;
+  }
+  // separator, so "ab"+"c" differs from "a"+"bc"
+  hash ^= 0xFF;
+  hash *= 1099511628211ull;
+  return hash;
+}
+
+static unsigned long long entry_key(const char *vsh, const char *fsh) {
+  unsigned long long hash = 14695981039346656037ull;
+  hash = hash_string(hash, vsh);
+  hash = hash_string(hash, fsh);
+  hash = hash_string(hash, (const char *)glGetString(GL_VENDOR));
+  hash = hash_string(hash, (const char *)glGetString(GL_RENDERER));
+  hash = hash_string(hash, (const char *)glGetString(GL_VERSION));
+  return hash;
+}
+
+ProgramCache::ProgramCache(const std::string &directory) : m_directory(directory) {}
+
+bool ProgramCache::isSupported() const {
+  if (!GLEW_ARB_get_program_binary) return false;
+  GLint formats = 0;
+  glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+  return formats > 0;
+}
+
+std::string ProgramCache::entryPath(const char *vsh, const char *fsh) const {
+  char name[32];
+  snprintf(name, sizeof(name), "%016llx.bin", entry_key(vsh, fsh));
+  return m_directory + "/" + name;
+}
+
+GLuint ProgramCache::load(const char *vsh, const char *fsh) {
+  if (!isSupported()) return 0;
+  unsigned long long key = entry_key(vsh, fsh);
+  FILE *file = fopen(entryPath(vsh, fsh).c_str(), "rb");
+  if (file == nullptr) return 0;
+
+  ProgramCacheHeader header;
+  std::vector<unsigned char> blob;
+  bool valid = fread(&header, sizeof(header), 1, file) == 1 &&
+               header.magic == PROGRAM_CACHE_MAGIC && header.version == PROGRAM_CACHE_VERSION &&
+               header.key == key && header.length > 0;
+  if (valid) {
+    blob.resize(header.length);
+    valid = fread(blob.data(), 1, blob.size(), file) == blob.size();
+  }
+  fclose(file);
+  if (!valid) return 0;
+
+  GLuint program = glCreateProgram();
+  glProgramBinary(program, header.format, blob.data(), header.length);
+  // driver may reject binaries of another build even with equal strings
+  GLint linked = 0;
+  glGetProgramiv(program, GL_LINK_STATUS, &linked);
+  if (!linked) {
+    glDeleteProgram(program);
+    return 0;
+  }
+  return program;
+}
+
+bool ProgramCache::store(GLuint program, const char *vsh, const char *fsh) {
+  if (program == 0 || !isSupported()) return false;
+  GLint length = 0;
+  glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+  if (length <= 0) return false;
+
+  ProgramCacheHeader header;
+  std::vector<unsigned char> blob(length);
+  GLenum format = 0;
+  glGetProgramBinary(program, length, NULL, &format, blob.data());
+  header.magic = PROGRAM_CACHE_MAGIC;
+  header.version = PROGRAM_CACHE_VERSION;
+  header.key = entry_key(vsh, fsh);
+  header.format = format;
+  header.length = (unsigned int)length;
+
+  // written aside and renamed into place, a concurrent load() never reads a partial entry
+  make_dir(m_directory.c_str());
+  std::string path = entryPath(vsh, fsh);
+  std::string temporary = path + "." + std::to_string(process_id()) + ".tmp";
+  FILE *file = fopen(temporary.c_str(), "wb");
+  if (file == nullptr) return false;
+  bool written = fwrite(&header, sizeof(header), 1, file) == 1 &&
+                 fwrite(blob.data(), 1, blob.size(), file) == blob.size();
+  written = fclose(file) == 0 && written;
+  if (written && replace_file(temporary.c_str(), path.c_str())) return true;
+  remove(temporary.c_str());
+  return false;
+}
@@ -0,0 +1,30 @@
+#pragma once
+#ifdef __WIN32
+  #ifndef GLEW_STATIC
+    #define GLEW_STATIC
+  #endif
+#endif
+#include <GLEW/glew.h>
+#include <string>
+
+// On-disk cache of linked program binaries (GL_ARB_get_program_binary).
+// Entries are keyed by a hash of the shader sources and the driver vendor,
+// renderer and version strings, so a driver update or a shader edit misses
+// the cache and the program is compiled again.
+class ProgramCache
+{
+public:
+  ProgramCache(const std::string &directory);
+  // true when the driver can return program binaries
+  bool isSupported() const;
+  // returns linked program from cache or 0 (missing, stale or rejected entry)
+  GLuint load(const char *vsh, const char *fsh);
+  // writes binary of program linked with GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+  bool store(GLuint program, const char *vsh, const char *fsh);
+
+private:
+  // cache file path for the given sources on the current driver
+  std::string entryPath(const char *vsh, const char *fsh) const;
+
+  std::string m_directory;
+};
@@ -0,0 +1,73 @@
+#include "RenderQueue.hpp"
+
+#define RQ_RADIX_BITS 11 // 6 passes cover 64-bit keys
+#define RQ_RADIX_SIZE (1 << RQ_RADIX_BITS)
+#define RQ_RADIX_PASSES ((64 + RQ_RADIX_BITS - 1) / RQ_RADIX_BITS)
+
+uint64_t RenderQueue::makeKey(unsigned pass, unsigned program, unsigned textures, unsigned mesh, float depth) {
+  const uint32_t depth_max = (1u << RQ_DEPTH_BITS) - 1;
+  uint32_t d = depth <= 0.f ? 0 : depth >= 1.f ? depth_max : (uint32_t)(depth * depth_max);
+  return (uint64_t)(pass & ((1u << RQ_PASS_BITS) - 1)) << RQ_PASS_SHIFT |
+         (uint64_t)(program & ((1u << RQ_PROGRAM_BITS) - 1)) << RQ_PROGRAM_SHIFT |
+         (uint64_t)(textures & ((1u << RQ_TEXTURES_BITS) - 1)) << RQ_TEXTURES_SHIFT |
+         (uint64_t)(mesh & ((1u << RQ_MESH_BITS) - 1)) << RQ_MESH_SHIFT |
+         (uint64_t)d << RQ_DEPTH_SHIFT;
+}
+
+void RenderQueue::reserve(size_t count) {
+  m_items.reserve(count);
+  m_scratch.reserve(count);
+}
+
+void RenderQueue::submit(uint64_t key, uint32_t payload) {
+  RenderItem item = {key, payload};
+  m_items.push_back(item);
+}
+
+void RenderQueue::sort() {
+  size_t count = m_items.size();
+  if (count < 2) return;
+  m_scratch.resize(count);
+
+  // histograms of all digits in a single sweep
+  m_counts.assign(RQ_RADIX_PASSES * RQ_RADIX_SIZE, 0);
+  for (size_t i = 0; i < count; ++i) {
+    uint64_t key = m_items[i].key;
+    for (int p = 0; p < RQ_RADIX_PASSES; ++p) ++m_counts[p * RQ_RADIX_SIZE + ((key >> (p * RQ_RADIX_BITS)) & (RQ_RADIX_SIZE - 1))];
+  }
+
+  RenderItem *src = m_items.data();
+  RenderItem *dst = m_scratch.data();
+  for (int p = 0; p < RQ_RADIX_PASSES; ++p) {
+    int shift = p * RQ_RADIX_BITS;
+    uint32_t *histogram = &m_counts[p * RQ_RADIX_SIZE];
+    // digit is the same in every key, nothing to reorder
+    if (histogram[(src[0].key >> shift) & (RQ_RADIX_SIZE - 1)] == count) continue;
+    // exclusive prefix sums give first slot of every digit
+    uint32_t sum = 0;
+    for (int d = 0; d < RQ_RADIX_SIZE; ++d) {
+      uint32_t c = histogram[d];
+      histogram[d] = sum;
+      sum += c;
+    }
+    for (size_t i = 0; i < count; ++i) dst[histogram[(src[i].key >> shift) & (RQ_RADIX_SIZE - 1)]++] = src[i];
+    RenderItem *tmp = src;
+    src = dst;
+    dst = tmp;
+  }
+  // odd number of passes leaves the result in the scratch buffer
+  if (src != m_items.data()) m_items.swap(m_scratch);
+}
+
+void RenderQueue::execute(RenderQueueHandler &handler) const {
+  // impossible previous values force the first state to be set
+  unsigned pass = ~0u, program = ~0u, textures = ~0u, mesh = ~0u;
+  for (size_t i = 0; i < m_items.size(); ++i) {
+    uint64_t key = m_items[i].key;
+    if (keyPass(key) != pass) handler.setPass(pass = keyPass(key));
+    if (keyProgram(key) != program) handler.setProgram(program = keyProgram(key));
+    if (keyTextures(key) != textures) handler.setTextures(textures = keyTextures(key));
+    if (keyMesh(key) != mesh) handler.setMesh(mesh = keyMesh(key));
+    handler.draw(m_items[i].payload);
+  }
+}
@@ -0,0 +1,68 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Sort key layout, most significant bits first:
+// | pass 4 | program 12 | texture set 12 | mesh 12 | depth 24 |
+// Sorting by key groups draws by pass, then by the most expensive state.
+#define RQ_PASS_BITS 4
+#define RQ_PROGRAM_BITS 12
+#define RQ_TEXTURES_BITS 12
+#define RQ_MESH_BITS 12
+#define RQ_DEPTH_BITS 24
+
+#define RQ_DEPTH_SHIFT 0
+#define RQ_MESH_SHIFT (RQ_DEPTH_SHIFT + RQ_DEPTH_BITS)
+#define RQ_TEXTURES_SHIFT (RQ_MESH_SHIFT + RQ_MESH_BITS)
+#define RQ_PROGRAM_SHIFT (RQ_TEXTURES_SHIFT + RQ_TEXTURES_BITS)
+#define RQ_PASS_SHIFT (RQ_PROGRAM_SHIFT + RQ_PROGRAM_BITS)
+
+struct RenderItem {
+  uint64_t key;      // packed sort key
+  uint32_t payload;  // caller's draw data index
+};
+
+// receives state changes and draws while the sorted queue is executed
+class RenderQueueHandler
+{
+public:
+  virtual ~RenderQueueHandler() {}
+  virtual void setPass(unsigned pass) = 0;
+  virtual void setProgram(unsigned program) = 0;
+  virtual void setTextures(unsigned textures) = 0;
+  virtual void setMesh(unsigned mesh) = 0;
+  virtual void draw(uint32_t payload) = 0;
+};
+
+// Draws submitted in any order during a frame, radix-sorted once and
+// executed with a state change only where the key field differs.
+class RenderQueue
+{
+public:
+  // depth is normalized to [0, 1], larger values are clamped
+  static uint64_t makeKey(unsigned pass, unsigned program, unsigned textures, unsigned mesh, float depth);
+  static unsigned keyPass(uint64_t key) { return field(key, RQ_PASS_SHIFT, RQ_PASS_BITS); }
+  static unsigned keyProgram(uint64_t key) { return field(key, RQ_PROGRAM_SHIFT, RQ_PROGRAM_BITS); }
+  static unsigned keyTextures(uint64_t key) { return field(key, RQ_TEXTURES_SHIFT, RQ_TEXTURES_BITS); }
+  static unsigned keyMesh(uint64_t key) { return field(key, RQ_MESH_SHIFT, RQ_MESH_BITS); }
+
+  void reserve(size_t count);
+  void clear() { m_items.clear(); }
+  void submit(uint64_t key, uint32_t payload);
+  // stable LSD radix sort by key, 11 bits per pass, constant digits are skipped
+  void sort();
+  // calls handler for every state change and every item in queue order
+  void execute(RenderQueueHandler &handler) const;
+
+  const std::vector<RenderItem> &items() const { return m_items; }
+
+private:
+  static unsigned field(uint64_t key, int shift, int bits) {
+    return (unsigned)(key >> shift) & ((1u << bits) - 1);
+  }
+
+  std::vector<RenderItem> m_items;
+  std::vector<RenderItem> m_scratch;  // radix sort ping-pong buffer
+  std::vector<uint32_t> m_counts;     // radix sort digit histograms
+};
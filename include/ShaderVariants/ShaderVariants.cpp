@@ -0,0 +1,199 @@
+#include "ShaderVariants.hpp"
+#include <chrono>
+#include <iostream>
+
+// names of the SV_* flags in shader sources, in bit order
+static const char *feature_defines[SV_FEATURES] = {"TEXTURES", "SPECULAR", "FACET_NORMALS", "GOURAUD", "PREMIXED"};
+
+ShaderVariants::ShaderVariants() : m_vsh(nullptr), m_fsh(nullptr), m_base(SV_VARIANTS) {
+  for (int i = 0; i < SV_VARIANTS; ++i) m_programs[i] = 0;
+}
+
+void ShaderVariants::setSources(const char *vsh, const char *fsh) {
+  m_vsh = vsh;
+  m_fsh = fsh;
+}
+
+unsigned ShaderVariants::normalize(unsigned features) {
+  features &= SV_VARIANTS - 1;
+  if (features & SV_GOURAUD) features &= ~SV_FACET_NORMALS;
+  if (!(features & SV_TEXTURES)) features &= ~SV_PREMIXED;
+  return features;
+}
+
+int ShaderVariants::cost(unsigned features) {
+  int result = 0;
+  // two texture fetches and a mix, or a single fetch
+  if (features & SV_TEXTURES) result += (features & SV_PREMIXED) ? 1 : 3;
+  // per-fragment lighting, specular adds reflect, normalize and pow
+  if (!(features & SV_GOURAUD)) result += (features & SV_SPECULAR) ? 4 : 2;
+  // derivatives and cross product
+  if (features & SV_FACET_NORMALS) result += 1;
+  return result;
+}
+
+std::string ShaderVariants::source(const char *body, unsigned features) {
+  std::string result = "#version 330\n";
+  for (int i = 0; i < SV_FEATURES; ++i)
+    if (features & (1u << i)) result += std::string("#define ") + feature_defines[i] + "\n";
+  return result + body;
+}
+
+// logs info log of a failed shader or program
+static void log_errors(GLuint object, bool is_program, const char *what) {
+  GLint infoLen = 0;
+  if (is_program) glGetProgramiv(object, GL_INFO_LOG_LENGTH, &infoLen);
+  else glGetShaderiv(object, GL_INFO_LOG_LENGTH, &infoLen);
+  if (infoLen <= 0) return;
+  std::vector<char> infoLog(infoLen);
+  if (is_program) glGetProgramInfoLog(object, infoLen, NULL, infoLog.data());
+  else glGetShaderInfoLog(object, infoLen, NULL, infoLog.data());
+  std::cout << what << std::endl << infoLog.data() << std::endl;
+}
+
+bool ShaderVariants::build(const std::vector<unsigned> &features, ProgramCache &cache) {
+  auto start = std::chrono::steady_clock::now();
+  if (GLEW_KHR_parallel_shader_compile) glMaxShaderCompilerThreadsKHR(0xFFFFFFFFu);
+
+  // issuing every compile & link before asking for results
+  std::vector<Pending> pending;
+  int cached = 0;
+  for (size_t i = 0; i < features.size(); ++i) {
+    unsigned f = normalize(features[i]);
+    if (m_programs[f] != 0) continue;
+    bool queued = false;
+    for (size_t j = 0; j < pending.size(); ++j) queued = queued || pending[j].features == f;
+    if (queued) continue;
+
+    Pending variant;
+    variant.features = f;
+    variant.vsh = source(m_vsh, f);
+    variant.fsh = source(m_fsh, f);
+    m_programs[f] = cache.load(variant.vsh.c_str(), variant.fsh.c_str());
+    if (m_programs[f] != 0) {
+      ++cached;
+      continue;
+    }
+    const GLchar *code = variant.vsh.c_str();
+    variant.vertexShader = glCreateShader(GL_VERTEX_SHADER);
+    glShaderSource(variant.vertexShader, 1, &code, NULL);
+    glCompileShader(variant.vertexShader);
+    code = variant.fsh.c_str();
+    variant.fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
+    glShaderSource(variant.fragmentShader, 1, &code, NULL);
+    glCompileShader(variant.fragmentShader);
+
+    variant.program = glCreateProgram();
+    glAttachShader(variant.program, variant.vertexShader);
+    glAttachShader(variant.program, variant.fragmentShader);
+    // allowing the linked binary to be read back for the program cache
+    if (GLEW_ARB_get_program_binary) glProgramParameteri(variant.program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    glLinkProgram(variant.program);
+    pending.push_back(variant);
+  }
+
+  // waiting for the base variant only when the driver compiles in the
+  // background, otherwise any status query blocks and all are collected
+  bool result = true;
+  size_t compiled = pending.size();
+  if (GLEW_KHR_parallel_shader_compile) {
+    for (size_t i = 0; i < features.size() && m_base == SV_VARIANTS; ++i) {
+      unsigned f = normalize(features[i]);
+      for (size_t j = 0; j < pending.size(); ++j) {
+        if (pending[j].features != f) continue;
+        result = finish(pending[j], cache) && result;
+        pending.erase(pending.begin() + j);
+        break;
+      }
+      if (m_programs[f] != 0) m_base = f;
+    }
+    m_pending.insert(m_pending.end(), pending.begin(), pending.end());
+    compiled -= pending.size();
+  } else {
+    for (size_t i = 0; i < pending.size(); ++i) result = finish(pending[i], cache) && result;
+  }
+  // the first requested variant that exists is the fallback of select()
+  for (size_t i = 0; i < features.size() && m_base == SV_VARIANTS; ++i)
+    if (m_programs[normalize(features[i])] != 0) m_base = normalize(features[i]);
+
+  m_start = start;
+  std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+  std::cout << "Shader variants: " << compiled << " compiled, " << cached << " loaded from cache in "
+            << elapsed.count() << " ms, " << m_pending.size() << " left to the background" << std::endl;
+  return result;
+}
+
+std::vector<unsigned> ShaderVariants::poll(ProgramCache &cache, bool wait) {
+  std::vector<unsigned> ready;
+  if (m_pending.empty()) return ready;
+  for (size_t i = 0; i < m_pending.size();) {
+    Pending &variant = m_pending[i];
+    GLint completed = 0;
+    if (!wait) glGetProgramiv(variant.program, GL_COMPLETION_STATUS_KHR, &completed);
+    if (!wait && !completed) {
+      ++i;
+      continue;
+    }
+    if (finish(variant, cache)) ready.push_back(variant.features);
+    m_pending.erase(m_pending.begin() + i);
+  }
+  if (m_pending.empty()) {
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - m_start;
+    std::cout << "Shader variants: background compiles done " << elapsed.count() << " ms after the build"
+              << std::endl;
+  }
+  return ready;
+}
+
+bool ShaderVariants::finish(Pending &variant, ProgramCache &cache) {
+  GLint linked = 0;
+  glGetProgramiv(variant.program, GL_LINK_STATUS, &linked);
+  if (!linked) {
+    GLint compiled = 0;
+    glGetShaderiv(variant.vertexShader, GL_COMPILE_STATUS, &compiled);
+    if (!compiled) log_errors(variant.vertexShader, false, "Shader compilation error");
+    glGetShaderiv(variant.fragmentShader, GL_COMPILE_STATUS, &compiled);
+    if (!compiled) log_errors(variant.fragmentShader, false, "Shader compilation error");
+    log_errors(variant.program, true, "Shader program linking error");
+    glDeleteProgram(variant.program);
+    variant.program = 0;
+  } else {
+    cache.store(variant.program, variant.vsh.c_str(), variant.fsh.c_str());
+  }
+  glDeleteShader(variant.vertexShader);
+  glDeleteShader(variant.fragmentShader);
+  m_programs[variant.features] = variant.program;
+  return linked != 0;
+}
+
+void ShaderVariants::destroy() {
+  for (size_t i = 0; i < m_pending.size(); ++i) {
+    glDeleteShader(m_pending[i].vertexShader);
+    glDeleteShader(m_pending[i].fragmentShader);
+    glDeleteProgram(m_pending[i].program);
+  }
+  m_pending.clear();
+  for (int i = 0; i < SV_VARIANTS; ++i) {
+    if (m_programs[i] != 0) glDeleteProgram(m_programs[i]);
+    m_programs[i] = 0;
+  }
+  m_base = SV_VARIANTS;
+}
+
+unsigned ShaderVariants::select(unsigned required) const {
+  required = normalize(required);
+  if (m_programs[required] != 0) return required;
+  // superset with the lowest cost
+  unsigned best = required;
+  int bestCost = -1;
+  for (unsigned f = 0; f < SV_VARIANTS; ++f) {
+    if (m_programs[f] == 0 || (f & required) != required) continue;
+    if (bestCost < 0 || cost(f) < bestCost) {
+      best = f;
+      bestCost = cost(f);
+    }
+  }
+  // missing features are better than a program of 0, which draws nothing
+  if (bestCost < 0 && m_base != SV_VARIANTS) return m_base;
+  return best;
+}
@@ -0,0 +1,72 @@
+#pragma once
+#ifdef __WIN32
+  #ifndef GLEW_STATIC
+    #define GLEW_STATIC
+  #endif
+#endif
+#include <GLEW/glew.h>
+#include <chrono>
+#include <string>
+#include <vector>
+#include "../ProgramCache/ProgramCache.hpp"
+
+// feature flags, each one is injected into the sources as a #define
+#define SV_TEXTURES 1       // sample and mix texture maps, base color otherwise
+#define SV_SPECULAR 2       // specular highlight
+#define SV_FACET_NORMALS 4  // normals from screen-space derivatives instead of the analytic gradient
+#define SV_GOURAUD 8        // lighting per vertex instead of per fragment
+#define SV_PREMIXED 16      // texture maps are baked into one, single fetch
+#define SV_FEATURES 5       // number of flags
+#define SV_VARIANTS (1 << SV_FEATURES) // number of flag combinations
+
+// Permutations of one vertex/fragment shader pair.
+// Sources are given without #version, every variant gets the version line
+// followed by the #defines of its features. Variants are compiled at load,
+// all compiles are issued before the first status query so the driver can
+// run them in parallel. With GL_KHR_parallel_shader_compile only the base
+// variant is waited for, the others finish in the background while select()
+// falls back to the base.
+class ShaderVariants
+{
+public:
+  ShaderVariants();
+  void setSources(const char *vsh, const char *fsh);
+  // drops flags that contradict others, per-vertex lighting needs analytic
+  // normals and premixed maps need textures
+  static unsigned normalize(unsigned features);
+  // rough per-fragment cost, used to pick the cheapest variant
+  static int cost(unsigned features);
+  // full source of a variant
+  static std::string source(const char *body, unsigned features);
+
+  // builds variants not built yet, loading from cache where possible,
+  // false when one of those finished here failed to link
+  bool build(const std::vector<unsigned> &features, ProgramCache &cache);
+  // collects background compiles that are done, all of them when wait is
+  // set; returns the features of the variants that linked
+  std::vector<unsigned> poll(ProgramCache &cache, bool wait = false);
+  bool compiling() const { return !m_pending.empty(); }
+  void destroy();
+  // linked program of a variant or 0
+  GLuint program(unsigned features) const { return m_programs[normalize(features)]; }
+  // cheapest built variant that has all required features, the base variant
+  // when none is built
+  unsigned select(unsigned required) const;
+
+private:
+  // variant being compiled & linked
+  struct Pending {
+    unsigned features;
+    std::string vsh, fsh;
+    GLuint vertexShader, fragmentShader, program;
+  };
+  // waits for a pending variant, stores the linked binary in the cache
+  bool finish(Pending &variant, ProgramCache &cache);
+
+  const char *m_vsh;
+  const char *m_fsh;
+  GLuint m_programs[SV_VARIANTS];
+  unsigned m_base; // first variant that linked, always available for select()
+  std::vector<Pending> m_pending; // compiles left to the background
+  std::chrono::steady_clock::time_point m_start; // of the build that issued them
+};
@@ -0,0 +1,446 @@
+#include "TextureAtlas.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+
+void AtlasPacker::reset(int width, int height) {
+  m_width = width;
+  m_height = height;
+  m_skyline.clear();
+  Node floor = {0, 0, width};
+  m_skyline.push_back(floor);
+}
+
+int AtlasPacker::fit(size_t i, int width, int height) const {
+  if (m_skyline[i].x + width > m_width) return -1;
+  // resting on the highest node under the rectangle
+  int y = 0;
+  for (int left = width; left > 0; ++i) {
+    y = std::max(y, m_skyline[i].y);
+    left -= m_skyline[i].width;
+  }
+  return y + height <= m_height ? y : -1;
+}
+
+bool AtlasPacker::insert(int width, int height, int &x, int &y) {
+  size_t best = m_skyline.size();
+  int bestY = m_height;
+  for (size_t i = 0; i < m_skyline.size(); ++i) {
+    int top = fit(i, width, height);
+    if (top >= 0 && top < bestY) {
+      best = i;
+      bestY = top;
+    }
+  }
+  if (best == m_skyline.size()) return false;
+  x = m_skyline[best].x;
+  y = bestY;
+
+  // new node on top of the rectangle, nodes under it shrink or go away
+  Node node = {x, y + height, width};
+  m_skyline.insert(m_skyline.begin() + best, node);
+  for (size_t i = best + 1; i < m_skyline.size();) {
+    int covered = node.x + node.width - m_skyline[i].x;
+    if (covered <= 0) break;
+    if (covered < m_skyline[i].width) {
+      m_skyline[i].x += covered;
+      m_skyline[i].width -= covered;
+      break;
+    }
+    m_skyline.erase(m_skyline.begin() + i);
+  }
+  // merging neighbours of equal height
+  for (size_t i = 0; i + 1 < m_skyline.size();) {
+    if (m_skyline[i].y == m_skyline[i + 1].y) {
+      m_skyline[i].width += m_skyline[i + 1].width;
+      m_skyline.erase(m_skyline.begin() + i + 1);
+    } else {
+      ++i;
+    }
+  }
+  return true;
+}
+
+// revision of the layer order & region table, older cache entries do not match it
+static const int atlas_layout = 2;
+
+// GL format of a block format, GL_NONE when the driver lacks it
+static GLenum glFormat(BlockFormat format) {
+  if (format == BLOCK_BC7) return GLEW_ARB_texture_compression_bptc ? GL_COMPRESSED_RGBA_BPTC_UNORM_ARB : GL_NONE;
+  if (!GLEW_EXT_texture_compression_s3tc) return GL_NONE;
+  return format == BLOCK_BC1 ? GL_COMPRESSED_RGB_S3TC_DXT1_EXT : GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+}
+
+TextureAtlas::TextureAtlas()
+    : m_texture(0), m_packedTexture(0), m_regionBuffer(0), m_width(0), m_height(0), m_layers(0), m_firstPacked(0), m_levels(0), m_count(0),
+      m_compress(false), m_format(BLOCK_BC7), m_level(0), m_filter(MIP_KAISER), m_srgb(true), m_cache(nullptr),
+      m_unpack(0), m_staging(nullptr) {}
+
+void TextureAtlas::setCompression(BlockFormat format, int level) {
+  m_compress = true;
+  m_format = format;
+  m_level = level;
+}
+
+void TextureAtlas::setMipFilter(MipFilter filter, bool srgb) {
+  m_filter = filter;
+  m_srgb = srgb;
+}
+
+int TextureAtlas::add(const unsigned char *pixels, int width, int height) {
+  if (m_images.size() >= ATLAS_MAX_REGIONS) {
+    std::cout << "Texture atlas is out of regions" << std::endl;
+    return -1;
+  }
+  Image image = {pixels, width, height, 0, 0, 0, 0, nullptr, false};
+  m_images.push_back(image);
+  return (int)m_images.size() - 1;
+}
+
+// format the texture is stored in, RGBA8 when compression is off or unsupported
+int TextureAtlas::resolveFormat() {
+  if (!m_compress) return TEXTURE_RGBA8;
+  if (glFormat(m_format) != GL_NONE) return m_format;
+  std::cout << blockFormatName(m_format) << " textures are not supported, uploading RGBA8" << std::endl;
+  m_compress = false;
+  return TEXTURE_RGBA8;
+}
+
+int TextureAtlas::gutter() const {
+  // a bilinear fetch at the last level reaches one of its texels past the
+  // edge, and each texel there was filtered from base texels further out
+  int last = ATLAS_PACKED_LEVELS - 1;
+  return (1 << last) + mipReach(m_filter, last);
+}
+
+unsigned long long TextureAtlas::cacheKey(unsigned long long sources, int format) const {
+  // layout constants change the texel data just like the options do
+  int options[7] = {format, m_level, (int)m_filter, m_srgb, ATLAS_PACKED_LEVELS, ATLAS_MAX_REGIONS, atlas_layout};
+  return TextureCache::hash(options, sizeof(options), sources);
+}
+
+bool TextureAtlas::load(unsigned long long sources) {
+  if (m_cache == nullptr || sources == 0) return false;
+  auto start = std::chrono::steady_clock::now();
+  int format = resolveFormat();
+  TextureData data;
+  if (!m_cache->load(cacheKey(sources, format), data) || data.format != format) return false;
+  if (data.regions.size() % 8 != 0 || data.regions.size() / 8 > ATLAS_MAX_REGIONS) return false;
+  m_count = (int)data.regions.size() / 8;
+  m_regions.assign(ATLAS_MAX_REGIONS, AtlasRegion());
+  if (m_count > 0) memcpy(m_regions.data(), data.regions.data(), data.regions.size() * sizeof(float));
+  m_layers = data.layers;
+  m_levels = data.levels;
+  // full-size layers come first, as many as their regions reach
+  m_firstPacked = 0;
+  for (int i = 0; i < m_count; ++i) {
+    const AtlasRegion &region = m_regions[i];
+    if (region.layer[1] == 0.f) m_firstPacked = std::max(m_firstPacked, (int)region.layer[0] + 1);
+    else if (region.layer[1] != 1.f) return false;
+  }
+  if (m_firstPacked > m_layers) return false;
+  // texels go from the mapped pages straight to GL, nothing is decoded or staged here
+  bool uploaded = upload(data);
+  std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+  std::cout << "Textures: " << m_layers << " layers, " << data.levels << " " << mipFilterName(m_filter) << " levels, "
+            << (format == TEXTURE_RGBA8 ? "RGBA8" : blockFormatName(m_format)) << ", mapped from cache in "
+            << elapsed.count() << " ms" << std::endl;
+  m_images.clear();
+  return uploaded;
+}
+
+void TextureAtlas::layout() {
+  m_width = m_height = 0;
+  for (size_t i = 0; i < m_images.size(); ++i) {
+    m_width = std::max(m_width, m_images[i].width);
+    m_height = std::max(m_height, m_images[i].height);
+  }
+  int width = m_width, height = m_height;
+
+  // full-size images take a layer each, the rest is packed tallest first
+  std::vector<size_t> packed;
+  m_layers = 0;
+  for (size_t i = 0; i < m_images.size(); ++i) {
+    if (m_images[i].width == width && m_images[i].height == height) m_images[i].layer = m_layers++;
+    else packed.push_back(i);
+  }
+  std::stable_sort(packed.begin(), packed.end(), [this](size_t a, size_t b) { return m_images[a].height > m_images[b].height; });
+  std::vector<AtlasPacker> packers;
+  int border = gutter();
+  m_firstPacked = m_layers;
+  for (size_t p = 0; p < packed.size(); ++p) {
+    Image &image = m_images[packed[p]];
+    // images close to the layer size get no gutter
+    bool fits = image.width + 2 * border <= width && image.height + 2 * border <= height;
+    image.gutter = fits ? border : 0;
+    int w = image.width + 2 * image.gutter, h = image.height + 2 * image.gutter;
+    bool placed = false;
+    for (size_t l = 0; l < packers.size() && !placed; ++l) {
+      placed = packers[l].insert(w, h, image.x, image.y);
+      image.layer = m_firstPacked + (int)l;
+    }
+    if (!placed) {
+      packers.push_back(AtlasPacker());
+      packers.back().reset(width, height);
+      packers.back().insert(w, h, image.x, image.y);
+      image.layer = m_layers++;
+    }
+    image.x += image.gutter;
+    image.y += image.gutter;
+  }
+  m_levels = mipLevels(width, height);
+}
+
+int TextureAtlas::packedLevels() const {
+  // packed images may only shrink as far as their gutter reaches
+  return std::min(m_levels, ATLAS_PACKED_LEVELS);
+}
+
+bool TextureAtlas::reserve() {
+  if (m_texture != 0 || m_packedTexture != 0) return true;
+  if (m_images.empty()) return false;
+  layout();
+  int format = resolveFormat();
+  if (m_firstPacked > 0 && !allocate(m_texture, format, m_firstPacked, m_levels)) return false;
+  if (m_firstPacked < m_layers && !allocate(m_packedTexture, format, m_layers - m_firstPacked, packedLevels()))
+    return false;
+  // base levels of full-size images are their layers as they are, unless compressed
+  size_t layerSize = (size_t)m_width * m_height * 4, size = layerSize * m_firstPacked;
+  if (format != TEXTURE_RGBA8 || size == 0) return true;
+  if (GLEW_ARB_buffer_storage) {
+    // Persistent, coherent mapping: decoders write into it while GL reads the
+    // layers written before, mips are then filtered from the same memory
+    GLbitfield flags = GL_MAP_READ_BIT | GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    glGenBuffers(1, &m_unpack);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_unpack);
+    glBufferStorage(GL_PIXEL_UNPACK_BUFFER, size, NULL, flags);
+    m_staging = (unsigned char *)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, flags);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    if (m_staging == nullptr) releaseStaging();
+  }
+  if (m_staging == nullptr) {
+    m_clientStaging.resize(size);
+    m_staging = m_clientStaging.data();
+  }
+  for (size_t i = 0; i < m_images.size(); ++i)
+    if (m_images[i].layer < m_firstPacked) m_images[i].staging = m_staging + layerSize * m_images[i].layer;
+  return true;
+}
+
+unsigned char *TextureAtlas::staging(int region) const {
+  return region >= 0 && region < (int)m_images.size() ? m_images[region].staging : nullptr;
+}
+
+void TextureAtlas::stream(int region, const unsigned char *pixels) {
+  if (region < 0 || region >= (int)m_images.size()) return;
+  Image &image = m_images[region];
+  image.pixels = pixels;
+  if (image.staging == nullptr || pixels != image.staging || image.streamed) return;
+  glBindTexture(GL_TEXTURE_2D_ARRAY, m_texture);
+  // from the buffer the texels were decoded into, else from client memory
+  const void *texels = image.staging;
+  if (m_unpack != 0) {
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_unpack);
+    texels = (const void *)(image.staging - m_staging);
+  }
+  glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, image.layer, image.width, image.height, 1, GL_RGBA, GL_UNSIGNED_BYTE, texels);
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+  image.streamed = true;
+}
+
+bool TextureAtlas::build(unsigned long long sources) {
+  if (!reserve()) return false;
+  int width = m_width, height = m_height;
+  for (size_t i = 0; i < m_images.size(); ++i)
+    if (m_images[i].pixels == nullptr) {
+      std::cout << "Texture atlas region " << i << " has no pixels" << std::endl;
+      return false;
+    }
+
+  // full-size images are layers as they are, shared layers are assembled here
+  size_t layerSize = (size_t)width * height * 4;
+  std::vector<const unsigned char *> layers(m_layers);
+  std::vector<unsigned char> pixels(layerSize * (m_layers - m_firstPacked), 0);
+  for (int l = m_firstPacked; l < m_layers; ++l) layers[l] = &pixels[layerSize * (l - m_firstPacked)];
+  m_count = (int)m_images.size();
+  m_regions.assign(ATLAS_MAX_REGIONS, AtlasRegion());
+  for (size_t i = 0; i < m_images.size(); ++i) {
+    const Image &image = m_images[i];
+    AtlasRegion &region = m_regions[i];
+    region.rect[0] = (float)image.x / width;
+    region.rect[1] = (float)image.y / height;
+    region.rect[2] = (float)image.width / width;
+    region.rect[3] = (float)image.height / height;
+    // packed layers are counted from the start of their own texture
+    bool packed = image.layer >= m_firstPacked;
+    region.layer[0] = (float)(packed ? image.layer - m_firstPacked : image.layer);
+    region.layer[1] = packed ? 1.f : 0.f;
+    if (!packed) {
+      layers[image.layer] = image.pixels;
+      continue;
+    }
+    // gutter repeats the opposite edges, as GL_REPEAT would
+    unsigned char *layer = &pixels[layerSize * (image.layer - m_firstPacked)];
+    for (int y = -image.gutter; y < image.height + image.gutter; ++y) {
+      int sy = (y % image.height + image.height) % image.height;
+      for (int x = -image.gutter; x < image.width + image.gutter; ++x) {
+        int sx = (x % image.width + image.width) % image.width;
+        memcpy(&layer[((size_t)(image.y + y) * width + image.x + x) * 4], &image.pixels[((size_t)sy * image.width + sx) * 4], 4);
+      }
+    }
+  }
+
+  int format = resolveFormat(), levels = m_levels;
+  auto start = std::chrono::steady_clock::now();
+  TextureData data;
+  data.format = format;
+  data.width = width;
+  data.height = height;
+  data.layers = m_layers;
+  data.levels = levels;
+  data.regions.resize((size_t)m_count * 8);
+  memcpy(data.regions.data(), m_regions.data(), data.regions.size() * sizeof(float));
+  data.storage.resize(data.levelOffset(levels));
+  data.texels = data.storage.data();
+  std::vector<std::vector<unsigned char> > mips;
+  for (int l = 0; l < m_layers; ++l) {
+    // levels packed layers do not have stay zero in the cache
+    const unsigned char *layer = layers[l];
+    int layerLevels = l < m_firstPacked ? levels : packedLevels();
+    generateMips(layer, width, height, layerLevels, m_filter, m_srgb, mips);
+    for (int level = 0; level < layerLevels; ++level) {
+      const unsigned char *src = level == 0 ? layer : mips[level - 1].data();
+      unsigned char *dst = &data.storage[data.levelOffset(level) + data.layerSize(level) * l];
+      if (format == TEXTURE_RGBA8) memcpy(dst, src, data.layerSize(level));
+      else compressImage(src, data.levelWidth(level), data.levelHeight(level), m_format, m_level, dst);
+    }
+  }
+  // the next launch maps this instead of decoding the sources
+  if (m_cache != nullptr && sources != 0) m_cache->store(cacheKey(sources, format), data);
+  std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+  std::cout << "Textures: " << m_layers << " layers, " << levels << " " << mipFilterName(m_filter) << " levels, "
+            << (format == TEXTURE_RGBA8 ? "RGBA8" : blockFormatName(m_format)) << ", built in " << elapsed.count()
+            << " ms" << std::endl;
+
+  bool uploaded = upload(data);
+  // pixels belong to the caller
+  releaseStaging();
+  m_images.clear();
+  return uploaded;
+}
+
+bool TextureAtlas::allocate(GLuint &texture, int format, int layers, int levels) {
+  GLint maxLayers = 0;
+  glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &maxLayers);
+  if (layers > maxLayers) {
+    std::cout << "Texture atlas needs " << layers << " layers, " << maxLayers << " supported" << std::endl;
+    return false;
+  }
+  glGenTextures(1, &texture);
+  glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, levels - 1);
+  // Anisotropic filtering
+  if (glewIsSupported("GL_EXT_texture_filter_anisotropic")) {
+    GLfloat fLargest;
+    glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT, &fLargest);
+    glTexParameterf(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_ANISOTROPY_EXT, fLargest);
+  }
+
+  // immutable storage for the whole chain, levels are filled layer by layer
+  GLenum internalFormat = format == TEXTURE_RGBA8 ? GL_RGBA8 : glFormat((BlockFormat)format);
+  if (GLEW_ARB_texture_storage) {
+    glTexStorage3D(GL_TEXTURE_2D_ARRAY, levels, internalFormat, m_width, m_height, layers);
+    return true;
+  }
+  TextureData shape; // level sizes only
+  shape.format = format;
+  shape.width = m_width;
+  shape.height = m_height;
+  shape.layers = layers;
+  for (int l = 0; l < levels; ++l) {
+    // no unpack buffer is bound, NULL allocates without texels
+    int w = shape.levelWidth(l), h = shape.levelHeight(l);
+    if (format == TEXTURE_RGBA8)
+      glTexImage3D(GL_TEXTURE_2D_ARRAY, l, GL_RGBA8, w, h, layers, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    else
+      glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, l, internalFormat, w, h, layers, 0, (GLsizei)shape.levelSize(l), NULL);
+  }
+  return true;
+}
+
+bool TextureAtlas::layerStreamed(int layer) const {
+  for (size_t i = 0; i < m_images.size(); ++i)
+    if (m_images[i].layer == layer && m_images[i].streamed) return true;
+  return false;
+}
+
+bool TextureAtlas::upload(const TextureData &data) {
+  m_width = data.width;
+  m_height = data.height;
+  int packed = data.layers - m_firstPacked;
+  if (m_texture == 0 && m_firstPacked > 0 && !allocate(m_texture, data.format, m_firstPacked, data.levels)) return false;
+  if (m_packedTexture == 0 && packed > 0 && !allocate(m_packedTexture, data.format, packed, packedLevels())) return false;
+  GLenum internalFormat = data.format == TEXTURE_RGBA8 ? GL_RGBA8 : glFormat((BlockFormat)data.format);
+  // Straight from the texels, the driver copies them once on its way to the
+  // GPU, staging them in a buffer first would add a copy of its own
+  for (int t = 0; t < 2; ++t) {
+    // full-size layers with the whole chain, then packed ones with fewer levels
+    int first = t == 0 ? 0 : m_firstPacked, end = t == 0 ? m_firstPacked : data.layers;
+    int levels = t == 0 ? data.levels : packedLevels();
+    if (first == end) continue;
+    glBindTexture(GL_TEXTURE_2D_ARRAY, t == 0 ? m_texture : m_packedTexture);
+    for (int level = 0; level < levels; ++level) {
+      int w = data.levelWidth(level), h = data.levelHeight(level);
+      GLsizei size = (GLsizei)data.layerSize(level);
+      for (int layer = first; layer < end; ++layer) {
+        // runs of layers not streamed yet go up in one call
+        int count = 0;
+        while (layer + count < end && !(level == 0 && layerStreamed(layer + count))) ++count;
+        if (count == 0) continue;
+        const unsigned char *texels = data.texels + data.levelOffset(level) + (size_t)size * layer;
+        if (data.format == TEXTURE_RGBA8)
+          glTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, layer - first, w, h, count, GL_RGBA, GL_UNSIGNED_BYTE, texels);
+        else
+          glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, layer - first, w, h, count, internalFormat, size * count,
+                                    texels);
+        layer += count - 1;
+      }
+    }
+  }
+
+  // region table never changes, one static buffer
+  glGenBuffers(1, &m_regionBuffer);
+  glBindBuffer(GL_UNIFORM_BUFFER, m_regionBuffer);
+  glBufferData(GL_UNIFORM_BUFFER, m_regions.size() * sizeof(AtlasRegion), m_regions.data(), GL_STATIC_DRAW);
+  glBindBuffer(GL_UNIFORM_BUFFER, 0);
+  return (m_texture != 0 || m_packedTexture != 0) && m_regionBuffer != 0;
+}
+
+void TextureAtlas::releaseStaging() {
+  if (m_unpack != 0) {
+    // GL keeps a deleted buffer until the layers streamed from it are read
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_unpack);
+    if (m_staging != nullptr) glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    glDeleteBuffers(1, &m_unpack);
+    m_unpack = 0;
+  }
+  m_staging = nullptr;
+  std::vector<unsigned char>().swap(m_clientStaging);
+  for (size_t i = 0; i < m_images.size(); ++i) m_images[i].staging = nullptr;
+}
+
+void TextureAtlas::destroy() {
+  releaseStaging();
+  if (m_texture != 0) glDeleteTextures(1, &m_texture);
+  if (m_packedTexture != 0) glDeleteTextures(1, &m_packedTexture);
+  if (m_regionBuffer != 0) glDeleteBuffers(1, &m_regionBuffer);
+  m_texture = m_packedTexture = m_regionBuffer = 0;
+  m_layers = m_count = 0;
+  m_images.clear();
+}
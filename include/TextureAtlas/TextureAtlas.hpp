@@ -0,0 +1,136 @@
+#pragma once
+#ifdef __WIN32
+  #ifndef GLEW_STATIC
+    #define GLEW_STATIC
+  #endif
+#endif
+#include <GLEW/glew.h>
+#include <vector>
+#include "../BlockCompress/BlockCompress.hpp"
+#include "../MipChain/MipChain.hpp"
+#include "../TextureCache/TextureCache.hpp"
+
+// uniform block binding point of the region table
+#define UBO_REGIONS_BINDING 2
+#define ATLAS_MAX_REGIONS 16 // must match the "Regions" array size in the shaders
+#define ATLAS_PACKED_LEVELS 3 // mip levels of the packed images' texture, their gutter is sized for these
+
+// std140 region of one image in the texture array, must match "Region" in the shaders
+struct AtlasRegion {
+  float rect[4];   // offset xy & scale zw in layer coordinates
+  float layer[4];  // array layer (x) of the full-size (y = 0) or packed (y = 1) texture, padded to vec4
+};
+
+// Skyline bin-packer, rectangles are placed as low as possible, then leftmost
+class AtlasPacker
+{
+public:
+  void reset(int width, int height);
+  // returns false when the rectangle does not fit
+  bool insert(int width, int height, int &x, int &y);
+
+private:
+  // top edge of the packed area between x and x + width
+  struct Node {
+    int x, y, width;
+  };
+  // height at which a rectangle placed at node i rests, -1 if it does not fit
+  int fit(size_t i, int width, int height) const;
+
+  int m_width, m_height;
+  std::vector<Node> m_skyline;
+};
+
+// RGBA images of a scene in GL_TEXTURE_2D_ARRAY textures.
+// Layers have the size of the largest image, images of that size take a
+// layer each with the whole mip chain. Smaller ones are packed into shared
+// layers of a second array texture with a wrapped gutter, as wide as the mip
+// filter reaches, so they still repeat; it only has ATLAS_PACKED_LEVELS levels.
+// Shaders look regions up by index, so two bindings serve every textured
+// surface. The mip chain is filtered on the CPU, optionally block compressed
+// and kept in a cache between launches, a warm start maps the cached texels &
+// regions without touching the images.
+// Layout only needs the image sizes: reserve() allocates the textures before
+// the pixels exist, so full-size images can be written into staging memory
+// and have their base level uploaded while the others are still decoding.
+class TextureAtlas
+{
+public:
+  TextureAtlas();
+  // queues an image, returns its region index or -1 when the table is full;
+  // pixels must stay valid until build(), nullptr when stream() gives them later
+  int add(const unsigned char *pixels, int width, int height);
+  // lays out the queued images and allocates the texture, build() does it
+  // otherwise; options can no longer change afterwards
+  bool reserve();
+  // memory a reserved full-size image of an uncompressed atlas is written
+  // to, nullptr for other regions; readable until build()
+  unsigned char *staging(int region) const;
+  // hands over the pixels of a queued region, staged ones have their base
+  // level uploaded right away
+  void stream(int region, const unsigned char *pixels);
+  // compresses every level when the driver supports the format
+  void setCompression(BlockFormat format, int level);
+  // Kaiser filter in linear space by default
+  void setMipFilter(MipFilter filter, bool srgb);
+  // built textures are looked up here first, nullptr builds every time
+  void setCache(TextureCache *cache) { m_cache = cache; }
+  // Maps the texture built from sources out of the cache and uploads it,
+  // false on a miss; sources hashes whatever the queued images come from
+  bool load(unsigned long long sources);
+  // packs queued images into layers, uploads the levels not streamed yet &
+  // the region table, stores the result under sources unless it is 0
+  bool build(unsigned long long sources = 0);
+  void destroy();
+
+  GLuint texture() const { return m_texture; }             // full-size layers, 0 if there are none
+  GLuint packedTexture() const { return m_packedTexture; } // packed layers, 0 if there are none
+  GLuint regionBuffer() const { return m_regionBuffer; }
+  int layers() const { return m_layers; }
+  int regions() const { return m_count; }
+  const AtlasRegion &region(int index) const { return m_regions[index]; }
+
+private:
+  struct Image {
+    const unsigned char *pixels;
+    int width, height;
+    int x, y, layer; // placement in the array
+    int gutter;      // wrapped border around the image
+    unsigned char *staging; // base level memory of a full-size image
+    bool streamed;          // its base level is uploaded
+  };
+
+  // packs the queued images into m_width x m_height layers
+  void layout();
+  int resolveFormat();
+  // wrapped border that keeps CPU filtering and GPU sampling of packed levels inside
+  int gutter() const;
+  unsigned long long cacheKey(unsigned long long sources, int format) const;
+  int packedLevels() const;
+  // immutable m_width x m_height storage for layers and levels
+  bool allocate(GLuint &texture, int format, int layers, int levels);
+  // uploads every level from client memory, skipping streamed base layers
+  bool upload(const TextureData &data);
+  bool layerStreamed(int layer) const;
+  void releaseStaging();
+
+  GLuint m_texture;
+  GLuint m_packedTexture;
+  GLuint m_regionBuffer;
+  int m_width, m_height;
+  int m_layers;
+  int m_firstPacked; // first layer shared by packed images
+  int m_levels;      // of the full-size layers
+  int m_count; // regions in use
+  std::vector<Image> m_images;
+  std::vector<AtlasRegion> m_regions;
+  bool m_compress;
+  BlockFormat m_format;
+  int m_level;
+  MipFilter m_filter;
+  bool m_srgb;
+  TextureCache *m_cache;
+  GLuint m_unpack;          // persistently mapped staging buffer
+  unsigned char *m_staging; // its memory, or m_clientStaging
+  std::vector<unsigned char> m_clientStaging; // without ARB_buffer_storage
+};
@@ -0,0 +1,151 @@
+#include "TextureCache.hpp"
+#include <cstdio>
+#include <cstring>
+#include "../BlockCompress/BlockCompress.hpp"
+#include "../lodepng/lodepng.h"
+#ifdef _WIN32
+  #include <direct.h>
+  #include <process.h>
+  #include <windows.h>
+  #define make_dir(path) _mkdir(path)
+  #define process_id() _getpid()
+  #define replace_file(from, to) (MoveFileExA(from, to, MOVEFILE_REPLACE_EXISTING) != 0)
+#else
+  #include <sys/stat.h>
+  #include <unistd.h>
+  #define make_dir(path) mkdir(path, 0755)
+  #define process_id() getpid()
+  #define replace_file(from, to) (rename(from, to) == 0)
+#endif
+
+#define TEXTURE_CACHE_MAGIC 0x58544C47u // "GLTX"
+#define TEXTURE_CACHE_VERSION 2u
+#define TEXTURE_CACHE_ALIGN 64 // texels start at a multiple of this offset
+#define TEXTURE_CACHE_MAX_SIZE 65536  // largest width & height accepted from a file
+#define TEXTURE_CACHE_MAX_LAYERS 2048 // most layers accepted from a file
+
+// file header followed by the region table, padding & the texels
+struct TextureCacheHeader {
+  unsigned int magic;
+  unsigned int version;
+  unsigned long long key;  // hash of the sources & build options
+  int format, width, height, layers, levels;
+  unsigned int regions;       // floats in the region table
+  unsigned long long offset;  // texels offset in the file
+  unsigned long long length;  // texels length in bytes
+};
+
+MappedFile::MappedFile() : m_data(nullptr), m_length(0) {}
+
+MappedFile::~MappedFile() { close(); }
+
+bool MappedFile::open(const std::string &path) {
+  close();
+  return lodepng_map_file(&m_data, &m_length, path.c_str()) == 0;
+}
+
+void MappedFile::close() {
+  lodepng_unmap_file(m_data, m_length);
+  m_data = nullptr;
+  m_length = 0;
+}
+
+size_t TextureData::layerSize(int level) const {
+  int w = levelWidth(level), h = levelHeight(level);
+  if (format == TEXTURE_RGBA8) return (size_t)w * h * 4;
+  return compressedSize((BlockFormat)format, w, h);
+}
+
+size_t TextureData::levelOffset(int level) const {
+  size_t offset = 0;
+  for (int l = 0; l < level; ++l) offset += levelSize(l);
+  return offset;
+}
+
+TextureCache::TextureCache(const std::string &directory) : m_directory(directory) {}
+
+unsigned long long TextureCache::hash(const void *data, size_t size, unsigned long long seed) {
+  const unsigned char *bytes = (const unsigned char *)data;
+  for (size_t i = 0; i < size; ++i) {
+    seed ^= bytes[i];
+    seed *= 1099511628211ull;
+  }
+  return seed;
+}
+
+// whether the layout of a header is one store() can write, before any size is computed from it
+static bool validLayout(const TextureCacheHeader &header) {
+  if (header.format != TEXTURE_RGBA8 && header.format != BLOCK_BC1 && header.format != BLOCK_BC3 &&
+      header.format != BLOCK_BC7)
+    return false;
+  if (header.width <= 0 || header.height <= 0 || header.layers <= 0) return false;
+  if (header.width > TEXTURE_CACHE_MAX_SIZE || header.height > TEXTURE_CACHE_MAX_SIZE ||
+      header.layers > TEXTURE_CACHE_MAX_LAYERS)
+    return false;
+  // a full chain ends at 1x1, floor(log2(max(width, height))) + 1 levels
+  int maxLevels = 1;
+  for (int size = header.width > header.height ? header.width : header.height; size > 1; size >>= 1) ++maxLevels;
+  return header.levels >= 1 && header.levels <= maxLevels;
+}
+
+std::string TextureCache::entryPath(unsigned long long key) const {
+  char name[32];
+  snprintf(name, sizeof(name), "%016llx.tex", key);
+  return m_directory + "/" + name;
+}
+
+bool TextureCache::load(unsigned long long key, TextureData &data) {
+  if (!data.mapping.open(entryPath(key))) return false;
+  const unsigned char *file = data.mapping.data();
+  size_t size = data.mapping.size();
+  TextureCacheHeader header;
+  bool valid = size >= sizeof(header);
+  if (valid) {
+    memcpy(&header, file, sizeof(header));
+    valid = header.magic == TEXTURE_CACHE_MAGIC && header.version == TEXTURE_CACHE_VERSION && header.key == key &&
+            validLayout(header) && header.regions <= size / sizeof(float) &&
+            header.offset >= sizeof(header) + header.regions * sizeof(float) && header.offset <= size &&
+            header.length <= size - header.offset;
+  }
+  if (valid) {
+    data.format = header.format;
+    data.width = header.width;
+    data.height = header.height;
+    data.layers = header.layers;
+    data.levels = header.levels;
+    // length must agree with the layout, a truncated or foreign file is a miss
+    valid = header.length == data.levelOffset(data.levels);
+  }
+  if (!valid) {
+    data.mapping.close();
+    return false;
+  }
+  data.regions.resize(header.regions);
+  memcpy(data.regions.data(), file + sizeof(header), header.regions * sizeof(float));
+  data.texels = file + header.offset;
+  return true;
+}
+
+bool TextureCache::store(unsigned long long key, const TextureData &data) {
+  TextureCacheHeader header = {TEXTURE_CACHE_MAGIC, TEXTURE_CACHE_VERSION, key, data.format, data.width,
+                               data.height, data.layers, data.levels, (unsigned int)data.regions.size(), 0,
+                               data.levelOffset(data.levels)};
+  size_t table = sizeof(header) + data.regions.size() * sizeof(float);
+  header.offset = (table + TEXTURE_CACHE_ALIGN - 1) / TEXTURE_CACHE_ALIGN * TEXTURE_CACHE_ALIGN;
+  std::vector<unsigned char> padding(header.offset - table, 0);
+
+  // written aside and renamed into place, a concurrent load() never maps a partial entry
+  make_dir(m_directory.c_str());
+  std::string path = entryPath(key);
+  std::string temporary = path + "." + std::to_string(process_id()) + ".tmp";
+  FILE *file = fopen(temporary.c_str(), "wb");
+  if (file == nullptr) return false;
+  bool written = fwrite(&header, sizeof(header), 1, file) == 1 &&
+                 fwrite(data.regions.data(), sizeof(float), data.regions.size(), file) == data.regions.size() &&
+                 fwrite(padding.data(), 1, padding.size(), file) == padding.size() &&
+                 fwrite(data.texels, 1, header.length, file) == header.length;
+  written = fclose(file) == 0 && written;
+  if (written && replace_file(temporary.c_str(), path.c_str())) return true;
+  remove(temporary.c_str());
+  return false;
+}
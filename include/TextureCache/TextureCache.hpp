@@ -0,0 +1,66 @@
+#pragma once
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#define TEXTURE_RGBA8 (-1) // format of uncompressed data, compressed data uses BlockFormat values
+
+// Read-only memory mapping of a whole file, owns a lodepng_map_file mapping
+class MappedFile
+{
+public:
+  MappedFile();
+  ~MappedFile();
+  bool open(const std::string &path);
+  void close();
+  const unsigned char *data() const { return m_data; }
+  size_t size() const { return m_length; }
+
+private:
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  const unsigned char *m_data;
+  size_t m_length;
+};
+
+// Texel data of an array texture with its mip chain, no GL dependency.
+// Levels follow each other from the largest, every level holds all layers.
+// Texels live either in storage or in a mapped cache file.
+struct TextureData {
+  int format;   // TEXTURE_RGBA8 or a BlockFormat
+  int width, height, layers, levels;
+  std::vector<float> regions; // atlas region table, opaque to the cache
+  std::vector<unsigned char> storage;
+  MappedFile mapping;
+  const unsigned char *texels;
+
+  TextureData() : format(TEXTURE_RGBA8), width(0), height(0), layers(0), levels(0), texels(nullptr) {}
+  int levelWidth(int level) const { return width >> level > 0 ? width >> level : 1; }
+  int levelHeight(int level) const { return height >> level > 0 ? height >> level : 1; }
+  // bytes of one layer of a level
+  size_t layerSize(int level) const;
+  size_t levelSize(int level) const { return layerSize(level) * layers; }
+  size_t levelOffset(int level) const;
+};
+
+// On-disk cache of built textures. An entry is a header, the region table
+// and the texels of all levels, keyed by a hash of the source files and
+// build options chosen by the caller. Entries are written aside and renamed
+// into place, then mapped, so a warm start hands the file pages straight to
+// GL without decoding or copying.
+class TextureCache
+{
+public:
+  TextureCache(const std::string &directory);
+  // 64-bit FNV-1a, chain calls through seed
+  static unsigned long long hash(const void *data, size_t size, unsigned long long seed = 14695981039346656037ull);
+  // maps the entry, false when it is missing or does not match key
+  bool load(unsigned long long key, TextureData &data);
+  bool store(unsigned long long key, const TextureData &data);
+
+private:
+  std::string entryPath(unsigned long long key) const;
+
+  std::string m_directory;
+};
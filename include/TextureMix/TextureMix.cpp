@@ -0,0 +1,46 @@
+#include "TextureMix.hpp"
+#if defined(__SSE2__) || defined(_M_X64)
+  #include <emmintrin.h>
+  #define TEXTUREMIX_SSE2
+#elif defined(__ARM_NEON)
+  #include <arm_neon.h>
+  #define TEXTUREMIX_NEON
+#endif
+
+void mixImages(const unsigned char *a, const unsigned char *b, unsigned char *out, size_t bytes, float t) {
+  if (t < 0.f) t = 0.f;
+  if (t > 1.f) t = 1.f;
+  const unsigned w = (unsigned)(t * 256.f + 0.5f);
+  size_t i = 0;
+#if defined(TEXTUREMIX_SSE2)
+  // 16 bytes per step, products fit into 16 bits: 255 * 256 + 128 < 65536
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i wa = _mm_set1_epi16((short)(256 - w));
+  const __m128i wb = _mm_set1_epi16((short)w);
+  const __m128i half = _mm_set1_epi16(128);
+  for (; i + 16 <= bytes; i += 16) {
+    __m128i va = _mm_loadu_si128((const __m128i *)(a + i));
+    __m128i vb = _mm_loadu_si128((const __m128i *)(b + i));
+    __m128i lo = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(va, zero), wa),
+                               _mm_mullo_epi16(_mm_unpacklo_epi8(vb, zero), wb));
+    __m128i hi = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(va, zero), wa),
+                               _mm_mullo_epi16(_mm_unpackhi_epi8(vb, zero), wb));
+    lo = _mm_srli_epi16(_mm_add_epi16(lo, half), 8);
+    hi = _mm_srli_epi16(_mm_add_epi16(hi, half), 8);
+    _mm_storeu_si128((__m128i *)(out + i), _mm_packus_epi16(lo, hi));
+  }
+#elif defined(TEXTUREMIX_NEON)
+  const uint16x8_t wa = vdupq_n_u16((uint16_t)(256 - w));
+  const uint16_t wb = (uint16_t)w;
+  for (; i + 16 <= bytes; i += 16) {
+    uint8x16_t va = vld1q_u8(a + i);
+    uint8x16_t vb = vld1q_u8(b + i);
+    uint16x8_t lo = vmlaq_n_u16(vmulq_u16(vmovl_u8(vget_low_u8(va)), wa), vmovl_u8(vget_low_u8(vb)), wb);
+    uint16x8_t hi = vmlaq_n_u16(vmulq_u16(vmovl_u8(vget_high_u8(va)), wa), vmovl_u8(vget_high_u8(vb)), wb);
+    // rounding shift adds 128 before shifting
+    vst1q_u8(out + i, vcombine_u8(vrshrn_n_u16(lo, 8), vrshrn_n_u16(hi, 8)));
+  }
+#endif
+  // tail and builds without SIMD
+  for (; i < bytes; ++i) out[i] = (unsigned char)((a[i] * (256 - w) + b[i] * w + 128) >> 8);
+}
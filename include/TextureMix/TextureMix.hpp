@@ -0,0 +1,7 @@
+#pragma once
+#include <cstddef>
+
+// Blends two images byte by byte: out = (a * (256 - w) + b * w + 128) / 256,
+// where w = round(t * 256). Same result on every code path (SSE2, NEON or
+// scalar), so a baked texture matches no matter where it was built.
+void mixImages(const unsigned char *a, const unsigned char *b, unsigned char *out, size_t bytes, float t);
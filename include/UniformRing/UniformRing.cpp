@@ -0,0 +1,104 @@
+#include "UniformRing.hpp"
+#include <cstring>
+#include <iostream>
+
+#define UNIFORM_RING_WAIT_TIMEOUT 1000000000ull // ns a fence wait blocks before it is retried
+
+UniformRing::UniformRing()
+    : m_buffer(0), m_data(nullptr), m_persistent(false), m_segmentSize(0),
+      m_alignment(256), m_framesCount(0), m_frame(0), m_head(0),
+      m_fences(nullptr) {}
+
+bool UniformRing::create(GLsizeiptr segment_size, int frames_count) {
+  glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &m_alignment);
+  if (m_alignment <= 0) m_alignment = 256;
+  // every segment starts at an aligned offset
+  m_segmentSize = (segment_size + m_alignment - 1) / m_alignment * m_alignment;
+  m_framesCount = frames_count;
+  m_frame = frames_count - 1;
+  m_head = 0;
+  m_fences = new GLsync[frames_count]();
+
+  GLsizeiptr size = m_segmentSize * frames_count;
+  glGenBuffers(1, &m_buffer);
+  glBindBuffer(GL_UNIFORM_BUFFER, m_buffer);
+  m_persistent = GLEW_ARB_buffer_storage != 0;
+  if (m_persistent) {
+    // immutable storage mapped once for the whole lifetime of the ring
+    GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    glBufferStorage(GL_UNIFORM_BUFFER, size, NULL, flags);
+    m_data = (unsigned char *)glMapBufferRange(GL_UNIFORM_BUFFER, 0, size, flags);
+    if (m_data == nullptr) {
+      std::cout << "Failed to map uniform buffer" << std::endl;
+      return false;
+    }
+  } else {
+    glBufferData(GL_UNIFORM_BUFFER, size, NULL, GL_STREAM_DRAW);
+    m_data = new unsigned char[size];
+  }
+  glBindBuffer(GL_UNIFORM_BUFFER, 0);
+  return m_buffer != 0;
+}
+
+void UniformRing::destroy() {
+  if (m_fences != nullptr) {
+    for (int i = 0; i < m_framesCount; ++i)
+      if (m_fences[i] != 0) glDeleteSync(m_fences[i]);
+    delete[] m_fences;
+    m_fences = nullptr;
+  }
+  if (m_buffer != 0) {
+    if (m_persistent) {
+      glBindBuffer(GL_UNIFORM_BUFFER, m_buffer);
+      glUnmapBuffer(GL_UNIFORM_BUFFER);
+      glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
+    glDeleteBuffers(1, &m_buffer);
+    m_buffer = 0;
+  }
+  if (!m_persistent) delete[] m_data;
+  m_data = nullptr;
+}
+
+void UniformRing::beginFrame() {
+  m_frame = (m_frame + 1) % m_framesCount;
+  m_head = 0;
+  // GPU may still read from this segment, wait for its fence
+  GLsync &fence = m_fences[m_frame];
+  if (fence != 0) {
+    // the first wait flushes so the fence is sure to reach the GPU, later ones only block
+    GLbitfield flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+    while (glClientWaitSync(fence, flags, UNIFORM_RING_WAIT_TIMEOUT) == GL_TIMEOUT_EXPIRED) flags = 0;
+    glDeleteSync(fence);
+    fence = 0;
+  }
+}
+
+void UniformRing::endFrame() {
+  m_fences[m_frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+GLintptr UniformRing::allocate(GLsizeiptr size) {
+  GLintptr offset = (m_head + m_alignment - 1) / m_alignment * m_alignment;
+  if (offset + size > m_segmentSize) {
+    std::cout << "Uniform ring segment overflow" << std::endl;
+    return -1;
+  }
+  m_head = offset + size;
+  return m_frame * m_segmentSize + offset;
+}
+
+GLintptr UniformRing::push(const void *data, GLsizeiptr size) {
+  GLintptr offset = allocate(size);
+  if (offset >= 0) memcpy(ptr(offset), data, size);
+  return offset;
+}
+
+void UniformRing::flush() {
+  if (m_persistent || m_head == 0) return;
+  // single upload of everything written in this frame
+  GLintptr start = m_frame * m_segmentSize;
+  glBindBuffer(GL_UNIFORM_BUFFER, m_buffer);
+  glBufferSubData(GL_UNIFORM_BUFFER, start, m_head, m_data + start);
+  glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
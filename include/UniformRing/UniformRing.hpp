@@ -0,0 +1,68 @@
+#pragma once
+#ifdef __WIN32
+  #ifndef GLEW_STATIC
+    #define GLEW_STATIC
+  #endif
+#endif
+#include <GLEW/glew.h>
+
+// uniform block binding points shared by all shader programs
+#define UBO_FRAME_BINDING 0
+#define UBO_OBJECT_BINDING 1
+
+// std140 per-frame block, must match "Frame" in the shaders
+struct FrameUniforms {
+  float proj[16];       // projection matrix
+  float light_pos[4];   // light position in view space (w unused)
+  float light_color[4]; // light color (w unused)
+  float eye_pos[4];     // eye position in view space (w unused)
+};
+
+// std140 per-object block, must match "Object" in the shaders
+struct ObjectUniforms {
+  float mv[16];         // model view matrix
+  float mvp[16];        // model view projection matrix
+  float normal[16];     // inverse transpose of mv, only the 3x3 part is used
+  float base_color[4];  // material base color (w unused)
+  float material[4];    // diffuse minimum, specular focus, texture mix, unused
+};
+
+// Ring of uniform data living in one buffer object.
+// The buffer is split into frames_count segments, each frame writes into its
+// own segment and a fence guards the segment until the GPU is done with it.
+// With GL_ARB_buffer_storage the buffer is persistently mapped and writes go
+// straight to it, otherwise a CPU copy of the segment is uploaded in flush().
+class UniformRing
+{
+public:
+  UniformRing();
+  // creates buffer object with segment_size bytes for each of frames_count frames
+  bool create(GLsizeiptr segment_size, int frames_count = 3);
+  void destroy();
+  // waits until the next segment is free and makes it current
+  void beginFrame();
+  // places fence on the current segment
+  void endFrame();
+  // reserves size bytes (aligned) in the current segment, returns offset or -1
+  GLintptr allocate(GLsizeiptr size);
+  // returns pointer to write allocated data to
+  void *ptr(GLintptr offset) { return m_data + offset; }
+  // copies data to a new allocation, returns offset or -1
+  GLintptr push(const void *data, GLsizeiptr size);
+  // uploads data written in the current frame (no-op when persistently mapped)
+  void flush();
+
+  GLuint buffer() const { return m_buffer; }
+  bool isPersistent() const { return m_persistent; }
+
+private:
+  GLuint m_buffer;
+  unsigned char *m_data;  // mapped pointer or CPU copy of the whole ring
+  bool m_persistent;
+  GLsizeiptr m_segmentSize;
+  GLint m_alignment;      // GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT
+  int m_framesCount;
+  int m_frame;            // current segment
+  GLintptr m_head;        // next free byte in the current segment
+  GLsync *m_fences;
+};
@@ -35,10 +35,38 @@ Rename this file to lodepng.cpp to use it for C++, or to lodepng.c to use it for
 #include <stdio.h> /* file handling */
 #endif /* LODEPNG_COMPILE_DISK */
 
+#ifdef LODEPNG_COMPILE_MMAP
+#ifdef _WIN32
+#include <windows.h> /* CreateFileMapping, MapViewOfFile */
+#else
+#include <fcntl.h> /* open */
+#include <sys/mman.h> /* mmap */
+#include <sys/stat.h> /* fstat */
+#include <unistd.h> /* close */
+#endif
+#endif /* LODEPNG_COMPILE_MMAP */
+
 #ifdef LODEPNG_COMPILE_ALLOCATORS
 #include <stdlib.h> /* allocations */
 #endif /* LODEPNG_COMPILE_ALLOCATORS */
 
+#ifdef LODEPNG_COMPILE_SIMD
+#ifdef __ARM_NEON
+#include <arm_neon.h>
+#else /*x86*/
+#include <emmintrin.h> /*SSE2*/
+#if defined(_MSC_VER)
+#include <intrin.h> /*__cpuid, and every intrinsic without compiler flags*/
+#define LODEPNG_SIMD_DISPATCH
+#define LODEPNG_TARGET(isa)
+#elif (defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))) || defined(__clang__)
+#include <immintrin.h> /*SSSE3 and AVX2, usable in functions with a target attribute*/
+#define LODEPNG_SIMD_DISPATCH
+#define LODEPNG_TARGET(isa) __attribute__((target(isa)))
+#endif
+#endif /*__ARM_NEON*/
+#endif /*LODEPNG_COMPILE_SIMD*/
+
 #if defined(_MSC_VER) && (_MSC_VER >= 1310) /*Visual Studio: A few warning types are not desired here.*/
 #pragma warning( disable : 4244 ) /*implicit conversions: not warned by gcc -Wall -Wextra and requires too much casts*/
 #pragma warning( disable : 4996 ) /*VS does not like fopen, but fopen_s is not standard C so unusable here*/
@@ -142,6 +170,47 @@ static size_t lodepng_strlen(const char* a) {
 #define LODEPNG_MIN(a, b) (((a) < (b)) ? (a) : (b))
 #define LODEPNG_ABS(x) ((x) < 0 ? -(x) : (x))
 
+/*input bytes per task when the encoder filters and deflates on parallel_for*/
+#define LODEPNG_BAND_SIZE 262144u
+
+/*instruction sets usable by the SIMD code paths, higher levels include the lower ones*/
+#define LODEPNG_SIMD_NONE 0
+#define LODEPNG_SIMD_SSE2 1 /*or NEON*/
+#define LODEPNG_SIMD_SSSE3 2
+#define LODEPNG_SIMD_AVX2 3
+
+#if defined(LODEPNG_COMPILE_PNG) || defined(LODEPNG_COMPILE_ZLIB)
+/*Returns the best level the CPU and OS support. Query it once per image rather than
+per row: cpuid is slow, especially in virtual machines.*/
+static unsigned lodepng_simd_level(void) {
+#if !defined(LODEPNG_COMPILE_SIMD)
+  return LODEPNG_SIMD_NONE;
+#elif defined(__ARM_NEON) || !defined(LODEPNG_SIMD_DISPATCH)
+  return LODEPNG_SIMD_SSE2;
+#elif defined(_MSC_VER)
+  int info[4];
+  unsigned level = LODEPNG_SIMD_SSE2;
+  int maxleaf;
+  __cpuid(info, 0);
+  maxleaf = info[0];
+  __cpuid(info, 1);
+  if(info[2] & (1 << 9)) level = LODEPNG_SIMD_SSSE3;
+  /*AVX2 also needs the OS to save the ymm registers (OSXSAVE, AVX and XCR0 bits)*/
+  if(level == LODEPNG_SIMD_SSSE3 && maxleaf >= 7 && (info[2] & (1 << 27)) && (info[2] & (1 << 28)) &&
+     (_xgetbv(0) & 6) == 6) {
+    __cpuidex(info, 7, 0);
+    if(info[1] & (1 << 5)) level = LODEPNG_SIMD_AVX2;
+  }
+  return level;
+#else
+  __builtin_cpu_init(); /*in case this runs before constructors, e.g. from a static initializer*/
+  if(__builtin_cpu_supports("avx2")) return LODEPNG_SIMD_AVX2;
+  if(__builtin_cpu_supports("ssse3")) return LODEPNG_SIMD_SSSE3;
+  return LODEPNG_SIMD_SSE2;
+#endif
+}
+#endif /*LODEPNG_COMPILE_PNG || LODEPNG_COMPILE_ZLIB*/
+
 #if defined(LODEPNG_COMPILE_PNG) || defined(LODEPNG_COMPILE_DECODER)
 /* Safely check if adding two integers will overflow (no undefined
 behavior, compiler removing the code, etc...) and output result. */
@@ -395,6 +464,58 @@ unsigned lodepng_save_file(const unsigned char* buffer, size_t buffersize, const
   return 0;
 }
 
+#ifdef LODEPNG_COMPILE_MMAP
+unsigned lodepng_map_file(const unsigned char** out, size_t* outsize, const char* filename) {
+#ifdef _WIN32
+  HANDLE file, mapping;
+  LARGE_INTEGER size;
+  *out = 0;
+  *outsize = 0;
+  file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  if(file == INVALID_HANDLE_VALUE) return 78;
+  if(!GetFileSizeEx(file, &size) || size.QuadPart <= 0 || (LONGLONG)(size_t)size.QuadPart != size.QuadPart) {
+    CloseHandle(file);
+    return 78;
+  }
+  mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+  /*the view keeps the file open, both handles can go*/
+  if(mapping) *out = (const unsigned char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+  if(mapping) CloseHandle(mapping);
+  CloseHandle(file);
+  if(!*out) return 78;
+  *outsize = (size_t)size.QuadPart;
+  return 0;
+#else
+  struct stat info;
+  void* data = MAP_FAILED;
+  int file = open(filename, O_RDONLY);
+  *out = 0;
+  *outsize = 0;
+  if(file < 0) return 78;
+  /*the size must fit in size_t, as on 32-bit systems with large file support*/
+  if(fstat(file, &info) == 0 && info.st_size > 0 && (off_t)(size_t)info.st_size == info.st_size) {
+    data = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+  }
+  /*the mapping keeps the file open*/
+  close(file);
+  if(data == MAP_FAILED) return 78;
+  *out = (const unsigned char*)data;
+  *outsize = (size_t)info.st_size;
+  return 0;
+#endif
+}
+
+void lodepng_unmap_file(const unsigned char* buffer, size_t buffersize) {
+  if(!buffer) return;
+#ifdef _WIN32
+  (void)buffersize;
+  UnmapViewOfFile(buffer);
+#else
+  munmap((void*)buffer, buffersize);
+#endif
+}
+#endif /*LODEPNG_COMPILE_MMAP*/
+
 #endif /*LODEPNG_COMPILE_DISK*/
 
 /* ////////////////////////////////////////////////////////////////////////// */
@@ -452,12 +573,26 @@ static void writeBitsReversed(LodePNGBitWriter* writer, unsigned value, size_t n
 
 #ifdef LODEPNG_COMPILE_DECODER
 
+/*bytes around a span boundary stitched together, enough for any ensureBits*/
+#define LODEPNG_SEAM_SIZE 16
+
 typedef struct {
   const unsigned char* data;
   size_t size; /*size of data in bytes*/
   size_t bitsize; /*size of data in bits, end of valid bp values, should be 8*size*/
   size_t bp;
   unsigned buffer; /*buffer for reading bits. NOTE: 'unsigned' must support at least 32 bits*/
+  /*A stream may be split over several spans, such as the IDAT chunks of a PNG. Then data is the
+  span holding the current byte, or a seam copied from both sides of a span boundary, and bp,
+  size and bitsize count from data[0], which is byte 'base' of the whole stream.*/
+  const unsigned char* const* spans; /*NULL for a single contiguous buffer*/
+  const size_t* spansizes;
+  size_t numspans;
+  size_t span; /*index of the span holding byte 'base'*/
+  size_t spanstart; /*stream offset of that span*/
+  size_t base; /*stream offset of data[0]*/
+  size_t total; /*size of the whole stream in bytes*/
+  unsigned char seam[LODEPNG_SEAM_SIZE];
 } LodePNGBitReader;
 
 /* data size argument is in bytes. Returns error if size too large causing overflow */
@@ -472,9 +607,89 @@ static unsigned LodePNGBitReader_init(LodePNGBitReader* reader, const unsigned c
   if(lodepng_addofl(reader->bitsize, 64u, &temp)) return 105;
   reader->bp = 0;
   reader->buffer = 0;
+  reader->spans = 0;
+  reader->spansizes = 0;
+  reader->numspans = 1;
+  reader->span = reader->spanstart = reader->base = 0;
+  reader->total = size;
+  return 0; /*ok*/
+}
+
+/*Same as LodePNGBitReader_init, for a stream made of numspans spans read one after another, the
+spans are read where they are and never concatenated.*/
+static unsigned LodePNGBitReader_initSpans(LodePNGBitReader* reader, const unsigned char* const* spans,
+                                           const size_t* spansizes, size_t numspans) {
+  size_t i, total = 0;
+  unsigned error;
+  for(i = 0; i != numspans; ++i) {
+    if(lodepng_addofl(total, spansizes[i], &total)) return 105;
+  }
+  error = LodePNGBitReader_init(reader, numspans ? spans[0] : 0, numspans ? spansizes[0] : 0);
+  if(error) return error;
+  /*bitsize counts the whole stream, checked for overflow like in LodePNGBitReader_init*/
+  if(lodepng_mulofl(total, 8u, &reader->bitsize)) return 105;
+  if(lodepng_addofl(reader->bitsize, 64u, &i)) return 105;
+  if(numspans > 1) {
+    reader->spans = spans;
+    reader->spansizes = spansizes;
+    reader->numspans = numspans;
+  }
+  reader->total = total;
   return 0; /*ok*/
 }
 
+/*copies count bytes from stream offset pos on, which must not lie before the current span*/
+static void LodePNGBitReader_copy(const LodePNGBitReader* reader, unsigned char* dst, size_t pos, size_t count) {
+  size_t span = reader->span, start = reader->spanstart;
+  if(!reader->spans) {
+    lodepng_memcpy(dst, reader->data + pos, count);
+    return;
+  }
+  while(count != 0) {
+    size_t size = reader->spansizes[span];
+    if(pos < start + size) {
+      size_t amount = LODEPNG_MIN(count, start + size - pos);
+      lodepng_memcpy(dst, reader->spans[span] + (pos - start), amount);
+      dst += amount;
+      pos += amount;
+      count -= amount;
+    }
+    start += size;
+    ++span;
+  }
+}
+
+/*
+Moves data to the span holding the current byte, or to a seam when that span ends less than
+LODEPNG_SEAM_SIZE bytes later. Only called when the ensureBits functions run out of data.
+Returns 0 if data already reaches the end of the stream, so nothing changed.
+*/
+static unsigned LodePNGBitReader_chain(LodePNGBitReader* reader) {
+  size_t pos = reader->base + (reader->bp >> 3u);
+  size_t bits = reader->bp & 7u;
+  size_t end;
+  if(reader->base + reader->size >= reader->total) return 0;
+  /*the reader only moves forward, so does the span index*/
+  while(reader->span + 1u < reader->numspans && pos >= reader->spanstart + reader->spansizes[reader->span]) {
+    reader->spanstart += reader->spansizes[reader->span];
+    ++reader->span;
+  }
+  end = reader->spanstart + reader->spansizes[reader->span];
+  if(end >= pos + LODEPNG_SEAM_SIZE || reader->span + 1u == reader->numspans) {
+    reader->data = reader->spans[reader->span];
+    reader->size = reader->spansizes[reader->span];
+    reader->base = reader->spanstart;
+  } else {
+    reader->size = LODEPNG_MIN(reader->total - pos, (size_t)LODEPNG_SEAM_SIZE);
+    LodePNGBitReader_copy(reader, reader->seam, pos, reader->size);
+    reader->data = reader->seam;
+    reader->base = pos;
+  }
+  reader->bp = ((pos - reader->base) << 3u) + bits;
+  reader->bitsize = (reader->total - reader->base) << 3u;
+  return 1;
+}
+
 /*
 ensureBits functions:
 Ensures the reader can at least read nbits bits in one or more readBits calls,
@@ -498,6 +713,7 @@ static unsigned ensureBits9(LodePNGBitReader* reader, size_t nbits) {
     reader->buffer >>= (reader->bp & 7u);
     return 1;
   } else {
+    if(reader->spans && LodePNGBitReader_chain(reader)) return ensureBits9(reader, nbits);
     reader->buffer = 0;
     if(start + 0u < size) reader->buffer |= reader->data[start + 0];
     reader->buffer >>= (reader->bp & 7u);
@@ -515,6 +731,7 @@ static unsigned ensureBits17(LodePNGBitReader* reader, size_t nbits) {
     reader->buffer >>= (reader->bp & 7u);
     return 1;
   } else {
+    if(reader->spans && LodePNGBitReader_chain(reader)) return ensureBits17(reader, nbits);
     reader->buffer = 0;
     if(start + 0u < size) reader->buffer |= reader->data[start + 0];
     if(start + 1u < size) reader->buffer |= ((unsigned)reader->data[start + 1] << 8u);
@@ -533,6 +750,7 @@ static LODEPNG_INLINE unsigned ensureBits25(LodePNGBitReader* reader, size_t nbi
     reader->buffer >>= (reader->bp & 7u);
     return 1;
   } else {
+    if(reader->spans && LodePNGBitReader_chain(reader)) return ensureBits25(reader, nbits);
     reader->buffer = 0;
     if(start + 0u < size) reader->buffer |= reader->data[start + 0];
     if(start + 1u < size) reader->buffer |= ((unsigned)reader->data[start + 1] << 8u);
@@ -553,6 +771,7 @@ static LODEPNG_INLINE unsigned ensureBits32(LodePNGBitReader* reader, size_t nbi
     reader->buffer |= (((unsigned)reader->data[start + 4] << 24u) << (8u - (reader->bp & 7u)));
     return 1;
   } else {
+    if(reader->spans && LodePNGBitReader_chain(reader)) return ensureBits32(reader, nbits);
     reader->buffer = 0;
     if(start + 0u < size) reader->buffer |= reader->data[start + 0];
     if(start + 1u < size) reader->buffer |= ((unsigned)reader->data[start + 1] << 8u);
@@ -685,6 +904,13 @@ static void HuffmanTree_cleanup(HuffmanTree* tree) {
 which is possible in case of only 0 or 1 present symbols. */
 #define INVALIDSYMBOL 65535u
 
+/* the inflate fast path keeps 64 bits of input in a size_t, so it needs 64-bit size_t */
+#if defined(__LP64__) || defined(_LP64) || defined(_WIN64)
+#define LODEPNG_INFLATE_FAST
+/* bits of the multi-literal table of the fast path, see makeFastTable */
+#define FASTBITS 11u
+#endif
+
 /* make table for huffman decoding */
 static unsigned HuffmanTree_makeTable(HuffmanTree* tree) {
   static const unsigned headsize = 1u << FIRSTBITS; /*size of the first table*/
@@ -1117,6 +1343,44 @@ static unsigned huffmanDecodeSymbol(LodePNGBitReader* reader, const HuffmanTree*
 /* / Inflator (Decompressor)                                                / */
 /* ////////////////////////////////////////////////////////////////////////// */
 
+static unsigned update_adler32(unsigned adler, const unsigned char* data, unsigned len, unsigned simd);
+
+/*
+Receives the output while it is inflated, so that only the last 32768 bytes, the furthest a
+back reference reaches, and what consume did not take yet stay in the output buffer.
+consume gets the output it has not seen yet and sets *used to the bytes it took from the front,
+the rest is passed again with more data on the next flush.
+*/
+typedef struct LodePNGInflateSink {
+  unsigned (*consume)(void* owner, const unsigned char* data, size_t size, size_t* used);
+  void* owner;
+  size_t step; /*the output grows by about this much between flushes*/
+  size_t limit; /*output size at which the next flush happens*/
+  size_t done; /*bytes at the start of the output buffer already consumed*/
+  size_t dropped; /*bytes removed from the start of the output buffer*/
+  unsigned adler; /*adler32 of the removed bytes*/
+  unsigned simd; /*SIMD level for the adler32*/
+} LodePNGInflateSink;
+
+/*passes the new output to the sink, then removes what is consumed and out of reach of back references*/
+static unsigned inflateFlush(ucvector* out, LodePNGInflateSink* sink) {
+  size_t used = 0, drop, i;
+  unsigned error = sink->consume(sink->owner, out->data + sink->done, out->size - sink->done, &used);
+  if(error) return error;
+  sink->done += used;
+  drop = out->size > 32768u ? LODEPNG_MIN(sink->done, out->size - 32768u) : 0;
+  if(drop) {
+    sink->adler = update_adler32(sink->adler, out->data, (unsigned)drop, sink->simd);
+    /*overlapping move towards the front*/
+    for(i = drop; i != out->size; ++i) out->data[i - drop] = out->data[i];
+    out->size -= drop;
+    sink->done -= drop;
+    sink->dropped += drop;
+  }
+  sink->limit = out->size + sink->step;
+  return 0;
+}
+
 /*get the tree of a deflated block with fixed tree, as specified in the deflate specification
 Returns error code.*/
 static unsigned getTreeInflateFixed(HuffmanTree* tree_ll, HuffmanTree* tree_d) {
@@ -1259,21 +1523,233 @@ static unsigned getTreeInflateDynamic(HuffmanTree* tree_ll, HuffmanTree* tree_d,
 }
 
 /*inflate a block with dynamic of fixed Huffman tree. btype must be 1 or 2.*/
+#ifdef LODEPNG_INFLATE_FAST
+/*
+Decodes the symbol whose code starts at the low bits of bits, if the code is at most nbits long.
+Bits above nbits may be anything. Returns 0 for longer codes.
+*/
+static unsigned peekSymbol(const HuffmanTree* tree, unsigned bits, unsigned nbits, unsigned* symbol, unsigned* len) {
+  unsigned code = bits & ((1u << FIRSTBITS) - 1u);
+  unsigned l = tree->table_len[code];
+  unsigned value = tree->table_value[code];
+  if(l > FIRSTBITS) {
+    unsigned index2 = value + ((bits >> FIRSTBITS) & ((1u << (l - FIRSTBITS)) - 1u));
+    l = tree->table_len[index2];
+    value = tree->table_value[index2];
+  }
+  if(l > nbits) return 0;
+  *symbol = value;
+  *len = l;
+  return 1;
+}
+
+/*
+Fills the table of inflateHuffmanFast for a literal/length tree. For each FASTBITS bit pattern an
+entry holds, from the low bits: the code bits it consumes (8 bits, 0 if the first code is longer
+than FASTBITS), the number of literals (8 bits, 0 for another symbol) and then either up to two
+literal bytes or the symbol (16 bits). Two literals are combined when both codes fit.
+*/
+static void makeFastTable(unsigned* fast, const HuffmanTree* tree_ll) {
+  unsigned i;
+  for(i = 0; i != (1u << FASTBITS); ++i) {
+    unsigned symbol, len, symbol2, len2;
+    if(!peekSymbol(tree_ll, i, FASTBITS, &symbol, &len)) {
+      fast[i] = 0;
+    } else if(symbol > 255) {
+      fast[i] = len | (symbol << 16u);
+    } else if(peekSymbol(tree_ll, i >> len, FASTBITS - len, &symbol2, &len2) && symbol2 <= 255) {
+      fast[i] = (len + len2) | (2u << 8u) | (symbol << 16u) | (symbol2 << 24u);
+    } else {
+      fast[i] = len | (1u << 8u) | (symbol << 16u);
+    }
+  }
+}
+
+/*
+Fills the distance table of inflateHuffmanFast. For each FASTBITS bit pattern an entry holds, from
+the low bits: the code bits (8 bits), the number of extra bits (8 bits) and the base distance
+(16 bits). Entries are 0 for codes longer than FASTBITS and for invalid codes, which are then
+decoded and reported as in the slow path.
+*/
+static void makeFastDistanceTable(unsigned* fastd, const HuffmanTree* tree_d) {
+  unsigned i;
+  for(i = 0; i != (1u << FASTBITS); ++i) {
+    unsigned symbol, len;
+    if(!peekSymbol(tree_d, i, FASTBITS, &symbol, &len) || symbol > 29) fastd[i] = 0;
+    else fastd[i] = len | (DISTANCEEXTRA[symbol] << 8u) | (DISTANCEBASE[symbol] << 16u);
+  }
+}
+
+/*little endian 64-bit load, compilers turn this into a single load where they can*/
+static LODEPNG_INLINE size_t readBits64(const unsigned char* p) {
+  return (size_t)p[0] | ((size_t)p[1] << 8u) | ((size_t)p[2] << 16u) | ((size_t)p[3] << 24u) |
+         ((size_t)p[4] << 32u) | ((size_t)p[5] << 40u) | ((size_t)p[6] << 48u) | ((size_t)p[7] << 56u);
+}
+
+/*
+Fast path of inflateHuffmanBlock: decodes symbols as long as 8 input bytes can be read at once
+and the output has room for the longest match plus 8 bytes of overshoot, and the output is below
+limit. The input is kept in a 64-bit buffer refilled without branches to at least 56 bits, enough
+for a length symbol, a distance symbol and their extra bits. Sets *end at the end code. Leaves the
+reader and out in the state the slow path expects, errors are the same as there.
+*/
+static unsigned inflateHuffmanFast(ucvector* out, LodePNGBitReader* reader, const HuffmanTree* tree_ll,
+                                   const HuffmanTree* tree_d, const unsigned* fast, const unsigned* fastd,
+                                   size_t limit, unsigned* end) {
+  const unsigned char* in = reader->data;
+  size_t inpos = reader->bp >> 3u;
+  size_t bits = 0;
+  unsigned nbits = 0, error = 0;
+  unsigned char* o = out->data;
+  size_t outpos = out->size;
+  /*room for a match of 258 bytes plus 8 bytes of overshoot*/
+  size_t outend = out->allocsize > 266u ? out->allocsize - 266u : 0;
+  if(limit < outend) outend = limit;
+
+  if(inpos + 8u > reader->size || outpos >= outend) return 0;
+  /*first refill, then skip the bits of the first byte that were read already*/
+  bits = readBits64(&in[inpos]) >> (reader->bp & 7u);
+  nbits = 56u - (unsigned)(reader->bp & 7u);
+  inpos += 7u;
+
+  while(inpos + 8u <= reader->size && outpos < outend) {
+    unsigned entry, symbol;
+    /*branchless refill to 56..63 bits*/
+    bits |= readBits64(&in[inpos]) << nbits;
+    inpos += (63u - nbits) >> 3u;
+    nbits |= 56u;
+
+    entry = fast[bits & ((1u << FASTBITS) - 1u)];
+    if(entry & 0xff00u) {
+      /*a refill holds three entries of at most FASTBITS bits, literals are taken without refilling*/
+      unsigned k = 0;
+      do {
+        /*one or two literals, writing the second one is harmless when there is only one*/
+        o[outpos] = (unsigned char)(entry >> 16u);
+        o[outpos + 1u] = (unsigned char)(entry >> 24u);
+        outpos += (entry >> 8u) & 0xffu;
+        bits >>= entry & 0xffu;
+        nbits -= entry & 0xffu;
+        entry = fast[bits & ((1u << FASTBITS) - 1u)];
+      } while(++k != 3u && (entry & 0xff00u));
+      continue;
+    }
+    if(entry) {
+      symbol = entry >> 16u;
+      bits >>= entry & 0xffu;
+      nbits -= entry & 0xffu;
+    } else {
+      /*code longer than FASTBITS, needs the secondary table*/
+      unsigned len;
+      peekSymbol(tree_ll, (unsigned)bits, 15u, &symbol, &len);
+      bits >>= len;
+      nbits -= len;
+    }
+    if(symbol <= 255) {
+      o[outpos++] = (unsigned char)symbol;
+    } else if(symbol >= FIRST_LENGTH_CODE_INDEX && symbol <= LAST_LENGTH_CODE_INDEX) {
+      unsigned code_d, distance, len, numextrabits;
+      size_t length, start;
+      length = LENGTHBASE[symbol - FIRST_LENGTH_CODE_INDEX];
+      numextrabits = LENGTHEXTRA[symbol - FIRST_LENGTH_CODE_INDEX];
+      length += bits & ((1u << numextrabits) - 1u);
+      bits >>= numextrabits;
+      nbits -= numextrabits;
+
+      entry = fastd[bits & ((1u << FASTBITS) - 1u)];
+      if(entry) {
+        bits >>= entry & 0xffu;
+        nbits -= entry & 0xffu;
+        distance = entry >> 16u;
+        numextrabits = (entry >> 8u) & 0xffu;
+      } else {
+        peekSymbol(tree_d, (unsigned)bits, 15u, &code_d, &len);
+        bits >>= len;
+        nbits -= len;
+        if(code_d > 29) {
+          if(code_d <= 31) {
+            ERROR_BREAK(18); /*error: invalid distance code (30-31 are never used)*/
+          } else /* if(code_d == INVALIDSYMBOL) */{
+            ERROR_BREAK(16); /*error: tried to read disallowed huffman symbol*/
+          }
+        }
+        distance = DISTANCEBASE[code_d];
+        numextrabits = DISTANCEEXTRA[code_d];
+      }
+      distance += (unsigned)bits & ((1u << numextrabits) - 1u);
+      bits >>= numextrabits;
+      nbits -= numextrabits;
+
+      if(distance > outpos) ERROR_BREAK(52); /*too long backward distance*/
+      start = outpos - distance;
+      if(distance >= 8) {
+        /*8 bytes at a time, may write up to 7 bytes past the match*/
+        size_t i;
+        for(i = 0; i < length; i += 8) lodepng_memcpy(&o[outpos + i], &o[start + i], 8);
+      } else if(distance == 1) {
+        lodepng_memset(&o[outpos], o[start], length);
+      } else if(length <= distance) {
+        /*short match that does not overlap itself, one 8 byte copy through a buffer*/
+        unsigned char chunk[8];
+        lodepng_memcpy(chunk, &o[start], 8);
+        lodepng_memcpy(&o[outpos], chunk, 8);
+      } else {
+        size_t i;
+        for(i = 0; i != length; ++i) o[outpos + i] = o[start + i];
+      }
+      outpos += length;
+    } else if(symbol == 256) {
+      *end = 1;
+      break;
+    } else /*if(symbol == INVALIDSYMBOL)*/ {
+      ERROR_BREAK(16); /*error: tried to read disallowed huffman symbol*/
+    }
+  }
+
+  out->size = outpos;
+  /*bits still in the buffer were not consumed*/
+  reader->bp = (inpos << 3u) - nbits;
+  return error;
+}
+#endif /*LODEPNG_INFLATE_FAST*/
+
 static unsigned inflateHuffmanBlock(ucvector* out, LodePNGBitReader* reader,
-                                    unsigned btype) {
+                                    unsigned btype, LodePNGInflateSink* sink) {
   unsigned error = 0;
+  size_t limit = sink ? sink->limit : (size_t)(-1); /*flush point, never reached without a sink*/
   HuffmanTree tree_ll; /*the huffman tree for literal and length codes*/
   HuffmanTree tree_d; /*the huffman tree for distance codes*/
+#ifdef LODEPNG_INFLATE_FAST
+  unsigned fast[1u << FASTBITS], fastd[1u << FASTBITS];
+#endif /*LODEPNG_INFLATE_FAST*/
 
   HuffmanTree_init(&tree_ll);
   HuffmanTree_init(&tree_d);
 
   if(btype == 1) error = getTreeInflateFixed(&tree_ll, &tree_d);
   else /*if(btype == 2)*/ error = getTreeInflateDynamic(&tree_ll, &tree_d, reader);
+#ifdef LODEPNG_INFLATE_FAST
+  if(!error) {
+    makeFastTable(fast, &tree_ll);
+    makeFastDistanceTable(fastd, &tree_d);
+  }
+#endif /*LODEPNG_INFLATE_FAST*/
 
   while(!error) /*decode all symbols until end reached, breaks at end code*/ {
     /*code_ll is literal, length or end code*/
     unsigned code_ll;
+#ifdef LODEPNG_INFLATE_FAST
+    unsigned end = 0;
+    /*most symbols are decoded here, the code below handles the ends of the input and output*/
+    error = inflateHuffmanFast(out, reader, &tree_ll, &tree_d, fast, fastd, limit, &end);
+    if(error || end) break;
+    if(out->size >= limit) {
+      error = inflateFlush(out, sink);
+      if(error) break;
+      limit = sink->limit;
+      continue;
+    }
+#endif /*LODEPNG_INFLATE_FAST*/
     ensureBits25(reader, 20); /* up to 15 for the huffman symbol, up to 5 for the length extra bits */
     code_ll = huffmanDecodeSymbol(reader, &tree_ll);
     if(code_ll <= 255) /*literal symbol*/ {
@@ -1341,6 +1817,11 @@ static unsigned inflateHuffmanBlock(ucvector* out, LodePNGBitReader* reader,
       /* TODO: revise error codes 10,11,50: the above comment is no longer valid */
       ERROR_BREAK(51); /*error, bit pointer jumps past memory*/
     }
+    if(out->size >= limit) {
+      error = inflateFlush(out, sink);
+      if(error) break;
+      limit = sink->limit;
+    }
   }
 
   HuffmanTree_cleanup(&tree_ll);
@@ -1352,16 +1833,19 @@ static unsigned inflateHuffmanBlock(ucvector* out, LodePNGBitReader* reader,
 static unsigned inflateNoCompression(ucvector* out, LodePNGBitReader* reader,
                                      const LodePNGDecompressSettings* settings) {
   size_t bytepos;
-  size_t size = reader->size;
+  size_t size = reader->total; /*positions below are stream offsets, they may lie in later spans*/
+  unsigned char lengths[4];
   unsigned LEN, NLEN, error = 0;
 
   /*go to first boundary of byte*/
-  bytepos = (reader->bp + 7u) >> 3u;
+  bytepos = reader->base + ((reader->bp + 7u) >> 3u);
 
   /*read LEN (2 bytes) and NLEN (2 bytes)*/
   if(bytepos + 4 >= size) return 52; /*error, bit pointer will jump past memory*/
-  LEN = (unsigned)reader->data[bytepos] + ((unsigned)reader->data[bytepos + 1] << 8u); bytepos += 2;
-  NLEN = (unsigned)reader->data[bytepos] + ((unsigned)reader->data[bytepos + 1] << 8u); bytepos += 2;
+  LodePNGBitReader_copy(reader, lengths, bytepos, 4);
+  LEN = (unsigned)lengths[0] + ((unsigned)lengths[1] << 8u);
+  NLEN = (unsigned)lengths[2] + ((unsigned)lengths[3] << 8u);
+  bytepos += 4;
 
   /*check if 16-bit NLEN is really the one's complement of LEN*/
   if(!settings->ignore_nlen && LEN + NLEN != 65535) {
@@ -1373,39 +1857,49 @@ static unsigned inflateNoCompression(ucvector* out, LodePNGBitReader* reader,
   /*read the literal data: LEN bytes are now stored in the out buffer*/
   if(bytepos + LEN > size) return 23; /*error: reading outside of in buffer*/
 
-  lodepng_memcpy(out->data + out->size - LEN, reader->data + bytepos, LEN);
+  LodePNGBitReader_copy(reader, out->data + out->size - LEN, bytepos, LEN);
   bytepos += LEN;
 
-  reader->bp = bytepos << 3u;
+  /*past the end of data the next ensureBits moves to the right span*/
+  reader->bp = (bytepos - reader->base) << 3u;
 
   return error;
 }
 
-static unsigned lodepng_inflatev(ucvector* out,
-                                 const unsigned char* in, size_t insize,
-                                 const LodePNGDecompressSettings* settings) {
+/*inflates all blocks from the current position of the reader on, flushing into sink if not NULL*/
+static unsigned inflateReader(ucvector* out, LodePNGBitReader* reader,
+                              const LodePNGDecompressSettings* settings, LodePNGInflateSink* sink) {
   unsigned BFINAL = 0;
-  LodePNGBitReader reader;
-  unsigned error = LodePNGBitReader_init(&reader, in, insize);
-
-  if(error) return error;
+  unsigned error = 0;
 
   while(!BFINAL) {
     unsigned BTYPE;
-    if(!ensureBits9(&reader, 3)) return 52; /*error, bit pointer will jump past memory*/
-    BFINAL = readBits(&reader, 1);
-    BTYPE = readBits(&reader, 2);
+    if(!ensureBits9(reader, 3)) return 52; /*error, bit pointer will jump past memory*/
+    BFINAL = readBits(reader, 1);
+    BTYPE = readBits(reader, 2);
 
     if(BTYPE == 3) return 20; /*error: invalid BTYPE*/
-    else if(BTYPE == 0) error = inflateNoCompression(out, &reader, settings); /*no compression*/
-    else error = inflateHuffmanBlock(out, &reader, BTYPE); /*compression, BTYPE 01 or 10*/
+    else if(BTYPE == 0) error = inflateNoCompression(out, reader, settings); /*no compression*/
+    else error = inflateHuffmanBlock(out, reader, BTYPE, sink); /*compression, BTYPE 01 or 10*/
 
+    if(!error && sink && out->size >= sink->limit) error = inflateFlush(out, sink);
     if(error) return error;
   }
 
   return error;
 }
 
+static unsigned lodepng_inflatev(ucvector* out,
+                                 const unsigned char* in, size_t insize,
+                                 const LodePNGDecompressSettings* settings) {
+  LodePNGBitReader reader;
+  unsigned error = LodePNGBitReader_init(&reader, in, insize);
+
+  if(error) return error;
+
+  return inflateReader(out, &reader, settings, 0);
+}
+
 unsigned lodepng_inflate(unsigned char** out, size_t* outsize,
                          const unsigned char* in, size_t insize,
                          const LodePNGDecompressSettings* settings) {
@@ -1571,6 +2065,153 @@ static void updateHashChain(Hash* hash, size_t wpos, unsigned hashval, unsigned
   hash->headz[numzeros] = (int)wpos;
 }
 
+/*Length of the common prefix of fore and back, not going past end. back lies before fore, so
+reading 16 bytes at once is safe for both while fore + 16 <= end.*/
+static unsigned matchLength(const unsigned char* fore, const unsigned char* back, const unsigned char* end) {
+  const unsigned char* start = fore;
+#if defined(LODEPNG_COMPILE_SIMD) && !defined(__ARM_NEON)
+  while(end - fore >= 16) {
+    __m128i eq = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)fore), _mm_loadu_si128((const __m128i*)back));
+    unsigned mask = (unsigned)_mm_movemask_epi8(eq) ^ 0xffffu; /*bits of the differing bytes*/
+    if(mask) {
+#if defined(_MSC_VER)
+      unsigned long first;
+      _BitScanForward(&first, mask);
+      return (unsigned)(fore - start) + (unsigned)first;
+#elif defined(__GNUC__)
+      return (unsigned)(fore - start) + (unsigned)__builtin_ctz(mask);
+#else
+      break; /*the byte loop finds it*/
+#endif
+    }
+    fore += 16;
+    back += 16;
+  }
+#endif /*LODEPNG_COMPILE_SIMD && !__ARM_NEON*/
+  while(fore != end && *fore == *back) {
+    ++fore;
+    ++back;
+  }
+  return (unsigned)(fore - start);
+}
+
+/*
+zlib like compression levels, as windowsize, minmatch, nicematch, lazymatching, the hash chain
+positions tried per byte and the longest match after which the next byte is still tried. Level 0
+stores, levels 1 to 3 have no chains but look at a single earlier position per byte.
+*/
+static const unsigned LODEPNG_LEVELS[10][6] = {
+  {    0u, 0u,   0u, 0u,    0u,   0u},
+  {32768u, 4u, 258u, 0u,    0u,   0u}, /*greedy, positions inside matches are not hashed*/
+  {32768u, 4u, 258u, 0u,    0u,   0u}, /*greedy*/
+  {32768u, 4u, 258u, 1u,    0u,  32u}, /*lazy*/
+  {32768u, 3u,  16u, 1u,   16u,   4u},
+  {32768u, 3u,  32u, 1u,   32u,  16u},
+  {32768u, 3u, 128u, 1u,  128u,  16u},
+  {32768u, 3u, 128u, 1u,  256u,  32u},
+  {32768u, 3u, 258u, 1u, 1024u, 128u},
+  {32768u, 3u, 258u, 1u, 4096u, 258u}
+};
+
+/*hash of the 4 bytes at data for the single probe matcher*/
+static unsigned getHash4(const unsigned char* data) {
+  unsigned v = (unsigned)data[0] | ((unsigned)data[1] << 8u) | ((unsigned)data[2] << 16u) | ((unsigned)data[3] << 24u);
+  return ((v * 2654435761u) >> 16u) & HASH_BIT_MASK;
+}
+
+/*
+Returns the length of the match at pos against the one position hash->head remembers for its 4 bytes,
+or 0 if there is none worth a length/distance pair; its distance goes to offset. Then remembers pos.
+*/
+static unsigned probeMatch(Hash* hash, const unsigned char* in, size_t pos, size_t insize,
+                           unsigned mask, unsigned* offset) {
+  size_t wpos = pos & mask;
+  unsigned hashval = getHash4(&in[pos]);
+  unsigned length = 0;
+  if(hash->head[hashval] != -1) {
+    *offset = (unsigned)(wpos - (unsigned)hash->head[hashval]) & mask;
+    if(*offset != 0) {
+      size_t limit = insize - pos < MAX_SUPPORTED_DEFLATE_LENGTH ? insize - pos : MAX_SUPPORTED_DEFLATE_LENGTH;
+      length = matchLength(&in[pos], &in[pos - *offset], &in[pos + limit]);
+      /*a 3 byte match only pays off at a short distance*/
+      if(length < 4 && !(length == 3 && *offset <= 4096)) length = 0;
+    }
+  }
+  hash->head[hashval] = (int)wpos;
+  return length;
+}
+
+/*
+LZ77 for the fast levels: hash->head keeps, per hash of 4 bytes, the window position where they
+were last seen, and only that one is compared. A stale entry still points to a valid earlier
+position, its bytes are compared like any other. With lazy matching, a match is given up for a
+longer one starting at the next byte.
+*/
+static unsigned encodeLZ77Fast(uivector* out, Hash* hash, const unsigned char* in, size_t inpos, size_t insize,
+                               unsigned windowsize, unsigned insertall, unsigned lazymatching, unsigned maxlazymatch) {
+  size_t pos = inpos;
+  unsigned error = 0;
+  unsigned length = 0, offset = 0;
+  unsigned mask = windowsize - 1;
+
+  while(pos < insize) {
+    if(insize - pos < 4) {
+      if(!uivector_push_back(out, in[pos])) ERROR_BREAK(83 /*alloc fail*/);
+      ++pos;
+      continue;
+    }
+    length = probeMatch(hash, in, pos, insize, mask, &offset);
+    if(lazymatching) {
+      while(length != 0 && length <= maxlazymatch && pos + 5 <= insize) {
+        unsigned nextlength, nextoffset = 0;
+        nextlength = probeMatch(hash, in, pos + 1, insize, mask, &nextoffset);
+        if(nextlength <= length) break;
+        if(!uivector_push_back(out, in[pos])) ERROR_BREAK(83 /*alloc fail*/);
+        ++pos;
+        length = nextlength;
+        offset = nextoffset;
+      }
+      if(error) break;
+    }
+    if(length == 0) {
+      if(!uivector_push_back(out, in[pos])) ERROR_BREAK(83 /*alloc fail*/);
+      ++pos;
+      continue;
+    }
+    addLengthDistance(out, length, offset);
+    if(insertall) {
+      /*hash the positions inside the match too, later bytes may refer to them*/
+      size_t end = pos + length, i;
+      for(i = pos + 1; i != end && i + 4 <= insize; ++i) hash->head[getHash4(&in[i])] = (int)(i & mask);
+    }
+    pos += length;
+  }
+
+  return error;
+}
+
+/*puts the positions from..start-1 in the hash as encodeLZ77 would, so matches can refer to them*/
+static void hashPrime(Hash* hash, const unsigned char* in, size_t from, size_t start, size_t insize,
+                      const LodePNGCompressSettings* settings) {
+  size_t pos;
+  unsigned numzeros = 0;
+  unsigned mask = settings->windowsize - 1;
+  if(settings->level > 0 && LODEPNG_LEVELS[settings->level][4] == 0) {
+    for(pos = from; pos != start && pos + 4 <= insize; ++pos) hash->head[getHash4(&in[pos])] = (int)(pos & mask);
+    return;
+  }
+  for(pos = from; pos != start; ++pos) {
+    unsigned hashval = getHash(in, insize, pos);
+    if(hashval == 0) {
+      if(numzeros == 0) numzeros = countZeros(in, insize, pos);
+      else if(pos + numzeros > insize || in[pos + numzeros - 1] != 0) --numzeros;
+    } else {
+      numzeros = 0;
+    }
+    updateHashChain(hash, pos & mask, hashval, (unsigned short)numzeros);
+  }
+}
+
 /*
 LZ77-encode the data. Return value is error code. The input are raw bytes, the output
 is in the form of unsigned integers with codes representing for example literal bytes, or
@@ -1581,10 +2222,14 @@ the "dictionary". A brute force search through all possible distances would be s
 this hash technique is one out of several ways to speed this up.
 */
 static unsigned encodeLZ77(uivector* out, Hash* hash,
-                           const unsigned char* in, size_t inpos, size_t insize, unsigned windowsize,
-                           unsigned minmatch, unsigned nicematch, unsigned lazymatching) {
+                           const unsigned char* in, size_t inpos, size_t insize,
+                           const LodePNGCompressSettings* settings) {
   size_t pos;
   unsigned i, error = 0;
+  unsigned windowsize = settings->windowsize;
+  unsigned minmatch = settings->minmatch;
+  unsigned nicematch = settings->nicematch;
+  unsigned lazymatching = settings->lazymatching;
   /*for large window lengths, assume the user wants no compression loss. Otherwise, max hash chain length speedup.*/
   unsigned maxchainlength = windowsize >= 8192 ? windowsize : windowsize / 8u;
   unsigned maxlazymatch = windowsize >= 8192 ? MAX_SUPPORTED_DEFLATE_LENGTH : 64;
@@ -1607,6 +2252,15 @@ static unsigned encodeLZ77(uivector* out, Hash* hash,
 
   if(nicematch > MAX_SUPPORTED_DEFLATE_LENGTH) nicematch = MAX_SUPPORTED_DEFLATE_LENGTH;
 
+  if(settings->level > 0) {
+    maxchainlength = LODEPNG_LEVELS[settings->level][4];
+    maxlazymatch = LODEPNG_LEVELS[settings->level][5];
+    if(maxchainlength == 0) {
+      return encodeLZ77Fast(out, hash, in, inpos, insize, windowsize, settings->level >= 2, lazymatching,
+                            maxlazymatch);
+    }
+  }
+
   for(pos = inpos; pos < insize; ++pos) {
     size_t wpos = pos & (windowsize - 1); /*position for in 'circular' hash buffers*/
     unsigned chainlength = 0;
@@ -1651,11 +2305,8 @@ static unsigned encodeLZ77(uivector* out, Hash* hash,
           foreptr += skip;
         }
 
-        while(foreptr != lastptr && *backptr == *foreptr) /*maximum supported length by deflate is max length*/ {
-          ++backptr;
-          ++foreptr;
-        }
-        current_length = (unsigned)(foreptr - &in[pos]);
+        /*maximum supported length by deflate is max length*/
+        current_length = (unsigned)(foreptr - &in[pos]) + matchLength(foreptr, backptr, lastptr);
 
         if(current_length > length) {
           length = current_length; /*the longest length*/
@@ -1731,18 +2382,19 @@ static unsigned encodeLZ77(uivector* out, Hash* hash,
 
 /* /////////////////////////////////////////////////////////////////////////// */
 
-static unsigned deflateNoCompression(ucvector* out, const unsigned char* data, size_t datasize) {
+static unsigned deflateNoCompression(ucvector* out, const unsigned char* data, size_t datasize, unsigned final) {
   /*non compressed deflate block data: 1 bit BFINAL,2 bits BTYPE,(5 bits): it jumps to start of next byte,
   2 bytes LEN, 2 bytes NLEN, LEN bytes literal DATA*/
 
   size_t i, numdeflateblocks = (datasize + 65534u) / 65535u;
   unsigned datapos = 0;
+  if(numdeflateblocks == 0) numdeflateblocks = 1; /*empty input still needs a final block*/
   for(i = 0; i != numdeflateblocks; ++i) {
     unsigned BFINAL, BTYPE, LEN, NLEN;
     unsigned char firstbyte;
     size_t pos = out->size;
 
-    BFINAL = (i == numdeflateblocks - 1);
+    BFINAL = final && (i == numdeflateblocks - 1);
     BTYPE = 0;
 
     LEN = 65535;
@@ -1855,8 +2507,7 @@ static unsigned deflateDynamic(LodePNGBitWriter* writer, Hash* hash,
     lodepng_memset(frequencies_cl, 0, NUM_CODE_LENGTH_CODES * sizeof(*frequencies_cl));
 
     if(settings->use_lz77) {
-      error = encodeLZ77(&lz77_encoded, hash, data, datapos, dataend, settings->windowsize,
-                         settings->minmatch, settings->nicematch, settings->lazymatching);
+      error = encodeLZ77(&lz77_encoded, hash, data, datapos, dataend, settings);
       if(error) break;
     } else {
       if(!uivector_resize(&lz77_encoded, datasize)) ERROR_BREAK(83 /*alloc fail*/);
@@ -2041,8 +2692,7 @@ static unsigned deflateFixed(LodePNGBitWriter* writer, Hash* hash,
     if(settings->use_lz77) /*LZ77 encoded*/ {
       uivector lz77_encoded;
       uivector_init(&lz77_encoded);
-      error = encodeLZ77(&lz77_encoded, hash, data, datapos, dataend, settings->windowsize,
-                         settings->minmatch, settings->nicematch, settings->lazymatching);
+      error = encodeLZ77(&lz77_encoded, hash, data, datapos, dataend, settings);
       if(!error) writeLZ77data(writer, &lz77_encoded, &tree_ll, &tree_d);
       uivector_cleanup(&lz77_encoded);
     } else /*no LZ77, but still will be Huffman compressed*/ {
@@ -2061,18 +2711,37 @@ static unsigned deflateFixed(LodePNGBitWriter* writer, Hash* hash,
   return error;
 }
 
-static unsigned lodepng_deflatev(ucvector* out, const unsigned char* in, size_t insize,
-                                 const LodePNGCompressSettings* settings) {
+/*
+Deflates in[start..end) of a stream of insize bytes, the bytes before start within the window can
+be referred to as if they were deflated before. Unless final, the data ends with an empty stored
+block, a sync flush, so that the deflate data of the next part can be appended to it.
+*/
+static unsigned deflateRange(ucvector* out, const unsigned char* in, size_t start, size_t end, size_t insize,
+                             const LodePNGCompressSettings* settings, unsigned final) {
   unsigned error = 0;
   size_t i, blocksize, numdeflateblocks;
   Hash hash;
   LodePNGBitWriter writer;
+  LodePNGCompressSettings leveled;
 
   LodePNGBitWriter_init(&writer, out);
 
+  if(settings->level < -1 || settings->level > 9) return 110;
+  if(settings->level == 0) return deflateNoCompression(out, in + start, end - start, final);
+  if(settings->level > 0) {
+    /*the level replaces the LZ77 settings*/
+    leveled = *settings;
+    leveled.use_lz77 = 1;
+    leveled.windowsize = LODEPNG_LEVELS[settings->level][0];
+    leveled.minmatch = LODEPNG_LEVELS[settings->level][1];
+    leveled.nicematch = LODEPNG_LEVELS[settings->level][2];
+    leveled.lazymatching = LODEPNG_LEVELS[settings->level][3];
+    settings = &leveled;
+  }
+
   if(settings->btype > 2) return 61;
-  else if(settings->btype == 0) return deflateNoCompression(out, in, insize);
-  else if(settings->btype == 1) blocksize = insize;
+  else if(settings->btype == 0) return deflateNoCompression(out, in + start, end - start, final);
+  else if(settings->btype == 1) blocksize = end - start;
   else /*if(settings->btype == 2)*/ {
     /*on PNGs, deflate blocks of 65-262k seem to give most dense encoding*/
     blocksize = insize / 8u + 8;
@@ -2080,20 +2749,34 @@ static unsigned lodepng_deflatev(ucvector* out, const unsigned char* in, size_t
     if(blocksize > 262144) blocksize = 262144;
   }
 
-  numdeflateblocks = (insize + blocksize - 1) / blocksize;
+  numdeflateblocks = (end - start + blocksize - 1) / blocksize;
   if(numdeflateblocks == 0) numdeflateblocks = 1;
 
   error = hash_init(&hash, settings->windowsize);
+  if(!error && settings->use_lz77 && start != 0) {
+    hashPrime(&hash, in, start - LODEPNG_MIN(start, settings->windowsize), start, insize, settings);
+  }
 
   if(!error) {
     for(i = 0; i != numdeflateblocks && !error; ++i) {
-      unsigned final = (i == numdeflateblocks - 1);
-      size_t start = i * blocksize;
-      size_t end = start + blocksize;
-      if(end > insize) end = insize;
+      unsigned last = (i == numdeflateblocks - 1);
+      size_t blockstart = start + i * blocksize;
+      size_t blockend = blockstart + blocksize;
+      if(blockend > end) blockend = end;
 
-      if(settings->btype == 1) error = deflateFixed(&writer, &hash, in, start, end, settings, final);
-      else if(settings->btype == 2) error = deflateDynamic(&writer, &hash, in, start, end, settings, final);
+      if(settings->btype == 1) error = deflateFixed(&writer, &hash, in, blockstart, blockend, settings, final && last);
+      else if(settings->btype == 2) error = deflateDynamic(&writer, &hash, in, blockstart, blockend, settings, final && last);
+    }
+  }
+  if(!error && !final) {
+    /*sync flush: BFINAL 0 and BTYPE 00 bits, then up to the next byte LEN 0 and NLEN 65535*/
+    size_t pos;
+    writeBits(&writer, 0, 3);
+    pos = out->size;
+    if(!ucvector_resize(out, pos + 4)) error = 83; /*alloc fail*/
+    else {
+      out->data[pos + 0] = out->data[pos + 1] = 0;
+      out->data[pos + 2] = out->data[pos + 3] = 255;
     }
   }
 
@@ -2102,6 +2785,11 @@ static unsigned lodepng_deflatev(ucvector* out, const unsigned char* in, size_t
   return error;
 }
 
+static unsigned lodepng_deflatev(ucvector* out, const unsigned char* in, size_t insize,
+                                 const LodePNGCompressSettings* settings) {
+  return deflateRange(out, in, 0, insize, insize, settings, 1);
+}
+
 unsigned lodepng_deflate(unsigned char** out, size_t* outsize,
                          const unsigned char* in, size_t insize,
                          const LodePNGCompressSettings* settings) {
@@ -2128,10 +2816,95 @@ static unsigned deflate(unsigned char** out, size_t* outsize,
 /* / Adler32                                                                / */
 /* ////////////////////////////////////////////////////////////////////////// */
 
-static unsigned update_adler32(unsigned adler, const unsigned char* data, unsigned len) {
+#ifdef LODEPNG_SIMD_DISPATCH
+/*
+Adler32 of whole 32 byte blocks, len / 32 of them. Per block, s1 gains the byte sum and s2 gains
+32 times the previous s1 plus the bytes weighted 32 down to 1, both done with multiply-adds.
+At most 5552 bytes are summed between two modulo reductions, as in the C code.
+*/
+LODEPNG_TARGET("ssse3") static unsigned adler32SSSE3(unsigned s1, unsigned s2, const unsigned char* data,
+                                                     unsigned blocks) {
+  const __m128i tap1 = _mm_setr_epi8(32, 31, 30, 29, 28, 27, 26, 25, 24, 23, 22, 21, 20, 19, 18, 17);
+  const __m128i tap2 = _mm_setr_epi8(16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1);
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i ones = _mm_set1_epi16(1);
+  while(blocks != 0) {
+    unsigned n = blocks > 5552u / 32u ? 5552u / 32u : blocks;
+    __m128i ps = _mm_cvtsi32_si128((int)(s1 * n)); /*the incoming s1 counts once per byte, so 32 per block*/
+    __m128i vs1 = zero;
+    __m128i vs2 = _mm_cvtsi32_si128((int)s2);
+    blocks -= n;
+    do {
+      const __m128i a = _mm_loadu_si128((const __m128i*)data);
+      const __m128i b = _mm_loadu_si128((const __m128i*)(data + 16));
+      ps = _mm_add_epi32(ps, vs1);
+      vs1 = _mm_add_epi32(vs1, _mm_add_epi32(_mm_sad_epu8(a, zero), _mm_sad_epu8(b, zero)));
+      vs2 = _mm_add_epi32(vs2, _mm_madd_epi16(_mm_maddubs_epi16(a, tap1), ones));
+      vs2 = _mm_add_epi32(vs2, _mm_madd_epi16(_mm_maddubs_epi16(b, tap2), ones));
+      data += 32;
+    } while(--n);
+    vs2 = _mm_add_epi32(vs2, _mm_slli_epi32(ps, 5));
+    vs1 = _mm_add_epi32(vs1, _mm_shuffle_epi32(vs1, _MM_SHUFFLE(1, 0, 3, 2)));
+    vs2 = _mm_add_epi32(vs2, _mm_shuffle_epi32(vs2, _MM_SHUFFLE(2, 3, 0, 1)));
+    vs2 = _mm_add_epi32(vs2, _mm_shuffle_epi32(vs2, _MM_SHUFFLE(1, 0, 3, 2)));
+    s1 = (s1 + (unsigned)_mm_cvtsi128_si32(vs1)) % 65521u;
+    s2 = (unsigned)_mm_cvtsi128_si32(vs2) % 65521u;
+  }
+  return (s2 << 16u) | s1;
+}
+
+/*the same with one 32 byte load per block*/
+LODEPNG_TARGET("avx2") static unsigned adler32AVX2(unsigned s1, unsigned s2, const unsigned char* data,
+                                                   unsigned blocks) {
+  const __m256i tap = _mm256_setr_epi8(32, 31, 30, 29, 28, 27, 26, 25, 24, 23, 22, 21, 20, 19, 18, 17,
+                                       16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1);
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i ones = _mm256_set1_epi16(1);
+  while(blocks != 0) {
+    unsigned n = blocks > 5552u / 32u ? 5552u / 32u : blocks;
+    __m256i ps = _mm256_setr_epi32((int)(s1 * n), 0, 0, 0, 0, 0, 0, 0);
+    __m256i vs1 = zero;
+    __m256i vs2 = _mm256_setr_epi32((int)s2, 0, 0, 0, 0, 0, 0, 0);
+    __m128i s1x, s2x;
+    blocks -= n;
+    do {
+      const __m256i a = _mm256_loadu_si256((const __m256i*)data);
+      ps = _mm256_add_epi32(ps, vs1);
+      vs1 = _mm256_add_epi32(vs1, _mm256_sad_epu8(a, zero));
+      vs2 = _mm256_add_epi32(vs2, _mm256_madd_epi16(_mm256_maddubs_epi16(a, tap), ones));
+      data += 32;
+    } while(--n);
+    vs2 = _mm256_add_epi32(vs2, _mm256_slli_epi32(ps, 5));
+    s1x = _mm_add_epi32(_mm256_castsi256_si128(vs1), _mm256_extracti128_si256(vs1, 1));
+    s2x = _mm_add_epi32(_mm256_castsi256_si128(vs2), _mm256_extracti128_si256(vs2, 1));
+    s1x = _mm_add_epi32(s1x, _mm_shuffle_epi32(s1x, _MM_SHUFFLE(1, 0, 3, 2)));
+    s2x = _mm_add_epi32(s2x, _mm_shuffle_epi32(s2x, _MM_SHUFFLE(2, 3, 0, 1)));
+    s2x = _mm_add_epi32(s2x, _mm_shuffle_epi32(s2x, _MM_SHUFFLE(1, 0, 3, 2)));
+    s1 = (s1 + (unsigned)_mm_cvtsi128_si32(s1x)) % 65521u;
+    s2 = (unsigned)_mm_cvtsi128_si32(s2x) % 65521u;
+  }
+  return (s2 << 16u) | s1;
+}
+#endif /*LODEPNG_SIMD_DISPATCH*/
+
+/*simd is the SIMD level from lodepng_simd_level, LODEPNG_SIMD_NONE for the C code only*/
+static unsigned update_adler32(unsigned adler, const unsigned char* data, unsigned len, unsigned simd) {
   unsigned s1 = adler & 0xffffu;
   unsigned s2 = (adler >> 16u) & 0xffffu;
 
+#ifdef LODEPNG_SIMD_DISPATCH
+  if(simd >= LODEPNG_SIMD_SSSE3 && len >= 64u) {
+    unsigned blocks = len / 32u;
+    adler = simd >= LODEPNG_SIMD_AVX2 ? adler32AVX2(s1, s2, data, blocks) : adler32SSSE3(s1, s2, data, blocks);
+    s1 = adler & 0xffffu;
+    s2 = adler >> 16u;
+    data += blocks * 32u;
+    len -= blocks * 32u;
+  }
+#else /*LODEPNG_SIMD_DISPATCH*/
+  (void)simd;
+#endif /*LODEPNG_SIMD_DISPATCH*/
+
   while(len != 0u) {
     unsigned i;
     /*at least 5552 sums can be done before the sums overflow, saving a lot of module divisions*/
@@ -2150,7 +2923,36 @@ static unsigned update_adler32(unsigned adler, const unsigned char* data, unsign
 
 /*Return the adler32 of the bytes data[0..len-1]*/
 static unsigned adler32(const unsigned char* data, unsigned len) {
-  return update_adler32(1u, data, len);
+  return update_adler32(1u, data, len, lodepng_simd_level());
+}
+
+#ifdef LODEPNG_COMPILE_ENCODER
+/*Return the adler32 of two buffers one after the other, from the adler32 of each and the length
+of the second. s1 of the second starts len2 bytes later at s1 of the first instead of 1, which
+adds s1 - 1 to its s1 and len2 * (s1 - 1) to its s2.*/
+static unsigned adler32_combine(unsigned adler1, unsigned adler2, size_t len2) {
+  unsigned rem = (unsigned)(len2 % 65521u);
+  unsigned s1 = adler1 & 0xffffu;
+  unsigned s2 = (rem * s1) % 65521u;
+  s1 += (adler2 & 0xffffu) + 65521u - 1u;
+  s2 += ((adler1 >> 16u) & 0xffffu) + ((adler2 >> 16u) & 0xffffu) + 65521u - rem;
+  if(s1 >= 65521u) s1 -= 65521u;
+  if(s1 >= 65521u) s1 -= 65521u;
+  if(s2 >= 65521u * 2u) s2 -= 65521u * 2u;
+  if(s2 >= 65521u) s2 -= 65521u;
+  return (s2 << 16u) | s1;
+}
+#endif /*LODEPNG_COMPILE_ENCODER*/
+
+unsigned lodepng_adler32(const unsigned char* data, size_t length) {
+  unsigned adler = 1u, simd = lodepng_simd_level();
+  /*in pieces that fit the unsigned length of update_adler32*/
+  while(length > 0x40000000u) {
+    adler = update_adler32(adler, data, 0x40000000u, simd);
+    data += 0x40000000u;
+    length -= 0x40000000u;
+  }
+  return update_adler32(adler, data, (unsigned)length, simd);
 }
 
 /* ////////////////////////////////////////////////////////////////////////// */
@@ -2159,13 +2961,10 @@ static unsigned adler32(const unsigned char* data, unsigned len) {
 
 #ifdef LODEPNG_COMPILE_DECODER
 
-static unsigned lodepng_zlib_decompressv(ucvector* out,
-                                         const unsigned char* in, size_t insize,
-                                         const LodePNGDecompressSettings* settings) {
-  unsigned error = 0;
+/*checks the two byte zlib header, returns error code*/
+static unsigned zlib_check_header(const unsigned char* in) {
   unsigned CM, CINFO, FDICT;
 
-  if(insize < 2) return 53; /*error, size of zlib data too small*/
   /*read information from zlib header*/
   if((in[0] * 256 + in[1]) % 31 != 0) {
     /*error: 256 * in[0] + in[1] must be a multiple of 31, the FCHECK value is supposed to be made that way*/
@@ -2188,6 +2987,18 @@ static unsigned lodepng_zlib_decompressv(ucvector* out,
     return 26;
   }
 
+  return 0; /*ok*/
+}
+
+static unsigned lodepng_zlib_decompressv(ucvector* out,
+                                         const unsigned char* in, size_t insize,
+                                         const LodePNGDecompressSettings* settings) {
+  unsigned error = 0;
+
+  if(insize < 2) return 53; /*error, size of zlib data too small*/
+  error = zlib_check_header(in);
+  if(error) return error;
+
   error = inflatev(out, in + 2, insize - 2, settings);
   if(error) return error;
 
@@ -2230,18 +3041,138 @@ static unsigned zlib_decompress(unsigned char** out, size_t* outsize, size_t exp
   }
 }
 
+#ifdef LODEPNG_COMPILE_PNG
+/*Same as zlib_decompress for a zlib stream split over numspans spans, such as the IDAT chunks of
+a PNG. The spans are inflated where they are, custom_zlib and custom_inflate are not used.
+With a sink, out only keeps the tail of the output that the sink has not consumed or that back
+references may still reach, the sink must have consumed all of it on return.*/
+static unsigned zlib_decompress_spans(unsigned char** out, size_t* outsize, size_t expected_size,
+                                      const unsigned char* const* spans, const size_t* spansizes,
+                                      size_t numspans, const LodePNGDecompressSettings* settings,
+                                      LodePNGInflateSink* sink) {
+  unsigned char header[4];
+  LodePNGBitReader reader;
+  ucvector v = ucvector_init(*out, *outsize);
+  unsigned error = LodePNGBitReader_initSpans(&reader, spans, spansizes, numspans);
+  if(!error && reader.total < 2) error = 53; /*error, size of zlib data too small*/
+  if(!error) {
+    LodePNGBitReader_copy(&reader, header, 0, 2);
+    error = zlib_check_header(header);
+  }
+  if(!error && expected_size) {
+    /*reserve the memory to avoid intermediate reallocations*/
+    ucvector_resize(&v, *outsize + expected_size);
+    v.size = *outsize;
+  }
+  if(sink) {
+    sink->limit = v.size + sink->step;
+    sink->done = sink->dropped = 0;
+    sink->adler = 1u;
+    sink->simd = lodepng_simd_level();
+  }
+  if(!error) {
+    reader.bp = 16; /*deflate data follows the header*/
+    error = inflateReader(&v, &reader, settings, sink);
+  }
+  if(!error && sink) error = inflateFlush(&v, sink);
+  if(!error && !settings->ignore_adler32) {
+    /*the checksum may lie in a span before the last one the inflater touched*/
+    reader.span = reader.spanstart = 0;
+    if(reader.total < 4) error = 53;
+    else LodePNGBitReader_copy(&reader, header, reader.total - 4, 4);
+    if(!error && update_adler32(sink ? sink->adler : 1u, v.data, (unsigned)v.size,
+                                sink ? sink->simd : lodepng_simd_level()) != lodepng_read32bitInt(header)) {
+      error = 58; /*error, adler checksum not correct, data must be corrupted*/
+    }
+  }
+  *out = v.data;
+  *outsize = v.size;
+  return error;
+}
+#endif /*LODEPNG_COMPILE_PNG*/
+
 #endif /*LODEPNG_COMPILE_DECODER*/
 
 #ifdef LODEPNG_COMPILE_ENCODER
 
+/*bands of a zlib stream, each deflated and checksummed by a task of parallel_for*/
+typedef struct DeflateBands {
+  const unsigned char* in;
+  size_t insize;
+  const LodePNGCompressSettings* settings;
+  size_t count;
+  ucvector* out; /*deflate data of each band*/
+  unsigned* adler; /*adler32 of each band's input*/
+  unsigned* error;
+} DeflateBands;
+
+static void deflateBand(void* data, size_t index) {
+  DeflateBands* bands = (DeflateBands*)data;
+  size_t start = index * LODEPNG_BAND_SIZE;
+  size_t end = LODEPNG_MIN(start + LODEPNG_BAND_SIZE, bands->insize);
+  bands->error[index] = deflateRange(&bands->out[index], bands->in, start, end, bands->insize, bands->settings,
+                                     index + 1 == bands->count);
+  bands->adler[index] = update_adler32(1u, bands->in + start, (unsigned)(end - start), lodepng_simd_level());
+}
+
+/*deflates the input in bands on parallel_for, the band outputs are concatenated and the checksum combined*/
+static unsigned deflateParallel(unsigned char** out, size_t* outsize, unsigned* adler,
+                                const unsigned char* in, size_t insize, const LodePNGCompressSettings* settings) {
+  unsigned error = 0;
+  size_t i, size = 0;
+  DeflateBands bands;
+  bands.in = in;
+  bands.insize = insize;
+  bands.settings = settings;
+  bands.count = (insize + LODEPNG_BAND_SIZE - 1u) / LODEPNG_BAND_SIZE;
+  bands.out = (ucvector*)lodepng_malloc(bands.count * sizeof(ucvector));
+  bands.adler = (unsigned*)lodepng_malloc(bands.count * sizeof(unsigned));
+  bands.error = (unsigned*)lodepng_malloc(bands.count * sizeof(unsigned));
+  if(!bands.out || !bands.adler || !bands.error) error = 83; /*alloc fail*/
+  if(bands.out) {
+    for(i = 0; i != bands.count; ++i) bands.out[i] = ucvector_init(NULL, 0);
+  }
+
+  if(!error) {
+    settings->parallel_for(deflateBand, &bands, bands.count, settings->parallel_context);
+    *adler = 1u;
+    for(i = 0; i != bands.count; ++i) {
+      if(!error) error = bands.error[i];
+      size += bands.out[i].size;
+      *adler = adler32_combine(*adler, bands.adler[i], LODEPNG_MIN(LODEPNG_BAND_SIZE, insize - i * LODEPNG_BAND_SIZE));
+    }
+  }
+  if(!error) {
+    *out = (unsigned char*)lodepng_malloc(size);
+    if(!*out && size) error = 83; /*alloc fail*/
+  }
+  if(!error) {
+    *outsize = 0;
+    for(i = 0; i != bands.count; ++i) {
+      lodepng_memcpy(*out + *outsize, bands.out[i].data, bands.out[i].size);
+      *outsize += bands.out[i].size;
+    }
+  }
+  if(bands.out) {
+    for(i = 0; i != bands.count; ++i) lodepng_free(bands.out[i].data);
+  }
+  lodepng_free(bands.out);
+  lodepng_free(bands.adler);
+  lodepng_free(bands.error);
+  return error;
+}
+
 unsigned lodepng_zlib_compress(unsigned char** out, size_t* outsize, const unsigned char* in,
                                size_t insize, const LodePNGCompressSettings* settings) {
   size_t i;
   unsigned error;
   unsigned char* deflatedata = 0;
   size_t deflatesize = 0;
+  unsigned ADLER32 = 0;
+  unsigned parallel = settings->parallel_for && !settings->custom_deflate && insize > LODEPNG_BAND_SIZE;
 
-  error = deflate(&deflatedata, &deflatesize, in, insize, settings);
+  if(parallel) error = deflateParallel(&deflatedata, &deflatesize, &ADLER32, in, insize, settings);
+  else error = deflate(&deflatedata, &deflatesize, in, insize, settings);
 
   *out = NULL;
   *outsize = 0;
@@ -2252,7 +3183,6 @@ unsigned lodepng_zlib_compress(unsigned char** out, size_t* outsize, const unsig
   }
 
   if(!error) {
-    unsigned ADLER32 = adler32(in, (unsigned)insize);
     /*zlib data: 1 byte CMF (CM+CINFO), 1 byte FLG, deflate data, 4 byte ADLER32 checksum of the Decompressed data*/
     unsigned CMF = 120; /*0b01111000: CM 8, CINFO 7. With CINFO 7, any window size up to 32768 can be used.*/
     unsigned FLEVEL = 0;
@@ -2260,6 +3190,7 @@ unsigned lodepng_zlib_compress(unsigned char** out, size_t* outsize, const unsig
     unsigned CMFFLG = 256 * CMF + FDICT * 32 + FLEVEL * 64;
     unsigned FCHECK = 31 - CMFFLG % 31;
     CMFFLG += FCHECK;
+    if(!parallel) ADLER32 = adler32(in, (unsigned)insize);
 
     (*out)[0] = (unsigned char)(CMFFLG >> 8);
     (*out)[1] = (unsigned char)(CMFFLG & 255);
@@ -2318,13 +3249,16 @@ void lodepng_compress_settings_init(LodePNGCompressSettings* settings) {
   settings->minmatch = 3;
   settings->nicematch = 128;
   settings->lazymatching = 1;
+  settings->level = -1;
+  settings->parallel_for = 0;
+  settings->parallel_context = 0;
 
   settings->custom_zlib = 0;
   settings->custom_deflate = 0;
   settings->custom_context = 0;
 }
 
-const LodePNGCompressSettings lodepng_default_compress_settings = {2, 1, DEFAULT_WINDOWSIZE, 3, 128, 1, 0, 0, 0};
+const LodePNGCompressSettings lodepng_default_compress_settings = {2, 1, DEFAULT_WINDOWSIZE, 3, 128, 1, -1, 0, 0, 0, 0, 0};
 
 
 #endif /*LODEPNG_COMPILE_ENCODER*/
@@ -2359,47 +3293,379 @@ const LodePNGDecompressSettings lodepng_default_decompress_settings = {0, 0, 0,
 
 #ifndef LODEPNG_NO_COMPILE_CRC
 /* CRC polynomial: 0xedb88320 */
-static unsigned lodepng_crc32_table[256] = {
-           0u, 1996959894u, 3993919788u, 2567524794u,  124634137u, 1886057615u, 3915621685u, 2657392035u,
-   249268274u, 2044508324u, 3772115230u, 2547177864u,  162941995u, 2125561021u, 3887607047u, 2428444049u,
-   498536548u, 1789927666u, 4089016648u, 2227061214u,  450548861u, 1843258603u, 4107580753u, 2211677639u,
-   325883990u, 1684777152u, 4251122042u, 2321926636u,  335633487u, 1661365465u, 4195302755u, 2366115317u,
-   997073096u, 1281953886u, 3579855332u, 2724688242u, 1006888145u, 1258607687u, 3524101629u, 2768942443u,
-   901097722u, 1119000684u, 3686517206u, 2898065728u,  853044451u, 1172266101u, 3705015759u, 2882616665u,
-   651767980u, 1373503546u, 3369554304u, 3218104598u,  565507253u, 1454621731u, 3485111705u, 3099436303u,
-   671266974u, 1594198024u, 3322730930u, 2970347812u,  795835527u, 1483230225u, 3244367275u, 3060149565u,
-  1994146192u,   31158534u, 2563907772u, 4023717930u, 1907459465u,  112637215u, 2680153253u, 3904427059u,
-  2013776290u,  251722036u, 2517215374u, 3775830040u, 2137656763u,  141376813u, 2439277719u, 3865271297u,
-  1802195444u,  476864866u, 2238001368u, 4066508878u, 1812370925u,  453092731u, 2181625025u, 4111451223u,
-  1706088902u,  314042704u, 2344532202u, 4240017532u, 1658658271u,  366619977u, 2362670323u, 4224994405u,
-  1303535960u,  984961486u, 2747007092u, 3569037538u, 1256170817u, 1037604311u, 2765210733u, 3554079995u,
-  1131014506u,  879679996u, 2909243462u, 3663771856u, 1141124467u,  855842277u, 2852801631u, 3708648649u,
-  1342533948u,  654459306u, 3188396048u, 3373015174u, 1466479909u,  544179635u, 3110523913u, 3462522015u,
-  1591671054u,  702138776u, 2966460450u, 3352799412u, 1504918807u,  783551873u, 3082640443u, 3233442989u,
-  3988292384u, 2596254646u,   62317068u, 1957810842u, 3939845945u, 2647816111u,   81470997u, 1943803523u,
-  3814918930u, 2489596804u,  225274430u, 2053790376u, 3826175755u, 2466906013u,  167816743u, 2097651377u,
-  4027552580u, 2265490386u,  503444072u, 1762050814u, 4150417245u, 2154129355u,  426522225u, 1852507879u,
-  4275313526u, 2312317920u,  282753626u, 1742555852u, 4189708143u, 2394877945u,  397917763u, 1622183637u,
-  3604390888u, 2714866558u,  953729732u, 1340076626u, 3518719985u, 2797360999u, 1068828381u, 1219638859u,
-  3624741850u, 2936675148u,  906185462u, 1090812512u, 3747672003u, 2825379669u,  829329135u, 1181335161u,
-  3412177804u, 3160834842u,  628085408u, 1382605366u, 3423369109u, 3138078467u,  570562233u, 1426400815u,
-  3317316542u, 2998733608u,  733239954u, 1555261956u, 3268935591u, 3050360625u,  752459403u, 1541320221u,
-  2607071920u, 3965973030u, 1969922972u,   40735498u, 2617837225u, 3943577151u, 1913087877u,   83908371u,
-  2512341634u, 3803740692u, 2075208622u,  213261112u, 2463272603u, 3855990285u, 2094854071u,  198958881u,
-  2262029012u, 4057260610u, 1759359992u,  534414190u, 2176718541u, 4139329115u, 1873836001u,  414664567u,
-  2282248934u, 4279200368u, 1711684554u,  285281116u, 2405801727u, 4167216745u, 1634467795u,  376229701u,
-  2685067896u, 3608007406u, 1308918612u,  956543938u, 2808555105u, 3495958263u, 1231636301u, 1047427035u,
-  2932959818u, 3654703836u, 1088359270u,  936918000u, 2847714899u, 3736837829u, 1202900863u,  817233897u,
-  3183342108u, 3401237130u, 1404277552u,  615818150u, 3134207493u, 3453421203u, 1423857449u,  601450431u,
-  3009837614u, 3294710456u, 1567103746u,  711928724u, 3020668471u, 3272380065u, 1510334235u,  755167117u
+static unsigned lodepng_crc32_table[8][256] = {
+  {
+             0u, 1996959894u, 3993919788u, 2567524794u,  124634137u, 1886057615u, 3915621685u, 2657392035u,
+     249268274u, 2044508324u, 3772115230u, 2547177864u,  162941995u, 2125561021u, 3887607047u, 2428444049u,
+     498536548u, 1789927666u, 4089016648u, 2227061214u,  450548861u, 1843258603u, 4107580753u, 2211677639u,
+     325883990u, 1684777152u, 4251122042u, 2321926636u,  335633487u, 1661365465u, 4195302755u, 2366115317u,
+     997073096u, 1281953886u, 3579855332u, 2724688242u, 1006888145u, 1258607687u, 3524101629u, 2768942443u,
+     901097722u, 1119000684u, 3686517206u, 2898065728u,  853044451u, 1172266101u, 3705015759u, 2882616665u,
+     651767980u, 1373503546u, 3369554304u, 3218104598u,  565507253u, 1454621731u, 3485111705u, 3099436303u,
+     671266974u, 1594198024u, 3322730930u, 2970347812u,  795835527u, 1483230225u, 3244367275u, 3060149565u,
+    1994146192u,   31158534u, 2563907772u, 4023717930u, 1907459465u,  112637215u, 2680153253u, 3904427059u,
+    2013776290u,  251722036u, 2517215374u, 3775830040u, 2137656763u,  141376813u, 2439277719u, 3865271297u,
+    1802195444u,  476864866u, 2238001368u, 4066508878u, 1812370925u,  453092731u, 2181625025u, 4111451223u,
+    1706088902u,  314042704u, 2344532202u, 4240017532u, 1658658271u,  366619977u, 2362670323u, 4224994405u,
+    1303535960u,  984961486u, 2747007092u, 3569037538u, 1256170817u, 1037604311u, 2765210733u, 3554079995u,
+    1131014506u,  879679996u, 2909243462u, 3663771856u, 1141124467u,  855842277u, 2852801631u, 3708648649u,
+    1342533948u,  654459306u, 3188396048u, 3373015174u, 1466479909u,  544179635u, 3110523913u, 3462522015u,
+    1591671054u,  702138776u, 2966460450u, 3352799412u, 1504918807u,  783551873u, 3082640443u, 3233442989u,
+    3988292384u, 2596254646u,   62317068u, 1957810842u, 3939845945u, 2647816111u,   81470997u, 1943803523u,
+    3814918930u, 2489596804u,  225274430u, 2053790376u, 3826175755u, 2466906013u,  167816743u, 2097651377u,
+    4027552580u, 2265490386u,  503444072u, 1762050814u, 4150417245u, 2154129355u,  426522225u, 1852507879u,
+    4275313526u, 2312317920u,  282753626u, 1742555852u, 4189708143u, 2394877945u,  397917763u, 1622183637u,
+    3604390888u, 2714866558u,  953729732u, 1340076626u, 3518719985u, 2797360999u, 1068828381u, 1219638859u,
+    3624741850u, 2936675148u,  906185462u, 1090812512u, 3747672003u, 2825379669u,  829329135u, 1181335161u,
+    3412177804u, 3160834842u,  628085408u, 1382605366u, 3423369109u, 3138078467u,  570562233u, 1426400815u,
+    3317316542u, 2998733608u,  733239954u, 1555261956u, 3268935591u, 3050360625u,  752459403u, 1541320221u,
+    2607071920u, 3965973030u, 1969922972u,   40735498u, 2617837225u, 3943577151u, 1913087877u,   83908371u,
+    2512341634u, 3803740692u, 2075208622u,  213261112u, 2463272603u, 3855990285u, 2094854071u,  198958881u,
+    2262029012u, 4057260610u, 1759359992u,  534414190u, 2176718541u, 4139329115u, 1873836001u,  414664567u,
+    2282248934u, 4279200368u, 1711684554u,  285281116u, 2405801727u, 4167216745u, 1634467795u,  376229701u,
+    2685067896u, 3608007406u, 1308918612u,  956543938u, 2808555105u, 3495958263u, 1231636301u, 1047427035u,
+    2932959818u, 3654703836u, 1088359270u,  936918000u, 2847714899u, 3736837829u, 1202900863u,  817233897u,
+    3183342108u, 3401237130u, 1404277552u,  615818150u, 3134207493u, 3453421203u, 1423857449u,  601450431u,
+    3009837614u, 3294710456u, 1567103746u,  711928724u, 3020668471u, 3272380065u, 1510334235u,  755167117u
+  },
+  {
+             0u,  421212481u,  842424962u,  724390851u, 1684849924u, 2105013317u, 1448781702u, 1329698503u,
+    3369699848u, 3519200073u, 4210026634u, 3824474571u, 2897563404u, 3048111693u, 2659397006u, 2274893007u,
+    1254232657u, 1406739216u, 2029285587u, 1643069842u,  783210325u,  934667796u,  479770071u,   92505238u,
+    2182846553u, 2600511768u, 2955803355u, 2838940570u, 3866582365u, 4285295644u, 3561045983u, 3445231262u,
+    2508465314u, 2359236067u, 2813478432u, 3198777185u, 4058571174u, 3908292839u, 3286139684u, 3670389349u,
+    1566420650u, 1145479147u, 1869335592u, 1987116393u,  959540142u,  539646703u,  185010476u,  303839341u,
+    3745920755u, 3327985586u, 3983561841u, 4100678960u, 3140154359u, 2721170102u, 2300350837u, 2416418868u,
+     396344571u,  243568058u,  631889529u, 1018359608u, 1945336319u, 1793607870u, 1103436669u, 1490954812u,
+    4034481925u, 3915546180u, 3259968903u, 3679722694u, 2484439553u, 2366552896u, 2787371139u, 3208174018u,
+     950060301u,  565965900u,  177645455u,  328046286u, 1556873225u, 1171730760u, 1861902987u, 2011255754u,
+    3132841300u, 2745199637u, 2290958294u, 2442530455u, 3738671184u, 3352078609u, 3974232786u, 4126854035u,
+    1919080284u, 1803150877u, 1079293406u, 1498383519u,  370020952u,  253043481u,  607678682u, 1025720731u,
+    1711106983u, 2095471334u, 1472923941u, 1322268772u,   26324643u,  411738082u,  866634785u,  717028704u,
+    2904875439u, 3024081134u, 2668790573u, 2248782444u, 3376948395u, 3495106026u, 4219356713u, 3798300520u,
+     792689142u,  908347575u,  487136116u,   68299317u, 1263779058u, 1380486579u, 2036719216u, 1618931505u,
+    3890672638u, 4278043327u, 3587215740u, 3435896893u, 2206873338u, 2593195963u, 2981909624u, 2829542713u,
+     998479947u,  580430090u,  162921161u,  279890824u, 1609522511u, 1190423566u, 1842954189u, 1958874764u,
+    4082766403u, 3930137346u, 3245109441u, 3631694208u, 2536953671u, 2385372678u, 2768287173u, 3155920004u,
+    1900120602u, 1750776667u, 1131931800u, 1517083097u,  355290910u,  204897887u,  656092572u, 1040194781u,
+    3113746450u, 2692952403u, 2343461520u, 2461357009u, 3723805974u, 3304059991u, 4022511508u, 4141455061u,
+    2919742697u, 3072101800u, 2620513899u, 2234183466u, 3396041197u, 3547351212u, 4166851439u, 3779471918u,
+    1725839073u, 2143618976u, 1424512099u, 1307796770u,   45282277u,  464110244u,  813994343u,  698327078u,
+    3838160568u, 4259225593u, 3606301754u, 3488152955u, 2158586812u, 2578602749u, 2996767038u, 2877569151u,
+     740041904u,  889656817u,  506086962u,  120682355u, 1215357364u, 1366020341u, 2051441462u, 1667084919u,
+    3422213966u, 3538019855u, 4190942668u, 3772220557u, 2945847882u, 3062702859u, 2644537544u, 2226864521u,
+      52649286u,  439905287u,  823476164u,  672009861u, 1733269570u, 2119477507u, 1434057408u, 1281543041u,
+    2167981343u, 2552493150u, 3004082077u, 2853541596u, 3847487515u, 4233048410u, 3613549209u, 3464057816u,
+    1239502615u, 1358593622u, 2077699477u, 1657543892u,  764250643u,  882293586u,  532408465u,  111204816u,
+    1585378284u, 1197851309u, 1816695150u, 1968414767u,  974272232u,  587794345u,  136598634u,  289367339u,
+    2527558116u, 2411481253u, 2760973158u, 3179948583u, 4073438432u, 3956313505u, 3237863010u, 3655790371u,
+     347922877u,  229101820u,  646611775u, 1066513022u, 1892689081u, 1774917112u, 1122387515u, 1543337850u,
+    3697634229u, 3313392372u, 3998419255u, 4148705398u, 3087642289u, 2702352368u, 2319436851u, 2468674930u
+  },
+  {
+             0u,   29518391u,   59036782u,   38190681u,  118073564u,  114017003u,   76381362u,   89069189u,
+     236147128u,  265370511u,  228034006u,  206958561u,  152762724u,  148411219u,  178138378u,  190596925u,
+     472294256u,  501532999u,  530741022u,  509615401u,  456068012u,  451764635u,  413917122u,  426358261u,
+     305525448u,  334993663u,  296822438u,  275991697u,  356276756u,  352202787u,  381193850u,  393929805u,
+     944588512u,  965684439u, 1003065998u,  973863097u, 1061482044u, 1049003019u, 1019230802u, 1023561829u,
+     912136024u,  933002607u,  903529270u,  874031361u,  827834244u,  815125939u,  852716522u,  856752605u,
+     611050896u,  631869351u,  669987326u,  640506825u,  593644876u,  580921211u,  551983394u,  556069653u,
+     712553512u,  733666847u,  704405574u,  675154545u,  762387700u,  749958851u,  787859610u,  792175277u,
+    1889177024u, 1901651959u, 1931368878u, 1927033753u, 2006131996u, 1985040171u, 1947726194u, 1976933189u,
+    2122964088u, 2135668303u, 2098006038u, 2093965857u, 2038461604u, 2017599123u, 2047123658u, 2076625661u,
+    1824272048u, 1836991623u, 1866005214u, 1861914857u, 1807058540u, 1786244187u, 1748062722u, 1777547317u,
+    1655668488u, 1668093247u, 1630251878u, 1625932113u, 1705433044u, 1684323811u, 1713505210u, 1742760333u,
+    1222101792u, 1226154263u, 1263738702u, 1251046777u, 1339974652u, 1310460363u, 1281013650u, 1301863845u,
+    1187289752u, 1191637167u, 1161842422u, 1149379777u, 1103966788u, 1074747507u, 1112139306u, 1133218845u,
+    1425107024u, 1429406311u, 1467333694u, 1454888457u, 1408811148u, 1379576507u, 1350309090u, 1371438805u,
+    1524775400u, 1528845279u, 1499917702u, 1487177649u, 1575719220u, 1546255107u, 1584350554u, 1605185389u,
+    3778354048u, 3774312887u, 3803303918u, 3816007129u, 3862737756u, 3892238699u, 3854067506u, 3833203973u,
+    4012263992u, 4007927823u, 3970080342u, 3982554209u, 3895452388u, 3924658387u, 3953866378u, 3932773565u,
+    4245928176u, 4241609415u, 4271336606u, 4283762345u, 4196012076u, 4225268251u, 4187931714u, 4166823541u,
+    4076923208u, 4072833919u, 4035198246u, 4047918865u, 4094247316u, 4123732899u, 4153251322u, 4132437965u,
+    3648544096u, 3636082519u, 3673983246u, 3678331705u, 3732010428u, 3753090955u, 3723829714u, 3694611429u,
+    3614117080u, 3601426159u, 3572488374u, 3576541825u, 3496125444u, 3516976691u, 3555094634u, 3525581405u,
+    3311336976u, 3298595879u, 3336186494u, 3340255305u, 3260503756u, 3281337595u, 3251864226u, 3222399125u,
+    3410866088u, 3398419871u, 3368647622u, 3372945905u, 3427010420u, 3448139075u, 3485520666u, 3456284973u,
+    2444203584u, 2423127159u, 2452308526u, 2481530905u, 2527477404u, 2539934891u, 2502093554u, 2497740997u,
+    2679949304u, 2659102159u, 2620920726u, 2650438049u, 2562027300u, 2574714131u, 2603727690u, 2599670141u,
+    2374579504u, 2353749767u, 2383274334u, 2412743529u, 2323684844u, 2336421851u, 2298759554u, 2294686645u,
+    2207933576u, 2186809023u, 2149495014u, 2178734801u, 2224278612u, 2236720739u, 2266437690u, 2262135309u,
+    2850214048u, 2820717207u, 2858812622u, 2879680249u, 2934667388u, 2938704459u, 2909776914u, 2897069605u,
+    2817622296u, 2788420399u, 2759153014u, 2780249921u, 2700618180u, 2704950259u, 2742877610u, 2730399645u,
+    3049550800u, 3020298727u, 3057690558u, 3078802825u, 2999835404u, 3004150075u, 2974355298u, 2961925461u,
+    3151438440u, 3121956959u, 3092510214u, 3113327665u, 3168701108u, 3172786307u, 3210370778u, 3197646061u
+  },
+  {
+             0u, 3099354981u, 2852767883u,  313896942u, 2405603159u,  937357362u,  627793884u, 2648127673u,
+    3316918511u, 2097696650u, 1874714724u, 3607201537u, 1255587768u, 4067088605u, 3772741427u, 1482887254u,
+    1343838111u, 3903140090u, 4195393300u, 1118632049u, 3749429448u, 1741137837u, 1970407491u, 3452858150u,
+    2511175536u,  756094997u, 1067759611u, 2266550430u,  449832999u, 2725482306u, 2965774508u,  142231497u,
+    2687676222u,  412010587u,  171665333u, 2995192016u,  793786473u, 2548850444u, 2237264098u, 1038456711u,
+    1703315409u, 3711623348u, 3482275674u, 1999841343u, 3940814982u, 1381529571u, 1089329165u, 4166106984u,
+    4029413537u, 1217896388u, 1512189994u, 3802027855u, 2135519222u, 3354724499u, 3577784189u, 1845280792u,
+     899665998u, 2367928107u, 2677414085u,  657096608u, 3137160985u,   37822588u,  284462994u, 2823350519u,
+    2601801789u,  598228824u,  824021174u, 2309093331u,  343330666u, 2898962447u, 3195996129u,  113467524u,
+    1587572946u, 3860600759u, 4104763481u, 1276501820u, 3519211397u, 1769898208u, 2076913422u, 3279374443u,
+    3406630818u, 1941006535u, 1627703081u, 3652755532u, 1148164341u, 4241751952u, 3999682686u, 1457141531u,
+     247015245u, 3053797416u, 2763059142u,  470583459u, 2178658330u,  963106687u,  735213713u, 2473467892u,
+     992409347u, 2207944806u, 2435792776u,  697522413u, 3024379988u,  217581361u,  508405983u, 2800865210u,
+    4271038444u, 1177467017u, 1419450215u, 3962007554u, 1911572667u, 3377213406u, 3690561584u, 1665525589u,
+    1799331996u, 3548628985u, 3241568279u, 2039091058u, 3831314379u, 1558270126u, 1314193216u, 4142438437u,
+    2928380019u,  372764438u,   75645176u, 3158189981u,  568925988u, 2572515393u, 2346768303u,  861712586u,
+    3982079547u, 1441124702u, 1196457648u, 4293663189u, 1648042348u, 3666298377u, 3358779879u, 1888390786u,
+     686661332u, 2421291441u, 2196002399u,  978858298u, 2811169155u,  523464422u,  226935048u, 3040519789u,
+    3175145892u,  100435649u,  390670639u, 2952089162u,  841119475u, 2325614998u, 2553003640u,  546822429u,
+    2029308235u, 3225988654u, 3539796416u, 1782671013u, 4153826844u, 1328167289u, 1570739863u, 3844338162u,
+    1298864389u, 4124540512u, 3882013070u, 1608431339u, 3255406162u, 2058742071u, 1744848601u, 3501990332u,
+    2296328682u,  811816591u,  584513889u, 2590678532u,  129869501u, 3204563416u, 2914283062u,  352848211u,
+     494030490u, 2781751807u, 3078325777u,  264757620u, 2450577869u,  715964072u,  941166918u, 2158327331u,
+    3636881013u, 1618608400u, 1926213374u, 3396585883u, 1470427426u, 4011365959u, 4255988137u, 1158766284u,
+    1984818694u, 3471935843u, 3695453837u, 1693991400u, 4180638033u, 1100160564u, 1395044826u, 3952793279u,
+    3019491049u,  189112716u,  435162722u, 2706139399u, 1016811966u, 2217162459u, 2526189877u,  774831696u,
+     643086745u, 2666061564u, 2354934034u,  887166583u, 2838900430u,  294275499u,   54519365u, 3145957664u,
+    3823145334u, 1532818963u, 1240029693u, 4048895640u, 1820460577u, 3560857924u, 3331051178u, 2117577167u,
+    3598663992u, 1858283101u, 2088143283u, 3301633750u, 1495127663u, 3785470218u, 4078182116u, 1269332353u,
+     332098007u, 2876706482u, 3116540252u,   25085497u, 2628386432u,  605395429u,  916469259u, 2384220526u,
+    2254837415u, 1054503362u,  745528876u, 2496903497u,  151290352u, 2981684885u, 2735556987u,  464596510u,
+    1137851976u, 4218313005u, 3923506883u, 1365741990u, 3434129695u, 1946996346u, 1723425172u, 3724871409u
+  },
+  {
+             0u, 1029712304u, 2059424608u, 1201699536u, 4118849216u, 3370159984u, 2403399072u, 2988497936u,
+     812665793u,  219177585u, 1253054625u, 2010132753u, 3320900865u, 4170237105u, 3207642721u, 2186319825u,
+    1625331586u, 1568718386u,  438355170u,  658566482u, 2506109250u, 2818578674u, 4020265506u, 3535817618u,
+    1351670851u, 1844508147u,  709922595u,  389064339u, 2769320579u, 2557498163u, 3754961379u, 3803185235u,
+    3250663172u, 4238411444u, 3137436772u, 2254525908u,  876710340u,  153198708u, 1317132964u, 1944187668u,
+    4054934725u, 3436268917u, 2339452837u, 3054575125u,   70369797u,  961670069u, 2129760613u, 1133623509u,
+    2703341702u, 2621542710u, 3689016294u, 3867263574u, 1419845190u, 1774270454u,  778128678u,  318858390u,
+    2438067015u, 2888948471u, 3952189479u, 3606153623u, 1691440519u, 1504803895u,  504432359u,  594620247u,
+    1492342857u, 1704161785u,  573770537u,  525542041u, 2910060169u, 2417219385u, 3618876905u, 3939730521u,
+    1753420680u, 1440954936u,  306397416u,  790849880u, 2634265928u, 2690882808u, 3888375336u, 3668168600u,
+     940822475u,   91481723u, 1121164459u, 2142483739u, 3448989963u, 4042473659u, 3075684971u, 2318603227u,
+     140739594u,  889433530u, 1923340138u, 1338244826u, 4259521226u, 3229813626u, 2267247018u, 3124975642u,
+    2570221389u, 2756861693u, 3824297005u, 3734113693u, 1823658381u, 1372780605u,  376603373u,  722643805u,
+    2839690380u, 2485261628u, 3548540908u, 4007806556u, 1556257356u, 1638052860u,  637716780u,  459464860u,
+    4191346895u, 3300051327u, 2199040943u, 3195181599u,  206718479u,  825388991u, 1989285231u, 1274166495u,
+    3382881038u, 4106388158u, 3009607790u, 2382549470u, 1008864718u,   21111934u, 1189240494u, 2072147742u,
+    2984685714u, 2357631266u, 3408323570u, 4131834434u, 1147541074u, 2030452706u, 1051084082u,   63335554u,
+    2174155603u, 3170292451u, 4216760371u, 3325460867u, 1947622803u, 1232499747u,  248909555u,  867575619u,
+    3506841360u, 3966111392u, 2881909872u, 2527485376u,  612794832u,  434546784u, 1581699760u, 1663499008u,
+    3782634705u, 3692447073u, 2612412337u, 2799048193u,  351717905u,  697754529u, 1849071985u, 1398190273u,
+    1881644950u, 1296545318u,  182963446u,  931652934u, 2242328918u, 3100053734u, 4284967478u, 3255255942u,
+    1079497815u, 2100821479u,  983009079u,  133672583u, 3050795671u, 2293717799u, 3474399735u, 4067887175u,
+     281479188u,  765927844u, 1778867060u, 1466397380u, 3846680276u, 3626469220u, 2676489652u, 2733102084u,
+     548881365u,  500656741u, 1517752501u, 1729575173u, 3577210133u, 3898068133u, 2952246901u, 2459410373u,
+    3910527195u, 3564487019u, 2480257979u, 2931134987u,  479546907u,  569730987u, 1716854139u, 1530213579u,
+    3647316762u, 3825568426u, 2745561210u, 2663766474u,  753206746u,  293940330u, 1445287610u, 1799716618u,
+    2314567513u, 3029685993u, 4080348217u, 3461678473u, 2088098201u, 1091956777u,  112560889u, 1003856713u,
+    3112514712u, 2229607720u, 3276105720u, 4263857736u, 1275433560u, 1902492648u,  918929720u,  195422344u,
+     685033439u,  364179055u, 1377080511u, 1869921551u, 3713294623u, 3761522863u, 2811507327u, 2599689167u,
+     413436958u,  633644462u, 1650777982u, 1594160846u, 3978570462u, 3494118254u, 2548332990u, 2860797966u,
+    1211387997u, 1968470509u,  854852413u,  261368461u, 3182753437u, 2161434413u, 3346310653u, 4195650637u,
+    2017729436u, 1160000044u,   42223868u, 1071931724u, 2378480988u, 2963576044u, 4144295484u, 3395602316u
+  },
+  {
+             0u, 3411858341u, 1304994059u, 2257875630u, 2609988118u, 1355649459u, 3596215069u,  486879416u,
+    3964895853u,  655315400u, 2711298918u, 1791488195u, 2009251963u, 3164476382u,  973758832u, 4048990933u,
+      64357019u, 3364540734u, 1310630800u, 2235723829u, 2554806413u, 1394316072u, 3582976390u,  517157411u,
+    4018503926u,  618222419u, 2722963965u, 1762783832u, 1947517664u, 3209171269u,  970744811u, 4068520014u,
+     128714038u, 3438335635u, 1248109629u, 2167961496u, 2621261600u, 1466012805u, 3522553387u,  447296910u,
+    3959392091u,  547575038u, 2788632144u, 1835791861u, 1886307661u, 3140622056u, 1034314822u, 4143626211u,
+      75106221u, 3475428360u, 1236444838u, 2196665603u, 2682996155u, 1421317662u, 3525567664u,  427767573u,
+    3895035328u,  594892389u, 2782995659u, 1857943406u, 1941489622u, 3101955187u, 1047553757u, 4113347960u,
+     257428076u, 3288652233u, 1116777319u, 2311878850u, 2496219258u, 1603640287u, 3640781169u,  308099796u,
+    3809183745u,  676813732u, 2932025610u, 1704983215u, 2023410199u, 3016104370u,  894593820u, 4262377657u,
+     210634999u, 3352484690u, 1095150076u, 2316991065u, 2535410401u, 1547934020u, 3671583722u,  294336591u,
+    3772615322u,  729897279u, 2903845777u, 1716123700u, 2068629644u, 2953845545u,  914647431u, 4258839074u,
+     150212442u, 3282623743u, 1161604689u, 2388688372u, 2472889676u, 1480171241u, 3735940167u,  368132066u,
+    3836185911u,  805002898u, 2842635324u, 1647574937u, 2134298401u, 3026852996u,  855535146u, 4188192143u,
+     186781121u, 3229539940u, 1189784778u, 2377547631u, 2427670487u, 1542429810u, 3715886812u,  371670393u,
+    3882979244u,  741170185u, 2864262823u, 1642462466u, 2095107514u, 3082559007u,  824732849u, 4201955092u,
+     514856152u, 3589064573u, 1400419795u, 2552522358u, 2233554638u, 1316849003u, 3370776517u,   62202976u,
+    4075001525u,  968836368u, 3207280574u, 1954014235u, 1769133219u, 2720925446u,  616199592u, 4024870413u,
+     493229635u, 3594175974u, 1353627464u, 2616354029u, 2264355925u, 1303087088u, 3409966430u,    6498043u,
+    4046820398u,  979978123u, 3170710821u, 2007099008u, 1789187640u, 2717386141u,  661419827u, 3962610838u,
+     421269998u, 3527459403u, 1423225061u, 2676515648u, 2190300152u, 1238466653u, 3477467891u,   68755798u,
+    4115633027u, 1041448998u, 3095868040u, 1943789869u, 1860096405u, 2776760880u,  588673182u, 3897205563u,
+     449450869u, 3516317904u, 1459794558u, 2623431131u, 2170245475u, 1242006214u, 3432247400u,  131015629u,
+    4137259288u, 1036337853u, 3142660115u, 1879958454u, 1829294862u, 2790523051u,  549483013u, 3952910752u,
+     300424884u, 3669282065u, 1545650111u, 2541513754u, 2323209378u, 1092980487u, 3350330793u,  216870412u,
+    4256931033u,  921128828u, 2960342482u, 2066738807u, 1714085583u, 2910195050u,  736264132u, 3770592353u,
+     306060335u, 3647131530u, 1610005796u, 2494197377u, 2309971513u, 1123257756u, 3295149874u,  255536279u,
+    4268596802u,  892423655u, 3013951305u, 2029645036u, 1711070292u, 2929725425u,  674528607u, 3815288570u,
+     373562242u, 3709388839u, 1535949449u, 2429577516u, 2379569556u, 1183418929u, 3223189663u,  188820282u,
+    4195850735u,  827017802u, 3084859620u, 2089020225u, 1636228089u, 2866415708u,  743340786u, 3876759895u,
+     361896217u, 3738094268u, 1482340370u, 2466671543u, 2382584591u, 1163888810u, 3284924932u,  144124321u,
+    4190215028u,  849168593u, 3020503679u, 2136336858u, 1649465698u, 2836138695u,  798521449u, 3838094284u
+  },
+  {
+             0u, 2792819636u, 2543784233u,  837294749u, 4098827283u, 1379413927u, 1674589498u, 3316072078u,
+     871321191u, 2509784531u, 2758827854u,   34034938u, 3349178996u, 1641505216u, 1346337629u, 4131942633u,
+    1742642382u, 3249117050u, 4030828007u, 1446413907u, 2475800797u,  904311657u,   68069876u, 2725880384u,
+    1412551337u, 4064729373u, 3283010432u, 1708771380u, 2692675258u,  101317902u,  937551763u, 2442587175u,
+    3485284764u, 1774858792u, 1478633653u, 4266992385u, 1005723023u, 2642744891u, 2892827814u,  169477906u,
+    4233263099u, 1512406095u, 1808623314u, 3451546982u,  136139752u, 2926205020u, 2676114113u,  972376437u,
+    2825102674u,  236236518u, 1073525883u, 2576072655u, 1546420545u, 4200303349u, 3417542760u, 1841601500u,
+    2609703733u, 1039917185u,  202635804u, 2858742184u, 1875103526u, 3384067218u, 4166835727u, 1579931067u,
+    1141601657u, 3799809741u, 3549717584u, 1977839588u, 2957267306u,  372464350u,  668680259u, 2175552503u,
+    2011446046u, 3516084394u, 3766168119u, 1175200131u, 2209029901u,  635180217u,  338955812u, 2990736784u,
+     601221559u, 2242044419u, 3024812190u,  306049834u, 3617246628u, 1911408144u, 1074125965u, 3866285881u,
+     272279504u, 3058543716u, 2275784441u,  567459149u, 3832906691u, 1107462263u, 1944752874u, 3583875422u,
+    2343980261u,  767641425u,  472473036u, 3126744696u, 2147051766u, 3649987394u, 3899029983u, 1309766251u,
+    3092841090u,  506333494u,  801510315u, 2310084639u, 1276520081u, 3932237093u, 3683203000u, 2113813516u,
+    3966292011u, 1243601823u, 2079834370u, 3716205238u,  405271608u, 3192979340u, 2411259153u,  701492901u,
+    3750207052u, 2045810168u, 1209569125u, 4000285905u,  734575199u, 2378150379u, 3159862134u,  438345922u,
+    2283203314u,  778166598u,  529136603u, 3120492655u, 2086260449u, 3660498261u, 3955679176u, 1303499900u,
+    3153699989u,  495890209u,  744928700u, 2316418568u, 1337360518u, 3921775410u, 3626602927u, 2120129051u,
+    4022892092u, 1237286280u, 2018993941u, 3726666913u,  461853231u, 3186645403u, 2350400262u,  711936178u,
+    3693557851u, 2052076527u, 1270360434u, 3989775046u,  677911624u, 2384402428u, 3220639073u,  427820757u,
+    1202443118u, 3789347034u, 3493118535u, 1984154099u, 3018127229u,  362020041u,  612099668u, 2181885408u,
+    1950653705u, 3526596285u, 3822816288u, 1168934804u, 2148251930u,  645706414u,  395618355u, 2984485767u,
+     544559008u, 2248295444u, 3085590153u,  295523645u, 3560598451u, 1917673479u, 1134918298u, 3855773998u,
+     328860103u, 3052210803u, 2214924526u,  577903450u, 3889505748u, 1101147744u, 1883911421u, 3594338121u,
+    3424493451u, 1785369663u, 1535282850u, 4260726038u,  944946072u, 2653270060u, 2949491377u,  163225861u,
+    4294103532u, 1501944408u, 1752023237u, 3457862513u,  196998655u, 2915761739u, 2619532502u,  978710370u,
+    2881684293u,  229902577u, 1012666988u, 2586515928u, 1603020630u, 4193987810u, 3356702335u, 1852063179u,
+    2553040162u, 1046169238u,  263412747u, 2848217023u, 1818454321u, 3390333573u, 4227627032u, 1569420204u,
+      60859927u, 2782375331u, 2487203646u,  843627658u, 4159668740u, 1368951216u, 1617990445u, 3322386585u,
+     810543216u, 2520310724u, 2815490393u,   27783917u, 3288386659u, 1652017111u, 1402985802u, 4125677310u,
+    1685994201u, 3255382381u, 4091620336u, 1435902020u, 2419138250u,  910562686u,  128847843u, 2715354199u,
+    1469150398u, 4058414858u, 3222168983u, 1719234083u, 2749255853u,   94984985u,  876691844u, 2453031472u
+  },
+  {
+             0u, 3433693342u, 1109723005u, 2391738339u, 2219446010u, 1222643300u, 3329165703u,  180685081u,
+    3555007413u,  525277995u, 2445286600u, 1567235158u, 1471092047u, 2600801745u,  361370162u, 3642757804u,
+    2092642603u, 2953916853u, 1050555990u, 4063508168u, 4176560081u,  878395215u, 3134470316u, 1987983410u,
+    2942184094u, 1676945920u, 3984272867u,  567356797u,  722740324u, 3887998202u, 1764827929u, 2778407815u,
+    4185285206u,  903635656u, 3142804779u, 2012833205u, 2101111980u, 2979425330u, 1058630609u, 4088621903u,
+     714308067u, 3862526333u, 1756790430u, 2753330688u, 2933487385u, 1651734407u, 3975966820u,  542535930u,
+    2244825981u, 1231508451u, 3353891840u,  188896414u,   25648519u, 3442302233u, 1134713594u, 2399689316u,
+    1445480648u, 2592229462u,  336416693u, 3634843435u, 3529655858u,  516441772u, 2420588879u, 1559052753u,
+     698204909u, 3845636723u, 1807271312u, 2803025166u, 2916600855u, 1635634313u, 4025666410u,  593021940u,
+    4202223960u,  919787974u, 3093159461u, 1962401467u, 2117261218u, 2996361020u, 1008193759u, 4038971457u,
+    1428616134u, 2576151384u,  386135227u, 3685348389u, 3513580860u,  499580322u, 2471098945u, 1608776415u,
+    2260985971u, 1248454893u, 3303468814u,  139259792u,   42591881u, 3458459159u, 1085071860u, 2349261162u,
+    3505103035u,  474062885u, 2463016902u, 1583654744u, 1419882049u, 2550902495u,  377792828u, 3660491170u,
+      51297038u, 3483679632u, 1093385331u, 2374089965u, 2269427188u, 1273935210u, 3311514249u,  164344343u,
+    2890961296u, 1627033870u, 4000683757u,  585078387u,  672833386u, 3836780532u, 1782552599u, 2794821769u,
+    2142603813u, 3005188795u, 1032883544u, 4047146438u, 4227826911u,  928351297u, 3118105506u, 1970307900u,
+    1396409818u, 2677114180u,  287212199u, 3719594553u, 3614542624u,  467372990u, 2505346141u, 1509854403u,
+    2162073199u, 1282711281u, 3271268626u,  240228748u,   76845205u, 3359543307u, 1186043880u, 2317064054u,
+     796964081u, 3811226735u, 1839575948u, 2702160658u, 2882189835u, 1734392469u, 3924802934u,  625327592u,
+    4234522436u,  818917338u, 3191908409u, 1927981223u, 2016387518u, 3028656416u,  973776579u, 4137723485u,
+    2857232268u, 1726474002u, 3899187441u,  616751215u,  772270454u, 3803048424u, 1814228491u, 2693328533u,
+    2041117753u, 3036871847u,  999160644u, 4146592730u, 4259508931u,  826864221u, 3217552830u, 1936586016u,
+    3606501031u,  442291769u, 2496909786u, 1484378436u, 1388107869u, 2652297411u,  278519584u, 3694387134u,
+      85183762u, 3384397196u, 1194773103u, 2342308593u, 2170143720u, 1307820918u, 3279733909u,  265733131u,
+    2057717559u, 3054258089u,  948125770u, 4096344276u, 4276898253u,  843467091u, 3167309488u, 1885556270u,
+    2839764098u, 1709792284u, 3949353983u,  667704161u,  755585656u, 3785577190u, 1865176325u, 2743489947u,
+     102594076u, 3401021058u, 1144549729u, 2291298815u, 2186770662u, 1325234296u, 3228729243u,  215514885u,
+    3589828009u,  424832311u, 2547870420u, 1534552650u, 1370645331u, 2635621325u,  328688686u, 3745342640u,
+    2211456353u, 1333405183u, 3254067740u,  224338562u,  127544219u, 3408931589u, 1170156774u, 2299866232u,
+    1345666772u, 2627681866u,  303053225u, 3736746295u, 3565105198u,  416624816u, 2522494803u, 1525692365u,
+    4285207626u,  868291796u, 3176010551u, 1910772649u, 2065767088u, 3079346734u,  956571085u, 4121828691u,
+     747507711u, 3760459617u, 1856702594u, 2717976604u, 2831417605u, 1684930971u, 3940615800u,  642451174u
+  }
 };
 
+#if defined(LODEPNG_COMPILE_SIMD) && defined(LODEPNG_SIMD_DISPATCH)
+/*Whether the CPU has PCLMULQDQ (carry-less multiply). Cheap with gcc and clang, which read
+a table filled at startup, a cpuid with Visual Studio, so only asked for longer buffers.*/
+static unsigned lodepng_cpu_pclmul(void) {
+#if defined(_MSC_VER)
+  int info[4];
+  __cpuid(info, 1);
+  return (info[2] >> 1) & 1;
+#else
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("pclmul") != 0;
+#endif
+}
+
+/*
+CRC of a multiple of 16 bytes, at least 64, starting from the inverted CRC r. Folds 4 lanes of
+128 bits with carry-less multiplies, then reduces them to 32 bits, after "Fast CRC Computation
+for Generic Polynomials Using PCLMULQDQ Instruction" (Intel, 2009). The constants are x^(k) mod P
+for the bit reflected polynomial 0xedb88320, split in 32-bit halves since C90 has no 64-bit type.
+*/
+LODEPNG_TARGET("pclmul") static unsigned crc32PCLMUL(unsigned r, const unsigned char* data, size_t length) {
+  const __m128i k1k2 = _mm_setr_epi32(0x54442bd4, 1, (int)0xc6e41596u, 1);
+  const __m128i k3k4 = _mm_setr_epi32(0x751997d0, 1, (int)0xccaa009eu, 0);
+  const __m128i k5 = _mm_setr_epi32(0x63cd6124, 1, 0, 0);
+  const __m128i poly = _mm_setr_epi32((int)0xdb710641u, 1, (int)0xf7011641u, 1);
+  const __m128i low32 = _mm_setr_epi32(-1, 0, -1, 0);
+  __m128i x0 = _mm_loadu_si128((const __m128i*)(data + 0));
+  __m128i x1 = _mm_loadu_si128((const __m128i*)(data + 16));
+  __m128i x2 = _mm_loadu_si128((const __m128i*)(data + 32));
+  __m128i x3 = _mm_loadu_si128((const __m128i*)(data + 48));
+  __m128i t;
+  x0 = _mm_xor_si128(x0, _mm_cvtsi32_si128((int)r));
+  data += 64;
+  length -= 64;
+  /*4 independent lanes, each folded 512 bits forward per round*/
+  while(length >= 64) {
+    __m128i t0 = _mm_clmulepi64_si128(x0, k1k2, 0x00), t1 = _mm_clmulepi64_si128(x1, k1k2, 0x00);
+    __m128i t2 = _mm_clmulepi64_si128(x2, k1k2, 0x00), t3 = _mm_clmulepi64_si128(x3, k1k2, 0x00);
+    x0 = _mm_xor_si128(_mm_clmulepi64_si128(x0, k1k2, 0x11), t0);
+    x1 = _mm_xor_si128(_mm_clmulepi64_si128(x1, k1k2, 0x11), t1);
+    x2 = _mm_xor_si128(_mm_clmulepi64_si128(x2, k1k2, 0x11), t2);
+    x3 = _mm_xor_si128(_mm_clmulepi64_si128(x3, k1k2, 0x11), t3);
+    x0 = _mm_xor_si128(x0, _mm_loadu_si128((const __m128i*)(data + 0)));
+    x1 = _mm_xor_si128(x1, _mm_loadu_si128((const __m128i*)(data + 16)));
+    x2 = _mm_xor_si128(x2, _mm_loadu_si128((const __m128i*)(data + 32)));
+    x3 = _mm_xor_si128(x3, _mm_loadu_si128((const __m128i*)(data + 48)));
+    data += 64;
+    length -= 64;
+  }
+  /*fold the lanes into one, then the remaining 16 byte blocks into it*/
+  t = _mm_clmulepi64_si128(x0, k3k4, 0x00);
+  x0 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x0, k3k4, 0x11), t), x1);
+  t = _mm_clmulepi64_si128(x0, k3k4, 0x00);
+  x0 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x0, k3k4, 0x11), t), x2);
+  t = _mm_clmulepi64_si128(x0, k3k4, 0x00);
+  x0 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x0, k3k4, 0x11), t), x3);
+  while(length >= 16) {
+    t = _mm_clmulepi64_si128(x0, k3k4, 0x00);
+    x0 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x0, k3k4, 0x11), t), _mm_loadu_si128((const __m128i*)data));
+    data += 16;
+    length -= 16;
+  }
+  /*128 to 64 bits*/
+  t = _mm_clmulepi64_si128(x0, k3k4, 0x10);
+  x0 = _mm_xor_si128(_mm_srli_si128(x0, 8), t);
+  t = _mm_srli_si128(x0, 4);
+  x0 = _mm_xor_si128(_mm_clmulepi64_si128(_mm_and_si128(x0, low32), k5, 0x00), t);
+  /*Barrett reduction to 32 bits*/
+  t = _mm_clmulepi64_si128(_mm_and_si128(x0, low32), poly, 0x10);
+  t = _mm_clmulepi64_si128(_mm_and_si128(t, low32), poly, 0x00);
+  x0 = _mm_xor_si128(x0, t);
+  return (unsigned)_mm_cvtsi128_si32(_mm_srli_si128(x0, 4));
+}
+#endif /*LODEPNG_COMPILE_SIMD && LODEPNG_SIMD_DISPATCH*/
+
 /*Return the CRC of the bytes buf[0..len-1].*/
 unsigned lodepng_crc32(const unsigned char* data, size_t length) {
   unsigned r = 0xffffffffu;
-  size_t i;
-  for(i = 0; i < length; ++i) {
-    r = lodepng_crc32_table[(r ^ data[i]) & 0xffu] ^ (r >> 8u);
+#if defined(LODEPNG_COMPILE_SIMD) && defined(LODEPNG_SIMD_DISPATCH)
+  if(length >= 256 && lodepng_cpu_pclmul()) {
+    size_t blocks = length & ~(size_t)15;
+    r = crc32PCLMUL(r, data, blocks);
+    data += blocks;
+    length -= blocks;
+  }
+#endif /*LODEPNG_COMPILE_SIMD && LODEPNG_SIMD_DISPATCH*/
+  /*slicing by 8: table k gives the CRC of a byte followed by k zero bytes*/
+  while(length >= 8) {
+    r ^= (unsigned)data[0] | ((unsigned)data[1] << 8u) | ((unsigned)data[2] << 16u) | ((unsigned)data[3] << 24u);
+    r = lodepng_crc32_table[7][r & 0xffu] ^ lodepng_crc32_table[6][(r >> 8u) & 0xffu] ^
+        lodepng_crc32_table[5][(r >> 16u) & 0xffu] ^ lodepng_crc32_table[4][r >> 24u] ^
+        lodepng_crc32_table[3][data[4]] ^ lodepng_crc32_table[2][data[5]] ^
+        lodepng_crc32_table[1][data[6]] ^ lodepng_crc32_table[0][data[7]];
+    data += 8;
+    length -= 8;
+  }
+  while(length--) {
+    r = lodepng_crc32_table[0][(r ^ *data++) & 0xffu] ^ (r >> 8u);
   }
   return r ^ 0xffffffffu;
 }
@@ -3078,73 +4344,55 @@ static void addColorBits(unsigned char* out, size_t index, unsigned bits, unsign
   else out[index * bits / 8u] |= in;
 }
 
-typedef struct ColorTree ColorTree;
-
 /*
-One node of a color tree
-This is the data structure used to count the number of unique colors and to get a palette
-index for a color. It's like an octree, but because the alpha channel is used too, each
-node has 16 instead of 8 children.
+The set of colors of a palette or of an image with up to 257 colors, each with its palette index. An
+open addressing hash table twice as large as the most colors ever added, so a lookup is a multiply and
+usually a single compare, and nothing is allocated.
 */
-struct ColorTree {
-  ColorTree* children[16]; /*up to 16 pointers to ColorTree of next level*/
-  int index; /*the payload. Only has a meaningful value if this is in the last level*/
-};
+#define LODEPNG_COLOR_SLOTS 512u
+
+typedef struct ColorTable {
+  unsigned color[LODEPNG_COLOR_SLOTS]; /*r, g, b, a from the lowest byte*/
+  short index[LODEPNG_COLOR_SLOTS]; /*the payload, -1 for an empty slot*/
+} ColorTable;
 
-static void color_tree_init(ColorTree* tree) {
-  lodepng_memset(tree->children, 0, 16 * sizeof(*tree->children));
-  tree->index = -1;
+static void color_table_init(ColorTable* table) {
+  lodepng_memset(table->index, 255, sizeof(table->index)); /*all -1*/
 }
 
-static void color_tree_cleanup(ColorTree* tree) {
-  int i;
-  for(i = 0; i != 16; ++i) {
-    if(tree->children[i]) {
-      color_tree_cleanup(tree->children[i]);
-      lodepng_free(tree->children[i]);
-    }
-  }
+static unsigned color_table_slot(const ColorTable* table, unsigned color) {
+  unsigned slot = ((color * 2654435761u) >> 23u) & (LODEPNG_COLOR_SLOTS - 1u);
+  while(table->index[slot] >= 0 && table->color[slot] != color) slot = (slot + 1u) & (LODEPNG_COLOR_SLOTS - 1u);
+  return slot;
 }
 
 /*returns -1 if color not present, its index otherwise*/
-static int color_tree_get(ColorTree* tree, unsigned char r, unsigned char g, unsigned char b, unsigned char a) {
-  int bit = 0;
-  for(bit = 0; bit < 8; ++bit) {
-    int i = 8 * ((r >> bit) & 1) + 4 * ((g >> bit) & 1) + 2 * ((b >> bit) & 1) + 1 * ((a >> bit) & 1);
-    if(!tree->children[i]) return -1;
-    else tree = tree->children[i];
-  }
-  return tree ? tree->index : -1;
+static int color_table_get(const ColorTable* table,
+                           unsigned char r, unsigned char g, unsigned char b, unsigned char a) {
+  unsigned color = r | ((unsigned)g << 8u) | ((unsigned)b << 16u) | ((unsigned)a << 24u);
+  return table->index[color_table_slot(table, color)];
 }
 
 #ifdef LODEPNG_COMPILE_ENCODER
-static int color_tree_has(ColorTree* tree, unsigned char r, unsigned char g, unsigned char b, unsigned char a) {
-  return color_tree_get(tree, r, g, b, a) >= 0;
+static int color_table_has(const ColorTable* table,
+                           unsigned char r, unsigned char g, unsigned char b, unsigned char a) {
+  return color_table_get(table, r, g, b, a) >= 0;
 }
 #endif /*LODEPNG_COMPILE_ENCODER*/
 
-/*color is not allowed to already exist.
-Index should be >= 0 (it's signed to be compatible with using -1 for "doesn't exist")
-Returns error code, or 0 if ok*/
-static unsigned color_tree_add(ColorTree* tree,
-                               unsigned char r, unsigned char g, unsigned char b, unsigned char a, unsigned index) {
-  int bit;
-  for(bit = 0; bit < 8; ++bit) {
-    int i = 8 * ((r >> bit) & 1) + 4 * ((g >> bit) & 1) + 2 * ((b >> bit) & 1) + 1 * ((a >> bit) & 1);
-    if(!tree->children[i]) {
-      tree->children[i] = (ColorTree*)lodepng_malloc(sizeof(ColorTree));
-      if(!tree->children[i]) return 83; /*alloc fail*/
-      color_tree_init(tree->children[i]);
-    }
-    tree = tree->children[i];
-  }
-  tree->index = (int)index;
-  return 0;
+/*Adds the color, or gives it the new index if it is already present: the last of duplicate palette
+colors wins. Index should be >= 0 (it's signed to be compatible with using -1 for "doesn't exist")*/
+static void color_table_add(ColorTable* table,
+                            unsigned char r, unsigned char g, unsigned char b, unsigned char a, unsigned index) {
+  unsigned color = r | ((unsigned)g << 8u) | ((unsigned)b << 16u) | ((unsigned)a << 24u);
+  unsigned slot = color_table_slot(table, color);
+  table->color[slot] = color;
+  table->index[slot] = (short)index;
 }
 
 /*put a pixel, given its RGBA color, into image of any color type*/
 static unsigned rgba8ToPixel(unsigned char* out, size_t i,
-                             const LodePNGColorMode* mode, ColorTree* tree /*for palette*/,
+                             const LodePNGColorMode* mode, const ColorTable* table /*for palette*/,
                              unsigned char r, unsigned char g, unsigned char b, unsigned char a) {
   if(mode->colortype == LCT_GREY) {
     unsigned char gray = r; /*((unsigned short)r + g + b) / 3u;*/
@@ -3166,7 +4414,7 @@ static unsigned rgba8ToPixel(unsigned char* out, size_t i,
       out[i * 6 + 4] = out[i * 6 + 5] = b;
     }
   } else if(mode->colortype == LCT_PALETTE) {
-    int index = color_tree_get(tree, r, g, b, a);
+    int index = color_table_get(table, r, g, b, a);
     if(index < 0) return 82; /*color not in palette*/
     if(mode->bitdepth == 8) out[i] = index;
     else addColorBits(out, i, mode->bitdepth, (unsigned)index);
@@ -3300,6 +4548,264 @@ static void getPixelColorRGBA8(unsigned char* r, unsigned char* g,
   }
 }
 
+#ifdef LODEPNG_COMPILE_SIMD
+/*
+SIMD conversion to RGBA8 of the byte aligned color types and of 4-bit palettes. Converts whole
+vectors of pixels from the start and returns how many, getPixelColorsRGBA8 does the rest. Gives the
+same bytes as the C code, color keys included; 16-bit input keeps the high byte as the C code does.
+*/
+#ifdef __ARM_NEON
+
+static size_t convertRGBA8SIMD(unsigned char* LODEPNG_RESTRICT out, size_t numpixels,
+                               const unsigned char* LODEPNG_RESTRICT in, const LodePNGColorMode* mode,
+                               unsigned simd) {
+  /*a color key above the bit depth never matches, as in the C code*/
+  unsigned keyed = mode->key_defined && mode->key_r < 65536u && mode->key_g < 65536u && mode->key_b < 65536u;
+  uint8x16_t opaque = vdupq_n_u8(255);
+  size_t i = 0;
+  if(simd == LODEPNG_SIMD_NONE) return 0;
+  if(mode->colortype == LCT_GREY && mode->bitdepth == 8) {
+    uint8x16_t key = vdupq_n_u8((unsigned char)mode->key_r);
+    keyed = keyed && mode->key_r < 256u;
+    for(; i + 16u <= numpixels; i += 16u) {
+      uint8x16x4_t v;
+      v.val[0] = v.val[1] = v.val[2] = vld1q_u8(&in[i]);
+      v.val[3] = keyed ? vmvnq_u8(vceqq_u8(v.val[0], key)) : opaque;
+      vst4q_u8(&out[i * 4u], v);
+    }
+  } else if(mode->colortype == LCT_GREY && mode->bitdepth == 16) {
+    uint8x16_t keyhi = vdupq_n_u8((unsigned char)(mode->key_r >> 8u));
+    uint8x16_t keylo = vdupq_n_u8((unsigned char)mode->key_r);
+    for(; i + 16u <= numpixels; i += 16u) {
+      uint8x16x2_t g = vld2q_u8(&in[i * 2u]);
+      uint8x16x4_t v;
+      v.val[0] = v.val[1] = v.val[2] = g.val[0];
+      v.val[3] = keyed ? vmvnq_u8(vandq_u8(vceqq_u8(g.val[0], keyhi), vceqq_u8(g.val[1], keylo))) : opaque;
+      vst4q_u8(&out[i * 4u], v);
+    }
+  } else if(mode->colortype == LCT_GREY_ALPHA) {
+    for(; i + 16u <= numpixels; i += 16u) {
+      uint8x16x4_t v;
+      if(mode->bitdepth == 8) {
+        uint8x16x2_t ga = vld2q_u8(&in[i * 2u]);
+        v.val[0] = v.val[1] = v.val[2] = ga.val[0];
+        v.val[3] = ga.val[1];
+      } else {
+        uint8x16x4_t ga = vld4q_u8(&in[i * 4u]);
+        v.val[0] = v.val[1] = v.val[2] = ga.val[0];
+        v.val[3] = ga.val[2];
+      }
+      vst4q_u8(&out[i * 4u], v);
+    }
+  } else if(mode->colortype == LCT_RGB && mode->bitdepth == 8) {
+    uint8x16_t keyr = vdupq_n_u8((unsigned char)mode->key_r), keyg = vdupq_n_u8((unsigned char)mode->key_g);
+    uint8x16_t keyb = vdupq_n_u8((unsigned char)mode->key_b);
+    keyed = keyed && mode->key_r < 256u && mode->key_g < 256u && mode->key_b < 256u;
+    for(; i + 16u <= numpixels; i += 16u) {
+      uint8x16x3_t rgb = vld3q_u8(&in[i * 3u]);
+      uint8x16x4_t v;
+      v.val[0] = rgb.val[0];
+      v.val[1] = rgb.val[1];
+      v.val[2] = rgb.val[2];
+      v.val[3] = keyed ? vmvnq_u8(vandq_u8(vandq_u8(vceqq_u8(rgb.val[0], keyr), vceqq_u8(rgb.val[1], keyg)),
+                                           vceqq_u8(rgb.val[2], keyb))) : opaque;
+      vst4q_u8(&out[i * 4u], v);
+    }
+  } else if(mode->colortype == LCT_RGB && !keyed) {
+    for(; i + 8u <= numpixels; i += 8u) {
+      /*bytes go to the three registers in turn: high bytes of red and green land in the even bytes of
+      the first and third, high bytes of blue in the odd bytes of the second*/
+      uint8x16x3_t rgb = vld3q_u8(&in[i * 6u]);
+      uint8x8x4_t v;
+      v.val[0] = vmovn_u16(vreinterpretq_u16_u8(rgb.val[0]));
+      v.val[1] = vmovn_u16(vreinterpretq_u16_u8(rgb.val[2]));
+      v.val[2] = vshrn_n_u16(vreinterpretq_u16_u8(rgb.val[1]), 8);
+      v.val[3] = vdup_n_u8(255);
+      vst4_u8(&out[i * 4u], v);
+    }
+  } else if(mode->colortype == LCT_RGBA && mode->bitdepth == 16) {
+    for(; i + 4u <= numpixels; i += 4u) vst1q_u8(&out[i * 4u], vld2q_u8(&in[i * 8u]).val[0]);
+  } else if(mode->colortype == LCT_PALETTE && mode->bitdepth == 4) {
+    /*the 16 colors as one lookup table per channel*/
+    unsigned char channels[4][16];
+    uint8x8x2_t table[4];
+    unsigned c, k;
+    for(k = 0; k != 16; ++k) {
+      for(c = 0; c != 4; ++c) channels[c][k] = mode->palette[k * 4u + c];
+    }
+    for(c = 0; c != 4; ++c) {
+      table[c].val[0] = vld1_u8(&channels[c][0]);
+      table[c].val[1] = vld1_u8(&channels[c][8]);
+    }
+    for(; i + 16u <= numpixels; i += 16u) {
+      uint8x8_t packed = vld1_u8(&in[i / 2u]);
+      /*the high nibble is the first pixel*/
+      uint8x8x2_t index = vzip_u8(vshr_n_u8(packed, 4), vand_u8(packed, vdup_n_u8(15)));
+      for(k = 0; k != 2; ++k) {
+        uint8x8x4_t v;
+        for(c = 0; c != 4; ++c) v.val[c] = vtbl2_u8(table[c], index.val[k]);
+        vst4_u8(&out[(i + k * 8u) * 4u], v);
+      }
+    }
+  }
+  return i;
+}
+
+#else /*x86*/
+
+/*interleaves 16 pixels of separate channels into RGBA*/
+static LODEPNG_INLINE void storeRGBA8SSE2(unsigned char* out, __m128i r, __m128i g, __m128i b, __m128i a) {
+  __m128i rg = _mm_unpacklo_epi8(r, g), ba = _mm_unpacklo_epi8(b, a);
+  _mm_storeu_si128((__m128i*)&out[0], _mm_unpacklo_epi16(rg, ba));
+  _mm_storeu_si128((__m128i*)&out[16], _mm_unpackhi_epi16(rg, ba));
+  rg = _mm_unpackhi_epi8(r, g);
+  ba = _mm_unpackhi_epi8(b, a);
+  _mm_storeu_si128((__m128i*)&out[32], _mm_unpacklo_epi16(rg, ba));
+  _mm_storeu_si128((__m128i*)&out[48], _mm_unpackhi_epi16(rg, ba));
+}
+
+/*grey, grey with alpha and RGBA 16*/
+static size_t convertRGBA8SSE2(unsigned char* LODEPNG_RESTRICT out, size_t numpixels,
+                               const unsigned char* LODEPNG_RESTRICT in, const LodePNGColorMode* mode) {
+  /*a color key above the bit depth never matches, as in the C code*/
+  unsigned keyed = mode->key_defined && mode->key_r < (1u << mode->bitdepth);
+  __m128i opaque = _mm_set1_epi8(-1), low = _mm_set1_epi16(255);
+  size_t i = 0;
+#define LODEPNG_LOAD(p) _mm_loadu_si128((const __m128i*)(p))
+  if(mode->colortype == LCT_GREY && mode->bitdepth == 8) {
+    __m128i key = _mm_set1_epi8((char)mode->key_r);
+    for(; i + 16u <= numpixels; i += 16u) {
+      __m128i g = LODEPNG_LOAD(&in[i]);
+      storeRGBA8SSE2(&out[i * 4u], g, g, g, keyed ? _mm_xor_si128(_mm_cmpeq_epi8(g, key), opaque) : opaque);
+    }
+  } else if(mode->colortype == LCT_GREY && mode->bitdepth == 16) {
+    /*the big endian key as the little endian lanes load it*/
+    __m128i key = _mm_set1_epi16((short)(((mode->key_r & 255u) << 8u) | (mode->key_r >> 8u)));
+    for(; i + 16u <= numpixels; i += 16u) {
+      __m128i v0 = LODEPNG_LOAD(&in[i * 2u]), v1 = LODEPNG_LOAD(&in[i * 2u + 16u]);
+      __m128i g = _mm_packus_epi16(_mm_and_si128(v0, low), _mm_and_si128(v1, low)), a = opaque;
+      if(keyed) {
+        a = _mm_packs_epi16(_mm_xor_si128(_mm_cmpeq_epi16(v0, key), opaque),
+                            _mm_xor_si128(_mm_cmpeq_epi16(v1, key), opaque));
+      }
+      storeRGBA8SSE2(&out[i * 4u], g, g, g, a);
+    }
+  } else if(mode->colortype == LCT_GREY_ALPHA && mode->bitdepth == 8) {
+    for(; i + 16u <= numpixels; i += 16u) {
+      __m128i v0 = LODEPNG_LOAD(&in[i * 2u]), v1 = LODEPNG_LOAD(&in[i * 2u + 16u]);
+      __m128i g = _mm_packus_epi16(_mm_and_si128(v0, low), _mm_and_si128(v1, low));
+      __m128i a = _mm_packus_epi16(_mm_srli_epi16(v0, 8), _mm_srli_epi16(v1, 8));
+      storeRGBA8SSE2(&out[i * 4u], g, g, g, a);
+    }
+  } else if(mode->colortype == LCT_GREY_ALPHA) {
+    __m128i lowest = _mm_set1_epi32(255);
+    for(; i + 16u <= numpixels; i += 16u) {
+      __m128i v0 = LODEPNG_LOAD(&in[i * 4u]), v1 = LODEPNG_LOAD(&in[i * 4u + 16u]);
+      __m128i v2 = LODEPNG_LOAD(&in[i * 4u + 32u]), v3 = LODEPNG_LOAD(&in[i * 4u + 48u]);
+      /*high bytes of grey and alpha are bytes 0 and 2 of each 32-bit lane*/
+      __m128i g = _mm_packus_epi16(_mm_packs_epi32(_mm_and_si128(v0, lowest), _mm_and_si128(v1, lowest)),
+                                   _mm_packs_epi32(_mm_and_si128(v2, lowest), _mm_and_si128(v3, lowest)));
+      __m128i a;
+      v0 = _mm_srli_epi32(v0, 16);
+      v1 = _mm_srli_epi32(v1, 16);
+      v2 = _mm_srli_epi32(v2, 16);
+      v3 = _mm_srli_epi32(v3, 16);
+      a = _mm_packus_epi16(_mm_packs_epi32(_mm_and_si128(v0, lowest), _mm_and_si128(v1, lowest)),
+                           _mm_packs_epi32(_mm_and_si128(v2, lowest), _mm_and_si128(v3, lowest)));
+      storeRGBA8SSE2(&out[i * 4u], g, g, g, a);
+    }
+  } else if(mode->colortype == LCT_RGBA && mode->bitdepth == 16) {
+    for(; i + 4u <= numpixels; i += 4u) {
+      __m128i v0 = LODEPNG_LOAD(&in[i * 8u]), v1 = LODEPNG_LOAD(&in[i * 8u + 16u]);
+      _mm_storeu_si128((__m128i*)&out[i * 4u], _mm_packus_epi16(_mm_and_si128(v0, low), _mm_and_si128(v1, low)));
+    }
+  }
+#undef LODEPNG_LOAD
+  return i;
+}
+
+#ifdef LODEPNG_SIMD_DISPATCH
+/*RGB and 4-bit palettes, through pshufb*/
+LODEPNG_TARGET("ssse3") static size_t convertRGBA8SSSE3(unsigned char* LODEPNG_RESTRICT out, size_t numpixels,
+                                                        const unsigned char* LODEPNG_RESTRICT in,
+                                                        const LodePNGColorMode* mode) {
+  __m128i alpha = _mm_set1_epi32((int)0xff000000u);
+  size_t i = 0;
+  if(mode->colortype == LCT_RGB && mode->bitdepth == 8) {
+    /*a color key above the bit depth never matches, as in the C code*/
+    unsigned keyed = mode->key_defined && mode->key_r < 256u && mode->key_g < 256u && mode->key_b < 256u;
+    __m128i spread = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+    __m128i key = _mm_set1_epi32((int)(mode->key_r | (mode->key_g << 8u) | (mode->key_b << 16u)));
+    /*4 pixels per step, the load reads 4 bytes past them*/
+    for(; i + 6u <= numpixels; i += 4u) {
+      __m128i rgb = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)&in[i * 3u]), spread);
+      __m128i a = keyed ? _mm_andnot_si128(_mm_cmpeq_epi32(rgb, key), alpha) : alpha;
+      _mm_storeu_si128((__m128i*)&out[i * 4u], _mm_or_si128(rgb, a));
+    }
+  } else if(mode->colortype == LCT_RGB && !mode->key_defined) {
+    /*2 pixels from each load, the high bytes of the first pixels then of the second*/
+    __m128i first = _mm_setr_epi8(0, 2, 4, -1, 6, 8, 10, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+    __m128i second = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, 0, 2, 4, -1, 6, 8, 10, -1);
+    for(; i + 5u <= numpixels; i += 4u) {
+      __m128i rgb = _mm_or_si128(_mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)&in[i * 6u]), first),
+                                 _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)&in[i * 6u + 12u]), second));
+      _mm_storeu_si128((__m128i*)&out[i * 4u], _mm_or_si128(rgb, alpha));
+    }
+  } else if(mode->colortype == LCT_PALETTE && mode->bitdepth == 4) {
+    /*the 16 colors as one lookup table per channel*/
+    unsigned char channels[4][16];
+    __m128i r, g, b, a, nibble = _mm_set1_epi8(15);
+    unsigned c, k;
+    for(k = 0; k != 16; ++k) {
+      for(c = 0; c != 4; ++c) channels[c][k] = mode->palette[k * 4u + c];
+    }
+    r = _mm_loadu_si128((const __m128i*)channels[0]);
+    g = _mm_loadu_si128((const __m128i*)channels[1]);
+    b = _mm_loadu_si128((const __m128i*)channels[2]);
+    a = _mm_loadu_si128((const __m128i*)channels[3]);
+    for(; i + 16u <= numpixels; i += 16u) {
+      __m128i packed = _mm_loadl_epi64((const __m128i*)&in[i / 2u]);
+      /*the high nibble is the first pixel*/
+      __m128i high = _mm_and_si128(_mm_srli_epi16(packed, 4), nibble);
+      __m128i index = _mm_unpacklo_epi8(high, _mm_and_si128(packed, nibble));
+      storeRGBA8SSE2(&out[i * 4u], _mm_shuffle_epi8(r, index), _mm_shuffle_epi8(g, index),
+                     _mm_shuffle_epi8(b, index), _mm_shuffle_epi8(a, index));
+    }
+  }
+  return i;
+}
+
+/*8-bit palettes, each palette entry is one 32-bit RGBA gather*/
+LODEPNG_TARGET("avx2") static size_t convertPaletteAVX2(unsigned char* LODEPNG_RESTRICT out, size_t numpixels,
+                                                        const unsigned char* LODEPNG_RESTRICT in,
+                                                        const unsigned char* palette) {
+  size_t i = 0;
+  for(; i + 8u <= numpixels; i += 8u) {
+    __m256i index = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)&in[i]));
+    _mm256_storeu_si256((__m256i*)&out[i * 4u], _mm256_i32gather_epi32((const int*)palette, index, 4));
+  }
+  return i;
+}
+#endif /*LODEPNG_SIMD_DISPATCH*/
+
+static size_t convertRGBA8SIMD(unsigned char* LODEPNG_RESTRICT out, size_t numpixels,
+                               const unsigned char* LODEPNG_RESTRICT in, const LodePNGColorMode* mode,
+                               unsigned simd) {
+  if(simd == LODEPNG_SIMD_NONE) return 0;
+  if(mode->colortype == LCT_RGB || mode->colortype == LCT_PALETTE) {
+#ifdef LODEPNG_SIMD_DISPATCH
+    if(mode->colortype == LCT_PALETTE && mode->bitdepth == 8) {
+      return simd >= LODEPNG_SIMD_AVX2 ? convertPaletteAVX2(out, numpixels, in, mode->palette) : 0;
+    }
+    if(simd >= LODEPNG_SIMD_SSSE3) return convertRGBA8SSSE3(out, numpixels, in, mode);
+#endif /*LODEPNG_SIMD_DISPATCH*/
+    return 0;
+  }
+  return convertRGBA8SSE2(out, numpixels, in, mode);
+}
+#endif /*__ARM_NEON*/
+#endif /*LODEPNG_COMPILE_SIMD*/
+
 /*Similar to getPixelColorRGBA8, but with all the for loops inside of the color
 mode test cases, optimized to convert the colors much faster, when converting
 to the common case of RGBA with 8 bit per channel. buffer must be RGBA with
@@ -3504,7 +5010,7 @@ unsigned lodepng_convert(unsigned char* out, const unsigned char* in,
                          const LodePNGColorMode* mode_out, const LodePNGColorMode* mode_in,
                          unsigned w, unsigned h) {
   size_t i;
-  ColorTree tree;
+  ColorTable table;
   size_t numpixels = (size_t)w * (size_t)h;
   unsigned error = 0;
 
@@ -3538,11 +5044,10 @@ unsigned lodepng_convert(unsigned char* out, const unsigned char* in,
       }
     }
     if(palettesize < palsize) palsize = palettesize;
-    color_tree_init(&tree);
+    color_table_init(&table);
     for(i = 0; i != palsize; ++i) {
       const unsigned char* p = &palette[i * 4];
-      error = color_tree_add(&tree, p[0], p[1], p[2], p[3], (unsigned)i);
-      if(error) break;
+      color_table_add(&table, p[0], p[1], p[2], p[3], (unsigned)i);
     }
   }
 
@@ -3554,23 +5059,25 @@ unsigned lodepng_convert(unsigned char* out, const unsigned char* in,
         rgba16ToPixel(out, i, mode_out, r, g, b, a);
       }
     } else if(mode_out->bitdepth == 8 && mode_out->colortype == LCT_RGBA) {
+#ifdef LODEPNG_COMPILE_SIMD
+      /*the vectors convert the start of the image, the C code what is left at the end*/
+      size_t done = convertRGBA8SIMD(out, numpixels, in, mode_in, lodepng_simd_level());
+      getPixelColorsRGBA8(out + done * 4u, numpixels - done, in + done * lodepng_get_bpp(mode_in) / 8u, mode_in);
+#else /*LODEPNG_COMPILE_SIMD*/
       getPixelColorsRGBA8(out, numpixels, in, mode_in);
+#endif /*LODEPNG_COMPILE_SIMD*/
     } else if(mode_out->bitdepth == 8 && mode_out->colortype == LCT_RGB) {
       getPixelColorsRGB8(out, numpixels, in, mode_in);
     } else {
       unsigned char r = 0, g = 0, b = 0, a = 0;
       for(i = 0; i != numpixels; ++i) {
         getPixelColorRGBA8(&r, &g, &b, &a, in, i, mode_in);
-        error = rgba8ToPixel(out, i, mode_out, &tree, r, g, b, a);
+        error = rgba8ToPixel(out, i, mode_out, &table, r, g, b, a);
         if(error) break;
       }
     }
   }
 
-  if(mode_out->colortype == LCT_PALETTE) {
-    color_tree_cleanup(&tree);
-  }
-
   return error;
 }
 
@@ -3667,14 +5174,98 @@ static unsigned getValueRequiredBits(unsigned char value) {
   return 8;
 }
 
+/*Whether the pixel at p of an 8-bit RGBA image can change the stats. When fresh, while colors are
+counted or grey bits looked for, any pixel that differs from the one before it can: a repeated pixel
+never changes anything. Otherwise a colored pixel can, unless colored is done, and unless alpha is done
+a pixel that is not opaque, or with a color key one that breaks it: transparent with another color or
+opaque with the key color.*/
+static unsigned colorStatsChangeRGBA8(const unsigned char* p, unsigned fresh, unsigned colored_done,
+                                      unsigned alpha_done, const LodePNGColorStats* stats) {
+  unsigned matchkey;
+  if(fresh) return p[0] != p[-4] || p[1] != p[-3] || p[2] != p[-2] || p[3] != p[-1];
+  if(!colored_done && (p[0] != p[1] || p[0] != p[2])) return 1;
+  if(alpha_done) return 0;
+  if(!stats->key) return p[3] != 255;
+  matchkey = p[0] == stats->key_r && p[1] == stats->key_g && p[2] == stats->key_b;
+  return !((p[3] == 0 && matchkey) || (p[3] == 255 && !matchkey));
+}
+
+/*index of the first pixel from i on that can change the stats, numpixels if none*/
+static size_t colorStatsSkipRGBA8(const unsigned char* in, size_t i, size_t numpixels, unsigned fresh,
+                                  unsigned colored_done, unsigned alpha_done, const LodePNGColorStats* stats) {
+  if(fresh && i == 0) return 0; /*the first pixel has nothing before it*/
+  /*the vectors take the key as 8-bit, other keys (from 16-bit stats) are left to the C loop*/
+#if defined(LODEPNG_COMPILE_SIMD) && defined(__ARM_NEON)
+  if(!stats->key || (stats->key_r | stats->key_g | stats->key_b) < 256) {
+    uint32x4_t zero = vdupq_n_u32(0), low = vdupq_n_u32(255), rgbmask = vdupq_n_u32(0x00ffffffu);
+    uint32x4_t key = vdupq_n_u32(stats->key_r | (stats->key_g << 8u) | (stats->key_b << 16u));
+    for(; i + 4u <= numpixels; i += 4u) {
+      /*4 pixels as little endian 32-bit lanes, red in the lowest byte*/
+      uint32x4_t v = vreinterpretq_u32_u8(vld1q_u8(&in[i * 4u])), change = zero;
+      uint32x2_t any;
+      if(fresh) {
+        change = vmvnq_u32(vceqq_u32(v, vreinterpretq_u32_u8(vld1q_u8(&in[i * 4u - 4u]))));
+      } else {
+        if(!colored_done) {
+          uint32x4_t diff = vorrq_u32(veorq_u32(v, vshrq_n_u32(v, 8)), veorq_u32(v, vshrq_n_u32(v, 16)));
+          change = vmvnq_u32(vceqq_u32(vandq_u32(diff, low), zero));
+        }
+        if(!alpha_done) {
+          uint32x4_t opaque = vceqq_u32(vorrq_u32(v, rgbmask), vdupq_n_u32(0xffffffffu)), unchanged = opaque;
+          if(stats->key) {
+            uint32x4_t matchkey = vceqq_u32(vandq_u32(v, rgbmask), key);
+            unchanged = vorrq_u32(vceqq_u32(v, key), vbicq_u32(opaque, matchkey));
+          }
+          change = vorrq_u32(change, vmvnq_u32(unchanged));
+        }
+      }
+      any = vorr_u32(vget_low_u32(change), vget_high_u32(change));
+      if(vget_lane_u32(vpmax_u32(any, any), 0)) break; /*the C loop finds which one*/
+    }
+  }
+#elif defined(LODEPNG_COMPILE_SIMD)
+  if(!stats->key || (stats->key_r | stats->key_g | stats->key_b) < 256) {
+    __m128i zero = _mm_setzero_si128(), ones = _mm_set1_epi32(-1), low = _mm_set1_epi32(255);
+    __m128i rgbmask = _mm_set1_epi32(0x00ffffff);
+    __m128i key = _mm_set1_epi32((int)(stats->key_r | (stats->key_g << 8u) | (stats->key_b << 16u)));
+    for(; i + 4u <= numpixels; i += 4u) {
+      /*4 pixels as 32-bit lanes, red in the lowest byte*/
+      __m128i v = _mm_loadu_si128((const __m128i*)&in[i * 4u]), change = zero;
+      int mask;
+      if(fresh) {
+        change = _mm_xor_si128(_mm_cmpeq_epi32(v, _mm_loadu_si128((const __m128i*)&in[i * 4u - 4u])), ones);
+      } else {
+        if(!colored_done) {
+          __m128i diff = _mm_or_si128(_mm_xor_si128(v, _mm_srli_epi32(v, 8)), _mm_xor_si128(v, _mm_srli_epi32(v, 16)));
+          change = _mm_xor_si128(_mm_cmpeq_epi32(_mm_and_si128(diff, low), zero), ones);
+        }
+        if(!alpha_done) {
+          __m128i opaque = _mm_cmpeq_epi32(_mm_or_si128(v, rgbmask), ones), unchanged = opaque;
+          if(stats->key) {
+            __m128i matchkey = _mm_cmpeq_epi32(_mm_and_si128(v, rgbmask), key);
+            unchanged = _mm_or_si128(_mm_cmpeq_epi32(v, key), _mm_andnot_si128(matchkey, opaque));
+          }
+          change = _mm_or_si128(change, _mm_xor_si128(unchanged, ones));
+        }
+      }
+      mask = _mm_movemask_ps(_mm_castsi128_ps(change));
+      if(mask) return i + (mask & 1 ? 0 : mask & 2 ? 1 : mask & 4 ? 2 : 3);
+    }
+  }
+#endif /*LODEPNG_COMPILE_SIMD*/
+  for(; i != numpixels; ++i) {
+    if(colorStatsChangeRGBA8(&in[i * 4u], fresh, colored_done, alpha_done, stats)) break;
+  }
+  return i;
+}
+
 /*stats must already have been inited. */
 unsigned lodepng_compute_color_stats(LodePNGColorStats* stats,
                                      const unsigned char* in, unsigned w, unsigned h,
                                      const LodePNGColorMode* mode_in) {
   size_t i;
-  ColorTree tree;
+  ColorTable table;
   size_t numpixels = (size_t)w * (size_t)h;
-  unsigned error = 0;
 
   /* mark things as done already if it would be impossible to have a more expensive case */
   unsigned colored_done = lodepng_is_greyscale_type(mode_in) ? 1 : 0;
@@ -3691,7 +5282,7 @@ unsigned lodepng_compute_color_stats(LodePNGColorStats* stats,
   /*if palette not allowed, no need to compute numcolors*/
   if(!stats->allow_palette) numcolors_done = 1;
 
-  color_tree_init(&tree);
+  color_table_init(&table);
 
   /*If the stats was already filled in from previous data, fill its palette in tree
   and mark things as done already if we know they are the most expensive case already*/
@@ -3704,8 +5295,7 @@ unsigned lodepng_compute_color_stats(LodePNGColorStats* stats,
   if(!numcolors_done) {
     for(i = 0; i < stats->numcolors; i++) {
       const unsigned char* color = &stats->palette[i * 4];
-      error = color_tree_add(&tree, color[0], color[1], color[2], color[3], i);
-      if(error) goto cleanup;
+      color_table_add(&table, color[0], color[1], color[2], color[3], (unsigned)i);
     }
   }
 
@@ -3770,7 +5360,16 @@ unsigned lodepng_compute_color_stats(LodePNGColorStats* stats,
     }
   } else /* < 16-bit */ {
     unsigned char r = 0, g = 0, b = 0, a = 0;
+    /*8-bit RGBA, the format of rendered frames, skips the pixels that can't change the stats*/
+    unsigned rgba8 = mode_in->colortype == LCT_RGBA && mode_in->bitdepth == 8;
     for(i = 0; i != numpixels; ++i) {
+      if(rgba8) {
+        /*once colors are counted and the bits known, only colored and alpha pixels are left to find*/
+        unsigned fresh = !numcolors_done || (!bits_done && stats->bits < 8);
+        if(!fresh && colored_done && alpha_done) break;
+        i = colorStatsSkipRGBA8(in, i, numpixels, fresh, colored_done, alpha_done, stats);
+        if(i == numpixels) break;
+      }
       getPixelColorRGBA8(&r, &g, &b, &a, in, i, mode_in);
 
       if(!bits_done && stats->bits < 8) {
@@ -3808,9 +5407,8 @@ unsigned lodepng_compute_color_stats(LodePNGColorStats* stats,
       }
 
       if(!numcolors_done) {
-        if(!color_tree_has(&tree, r, g, b, a)) {
-          error = color_tree_add(&tree, r, g, b, a, stats->numcolors);
-          if(error) goto cleanup;
+        if(!color_table_has(&table, r, g, b, a)) {
+          color_table_add(&table, r, g, b, a, stats->numcolors);
           if(stats->numcolors < 256) {
             unsigned char* p = stats->palette;
             unsigned n = stats->numcolors;
@@ -3836,6 +5434,7 @@ unsigned lodepng_compute_color_stats(LodePNGColorStats* stats,
           stats->key = 0;
           alpha_done = 1;
           if(stats->bits < 8) stats->bits = 8; /*PNG has no alphachannel modes with less than 8-bit per channel*/
+          break; /*more such pixels change nothing*/
         }
       }
     }
@@ -3846,9 +5445,7 @@ unsigned lodepng_compute_color_stats(LodePNGColorStats* stats,
     stats->key_b += (stats->key_b << 8);
   }
 
-cleanup:
-  color_tree_cleanup(&tree);
-  return error;
+  return 0;
 }
 
 #ifdef LODEPNG_COMPILE_ANCILLARY_CHUNKS
@@ -4077,8 +5674,276 @@ unsigned lodepng_inspect(unsigned* w, unsigned* h, LodePNGState* state,
   return state->error;
 }
 
+#ifdef LODEPNG_COMPILE_SIMD
+/*
+SIMD unfiltering for pixels of 3, 4, 6 and 8 bytes. Sub, Average and Paeth depend on the pixel to
+the left, so they run one pixel per step with all its channels in one register; Up has no such
+dependency and runs 16 or 32 bytes per step. Every variant gives the same bytes as the C code.
+*/
+#ifdef __ARM_NEON
+
+/*Loads one pixel into the low bytes of a register, reading 8 bytes when avail allows, the lanes past
+the pixel are ignored. Stores write only the pixel, the next one may still be unread input.*/
+static LODEPNG_INLINE uint8x8_t loadPixelNEON(const unsigned char* p, size_t bytewidth, size_t avail) {
+  unsigned char px[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+  if(avail >= 8) return vld1_u8(p);
+  lodepng_memcpy(px, p, bytewidth);
+  return vld1_u8(px);
+}
+
+static LODEPNG_INLINE void storePixelNEON(unsigned char* p, uint8x8_t v, size_t bytewidth) {
+  unsigned char px[8];
+  vst1_u8(px, v);
+  lodepng_memcpy(p, px, bytewidth);
+}
+
+static LODEPNG_INLINE void unfilterSubNEON(unsigned char* recon, const unsigned char* scanline,
+                                           size_t bytewidth, size_t length) {
+  uint8x8_t a = vdup_n_u8(0);
+  size_t i;
+  for(i = 0; i != length; i += bytewidth) {
+    a = vadd_u8(a, loadPixelNEON(&scanline[i], bytewidth, length - i));
+    storePixelNEON(&recon[i], a, bytewidth);
+  }
+}
+
+static void unfilterUpNEON(unsigned char* recon, const unsigned char* scanline, const unsigned char* precon,
+                           size_t length) {
+  size_t i = 0;
+  for(; i + 16u <= length; i += 16u) vst1q_u8(&recon[i], vaddq_u8(vld1q_u8(&scanline[i]), vld1q_u8(&precon[i])));
+  for(; i != length; ++i) recon[i] = scanline[i] + precon[i];
+}
+
+static LODEPNG_INLINE void unfilterAverageNEON(unsigned char* recon, const unsigned char* scanline,
+                                               const unsigned char* precon, size_t bytewidth, size_t length) {
+  uint8x8_t a = vdup_n_u8(0);
+  size_t i;
+  for(i = 0; i != length; i += bytewidth) {
+    /*halving add rounds down, as (a + b) >> 1*/
+    uint8x8_t avg = vhadd_u8(a, loadPixelNEON(&precon[i], bytewidth, length - i));
+    a = vadd_u8(loadPixelNEON(&scanline[i], bytewidth, length - i), avg);
+    storePixelNEON(&recon[i], a, bytewidth);
+  }
+}
+
+static LODEPNG_INLINE void unfilterPaethNEON(unsigned char* recon, const unsigned char* scanline,
+                                             const unsigned char* precon, size_t bytewidth, size_t length) {
+  uint8x8_t a = vdup_n_u8(0), c = vdup_n_u8(0);
+  size_t i;
+  for(i = 0; i != length; i += bytewidth) {
+    uint8x8_t b = loadPixelNEON(&precon[i], bytewidth, length - i);
+    /*same distances as paethPredictor: |b - c|, |a - c| and |a + b - 2c|*/
+    uint16x8_t pa = vabdl_u8(b, c);
+    uint16x8_t pb = vabdl_u8(a, c);
+    int16x8_t sum = vaddq_s16(vreinterpretq_s16_u16(vsubl_u8(b, c)), vreinterpretq_s16_u16(vsubl_u8(a, c)));
+    uint16x8_t pc = vreinterpretq_u16_s16(vabsq_s16(sum));
+    uint16x8_t smallest = vminq_u16(vminq_u16(pa, pb), pc);
+    /*ties prefer a, then b*/
+    uint8x8_t nearest = vbsl_u8(vmovn_u16(vceqq_u16(smallest, pa)), a,
+                                vbsl_u8(vmovn_u16(vceqq_u16(smallest, pb)), b, c));
+    a = vadd_u8(loadPixelNEON(&scanline[i], bytewidth, length - i), nearest);
+    storePixelNEON(&recon[i], a, bytewidth);
+    c = b;
+  }
+}
+
+/*the inline loops above are instantiated for each pixel size, so the pixel loads are fixed size*/
+#define LODEPNG_UNFILTER_BYTEWIDTH(call) {\
+  switch(bytewidth) {\
+    case 3: { const size_t bytewidth = 3; call; } break;\
+    case 4: { const size_t bytewidth = 4; call; } break;\
+    case 6: { const size_t bytewidth = 6; call; } break;\
+    default: { const size_t bytewidth = 8; call; } break;\
+  }\
+}
+
+/*returns 1 if the scanline was unfiltered, 0 if the C code must do it*/
+static unsigned unfilterScanlineSIMD(unsigned char* recon, const unsigned char* scanline, const unsigned char* precon,
+                                     size_t bytewidth, unsigned char filterType, size_t length, unsigned simd) {
+  if(simd == LODEPNG_SIMD_NONE) return 0;
+  if(filterType == 2 && precon) {
+    unfilterUpNEON(recon, scanline, precon, length);
+    return 1;
+  }
+  if(bytewidth != 3 && bytewidth != 4 && bytewidth != 6 && bytewidth != 8) return 0;
+  if(filterType == 1 || (filterType == 4 && !precon)) {
+    LODEPNG_UNFILTER_BYTEWIDTH(unfilterSubNEON(recon, scanline, bytewidth, length));
+  } else if(filterType == 3 && precon) {
+    LODEPNG_UNFILTER_BYTEWIDTH(unfilterAverageNEON(recon, scanline, precon, bytewidth, length));
+  } else if(filterType == 4) {
+    LODEPNG_UNFILTER_BYTEWIDTH(unfilterPaethNEON(recon, scanline, precon, bytewidth, length));
+  } else {
+    return 0;
+  }
+  return 1;
+}
+
+#else /*x86*/
+
+/*Loads one pixel into the low bytes of a register, reading 8 bytes when avail allows, the lanes past
+the pixel are ignored. Stores write only the pixel, the next one may still be unread input.*/
+static LODEPNG_INLINE __m128i loadPixelSSE2(const unsigned char* p, size_t bytewidth, size_t avail) {
+  unsigned lo;
+  __m128i v;
+  if(bytewidth == 8 || avail >= 8) return _mm_loadl_epi64((const __m128i*)p);
+  lo = (unsigned)p[0] | ((unsigned)p[1] << 8u) | ((unsigned)p[2] << 16u);
+  if(bytewidth >= 4) lo |= (unsigned)p[3] << 24u;
+  v = _mm_cvtsi32_si128((int)lo);
+  if(bytewidth == 6) v = _mm_insert_epi16(v, (int)((unsigned)p[4] | ((unsigned)p[5] << 8u)), 2);
+  return v;
+}
+
+static LODEPNG_INLINE void storePixelSSE2(unsigned char* p, __m128i v, size_t bytewidth) {
+  unsigned lo;
+  if(bytewidth == 8) {
+    _mm_storel_epi64((__m128i*)p, v);
+    return;
+  }
+  lo = (unsigned)_mm_cvtsi128_si32(v);
+  p[0] = (unsigned char)lo;
+  p[1] = (unsigned char)(lo >> 8u);
+  p[2] = (unsigned char)(lo >> 16u);
+  if(bytewidth >= 4) p[3] = (unsigned char)(lo >> 24u);
+  if(bytewidth == 6) {
+    unsigned hi = (unsigned)_mm_extract_epi16(v, 2);
+    p[4] = (unsigned char)hi;
+    p[5] = (unsigned char)(hi >> 8u);
+  }
+}
+
+static LODEPNG_INLINE void unfilterSubSSE2(unsigned char* recon, const unsigned char* scanline,
+                                           size_t bytewidth, size_t length) {
+  __m128i a = _mm_setzero_si128();
+  size_t i;
+  for(i = 0; i != length; i += bytewidth) {
+    a = _mm_add_epi8(a, loadPixelSSE2(&scanline[i], bytewidth, length - i));
+    storePixelSSE2(&recon[i], a, bytewidth);
+  }
+}
+
+static void unfilterUpSSE2(unsigned char* recon, const unsigned char* scanline, const unsigned char* precon,
+                           size_t length) {
+  size_t i = 0;
+  for(; i + 16u <= length; i += 16u) {
+    __m128i x = _mm_loadu_si128((const __m128i*)&scanline[i]);
+    _mm_storeu_si128((__m128i*)&recon[i], _mm_add_epi8(x, _mm_loadu_si128((const __m128i*)&precon[i])));
+  }
+  for(; i != length; ++i) recon[i] = scanline[i] + precon[i];
+}
+
+static LODEPNG_INLINE void unfilterAverageSSE2(unsigned char* recon, const unsigned char* scanline,
+                                               const unsigned char* precon, size_t bytewidth, size_t length) {
+  __m128i a = _mm_setzero_si128(), one = _mm_set1_epi8(1);
+  size_t i;
+  for(i = 0; i != length; i += bytewidth) {
+    __m128i b = loadPixelSSE2(&precon[i], bytewidth, length - i);
+    /*pavgb rounds up, (a + b) >> 1 rounds down: subtract the low bit of a ^ b*/
+    __m128i avg = _mm_sub_epi8(_mm_avg_epu8(a, b), _mm_and_si128(_mm_xor_si128(a, b), one));
+    a = _mm_add_epi8(loadPixelSSE2(&scanline[i], bytewidth, length - i), avg);
+    storePixelSSE2(&recon[i], a, bytewidth);
+  }
+}
+
+/*one step of paethPredictor on 16-bit lanes, abs is the only part that differs between SSE2 and SSSE3*/
+#define LODEPNG_PAETH_SSE(abs16) {\
+  __m128i b = _mm_unpacklo_epi8(loadPixelSSE2(&precon[i], bytewidth, length - i), zero);\
+  __m128i pa = _mm_sub_epi16(b, c); /*p - a*/\
+  __m128i pb = _mm_sub_epi16(a, c); /*p - b*/\
+  __m128i pc = _mm_add_epi16(pa, pb); /*p - c*/\
+  __m128i smallest, nearest, isa, isb;\
+  pa = abs16(pa);\
+  pb = abs16(pb);\
+  pc = abs16(pc);\
+  smallest = _mm_min_epi16(pc, _mm_min_epi16(pa, pb));\
+  /*ties prefer a, then b*/\
+  isa = _mm_cmpeq_epi16(smallest, pa);\
+  isb = _mm_cmpeq_epi16(smallest, pb);\
+  nearest = _mm_or_si128(_mm_and_si128(isb, b), _mm_andnot_si128(isb, c));\
+  nearest = _mm_or_si128(_mm_and_si128(isa, a), _mm_andnot_si128(isa, nearest));\
+  nearest = _mm_add_epi8(loadPixelSSE2(&scanline[i], bytewidth, length - i), _mm_packus_epi16(nearest, nearest));\
+  storePixelSSE2(&recon[i], nearest, bytewidth);\
+  a = _mm_unpacklo_epi8(nearest, zero);\
+  c = b;\
+}
+
+static LODEPNG_INLINE __m128i absSSE2(__m128i x) {
+  return _mm_max_epi16(x, _mm_sub_epi16(_mm_setzero_si128(), x));
+}
+
+static LODEPNG_INLINE void unfilterPaethSSE2(unsigned char* recon, const unsigned char* scanline,
+                                             const unsigned char* precon, size_t bytewidth, size_t length) {
+  __m128i zero = _mm_setzero_si128(), a = zero, c = zero;
+  size_t i;
+  for(i = 0; i != length; i += bytewidth) LODEPNG_PAETH_SSE(absSSE2)
+}
+
+/*the inline loops above are instantiated for each pixel size, so the pixel loads are fixed size*/
+#define LODEPNG_UNFILTER_BYTEWIDTH(call) {\
+  switch(bytewidth) {\
+    case 3: { const size_t bytewidth = 3; call; } break;\
+    case 4: { const size_t bytewidth = 4; call; } break;\
+    case 6: { const size_t bytewidth = 6; call; } break;\
+    default: { const size_t bytewidth = 8; call; } break;\
+  }\
+}
+
+#ifdef LODEPNG_SIMD_DISPATCH
+LODEPNG_TARGET("ssse3") static void unfilterPaethSSSE3(unsigned char* recon, const unsigned char* scanline,
+                                                       const unsigned char* precon, size_t bytewidth, size_t length) {
+  __m128i zero = _mm_setzero_si128(), a = zero, c = zero;
+  size_t i;
+  switch(bytewidth) {
+    case 3: for(i = 0; i != length; i += 3) { const size_t bytewidth = 3; LODEPNG_PAETH_SSE(_mm_abs_epi16) } break;
+    case 4: for(i = 0; i != length; i += 4) { const size_t bytewidth = 4; LODEPNG_PAETH_SSE(_mm_abs_epi16) } break;
+    case 6: for(i = 0; i != length; i += 6) { const size_t bytewidth = 6; LODEPNG_PAETH_SSE(_mm_abs_epi16) } break;
+    default: for(i = 0; i != length; i += 8) { const size_t bytewidth = 8; LODEPNG_PAETH_SSE(_mm_abs_epi16) } break;
+  }
+}
+
+LODEPNG_TARGET("avx2") static void unfilterUpAVX2(unsigned char* recon, const unsigned char* scanline,
+                                                  const unsigned char* precon, size_t length) {
+  size_t i = 0;
+  for(; i + 32u <= length; i += 32u) {
+    __m256i x = _mm256_loadu_si256((const __m256i*)&scanline[i]);
+    _mm256_storeu_si256((__m256i*)&recon[i], _mm256_add_epi8(x, _mm256_loadu_si256((const __m256i*)&precon[i])));
+  }
+  for(; i != length; ++i) recon[i] = scanline[i] + precon[i];
+}
+#endif /*LODEPNG_SIMD_DISPATCH*/
+
+/*returns 1 if the scanline was unfiltered, 0 if the C code must do it*/
+static unsigned unfilterScanlineSIMD(unsigned char* recon, const unsigned char* scanline, const unsigned char* precon,
+                                     size_t bytewidth, unsigned char filterType, size_t length, unsigned simd) {
+  if(simd == LODEPNG_SIMD_NONE) return 0;
+  if(filterType == 2 && precon) {
+#ifdef LODEPNG_SIMD_DISPATCH
+    if(simd >= LODEPNG_SIMD_AVX2) unfilterUpAVX2(recon, scanline, precon, length);
+    else
+#endif /*LODEPNG_SIMD_DISPATCH*/
+    unfilterUpSSE2(recon, scanline, precon, length);
+    return 1;
+  }
+  if(bytewidth != 3 && bytewidth != 4 && bytewidth != 6 && bytewidth != 8) return 0;
+  if(filterType == 1 || (filterType == 4 && !precon)) {
+    LODEPNG_UNFILTER_BYTEWIDTH(unfilterSubSSE2(recon, scanline, bytewidth, length));
+  } else if(filterType == 3 && precon) {
+    LODEPNG_UNFILTER_BYTEWIDTH(unfilterAverageSSE2(recon, scanline, precon, bytewidth, length));
+  } else if(filterType == 4) {
+#ifdef LODEPNG_SIMD_DISPATCH
+    if(simd >= LODEPNG_SIMD_SSSE3) unfilterPaethSSSE3(recon, scanline, precon, bytewidth, length);
+    else
+#endif /*LODEPNG_SIMD_DISPATCH*/
+    LODEPNG_UNFILTER_BYTEWIDTH(unfilterPaethSSE2(recon, scanline, precon, bytewidth, length));
+  } else {
+    return 0;
+  }
+  return 1;
+}
+#endif /*__ARM_NEON*/
+#endif /*LODEPNG_COMPILE_SIMD*/
+
 static unsigned unfilterScanline(unsigned char* recon, const unsigned char* scanline, const unsigned char* precon,
-                                 size_t bytewidth, unsigned char filterType, size_t length) {
+                                 size_t bytewidth, unsigned char filterType, size_t length, unsigned simd) {
   /*
   For PNG filter method 0
   unfilter a PNG image scanline by scanline. when the pixels are smaller than 1 byte,
@@ -4086,9 +5951,15 @@ static unsigned unfilterScanline(unsigned char* recon, const unsigned char* scan
   precon is the previous unfiltered scanline, recon the result, scanline the current one
   the incoming scanlines do NOT include the filtertype byte, that one is given in the parameter filterType instead
   recon and scanline MAY be the same memory address! precon must be disjoint.
+  simd is the SIMD level from lodepng_simd_level, LODEPNG_SIMD_NONE for the C code only.
   */
 
   size_t i;
+#ifdef LODEPNG_COMPILE_SIMD
+  if(unfilterScanlineSIMD(recon, scanline, precon, bytewidth, filterType, length, simd)) return 0;
+#else /*LODEPNG_COMPILE_SIMD*/
+  (void)simd;
+#endif /*LODEPNG_COMPILE_SIMD*/
   switch(filterType) {
     case 0:
       for(i = 0; i != length; ++i) recon[i] = scanline[i];
@@ -4185,6 +6056,7 @@ static unsigned unfilter(unsigned char* out, const unsigned char* in, unsigned w
 
   unsigned y;
   unsigned char* prevline = 0;
+  unsigned simd = lodepng_simd_level();
 
   /*bytewidth is used for filtering, is 1 when bpp < 8, number of bytes per pixel otherwise*/
   size_t bytewidth = (bpp + 7u) / 8u;
@@ -4196,7 +6068,8 @@ static unsigned unfilter(unsigned char* out, const unsigned char* in, unsigned w
     size_t inindex = (1 + linebytes) * y; /*the extra filterbyte added to each row*/
     unsigned char filterType = in[inindex];
 
-    CERROR_TRY_RETURN(unfilterScanline(&out[outindex], &in[inindex + 1], prevline, bytewidth, filterType, linebytes));
+    CERROR_TRY_RETURN(unfilterScanline(&out[outindex], &in[inindex + 1], prevline, bytewidth, filterType, linebytes,
+                                       simd));
 
     prevline = &out[outindex];
   }
@@ -4325,6 +6198,120 @@ static unsigned postProcessScanlines(unsigned char* out, unsigned char* in,
   return 0;
 }
 
+/*destination of lodepng_decode_into and lodepng_decode_rows, written one scanline at a time*/
+typedef struct LodePNGRowWriter {
+  unsigned char* out; /*if not NULL, row y is stored at out + y * stride*/
+  size_t outsize;
+  size_t stride;
+  lodepng_row_callback callback; /*if not NULL, gets every row*/
+  void* user;
+  const LodePNGColorMode* mode_in; /*color mode of the PNG*/
+  const LodePNGColorMode* mode_out; /*color mode of the rows*/
+  unsigned convert;
+  unsigned w, h, y; /*y is the next row*/
+  size_t linebytes; /*bytes of a scanline without the filter type*/
+  size_t bytewidth;
+  unsigned simd; /*SIMD level for unfiltering*/
+  unsigned char* recon; /*current unfiltered scanline*/
+  unsigned char* precon; /*previous unfiltered scanline*/
+  unsigned char* row; /*converted row when there is no out*/
+} LodePNGRowWriter;
+
+static void LodePNGRowWriter_init(LodePNGRowWriter* writer) {
+  lodepng_memset(writer, 0, sizeof(*writer));
+}
+
+static void LodePNGRowWriter_cleanup(LodePNGRowWriter* writer) {
+  lodepng_free(writer->recon);
+  lodepng_free(writer->precon);
+  lodepng_free(writer->row);
+}
+
+/*checks the destination and allocates the scanlines, once the header and palette are read*/
+static unsigned LodePNGRowWriter_start(LodePNGRowWriter* writer, unsigned w, unsigned h, LodePNGState* state) {
+  unsigned bpp = lodepng_get_bpp(&state->info_png.color);
+  size_t rowbytes, size;
+  writer->mode_in = &state->info_png.color;
+  writer->mode_out = state->decoder.color_convert ? &state->info_raw : &state->info_png.color;
+  writer->convert = !lodepng_color_mode_equal(writer->mode_out, writer->mode_in);
+  if(writer->convert && !(writer->mode_out->colortype == LCT_RGB || writer->mode_out->colortype == LCT_RGBA)
+     && !(writer->mode_out->bitdepth == 8)) {
+    return 56; /*unsupported color mode conversion*/
+  }
+  writer->w = w;
+  writer->h = h;
+  writer->y = 0;
+  writer->linebytes = lodepng_get_raw_size_idat(w, 1, bpp) - 1u;
+  writer->bytewidth = (bpp + 7u) / 8u;
+  writer->simd = lodepng_simd_level();
+  rowbytes = lodepng_get_raw_size(w, 1, writer->mode_out);
+  if(writer->out) {
+    /*rows must not overlap and the last one must fit*/
+    if(writer->stride < rowbytes) return 109;
+    if(lodepng_mulofl(h - 1u, writer->stride, &size) || lodepng_addofl(size, rowbytes, &size)) return 109;
+    if(size > writer->outsize) return 109;
+  }
+  writer->recon = (unsigned char*)lodepng_malloc(writer->linebytes);
+  writer->precon = (unsigned char*)lodepng_malloc(writer->linebytes);
+  if(!writer->out && writer->convert) writer->row = (unsigned char*)lodepng_malloc(rowbytes);
+  if(!writer->recon || !writer->precon || (!writer->out && writer->convert && !writer->row)) return 83; /*alloc fail*/
+  /*rows rebuilt from a whole image get padding bits of 0; streamed rows keep the padding bits
+  stored in the file, they are unfiltered with the rest of the scanline and passed through*/
+  lodepng_memset(writer->recon, 0, writer->linebytes);
+  return 0;
+}
+
+/*converts the unfiltered scanline of row y to the destination*/
+static unsigned LodePNGRowWriter_emit(LodePNGRowWriter* writer, const unsigned char* line) {
+  unsigned char* row = writer->out ? writer->out + writer->y * writer->stride : writer->row;
+  unsigned error = 0;
+  if(writer->convert) {
+    error = lodepng_convert(row, line, writer->mode_out, writer->mode_in, writer->w, 1);
+    line = row;
+  } else if(writer->out) {
+    lodepng_memcpy(row, line, writer->linebytes);
+    line = row;
+  }
+  if(!error && writer->callback) error = writer->callback(line, writer->y, writer->user);
+  ++writer->y;
+  return error;
+}
+
+/*unfilters and emits the complete scanlines at the start of data, also the consume function of an inflate sink*/
+static unsigned LodePNGRowWriter_write(void* owner, const unsigned char* data, size_t size, size_t* used) {
+  LodePNGRowWriter* writer = (LodePNGRowWriter*)owner;
+  *used = 0;
+  while(writer->y < writer->h && size - *used > writer->linebytes) {
+    const unsigned char* scanline = &data[*used];
+    unsigned char* swap = writer->precon;
+    CERROR_TRY_RETURN(unfilterScanline(writer->recon, &scanline[1], writer->y ? writer->precon : 0,
+                                       writer->bytewidth, scanline[0], writer->linebytes, writer->simd));
+    CERROR_TRY_RETURN(LodePNGRowWriter_emit(writer, writer->recon));
+    writer->precon = writer->recon;
+    writer->recon = swap;
+    *used += writer->linebytes + 1u;
+  }
+  return 0;
+}
+
+/*emits the rows of a whole image in the color mode of the PNG, as output by postProcessScanlines*/
+static unsigned LodePNGRowWriter_image(LodePNGRowWriter* writer, const unsigned char* image) {
+  size_t linebits = (size_t)writer->w * lodepng_get_bpp(writer->mode_in);
+  while(writer->y < writer->h) {
+    if(linebits % 8u == 0) {
+      CERROR_TRY_RETURN(LodePNGRowWriter_emit(writer, &image[writer->y * (linebits / 8u)]));
+    } else {
+      /*rows are not padded to a byte in the image*/
+      size_t ibp = writer->y * linebits, obp = 0, i;
+      for(i = 0; i != linebits; ++i) {
+        setBitOfReversedStream(&obp, writer->recon, readBitFromReversedStream(&ibp, image));
+      }
+      CERROR_TRY_RETURN(LodePNGRowWriter_emit(writer, writer->recon));
+    }
+  }
+  return 0;
+}
+
 static unsigned readChunk_PLTE(LodePNGColorMode* color, const unsigned char* data, size_t chunkLength) {
   unsigned pos = 0, i;
   color->palettesize = chunkLength / 3u;
@@ -4717,16 +6704,24 @@ unsigned lodepng_inspect_chunk(LodePNGState* state, size_t pos,
 }
 
 /*read a PNG, the result will be in the same color type as the PNG (hence "generic")*/
+/*Reads the PNG into *out, or with rows not NULL hands each row to rows and leaves *out NULL.
+Without interlacing, rows are written while inflating and no image sized buffer is allocated.*/
 static void decodeGeneric(unsigned char** out, unsigned* w, unsigned* h,
                           LodePNGState* state,
-                          const unsigned char* in, size_t insize) {
+                          const unsigned char* in, size_t insize, LodePNGRowWriter* rows) {
   unsigned char IEND = 0;
   const unsigned char* chunk;
-  unsigned char* idat; /*the data from idat chunks, zlib compressed*/
+  unsigned char* idat = 0; /*the data from idat chunks, zlib compressed*/
   size_t idatsize = 0;
+  /*without a custom zlib decoder the IDAT chunks are inflated in place, these point at their data*/
+  const unsigned char** spans = 0;
+  size_t* spansizes = 0;
+  size_t numspans = 0, maxspans = 0;
+  unsigned chained = 0;
   unsigned char* scanlines = 0;
   size_t scanlines_size = 0, expected_size = 0;
   size_t outsize = 0;
+  unsigned written = 0; /*rows are already written*/
 
   /*for unknown chunk order*/
   unsigned unknown = 0;
@@ -4746,9 +6741,14 @@ static void decodeGeneric(unsigned char** out, unsigned* w, unsigned* h,
     CERROR_RETURN(state->error, 92); /*overflow possible due to amount of pixels*/
   }
 
-  /*the input filesize is a safe upper bound for the sum of idat chunks size*/
-  idat = (unsigned char*)lodepng_malloc(insize);
-  if(!idat) CERROR_RETURN(state->error, 83); /*alloc fail*/
+#ifdef LODEPNG_COMPILE_ZLIB
+  chained = !state->decoder.zlibsettings.custom_zlib && !state->decoder.zlibsettings.custom_inflate;
+#endif /*LODEPNG_COMPILE_ZLIB*/
+  if(!chained) {
+    /*the input filesize is a safe upper bound for the sum of idat chunks size*/
+    idat = (unsigned char*)lodepng_malloc(insize);
+    if(!idat) CERROR_RETURN(state->error, 83); /*alloc fail*/
+  }
 
   chunk = &in[33]; /*first byte of the first chunk after the header*/
 
@@ -4785,7 +6785,24 @@ static void decodeGeneric(unsigned char** out, unsigned* w, unsigned* h,
       size_t newsize;
       if(lodepng_addofl(idatsize, chunkLength, &newsize)) CERROR_BREAK(state->error, 95);
       if(newsize > insize) CERROR_BREAK(state->error, 95);
-      lodepng_memcpy(idat + idatsize, data, chunkLength);
+      if(chained) {
+        if(numspans == maxspans) {
+          /*grows by doubling, a PNG has few IDAT chunks compared to its size*/
+          size_t grown = maxspans ? maxspans * 2u : 16u;
+          const unsigned char** newspans = (const unsigned char**)lodepng_realloc((void*)spans, grown * sizeof(*spans));
+          size_t* newsizes;
+          if(!newspans) CERROR_BREAK(state->error, 83); /*alloc fail*/
+          spans = newspans;
+          newsizes = (size_t*)lodepng_realloc(spansizes, grown * sizeof(*spansizes));
+          if(!newsizes) CERROR_BREAK(state->error, 83); /*alloc fail*/
+          spansizes = newsizes;
+          maxspans = grown;
+        }
+        spans[numspans] = data;
+        spansizes[numspans++] = chunkLength;
+      } else {
+        lodepng_memcpy(idat + idatsize, data, chunkLength);
+      }
       idatsize += chunkLength;
 #ifdef LODEPNG_COMPILE_ANCILLARY_CHUNKS
       critical_pos = 3;
@@ -4875,6 +6892,8 @@ static void decodeGeneric(unsigned char** out, unsigned* w, unsigned* h,
     state->error = 106; /* error: PNG file must have PLTE chunk if color type is palette */
   }
 
+  if(!state->error && rows) state->error = LodePNGRowWriter_start(rows, *w, *h, state);
+
   if(!state->error) {
     /*predict output size, to allocate exact size for output buffer to avoid more dynamic allocation.
     If the decompressed size does not match the prediction, the image must be corrupt.*/
@@ -4894,28 +6913,64 @@ static void decodeGeneric(unsigned char** out, unsigned* w, unsigned* h,
       expected_size += lodepng_get_raw_size_idat((*w + 0), (*h + 0) >> 1, bpp);
     }
 
-    state->error = zlib_decompress(&scanlines, &scanlines_size, expected_size, idat, idatsize, &state->decoder.zlibsettings);
+#ifdef LODEPNG_COMPILE_ZLIB
+    if(chained && rows && state->info_png.interlace_method == 0) {
+      /*only the inflate window and two scanlines stay in memory*/
+      LodePNGInflateSink sink;
+      sink.consume = LodePNGRowWriter_write;
+      sink.owner = rows;
+      sink.step = 32768u + rows->linebytes + 1u;
+      state->error = zlib_decompress_spans(&scanlines, &scanlines_size, 0,
+                                           spans, spansizes, numspans, &state->decoder.zlibsettings, &sink);
+      /*every row must be written from exactly the expected amount of data*/
+      if(!state->error && (rows->y != *h || sink.done != scanlines_size)) state->error = 91;
+      written = 1;
+    } else if(chained) {
+      state->error = zlib_decompress_spans(&scanlines, &scanlines_size, expected_size,
+                                           spans, spansizes, numspans, &state->decoder.zlibsettings, 0);
+    } else
+#endif /*LODEPNG_COMPILE_ZLIB*/
+    {
+      state->error = zlib_decompress(&scanlines, &scanlines_size, expected_size, idat, idatsize,
+                                     &state->decoder.zlibsettings);
+    }
+  }
+  if(!state->error && !written && scanlines_size != expected_size) {
+    state->error = 91; /*decompressed size doesn't match prediction*/
   }
-  if(!state->error && scanlines_size != expected_size) state->error = 91; /*decompressed size doesn't match prediction*/
   lodepng_free(idat);
+  lodepng_free((void*)spans);
+  lodepng_free(spansizes);
 
-  if(!state->error) {
+  if(!state->error && rows && !written && state->info_png.interlace_method == 0) {
+    /*inflated by custom_zlib or custom_inflate, all scanlines are there already*/
+    size_t used;
+    state->error = LodePNGRowWriter_write(rows, scanlines, scanlines_size, &used);
+    written = 1;
+  }
+  if(!state->error && !written) {
     outsize = lodepng_get_raw_size(*w, *h, &state->info_png.color);
     *out = (unsigned char*)lodepng_malloc(outsize);
     if(!*out) state->error = 83; /*alloc fail*/
   }
-  if(!state->error) {
+  if(!state->error && !written) {
     lodepng_memset(*out, 0, outsize);
     state->error = postProcessScanlines(*out, scanlines, *w, *h, &state->info_png);
   }
   lodepng_free(scanlines);
+  if(rows) {
+    /*Adam7 needs the whole image before any row is complete*/
+    if(!state->error && !written) state->error = LodePNGRowWriter_image(rows, *out);
+    lodepng_free(*out);
+    *out = 0;
+  }
 }
 
 unsigned lodepng_decode(unsigned char** out, unsigned* w, unsigned* h,
                         LodePNGState* state,
                         const unsigned char* in, size_t insize) {
   *out = 0;
-  decodeGeneric(out, w, h, state, in, insize);
+  decodeGeneric(out, w, h, state, in, insize, 0);
   if(state->error) return state->error;
   if(!state->decoder.color_convert || lodepng_color_mode_equal(&state->info_raw, &state->info_png.color)) {
     /*same color type, no copying or converting of data needed*/
@@ -4948,6 +7003,37 @@ unsigned lodepng_decode(unsigned char** out, unsigned* w, unsigned* h,
   return state->error;
 }
 
+static unsigned decodeRows(LodePNGRowWriter* writer, unsigned* w, unsigned* h,
+                           LodePNGState* state, const unsigned char* in, size_t insize) {
+  unsigned char* image = 0;
+  decodeGeneric(&image, w, h, state, in, insize, writer);
+  LodePNGRowWriter_cleanup(writer);
+  if(!state->error && !state->decoder.color_convert) {
+    /*same as lodepng_decode: info_raw tells the color type of the rows*/
+    state->error = lodepng_color_mode_copy(&state->info_raw, &state->info_png.color);
+  }
+  return state->error;
+}
+
+unsigned lodepng_decode_into(unsigned char* out, size_t outsize, size_t stride, unsigned* w, unsigned* h,
+                             LodePNGState* state, const unsigned char* in, size_t insize) {
+  LodePNGRowWriter writer;
+  LodePNGRowWriter_init(&writer);
+  writer.out = out;
+  writer.outsize = outsize;
+  writer.stride = stride;
+  return decodeRows(&writer, w, h, state, in, insize);
+}
+
+unsigned lodepng_decode_rows(lodepng_row_callback callback, void* user, unsigned* w, unsigned* h,
+                             LodePNGState* state, const unsigned char* in, size_t insize) {
+  LodePNGRowWriter writer;
+  LodePNGRowWriter_init(&writer);
+  writer.callback = callback;
+  writer.user = user;
+  return decodeRows(&writer, w, h, state, in, insize);
+}
+
 unsigned lodepng_decode_memory(unsigned char** out, unsigned* w, unsigned* h, const unsigned char* in,
                                size_t insize, LodePNGColorType colortype, unsigned bitdepth) {
   unsigned error;
@@ -4971,15 +7057,29 @@ unsigned lodepng_decode24(unsigned char** out, unsigned* w, unsigned* h, const u
 #ifdef LODEPNG_COMPILE_DISK
 unsigned lodepng_decode_file(unsigned char** out, unsigned* w, unsigned* h, const char* filename,
                              LodePNGColorType colortype, unsigned bitdepth) {
-  unsigned char* buffer = 0;
   size_t buffersize;
   unsigned error;
   /* safe output values in case error happens */
   *out = 0;
   *w = *h = 0;
-  error = lodepng_load_file(&buffer, &buffersize, filename);
-  if(!error) error = lodepng_decode_memory(out, w, h, buffer, buffersize, colortype, bitdepth);
-  lodepng_free(buffer);
+#ifdef LODEPNG_COMPILE_MMAP
+  {
+    /*decoded straight from the page cache, the file is never copied*/
+    const unsigned char* mapped;
+    error = lodepng_map_file(&mapped, &buffersize, filename);
+    if(!error) {
+      error = lodepng_decode_memory(out, w, h, mapped, buffersize, colortype, bitdepth);
+      lodepng_unmap_file(mapped, buffersize);
+      return error;
+    }
+  }
+#endif /*LODEPNG_COMPILE_MMAP*/
+  {
+    unsigned char* buffer = 0;
+    error = lodepng_load_file(&buffer, &buffersize, filename);
+    if(!error) error = lodepng_decode_memory(out, w, h, buffer, buffersize, colortype, bitdepth);
+    lodepng_free(buffer);
+  }
   return error;
 }
 
@@ -5332,20 +7432,272 @@ static unsigned addChunk_iCCP(ucvector* out, const LodePNGInfo* info, LodePNGCom
 
 #endif /*LODEPNG_COMPILE_ANCILLARY_CHUNKS*/
 
+#ifdef LODEPNG_COMPILE_SIMD
+/*
+SIMD filtering for the encoder. Filtering only reads the unfiltered row and the one above, so unlike
+unfiltering there is no dependency between pixels: every filter runs 16 (AVX2: 32) bytes per step for
+any pixel size. The first pixel and the tail of the row are left to the C code.
+*/
+#ifdef __ARM_NEON
+
+/*paethPredictor on 8 bytes, through 16-bit lanes*/
+static LODEPNG_INLINE uint8x8_t paethNEON(uint8x8_t a, uint8x8_t b, uint8x8_t c) {
+  uint16x8_t pa = vabdl_u8(b, c);
+  uint16x8_t pb = vabdl_u8(a, c);
+  int16x8_t sum = vaddq_s16(vreinterpretq_s16_u16(vsubl_u8(b, c)), vreinterpretq_s16_u16(vsubl_u8(a, c)));
+  uint16x8_t pc = vreinterpretq_u16_s16(vabsq_s16(sum));
+  uint16x8_t smallest = vminq_u16(vminq_u16(pa, pb), pc);
+  /*ties prefer a, then b*/
+  return vbsl_u8(vmovn_u16(vceqq_u16(smallest, pa)), a, vbsl_u8(vmovn_u16(vceqq_u16(smallest, pb)), b, c));
+}
+
+/*filters whole vectors from the second pixel on (Up: from the start), returns where the C code continues*/
+static size_t filterScanlineSIMD(unsigned char* out, const unsigned char* scanline, const unsigned char* prevline,
+                                 size_t length, size_t bytewidth, unsigned char filterType, unsigned simd) {
+  size_t i = bytewidth;
+  if(simd == LODEPNG_SIMD_NONE || filterType == 0 || filterType > 4) return 0;
+  if(filterType == 2) {
+    if(!prevline) return 0;
+    for(i = 0; i + 16u <= length; i += 16u) {
+      vst1q_u8(&out[i], vsubq_u8(vld1q_u8(&scanline[i]), vld1q_u8(&prevline[i])));
+    }
+  } else if(filterType == 1 || (filterType == 4 && !prevline)) {
+    for(; i + 16u <= length; i += 16u) {
+      vst1q_u8(&out[i], vsubq_u8(vld1q_u8(&scanline[i]), vld1q_u8(&scanline[i - bytewidth])));
+    }
+  } else if(filterType == 3 && !prevline) {
+    for(; i + 16u <= length; i += 16u) {
+      vst1q_u8(&out[i], vsubq_u8(vld1q_u8(&scanline[i]), vshrq_n_u8(vld1q_u8(&scanline[i - bytewidth]), 1)));
+    }
+  } else if(filterType == 3) {
+    /*halving add rounds down, as (a + b) >> 1*/
+    for(; i + 16u <= length; i += 16u) {
+      uint8x16_t avg = vhaddq_u8(vld1q_u8(&scanline[i - bytewidth]), vld1q_u8(&prevline[i]));
+      vst1q_u8(&out[i], vsubq_u8(vld1q_u8(&scanline[i]), avg));
+    }
+  } else {
+    for(; i + 16u <= length; i += 16u) {
+      uint8x16_t a = vld1q_u8(&scanline[i - bytewidth]), b = vld1q_u8(&prevline[i]);
+      uint8x16_t c = vld1q_u8(&prevline[i - bytewidth]);
+      uint8x16_t p = vcombine_u8(paethNEON(vget_low_u8(a), vget_low_u8(b), vget_low_u8(c)),
+                                 paethNEON(vget_high_u8(a), vget_high_u8(b), vget_high_u8(c)));
+      vst1q_u8(&out[i], vsubq_u8(vld1q_u8(&scanline[i]), p));
+    }
+  }
+  return i;
+}
+
+/*adds the bytes of whole vectors to *sum, as signed distances from 0 when differences is set,
+returns where the C code continues*/
+static size_t filterSumSIMD(size_t* sum, const unsigned char* data, size_t length, unsigned differences,
+                            unsigned simd) {
+  uint32x4_t acc = vdupq_n_u32(0);
+  unsigned lanes[4];
+  size_t i = 0;
+  if(simd == LODEPNG_SIMD_NONE) return 0;
+  for(; i + 16u <= length; i += 16u) {
+    uint8x16_t v = vld1q_u8(&data[i]);
+    /*min(s, 255 - s) is s below 128 and 255 - s above*/
+    if(differences) v = vminq_u8(v, vmvnq_u8(v));
+    acc = vpadalq_u16(acc, vpaddlq_u8(v));
+  }
+  vst1q_u32(lanes, acc);
+  *sum += (size_t)lanes[0] + lanes[1] + lanes[2] + lanes[3];
+  return i;
+}
+
+#else /*x86*/
+
+/*paethPredictor on 8 bytes widened to 16-bit lanes*/
+static LODEPNG_INLINE __m128i paethHalfSSE2(__m128i a, __m128i b, __m128i c) {
+  __m128i zero = _mm_setzero_si128();
+  __m128i pa = _mm_sub_epi16(b, c); /*p - a*/
+  __m128i pb = _mm_sub_epi16(a, c); /*p - b*/
+  __m128i pc = _mm_add_epi16(pa, pb); /*p - c*/
+  __m128i smallest, nearest, isa, isb;
+  pa = _mm_max_epi16(pa, _mm_sub_epi16(zero, pa));
+  pb = _mm_max_epi16(pb, _mm_sub_epi16(zero, pb));
+  pc = _mm_max_epi16(pc, _mm_sub_epi16(zero, pc));
+  smallest = _mm_min_epi16(pc, _mm_min_epi16(pa, pb));
+  /*ties prefer a, then b*/
+  isa = _mm_cmpeq_epi16(smallest, pa);
+  isb = _mm_cmpeq_epi16(smallest, pb);
+  nearest = _mm_or_si128(_mm_and_si128(isb, b), _mm_andnot_si128(isb, c));
+  return _mm_or_si128(_mm_and_si128(isa, a), _mm_andnot_si128(isa, nearest));
+}
+
+static size_t filterScanlineSSE2(unsigned char* out, const unsigned char* scanline, const unsigned char* prevline,
+                                 size_t length, size_t bytewidth, unsigned char filterType) {
+  __m128i zero = _mm_setzero_si128();
+  size_t i = bytewidth;
+#define LODEPNG_LOAD(p) _mm_loadu_si128((const __m128i*)(p))
+  if(filterType == 2) {
+    for(i = 0; i + 16u <= length; i += 16u) {
+      _mm_storeu_si128((__m128i*)&out[i], _mm_sub_epi8(LODEPNG_LOAD(&scanline[i]), LODEPNG_LOAD(&prevline[i])));
+    }
+  } else if(filterType == 1 || (filterType == 4 && !prevline)) {
+    for(; i + 16u <= length; i += 16u) {
+      __m128i a = LODEPNG_LOAD(&scanline[i - bytewidth]);
+      _mm_storeu_si128((__m128i*)&out[i], _mm_sub_epi8(LODEPNG_LOAD(&scanline[i]), a));
+    }
+  } else if(filterType == 3 && !prevline) {
+    __m128i low7 = _mm_set1_epi8(127);
+    for(; i + 16u <= length; i += 16u) {
+      /*there is no byte shift, shift 16-bit lanes and drop the bit shifted in from the byte above*/
+      __m128i half = _mm_and_si128(_mm_srli_epi16(LODEPNG_LOAD(&scanline[i - bytewidth]), 1), low7);
+      _mm_storeu_si128((__m128i*)&out[i], _mm_sub_epi8(LODEPNG_LOAD(&scanline[i]), half));
+    }
+  } else if(filterType == 3) {
+    __m128i one = _mm_set1_epi8(1);
+    for(; i + 16u <= length; i += 16u) {
+      __m128i a = LODEPNG_LOAD(&scanline[i - bytewidth]), b = LODEPNG_LOAD(&prevline[i]);
+      /*pavgb rounds up, (a + b) >> 1 rounds down: subtract the low bit of a ^ b*/
+      __m128i avg = _mm_sub_epi8(_mm_avg_epu8(a, b), _mm_and_si128(_mm_xor_si128(a, b), one));
+      _mm_storeu_si128((__m128i*)&out[i], _mm_sub_epi8(LODEPNG_LOAD(&scanline[i]), avg));
+    }
+  } else {
+    for(; i + 16u <= length; i += 16u) {
+      __m128i a = LODEPNG_LOAD(&scanline[i - bytewidth]), b = LODEPNG_LOAD(&prevline[i]);
+      __m128i c = LODEPNG_LOAD(&prevline[i - bytewidth]);
+      __m128i lo = paethHalfSSE2(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero), _mm_unpacklo_epi8(c, zero));
+      __m128i hi = paethHalfSSE2(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero), _mm_unpackhi_epi8(c, zero));
+      _mm_storeu_si128((__m128i*)&out[i], _mm_sub_epi8(LODEPNG_LOAD(&scanline[i]), _mm_packus_epi16(lo, hi)));
+    }
+  }
+#undef LODEPNG_LOAD
+  return i;
+}
+
+static size_t filterSumSSE2(size_t* sum, const unsigned char* data, size_t length, unsigned differences) {
+  __m128i zero = _mm_setzero_si128(), ones = _mm_set1_epi8(-1), acc = zero;
+  size_t i = 0;
+  for(; i + 16u <= length; i += 16u) {
+    __m128i v = _mm_loadu_si128((const __m128i*)&data[i]);
+    /*min(s, 255 - s) is s below 128 and 255 - s above*/
+    if(differences) v = _mm_min_epu8(v, _mm_xor_si128(v, ones));
+    acc = _mm_add_epi64(acc, _mm_sad_epu8(v, zero));
+  }
+  *sum += (size_t)(unsigned)_mm_cvtsi128_si32(acc) + (unsigned)_mm_cvtsi128_si32(_mm_unpackhi_epi64(acc, acc));
+  return i;
+}
+
+#ifdef LODEPNG_SIMD_DISPATCH
+LODEPNG_TARGET("avx2") static __m256i paethHalfAVX2(__m256i a, __m256i b, __m256i c) {
+  __m256i pa = _mm256_abs_epi16(_mm256_sub_epi16(b, c));
+  __m256i pb = _mm256_abs_epi16(_mm256_sub_epi16(a, c));
+  __m256i pc = _mm256_abs_epi16(_mm256_add_epi16(_mm256_sub_epi16(b, c), _mm256_sub_epi16(a, c)));
+  __m256i smallest = _mm256_min_epi16(pc, _mm256_min_epi16(pa, pb));
+  /*ties prefer a, then b*/
+  __m256i nearest = _mm256_blendv_epi8(c, b, _mm256_cmpeq_epi16(smallest, pb));
+  return _mm256_blendv_epi8(nearest, a, _mm256_cmpeq_epi16(smallest, pa));
+}
+
+/*as the SSE2 version, the 16-bit lanes unpack and pack within each 128-bit half so the order holds*/
+LODEPNG_TARGET("avx2") static size_t filterScanlineAVX2(unsigned char* out, const unsigned char* scanline,
+                                                        const unsigned char* prevline, size_t length,
+                                                        size_t bytewidth, unsigned char filterType) {
+  __m256i zero = _mm256_setzero_si256();
+  size_t i = bytewidth;
+#define LODEPNG_LOAD(p) _mm256_loadu_si256((const __m256i*)(p))
+  if(filterType == 2) {
+    for(i = 0; i + 32u <= length; i += 32u) {
+      _mm256_storeu_si256((__m256i*)&out[i], _mm256_sub_epi8(LODEPNG_LOAD(&scanline[i]), LODEPNG_LOAD(&prevline[i])));
+    }
+  } else if(filterType == 1 || (filterType == 4 && !prevline)) {
+    for(; i + 32u <= length; i += 32u) {
+      __m256i a = LODEPNG_LOAD(&scanline[i - bytewidth]);
+      _mm256_storeu_si256((__m256i*)&out[i], _mm256_sub_epi8(LODEPNG_LOAD(&scanline[i]), a));
+    }
+  } else if(filterType == 3 && !prevline) {
+    __m256i low7 = _mm256_set1_epi8(127);
+    for(; i + 32u <= length; i += 32u) {
+      __m256i half = _mm256_and_si256(_mm256_srli_epi16(LODEPNG_LOAD(&scanline[i - bytewidth]), 1), low7);
+      _mm256_storeu_si256((__m256i*)&out[i], _mm256_sub_epi8(LODEPNG_LOAD(&scanline[i]), half));
+    }
+  } else if(filterType == 3) {
+    __m256i one = _mm256_set1_epi8(1);
+    for(; i + 32u <= length; i += 32u) {
+      __m256i a = LODEPNG_LOAD(&scanline[i - bytewidth]), b = LODEPNG_LOAD(&prevline[i]);
+      __m256i avg = _mm256_sub_epi8(_mm256_avg_epu8(a, b), _mm256_and_si256(_mm256_xor_si256(a, b), one));
+      _mm256_storeu_si256((__m256i*)&out[i], _mm256_sub_epi8(LODEPNG_LOAD(&scanline[i]), avg));
+    }
+  } else {
+    for(; i + 32u <= length; i += 32u) {
+      __m256i a = LODEPNG_LOAD(&scanline[i - bytewidth]), b = LODEPNG_LOAD(&prevline[i]);
+      __m256i c = LODEPNG_LOAD(&prevline[i - bytewidth]);
+      __m256i lo = paethHalfAVX2(_mm256_unpacklo_epi8(a, zero), _mm256_unpacklo_epi8(b, zero),
+                                 _mm256_unpacklo_epi8(c, zero));
+      __m256i hi = paethHalfAVX2(_mm256_unpackhi_epi8(a, zero), _mm256_unpackhi_epi8(b, zero),
+                                 _mm256_unpackhi_epi8(c, zero));
+      _mm256_storeu_si256((__m256i*)&out[i], _mm256_sub_epi8(LODEPNG_LOAD(&scanline[i]), _mm256_packus_epi16(lo, hi)));
+    }
+  }
+#undef LODEPNG_LOAD
+  return i;
+}
+
+LODEPNG_TARGET("avx2") static size_t filterSumAVX2(size_t* sum, const unsigned char* data, size_t length,
+                                                   unsigned differences) {
+  __m256i zero = _mm256_setzero_si256(), ones = _mm256_set1_epi8(-1), acc = zero;
+  __m128i half;
+  size_t i = 0;
+  for(; i + 32u <= length; i += 32u) {
+    __m256i v = _mm256_loadu_si256((const __m256i*)&data[i]);
+    if(differences) v = _mm256_min_epu8(v, _mm256_xor_si256(v, ones));
+    acc = _mm256_add_epi64(acc, _mm256_sad_epu8(v, zero));
+  }
+  half = _mm_add_epi64(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+  *sum += (size_t)(unsigned)_mm_cvtsi128_si32(half) + (unsigned)_mm_cvtsi128_si32(_mm_unpackhi_epi64(half, half));
+  return i;
+}
+#endif /*LODEPNG_SIMD_DISPATCH*/
+
+/*filters whole vectors from the second pixel on (Up: from the start), returns where the C code continues*/
+static size_t filterScanlineSIMD(unsigned char* out, const unsigned char* scanline, const unsigned char* prevline,
+                                 size_t length, size_t bytewidth, unsigned char filterType, unsigned simd) {
+  if(simd == LODEPNG_SIMD_NONE || filterType == 0 || filterType > 4 || (filterType == 2 && !prevline)) return 0;
+#ifdef LODEPNG_SIMD_DISPATCH
+  if(simd >= LODEPNG_SIMD_AVX2) return filterScanlineAVX2(out, scanline, prevline, length, bytewidth, filterType);
+#endif /*LODEPNG_SIMD_DISPATCH*/
+  return filterScanlineSSE2(out, scanline, prevline, length, bytewidth, filterType);
+}
+
+/*adds the bytes of whole vectors to *sum, as signed distances from 0 when differences is set,
+returns where the C code continues*/
+static size_t filterSumSIMD(size_t* sum, const unsigned char* data, size_t length, unsigned differences,
+                            unsigned simd) {
+  if(simd == LODEPNG_SIMD_NONE) return 0;
+#ifdef LODEPNG_SIMD_DISPATCH
+  if(simd >= LODEPNG_SIMD_AVX2) return filterSumAVX2(sum, data, length, differences);
+#endif /*LODEPNG_SIMD_DISPATCH*/
+  return filterSumSSE2(sum, data, length, differences);
+}
+#endif /*__ARM_NEON*/
+#endif /*LODEPNG_COMPILE_SIMD*/
+
+/*simd is the SIMD level from lodepng_simd_level, LODEPNG_SIMD_NONE for the C code only*/
 static void filterScanline(unsigned char* out, const unsigned char* scanline, const unsigned char* prevline,
-                           size_t length, size_t bytewidth, unsigned char filterType) {
-  size_t i;
+                           size_t length, size_t bytewidth, unsigned char filterType, unsigned simd) {
+  size_t i, start, rest;
+#ifdef LODEPNG_COMPILE_SIMD
+  /*the C code only does the first pixel and what the vectors left*/
+  start = filterScanlineSIMD(out, scanline, prevline, length, bytewidth, filterType, simd);
+#else /*LODEPNG_COMPILE_SIMD*/
+  start = 0;
+  (void)simd;
+#endif /*LODEPNG_COMPILE_SIMD*/
+  rest = LODEPNG_MAX(bytewidth, start); /*continues the loops after the first pixel*/
   switch(filterType) {
     case 0: /*None*/
       for(i = 0; i != length; ++i) out[i] = scanline[i];
       break;
     case 1: /*Sub*/
       for(i = 0; i != bytewidth; ++i) out[i] = scanline[i];
-      for(i = bytewidth; i < length; ++i) out[i] = scanline[i] - scanline[i - bytewidth];
+      for(i = rest; i < length; ++i) out[i] = scanline[i] - scanline[i - bytewidth];
       break;
     case 2: /*Up*/
       if(prevline) {
-        for(i = 0; i != length; ++i) out[i] = scanline[i] - prevline[i];
+        for(i = start; i < length; ++i) out[i] = scanline[i] - prevline[i];
       } else {
         for(i = 0; i != length; ++i) out[i] = scanline[i];
       }
@@ -5353,29 +7705,63 @@ static void filterScanline(unsigned char* out, const unsigned char* scanline, co
     case 3: /*Average*/
       if(prevline) {
         for(i = 0; i != bytewidth; ++i) out[i] = scanline[i] - (prevline[i] >> 1);
-        for(i = bytewidth; i < length; ++i) out[i] = scanline[i] - ((scanline[i - bytewidth] + prevline[i]) >> 1);
+        for(i = rest; i < length; ++i) out[i] = scanline[i] - ((scanline[i - bytewidth] + prevline[i]) >> 1);
       } else {
         for(i = 0; i != bytewidth; ++i) out[i] = scanline[i];
-        for(i = bytewidth; i < length; ++i) out[i] = scanline[i] - (scanline[i - bytewidth] >> 1);
+        for(i = rest; i < length; ++i) out[i] = scanline[i] - (scanline[i - bytewidth] >> 1);
       }
       break;
     case 4: /*Paeth*/
       if(prevline) {
         /*paethPredictor(0, prevline[i], 0) is always prevline[i]*/
         for(i = 0; i != bytewidth; ++i) out[i] = (scanline[i] - prevline[i]);
-        for(i = bytewidth; i < length; ++i) {
+        for(i = rest; i < length; ++i) {
           out[i] = (scanline[i] - paethPredictor(scanline[i - bytewidth], prevline[i], prevline[i - bytewidth]));
         }
       } else {
         for(i = 0; i != bytewidth; ++i) out[i] = scanline[i];
         /*paethPredictor(scanline[i - bytewidth], 0, 0) is always scanline[i - bytewidth]*/
-        for(i = bytewidth; i < length; ++i) out[i] = (scanline[i] - scanline[i - bytewidth]);
+        for(i = rest; i < length; ++i) out[i] = (scanline[i] - scanline[i - bytewidth]);
       }
       break;
     default: return; /*invalid filter type given*/
   }
 }
 
+/*the LFS_MINSUM measure of a filtered row: filter types other than 0 are differences, so their bytes
+count as signed, values above 127 are negative*/
+static size_t filterSum(const unsigned char* data, size_t length, unsigned char filterType, unsigned simd) {
+  size_t x, sum = 0;
+#ifdef LODEPNG_COMPILE_SIMD
+  x = filterSumSIMD(&sum, data, length, filterType != 0, simd);
+#else /*LODEPNG_COMPILE_SIMD*/
+  x = 0;
+  (void)simd;
+#endif /*LODEPNG_COMPILE_SIMD*/
+  if(filterType == 0) {
+    for(; x != length; ++x) sum += data[x];
+  } else {
+    for(; x != length; ++x) sum += data[x] < 128 ? data[x] : (255U - data[x]);
+  }
+  return sum;
+}
+
+/*byte histogram of a row for LFS_ENTROPY. Four tables take turns, so runs of equal bytes don't
+wait on the previous increment of the same counter.*/
+static void filterHistogram(unsigned* count, const unsigned char* data, size_t length) {
+  unsigned tables[4][256];
+  size_t x = 0;
+  lodepng_memset(tables, 0, sizeof(tables));
+  for(; x + 4u <= length; x += 4u) {
+    ++tables[0][data[x + 0]];
+    ++tables[1][data[x + 1]];
+    ++tables[2][data[x + 2]];
+    ++tables[3][data[x + 3]];
+  }
+  for(; x != length; ++x) ++tables[0][data[x]];
+  for(x = 0; x != 256; ++x) count[x] = tables[0][x] + tables[1][x] + tables[2][x] + tables[3][x];
+}
+
 /* integer binary logarithm, max return value is 31 */
 static size_t ilog2(size_t i) {
   size_t result = 0;
@@ -5397,50 +7783,21 @@ static size_t ilog2i(size_t i) {
   return i * l + ((i - (1u << l)) << 1u);
 }
 
-static unsigned filter(unsigned char* out, const unsigned char* in, unsigned w, unsigned h,
-                       const LodePNGColorMode* color, const LodePNGEncoderSettings* settings) {
-  /*
-  For PNG filter method 0
-  out must be a buffer with as size: h + (w * h * bpp + 7u) / 8u, because there are
-  the scanlines with 1 extra byte per scanline
-  */
-
-  unsigned bpp = lodepng_get_bpp(color);
-  /*the width of a scanline in bytes, not including the filter type*/
-  size_t linebytes = lodepng_get_raw_size_idat(w, 1, bpp) - 1u;
-
-  /*bytewidth is used for filtering, is 1 when bpp < 8, number of bytes per pixel otherwise*/
-  size_t bytewidth = (bpp + 7u) / 8u;
-  const unsigned char* prevline = 0;
+/*filters the rows y0 to y1 - 1, in has linebytes per row and out one more for the filter type*/
+static unsigned filterRows(unsigned char* out, const unsigned char* in, size_t linebytes, size_t bytewidth,
+                           unsigned y0, unsigned y1, LodePNGFilterStrategy strategy,
+                           const LodePNGEncoderSettings* settings, unsigned simd) {
+  const unsigned char* prevline = y0 ? &in[(y0 - 1u) * linebytes] : 0;
   unsigned x, y;
   unsigned error = 0;
-  LodePNGFilterStrategy strategy = settings->filter_strategy;
-
-  /*
-  There is a heuristic called the minimum sum of absolute differences heuristic, suggested by the PNG standard:
-   *  If the image type is Palette, or the bit depth is smaller than 8, then do not filter the image (i.e.
-      use fixed filtering, with the filter None).
-   * (The other case) If the image type is Grayscale or RGB (with or without Alpha), and the bit depth is
-     not smaller than 8, then use adaptive filtering heuristic as follows: independently for each row, apply
-     all five filters and select the filter that produces the smallest sum of absolute values per row.
-  This heuristic is used if filter strategy is LFS_MINSUM and filter_palette_zero is true.
-
-  If filter_palette_zero is true and filter_strategy is not LFS_MINSUM, the above heuristic is followed,
-  but for "the other case", whatever strategy filter_strategy is set to instead of the minimum sum
-  heuristic is used.
-  */
-  if(settings->filter_palette_zero &&
-     (color->colortype == LCT_PALETTE || color->bitdepth < 8)) strategy = LFS_ZERO;
-
-  if(bpp == 0) return 31; /*error: invalid color type*/
 
   if(strategy >= LFS_ZERO && strategy <= LFS_FOUR) {
     unsigned char type = (unsigned char)strategy;
-    for(y = 0; y != h; ++y) {
+    for(y = y0; y != y1; ++y) {
       size_t outindex = (1 + linebytes) * y; /*the extra filterbyte added to each row*/
       size_t inindex = linebytes * y;
       out[outindex] = type; /*filter type byte*/
-      filterScanline(&out[outindex + 1], &in[inindex], prevline, linebytes, bytewidth, type);
+      filterScanline(&out[outindex + 1], &in[inindex], prevline, linebytes, bytewidth, type, simd);
       prevline = &in[inindex];
     }
   } else if(strategy == LFS_MINSUM) {
@@ -5455,24 +7812,15 @@ static unsigned filter(unsigned char* out, const unsigned char* in, unsigned w,
     }
 
     if(!error) {
-      for(y = 0; y != h; ++y) {
+      for(y = y0; y != y1; ++y) {
         /*try the 5 filter types*/
         for(type = 0; type != 5; ++type) {
-          size_t sum = 0;
-          filterScanline(attempt[type], &in[y * linebytes], prevline, linebytes, bytewidth, type);
-
-          /*calculate the sum of the result*/
-          if(type == 0) {
-            for(x = 0; x != linebytes; ++x) sum += (unsigned char)(attempt[type][x]);
-          } else {
-            for(x = 0; x != linebytes; ++x) {
-              /*For differences, each byte should be treated as signed, values above 127 are negative
-              (converted to signed char). Filtertype 0 isn't a difference though, so use unsigned there.
-              This means filtertype 0 is almost never chosen, but that is justified.*/
-              unsigned char s = attempt[type][x];
-              sum += s < 128 ? s : (255U - s);
-            }
-          }
+          size_t sum;
+          filterScanline(attempt[type], &in[y * linebytes], prevline, linebytes, bytewidth, type, simd);
+
+          /*calculate the sum of the result. Filtertype 0 isn't a difference, so its bytes count as
+          unsigned. This means filtertype 0 is almost never chosen, but that is justified.*/
+          sum = filterSum(attempt[type], linebytes, type, simd);
 
           /*check if this is smallest sum (or if type == 0 it's the first case so always store the values)*/
           if(type == 0 || sum < smallest) {
@@ -5485,7 +7833,7 @@ static unsigned filter(unsigned char* out, const unsigned char* in, unsigned w,
 
         /*now fill the out values*/
         out[y * (linebytes + 1)] = bestType; /*the first byte of a scanline will be the filter type*/
-        for(x = 0; x != linebytes; ++x) out[y * (linebytes + 1) + 1 + x] = attempt[bestType][x];
+        lodepng_memcpy(&out[y * (linebytes + 1) + 1], attempt[bestType], linebytes);
       }
     }
 
@@ -5502,13 +7850,12 @@ static unsigned filter(unsigned char* out, const unsigned char* in, unsigned w,
     }
 
     if(!error) {
-      for(y = 0; y != h; ++y) {
+      for(y = y0; y != y1; ++y) {
         /*try the 5 filter types*/
         for(type = 0; type != 5; ++type) {
           size_t sum = 0;
-          filterScanline(attempt[type], &in[y * linebytes], prevline, linebytes, bytewidth, type);
-          lodepng_memset(count, 0, 256 * sizeof(*count));
-          for(x = 0; x != linebytes; ++x) ++count[attempt[type][x]];
+          filterScanline(attempt[type], &in[y * linebytes], prevline, linebytes, bytewidth, type, simd);
+          filterHistogram(count, attempt[type], linebytes);
           ++count[type]; /*the filter type itself is part of the scanline*/
           for(x = 0; x != 256; ++x) {
             sum += ilog2i(count[x]);
@@ -5524,18 +7871,18 @@ static unsigned filter(unsigned char* out, const unsigned char* in, unsigned w,
 
         /*now fill the out values*/
         out[y * (linebytes + 1)] = bestType; /*the first byte of a scanline will be the filter type*/
-        for(x = 0; x != linebytes; ++x) out[y * (linebytes + 1) + 1 + x] = attempt[bestType][x];
+        lodepng_memcpy(&out[y * (linebytes + 1) + 1], attempt[bestType], linebytes);
       }
     }
 
     for(type = 0; type != 5; ++type) lodepng_free(attempt[type]);
   } else if(strategy == LFS_PREDEFINED) {
-    for(y = 0; y != h; ++y) {
+    for(y = y0; y != y1; ++y) {
       size_t outindex = (1 + linebytes) * y; /*the extra filterbyte added to each row*/
       size_t inindex = linebytes * y;
       unsigned char type = settings->predefined_filters[y];
       out[outindex] = type; /*filter type byte*/
-      filterScanline(&out[outindex + 1], &in[inindex], prevline, linebytes, bytewidth, type);
+      filterScanline(&out[outindex + 1], &in[inindex], prevline, linebytes, bytewidth, type, simd);
       prevline = &in[inindex];
     }
   } else if(strategy == LFS_BRUTE_FORCE) {
@@ -5558,17 +7905,18 @@ static unsigned filter(unsigned char* out, const unsigned char* in, unsigned w,
     images only, so disable it*/
     zlibsettings.custom_zlib = 0;
     zlibsettings.custom_deflate = 0;
+    zlibsettings.parallel_for = 0; /*a row is far below a band, and this may run on a task already*/
     for(type = 0; type != 5; ++type) {
       attempt[type] = (unsigned char*)lodepng_malloc(linebytes);
       if(!attempt[type]) error = 83; /*alloc fail*/
     }
     if(!error) {
-      for(y = 0; y != h; ++y) /*try the 5 filter types*/ {
+      for(y = y0; y != y1; ++y) /*try the 5 filter types*/ {
         for(type = 0; type != 5; ++type) {
           unsigned testsize = (unsigned)linebytes;
           /*if(testsize > 8) testsize /= 8;*/ /*it already works good enough by testing a part of the row*/
 
-          filterScanline(attempt[type], &in[y * linebytes], prevline, linebytes, bytewidth, type);
+          filterScanline(attempt[type], &in[y * linebytes], prevline, linebytes, bytewidth, type, simd);
           size[type] = 0;
           dummy = 0;
           zlib_compress(&dummy, &size[type], attempt[type], testsize, &zlibsettings);
@@ -5581,7 +7929,7 @@ static unsigned filter(unsigned char* out, const unsigned char* in, unsigned w,
         }
         prevline = &in[y * linebytes];
         out[y * (linebytes + 1)] = bestType; /*the first byte of a scanline will be the filter type*/
-        for(x = 0; x != linebytes; ++x) out[y * (linebytes + 1) + 1 + x] = attempt[bestType][x];
+        lodepng_memcpy(&out[y * (linebytes + 1) + 1], attempt[bestType], linebytes);
       }
     }
     for(type = 0; type != 5; ++type) lodepng_free(attempt[type]);
@@ -5591,6 +7939,88 @@ static unsigned filter(unsigned char* out, const unsigned char* in, unsigned w,
   return error;
 }
 
+/*bands of rows of an image, each filtered by a task of parallel_for*/
+typedef struct FilterBands {
+  unsigned char* out;
+  const unsigned char* in;
+  size_t linebytes, bytewidth;
+  unsigned h, rows; /*rows of the image and per band*/
+  LodePNGFilterStrategy strategy;
+  const LodePNGEncoderSettings* settings;
+  unsigned simd;
+  unsigned* error;
+} FilterBands;
+
+static void filterBand(void* data, size_t index) {
+  FilterBands* bands = (FilterBands*)data;
+  unsigned y0 = (unsigned)index * bands->rows;
+  unsigned y1 = bands->h - y0 > bands->rows ? y0 + bands->rows : bands->h;
+  bands->error[index] = filterRows(bands->out, bands->in, bands->linebytes, bands->bytewidth, y0, y1,
+                                   bands->strategy, bands->settings, bands->simd);
+}
+
+static unsigned filter(unsigned char* out, const unsigned char* in, unsigned w, unsigned h,
+                       const LodePNGColorMode* color, const LodePNGEncoderSettings* settings) {
+  /*
+  For PNG filter method 0
+  out must be a buffer with as size: h + (w * h * bpp + 7u) / 8u, because there are
+  the scanlines with 1 extra byte per scanline
+  */
+
+  unsigned bpp = lodepng_get_bpp(color);
+  /*the width of a scanline in bytes, not including the filter type*/
+  size_t linebytes = lodepng_get_raw_size_idat(w, 1, bpp) - 1u;
+
+  /*bytewidth is used for filtering, is 1 when bpp < 8, number of bytes per pixel otherwise*/
+  size_t bytewidth = (bpp + 7u) / 8u;
+  LodePNGFilterStrategy strategy = settings->filter_strategy;
+  /*brute force deflates every row five times, so its bands are smaller to share the work more evenly*/
+  size_t bandsize = strategy == LFS_BRUTE_FORCE ? LODEPNG_BAND_SIZE / 16u : LODEPNG_BAND_SIZE;
+  unsigned simd = lodepng_simd_level();
+
+  /*
+  There is a heuristic called the minimum sum of absolute differences heuristic, suggested by the PNG standard:
+   *  If the image type is Palette, or the bit depth is smaller than 8, then do not filter the image (i.e.
+      use fixed filtering, with the filter None).
+   * (The other case) If the image type is Grayscale or RGB (with or without Alpha), and the bit depth is
+     not smaller than 8, then use adaptive filtering heuristic as follows: independently for each row, apply
+     all five filters and select the filter that produces the smallest sum of absolute values per row.
+  This heuristic is used if filter strategy is LFS_MINSUM and filter_palette_zero is true.
+
+  If filter_palette_zero is true and filter_strategy is not LFS_MINSUM, the above heuristic is followed,
+  but for "the other case", whatever strategy filter_strategy is set to instead of the minimum sum
+  heuristic is used.
+  */
+  if(settings->filter_palette_zero &&
+     (color->colortype == LCT_PALETTE || color->bitdepth < 8)) strategy = LFS_ZERO;
+
+  if(bpp == 0) return 31; /*error: invalid color type*/
+
+  if(settings->zlibsettings.parallel_for && (size_t)h * linebytes > bandsize) {
+    /*rows only depend on the unfiltered row above, so bands can be filtered in any order*/
+    FilterBands bands;
+    size_t i, count;
+    unsigned error = 0;
+    bands.out = out;
+    bands.in = in;
+    bands.linebytes = linebytes;
+    bands.bytewidth = bytewidth;
+    bands.h = h;
+    bands.rows = (unsigned)LODEPNG_MAX(1u, bandsize / linebytes);
+    bands.strategy = strategy;
+    bands.settings = settings;
+    bands.simd = simd;
+    count = (h + bands.rows - 1u) / bands.rows;
+    bands.error = (unsigned*)lodepng_malloc(count * sizeof(unsigned));
+    if(!bands.error) return 83; /*alloc fail*/
+    settings->zlibsettings.parallel_for(filterBand, &bands, count, settings->zlibsettings.parallel_context);
+    for(i = 0; i != count && !error; ++i) error = bands.error[i];
+    lodepng_free(bands.error);
+    return error;
+  }
+  return filterRows(out, in, linebytes, bytewidth, 0, h, strategy, settings, simd);
+}
+
 static void addPaddingBits(unsigned char* out, const unsigned char* in,
                            size_t olinebits, size_t ilinebits, unsigned h) {
   /*The opposite of the removePaddingBits function
@@ -5806,7 +8236,8 @@ unsigned lodepng_encode(unsigned char** out, size_t* outsize,
   lodepng_info_copy(&info, &state->info_png);
   if(state->encoder.auto_convert) {
     LodePNGColorStats stats;
-    lodepng_color_stats_init(&stats);
+    if(state->encoder.color_hint) stats = *state->encoder.color_hint;
+    else lodepng_color_stats_init(&stats);
 #ifdef LODEPNG_COMPILE_ANCILLARY_CHUNKS
     if(info_png->iccp_defined &&
         isGrayICCProfile(info_png->iccp_profile, info_png->iccp_profile_size)) {
@@ -6078,6 +8509,7 @@ void lodepng_encoder_settings_init(LodePNGEncoderSettings* settings) {
   settings->auto_convert = 1;
   settings->force_palette = 0;
   settings->predefined_filters = 0;
+  settings->color_hint = 0;
 #ifdef LODEPNG_COMPILE_ANCILLARY_CHUNKS
   settings->add_id = 0;
   settings->text_compression = 1;
@@ -6204,6 +8636,8 @@ const char* lodepng_error_text(unsigned code) {
     case 106: return "PNG file must have PLTE chunk if color type is palette";
     case 107: return "color convert from palette mode requested without setting the palette data in it";
     case 108: return "tried to add more than 256 values to a palette";
+    case 109: return "output buffer or its row stride too small for the decoded image";
+    case 110: return "invalid compression level given in the settings of the encoder (only -1 to 9 are allowed)";
   }
   return "unknown error code";
 }
@@ -6340,6 +8774,15 @@ unsigned decode(std::vector<unsigned char>& out, unsigned& w, unsigned& h, const
   std::vector<unsigned char> buffer;
   /* safe output values in case error happens */
   w = h = 0;
+#ifdef LODEPNG_COMPILE_MMAP
+  const unsigned char* mapped;
+  size_t mappedsize;
+  if(!lodepng_map_file(&mapped, &mappedsize, filename.c_str())) {
+    unsigned error = decode(out, w, h, mapped, mappedsize, colortype, bitdepth);
+    lodepng_unmap_file(mapped, mappedsize);
+    return error;
+  }
+#endif /*LODEPNG_COMPILE_MMAP*/
   unsigned error = load_file(buffer, filename);
   if(error) return error;
   return decode(out, w, h, buffer, colortype, bitdepth);
@@ -65,6 +65,19 @@ the custom_zlib field of the compress and decompress settings*/
 #define LODEPNG_COMPILE_DISK
 #endif
 
+/*map files into memory instead of reading them, needs POSIX mmap or the Windows file mapping API*/
+#if !defined(LODEPNG_NO_COMPILE_MMAP) && defined(LODEPNG_COMPILE_DISK) && \
+    (defined(_WIN32) || defined(__unix__) || defined(__APPLE__))
+#define LODEPNG_COMPILE_MMAP
+#endif
+
+/*SIMD code paths: SSE2 up to AVX2 picked at runtime on x86, NEON on ARM. They give the same
+results as the plain C code, which remains in use on other platforms.*/
+#if !defined(LODEPNG_NO_COMPILE_SIMD) && \
+    (defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64) || defined(__ARM_NEON))
+#define LODEPNG_COMPILE_SIMD
+#endif
+
 /*support for chunks other than IHDR, IDAT, PLTE, tRNS, IEND: ancillary and unknown chunks*/
 #ifndef LODEPNG_NO_COMPILE_ANCILLARY_CHUNKS
 #define LODEPNG_COMPILE_ANCILLARY_CHUNKS
@@ -301,6 +314,15 @@ struct LodePNGCompressSettings /*deflate = compress*/ {
   unsigned minmatch; /*minimum lz77 length. 3 is normally best, 6 can be better for some PNGs. Default: 0*/
   unsigned nicematch; /*stop searching if >= this length found. Set to 258 for best compression. Default: 128*/
   unsigned lazymatching; /*use lazy matching: better compression but a bit slower. Default: true*/
+  /*zlib like level from 0 (store) through 1 (fastest) to 9 (smallest), replacing use_lz77, windowsize, minmatch,
+  nicematch and lazymatching. Default: -1, use those settings*/
+  int level;
+
+  /*runs task(data, 0) to task(data, count - 1), possibly several at once on other threads, and returns once
+  all are done. When set, images are filtered and deflated in bands of 256KB, one per task, that are joined
+  into one zlib stream. parallel_context is passed as context (default: null, all on the calling thread)*/
+  void (*parallel_for)(void (*task)(void* data, size_t index), void* data, size_t count, const void* context);
+  const void* parallel_context; /*context of parallel_for, custom_context stays free for custom_zlib*/
 
   /*use custom zlib encoder instead of built in one (default: null)*/
   unsigned (*custom_zlib)(unsigned char**, size_t*,
@@ -722,6 +744,12 @@ typedef struct LodePNGEncoderSettings {
   /*force creating a PLTE chunk if colortype is 2 or 6 (= a suggested palette).
   If colortype is 3, PLTE is _always_ created.*/
   unsigned force_palette;
+  /*with auto_convert, stats to start from instead of freshly inited ones, from what the caller already
+  knows of the pixels. What they already mark as the most expensive case (colored, alpha, 16 bits, a full
+  palette or allow_palette 0) is not looked for again, so e.g. colored frames with allow_palette 0 only
+  get their alpha checked. A hint can only make the chosen color mode more expensive, never lossy.
+  Leave its numpixels at 0. Default: NULL*/
+  const LodePNGColorStats* color_hint;
 #ifdef LODEPNG_COMPILE_ANCILLARY_CHUNKS
   /*add LodePNG identifier and version as a text chunk, for debugging*/
   unsigned add_id;
@@ -763,6 +791,34 @@ unsigned lodepng_decode(unsigned char** out, unsigned* w, unsigned* h,
                         LodePNGState* state,
                         const unsigned char* in, size_t insize);
 
+/*
+Same as lodepng_decode, but decodes into memory given by the caller, such as a mapped
+pixel buffer. Row y is stored at out + y * stride in the color type of state->info_raw,
+rows always start at a byte, also when pixels are smaller than a byte. The padding
+bits at the end of such rows are not cleared, they may hold what the file has there. Use
+lodepng_inspect first to get w and h; stride must be at least
+lodepng_get_raw_size(w, 1, &state->info_raw) and outsize at least (h - 1) * stride
+plus that, else error 109 is returned.
+Scanlines are unfiltered and converted as soon as they are inflated, so besides out
+only two scanlines and the 32KB inflate window are kept in memory. Interlaced images,
+and decoding with custom_zlib or custom_inflate, still need a whole image in memory.
+*/
+unsigned lodepng_decode_into(unsigned char* out, size_t outsize, size_t stride,
+                             unsigned* w, unsigned* h, LodePNGState* state,
+                             const unsigned char* in, size_t insize);
+
+/*
+Receives a row from lodepng_decode_rows, row holds the pixels of row y in the color
+type of state->info_raw and is only valid during the call. Returning nonzero stops
+decoding, lodepng_decode_rows then returns that value.
+*/
+typedef unsigned (*lodepng_row_callback)(const unsigned char* row, unsigned y, void* user);
+
+/*Same as lodepng_decode_into, but passes every row to callback, from the top, instead of storing it.*/
+unsigned lodepng_decode_rows(lodepng_row_callback callback, void* user,
+                             unsigned* w, unsigned* h, LodePNGState* state,
+                             const unsigned char* in, size_t insize);
+
 /*
 Read the PNG header, but not the actual data. This returns only the information
 that is in the IHDR chunk of the PNG, such as width, height and color type. The
@@ -898,6 +954,9 @@ buffer. It cannot be used to create gzip files however, and it only supports the
 part of zlib that is required for PNG, it does not support dictionaries.
 */
 
+/*Calculate the Adler32 checksum of buffer, as in the zlib trailer*/
+unsigned lodepng_adler32(const unsigned char* buf, size_t len);
+
 #ifdef LODEPNG_COMPILE_DECODER
 /*Inflate a buffer. Inflate is the decompression step of deflate. Out buffer must be freed after use.*/
 unsigned lodepng_inflate(unsigned char** out, size_t* outsize,
@@ -962,6 +1021,22 @@ filename: the path to the file to save to
 return value: error code (0 means ok)
 */
 unsigned lodepng_save_file(const unsigned char* buffer, size_t buffersize, const char* filename);
+
+#ifdef LODEPNG_COMPILE_MMAP
+/*
+Map a file from disk read-only into memory. Unlike lodepng_load_file nothing is
+allocated or copied, the OS reads the pages when they are first touched, and the
+decoder inflates the IDAT chunks straight from the mapping.
+out: output parameter, pointer to the mapped file, unmap it after usage
+outsize: output parameter, size of the file
+filename: the path to the file to map
+return value: error code (0 means ok), empty files give error 78 too
+*/
+unsigned lodepng_map_file(const unsigned char** out, size_t* outsize, const char* filename);
+
+/*Unmap a file mapped with lodepng_map_file. Does nothing if buffer is NULL.*/
+void lodepng_unmap_file(const unsigned char* buffer, size_t buffersize);
+#endif /*LODEPNG_COMPILE_MMAP*/
 #endif /*LODEPNG_COMPILE_DISK*/
 
 #ifdef LODEPNG_COMPILE_CPP
@@ -1333,9 +1408,15 @@ can encode the colors of all pixels without information loss.
    true for proper compression.
 *) windowsize: the window size used by the LZ77 encoder (1 - 32768). Has value
    2048 by default, but can be set to 32768 for better, but slow, compression.
+*) level: -1 by default. 0 to 9 pick the LZ77 search like zlib levels and
+   override use_lz77, windowsize, minmatch, nicematch and lazymatching: 0 stores,
+   1 to 3 compare each position with a single earlier one, 4 to 9 follow hash
+   chains further.
 *) force_palette: if colortype is 2 or 6, you can make the encoder write a PLTE
    chunk if force_palette is true. This can used as suggested palette to convert
    to by viewers that don't support more than 256 colors (if those still exist)
+*) color_hint: with auto_convert, LodePNGColorStats to start from, so the
+   encoder does not scan the pixels for what the caller already knows.
 *) add_id: add text chunk "Encoder: LodePNG <version>" to the image.
 *) text_compression: default 1. If 1, it'll store texts as zTXt instead of tEXt chunks.
   zTXt chunks use zlib compression on the text. This gives a smaller result on
@@ -3,221 +3,361 @@
 #endif
 
 #include <iostream>
+#include <cstring>
+#include <cstddef>
+#include <cstdlib>
+#include <cmath>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <algorithm>
 #include <GLEW/glew.h>
 #include <GLFW/glfw3.h>
 #include <lodepng/lodepng.h>
 #include "Mat4x4/Mat4x4.hpp"
-
-const int n = 100; // grid size
+#include "UniformRing/UniformRing.hpp"
+#include "MeshArena/MeshArena.hpp"
+#include "GLState/GLState.hpp"
+#include "RenderQueue/RenderQueue.hpp"
+#include "ProgramCache/ProgramCache.hpp"
+#include "ShaderVariants/ShaderVariants.hpp"
+#include "TextureMix/TextureMix.hpp"
+#include "TextureAtlas/TextureAtlas.hpp"
+#include "ImageDecoder/ImageDecoder.hpp"
+
+const int n = 100; // grid size of the most detailed mesh
+const int lod_count = 4; // levels of detail
+const int lod_sizes[lod_count] = {n, n / 2, n / 4, n / 8}; // grid size of each level
 const float far = 1000.f; // far plane
 const float near = 0.01f; // near plane
 const float PI = 3.14159F;
 const float FOV_rad = 45.f / 180.f * PI; // 45 degrees
 const std::string png_paths[2] = {"./data/cell.png", "./data/dot.png"}; // paths to textures
 const int textures_count = 2;
+const std::string program_cache_dir = "./cache"; // linked program binaries
+const std::string texture_cache_dir = "./cache"; // textures with their mip chains
+const GLsizeiptr ubo_segment_size = 64 * 1024; // uniform bytes per frame
+// lighting & material constants
+const float light_pos[4] = {10.f, 10.f, 0.f, 1.f}; // view space
+const float light_color[4] = {220.f / 255.f, 220.f / 255.f, 220.f / 255.f, 1.f};
+const float eye_pos[4] = {0.f, 0.f, 0.f, 1.f}; // view space
+const float base_color[4] = {53.f / 255.f, 104.f / 255.f, 103.f / 255.f, 1.f};
+const float material[4] = {0.3f, 4.f, 0.65f, 0.f}; // d_min, s_focus, texture mix
+const float surface_a = 0.8f, surface_b = 0.6f; // default surface parameters
+// instance counts measured by --bench
+const int bench_counts[] = {1, 16, 64, 256, 1024, 4096};
+const int bench_frames = 50; // frames measured per instance count
+const int fill_width = 3840, fill_height = 2160; // fill-rate benchmark target size
+const int fill_frames = 20; // frames measured per fill-rate mode
 float aspect_ratio = 4.f / 3.f; // window aspect ratio
 float scaling_ratio = 1.f; // zoom
 
 
 GLFWwindow *g_window; // window descriptor
 
-GLuint g_shaderProgram; // shader program descriptor
-GLint g_uMVP; // Model View Projection descriptor
-GLint g_uMV; // Model View descriptor
-GLuint g_textures[textures_count]; // textures descriptor
-GLuint mapLocs[textures_count]; // textures map location
+ShaderVariants g_variants; // shader program of every feature combination in use
+unsigned g_features = SV_TEXTURES | SV_SPECULAR; // features requested on the command line
+ProgramCache g_programCache(program_cache_dir); // skips shader compilation on later launches
+TextureCache g_textureCache(texture_cache_dir); // skips decoding, mip filtering & encoding on later launches
+UniformRing g_uniforms; // per-frame & per-object uniform blocks
+TextureAtlas g_atlas; // every texture map in one array, one binding for all surfaces
+int g_mapRegions[textures_count]; // atlas region of each map
+int g_bakedRegions[textures_count]; // map i blended over map i + 1, -1 when not baked
+bool g_bake = true; // --no-bake keeps sampling both maps
+const unsigned char *g_pngFiles[textures_count]; // mapped texture files until they are decoded
+size_t g_pngSizes[textures_count];
+unsigned long long g_textureSources; // hash of the texture files & bake options
+ImageDecoder g_decoder; // decodes the texture files off the GL thread
+GLState g_state; // skips redundant per-draw GL calls
 
 struct Model {
-  GLuint vbo; // vertex buffer object descriptor
-  GLuint ibo; // index buffer object descriptor
   GLuint vao; // vertex array object descriptor
-  GLsizei indexCount; // number of indices
+  GLuint instanceVbo; // per-instance data buffer descriptor
+  GLsizei instanceCount; // number of instances
+  Mesh lods[lod_count]; // grid meshes sub-allocated in the arena
+  GLuint lodInstances[lod_count]; // number of instances drawn with each level
+  GLuint lodBaseInstance[lod_count]; // first instance of each level
 };
 
-Model g_model;
-
-GLuint createShader(const GLchar *code, GLenum type) {
-  // creating shader object
-  GLuint result = glCreateShader(type);
-  // loading shader source code
-  glShaderSource(result, 1, &code, NULL);
-  glCompileShader(result);
-
-  GLint compiled;
-  // requesting compiler status
-  glGetShaderiv(result, GL_COMPILE_STATUS, &compiled);
-  // logging error message & deleting shader if not compiled
-  if (!compiled) {
-    GLint infoLen = 0;
-    glGetShaderiv(result, GL_INFO_LOG_LENGTH, &infoLen);
-    if (infoLen > 0) {
-      char infoLog[infoLen];
-      glGetShaderInfoLog(result, infoLen, NULL, infoLog);
-      std::cout << "Shader compilation error" << std::endl
-                << infoLog << std::endl;
-    }
-    glDeleteShader(result);
-    return 0;
-  }
-  // compiled shader descriptor
-  return result;
-}
-
-GLuint createProgram(GLuint vsh, GLuint fsh) {
-  // creating shader program object
-  GLuint result = glCreateProgram();
-  // attaching vector & fragment shaders to program
-  glAttachShader(result, vsh);
-  glAttachShader(result, fsh);
-
-  glLinkProgram(result);
-
-  GLint linked;
-  // requesting linker status
-  glGetProgramiv(result, GL_LINK_STATUS, &linked);
-  // logging errors & deleting program object if not linked
-  if (!linked) {
-    GLint infoLen = 0;
-    glGetProgramiv(result, GL_INFO_LOG_LENGTH, &infoLen);
-    if (infoLen > 0) {
-      char *infoLog = (char *)alloca(infoLen);
-      glGetProgramInfoLog(result, infoLen, NULL, infoLog);
-      std::cout << "Shader program linking error" << std::endl
-                << infoLog << std::endl;
-    }
-    glDeleteProgram(result);
-    return 0;
-  }
-
-  return result;
-}
+// per-instance vertex attributes (divisor 1)
+struct Instance {
+  float model[16]; // model matrix, rotation + uniform scale + translation
+  float params[4]; // surface a, b, atlas regions of the first & second map (baked map & unused when premixed)
+};
 
-bool createShaderProgram() {
-  g_shaderProgram = 0;
+Model g_model;
+MeshArena g_arena; // vertex & index storage shared by all meshes
+IndirectBatch g_batch; // draw commands of the current frame
+RenderQueue g_queue; // draws of the current frame sorted by state
 
-  const GLchar vsh[] =
-  // setting GLSL version
-    "#version 330\n"
+// shader bodies, #version and feature #defines are prepended per variant
+const GLchar vsh[] =
   // declaring the attributes (vertices data) & assigning the descriptors to them
     "layout(location = 0) in vec2 a_position;" // x and y vector 
 	"layout(location = 1) in vec2 a_texture;" // texture coordinates
-	"out vec3  v_pos, v_normal;"
+	"layout(location = 2) in mat4 a_model;" // per-instance model matrix (locations 2-5)
+	"layout(location = 6) in vec4 a_params;" // per-instance surface parameters
+	"out vec3 v_pos;"
+	"\n#ifndef FACET_NORMALS\n"
+	"out vec3 v_normal;"
+	"\n#endif\n"
 	"out vec2 v_texCoord;" 
-  // declaring matrix uniforms (MVP, MV, MN)
-    "uniform mat4 u_mv, u_mvp;"
+	"\n#ifdef GOURAUD\n"
+	"out vec2 v_light;" // diffuse & specular factors
+	"\n#endif\n"
+	"\n#ifdef TEXTURES\n"
+	"flat out vec4 v_rect1, v_rect2;" // atlas regions of both maps
+	"flat out vec4 v_layers;" // layer & texture of both maps
+	"\n#endif\n"
+  // declaring uniform blocks (matrices, light & material)
+    "layout(std140) uniform Frame { mat4 u_proj; vec4 u_lightPos, u_lightColor, u_eyePos; };"
+    "layout(std140) uniform Object { mat4 u_mv, u_mvp, u_normal; vec4 u_baseColor, u_material; };"
+	"\n#ifdef TEXTURES\n"
+	"struct Region { vec4 rect; vec4 layer; };"
+	"layout(std140) uniform Regions { Region u_regions[ATLAS_MAX_REGIONS]; };"
+	"\n#endif\n"
   // declaring and defining surface function and derivatives
-    "float a = 0.8f;"
-	"float b = 0.6f;"
+    "float a, b;"
     "float f_surface (float x, float y) { return (x*x/(a*a) - y*y/(b*b)); }"
 	"float dF_dx (float x, float y) { return 2*x/(a*a);}"
 	"float dF_dy (float x, float y) { return -2*y/(b*b);}"
 	"float dF_dz () { return -1.f; }"
+	"\n#ifdef GOURAUD\n"
+    "%LIGHTING%"
+	"\n#endif\n"
     "void main(){"
+    "  a = a_params.x;"
+    "  b = a_params.y;"
   // defining position vector
     "  vec3 position = vec3(a_position[0], a_position[1], f_surface(a_position[0], a_position[1]));"
+    "  vec4 world = a_model * vec4(position, 1.f);"
+	"  v_pos = (u_mv * world).xyz;"
+	"\n#ifndef FACET_NORMALS\n"
 	"  vec3 grad_F = vec3(dF_dx(a_position[0], a_position[1]),"
 	"                     dF_dy(a_position[0], a_position[1]),"
 	"                     dF_dz());"
-  // normal transformation
-	"  v_normal = normalize(transpose(inverse(mat3(u_mv))) * grad_F);"
-	"  v_pos = (u_mv * vec4(position, 1.f)).xyz;"
+  // normal transformation (instance scale is uniform, so its 3x3 part is enough)
+	"  v_normal = normalize(mat3(u_normal) * mat3(a_model) * grad_F);"
+	"\n#endif\n"
+	"\n#ifdef GOURAUD\n"
+	"  v_light = lighting(v_pos, - v_normal);"
+	"\n#endif\n"
   // defining the gl_Position system variable
-    "  gl_Position = u_mvp * vec4(position, 1.f);"
+    "  gl_Position = u_mvp * world;"
 	"  v_texCoord = a_texture;"
+	"\n#ifdef TEXTURES\n"
+  // looking up instance regions once per vertex
+	"  Region region1 = u_regions[int(a_params.z)];"
+	"  Region region2 = u_regions[int(a_params.w)];"
+	"  v_rect1 = region1.rect;"
+	"  v_rect2 = region2.rect;"
+	"  v_layers = vec4(region1.layer.xy, region2.layer.xy);"
+	"\n#endif\n"
     "}";
 
-  const GLchar fsh[] =
-    "#version 330\n"
+const GLchar fsh[] =
   // explicitly declaring rendering target (color buffer) / output variable
 	"layout(location = 0) out vec4 o_color;"
-	"in vec3 v_pos, v_normal;"
+	"in vec3 v_pos;"
+	"\n#ifndef FACET_NORMALS\n"
+	"in vec3 v_normal;"
+	"\n#endif\n"
 	"in vec2 v_texCoord;"
-	"uniform sampler2D u_map1, u_map2;"
+	"\n#ifdef GOURAUD\n"
+	"in vec2 v_light;"
+	"\n#endif\n"
+	"\n#ifdef TEXTURES\n"
+	"flat in vec4 v_rect1, v_rect2;"
+	"flat in vec4 v_layers;"
+	"uniform sampler2DArray u_maps, u_packed;"
+  // repeats the region inside its layer, gradients of the unwrapped coordinates keep filtering continuous at the seams
+	"vec4 sampleRegion(vec4 rect, vec2 layer) {"
+	"  vec2 uv = v_texCoord * rect.zw;"
+	"  vec2 dx = dFdx(uv), dy = dFdy(uv);"
+  // whole layers repeat through GL_REPEAT alone
+	"  vec2 st = rect.zw == vec2(1.f) ? v_texCoord : rect.xy + fract(v_texCoord) * rect.zw;"
+  // packed images have a texture with a shorter mip chain, the choice is the same for a whole instance
+	"  if (layer.y != 0.f) return textureGrad(u_packed, vec3(st, layer.x), dx, dy);"
+	"  return textureGrad(u_maps, vec3(st, layer.x), dx, dy);"
+	"}"
+	"\n#endif\n"
+    "layout(std140) uniform Frame { mat4 u_proj; vec4 u_lightPos, u_lightColor, u_eyePos; };"
+    "layout(std140) uniform Object { mat4 u_mv, u_mvp, u_normal; vec4 u_baseColor, u_material; };"
+	"\n#ifndef GOURAUD\n"
+    "%LIGHTING%"
+	"\n#endif\n"
     "void main() {"
-  // Phong Shading
-    "  vec3 normal = - normalize(v_normal);"
-  	"  float d_min = 0.3f;"
-	"  float s_focus = 4.f;"
-	"  vec3 c_light = vec3(220.f, 220.f, 220.f) / 255.f;"
-	"  vec3 c_base = vec3(53.f, 104.f, 103.f) / 255.f;"
-	"  vec3 L = vec3(10.f, 10.f, 0.f);"
-	"  vec3 E = vec3(0.f, 0.f, 0.f);"
-
-	"  vec3 l = normalize(v_pos - L);"
+	"  vec3 c_light = u_lightColor.xyz;"
+	"\n#if defined(GOURAUD)\n"
+	"  vec2 light = v_light;"
+	"\n#elif defined(FACET_NORMALS)\n"
+  // flat normal of the triangle, facing the viewer
+	"  vec3 normal = normalize(cross(dFdx(v_pos), dFdy(v_pos)));"
+	"  vec2 light = lighting(v_pos, normal);"
+	"\n#else\n"
+	"  vec3 normal = - normalize(v_normal);"
+	"  vec2 light = lighting(v_pos, normal);"
+	"\n#endif\n"
+	"  float d = light.x;"
+	"  float s = light.y;"
+	"\n#ifdef TEXTURES\n"
+	"\n#ifdef PREMIXED\n"
+  // Both textures baked into the first region at load
+	"  vec3 albedo = sampleRegion(v_rect1, v_layers.xy).xyz;"
+	"\n#else\n"
+  // Mix two textures
+    "  vec4 mixed_textures = mix(sampleRegion(v_rect1, v_layers.xy), sampleRegion(v_rect2, v_layers.zw), u_material.z);"
+	"  vec3 albedo = mixed_textures.xyz;"
+	"\n#endif\n"
+	"\n#else\n"
+	"  vec3 albedo = u_baseColor.xyz;"
+	"\n#endif\n"
+	"  o_color = vec4(c_light * (d * albedo + vec3(s)), 1.f);"
+    "}";
+
+// Phong lighting shared by both stages, returns diffuse & specular factors
+const GLchar lighting[] =
+    "vec2 lighting(vec3 pos, vec3 normal) {"
+  	"  float d_min = u_material.x;"
+	"  float s_focus = u_material.y;"
+	"  vec3 L = u_lightPos.xyz;"
+	"  vec3 E = u_eyePos.xyz;"
+
+	"  vec3 l = normalize(pos - L);"
 	"  float cos_a = dot(-l, normal);"
 	"  float d = max(cos_a, d_min);"
-	"  vec3 e = normalize(E - v_pos);"
+	"\n#ifdef SPECULAR\n"
+	"  vec3 e = normalize(E - pos);"
 	"  vec3 r = reflect(l, normal);"
-	
 	"  float s = cos_a > 0.f ? max(pow(dot(r,e), s_focus), 0.f) : 0.f;"
-  // Mix two textures
-    "  vec4 mixed_textures = mix(texture(u_map1, v_texCoord), texture(u_map2, v_texCoord), 0.65);"
-	"  o_color = vec4(c_light * (d * mixed_textures.xyz + vec3(s)), 1.f);"
+	"\n#else\n"
+	"  float s = 0.f;"
+	"\n#endif\n"
+	"  return vec2(d, s);"
     "}";
 
-  auto vertexShader = createShader(vsh, GL_VERTEX_SHADER);
-  auto fragmentShader = createShader(fsh, GL_FRAGMENT_SHADER);
+// substitutes %LIGHTING% with the shared lighting function
+std::string withLighting(const GLchar *body) {
+  std::string result = body;
+  size_t at = result.find("%LIGHTING%");
+  if (at != std::string::npos) result.replace(at, strlen("%LIGHTING%"), lighting);
+  return result;
+}
 
-  g_shaderProgram = createProgram(vertexShader, fragmentShader);
-  
-  // getting the descriptor to the MVP uniform
-  g_uMVP = glGetUniformLocation(g_shaderProgram, "u_mvp");
-  g_uMV = glGetUniformLocation(g_shaderProgram, "u_mv");
+// features of the surfaces drawn with the given level of detail
+unsigned lodFeatures(int lod) {
+  // coarse levels are far from the center of a sweep, highlights are not visible there
+  return lod >= 2 ? g_features & ~SV_SPECULAR : g_features;
+}
 
-  glDeleteShader(vertexShader);
-  glDeleteShader(fragmentShader);
+// binds the uniform blocks & samplers of a newly linked variant
+void setupProgram(GLuint program) {
+  // assigning uniform blocks to their binding points
+  GLuint frameBlock = glGetUniformBlockIndex(program, "Frame");
+  GLuint objectBlock = glGetUniformBlockIndex(program, "Object");
+  GLuint regionsBlock = glGetUniformBlockIndex(program, "Regions");
+  if (frameBlock != GL_INVALID_INDEX) glUniformBlockBinding(program, frameBlock, UBO_FRAME_BINDING);
+  if (objectBlock != GL_INVALID_INDEX) glUniformBlockBinding(program, objectBlock, UBO_OBJECT_BINDING);
+  if (regionsBlock != GL_INVALID_INDEX) glUniformBlockBinding(program, regionsBlock, UBO_REGIONS_BINDING);
+  // texture units never change, sampler uniforms are set once
+  g_state.useProgram(program);
+  glUniform1i(glGetUniformLocation(program, "u_maps"), 0);
+  glUniform1i(glGetUniformLocation(program, "u_packed"), 1);
+}
 
-  return g_shaderProgram != 0;
+// sets up variants that finished compiling in the background, waits for
+// all of them when wait is set
+void pollVariants(bool wait = false) {
+  if (!g_variants.compiling()) return;
+  std::vector<unsigned> ready = g_variants.poll(g_programCache, wait);
+  for (size_t i = 0; i < ready.size(); ++i) setupProgram(g_variants.program(ready[i]));
 }
 
-bool createModel() {
-  // Vertex array of n^2 elements (4 attributes for each vertex)
-  GLfloat *vertices = new GLfloat[n * n * 4];
+bool createVariants(const std::vector<unsigned> &features) {
+  bool result = g_variants.build(features, g_programCache);
+  // variants still compiling are set up by pollVariants()
+  for (size_t i = 0; i < features.size(); ++i) {
+    GLuint program = g_variants.program(features[i]);
+    if (program != 0) setupProgram(program);
+  }
+  return result && g_variants.program(g_variants.select(features[0])) != 0;
+}
+
+bool createShaderProgram() {
+  // region table size is shared with the atlas
+  static const std::string regions = "#define ATLAS_MAX_REGIONS " + std::to_string(ATLAS_MAX_REGIONS) + "\n";
+  static const std::string vertexSource = regions + withLighting(vsh);
+  static const std::string fragmentSource = regions + withLighting(fsh);
+  g_variants.setSources(vertexSource.c_str(), fragmentSource.c_str());
+
+  // variants needed by every level of detail, built at once
+  std::vector<unsigned> features;
+  for (int l = 0; l < lod_count; ++l) features.push_back(lodFeatures(l));
+  return createVariants(features);
+}
+
+bool createGrid(int grid, Mesh &mesh) {
+  // Vertex array of grid^2 elements (4 attributes for each vertex)
+  GLfloat *vertices = new GLfloat[grid * grid * 4];
   // Index array
-  GLuint *indices = new GLuint[(n - 1) * (n - 1) * 6];
+  GLuint *indices = new GLuint[(grid - 1) * (grid - 1) * 6];
   uint32_t current_v = 0;
-  for (int z = 0; z < n; ++z) {
-    for (int x = 0; x < n; ++x) {
-      vertices[current_v++] = (float)x / n - 0.5f;
-      vertices[current_v++] = (float)z / n - 0.5f;
-      vertices[current_v++] = (float)x / 10;
-      vertices[current_v++] = (float)z / 10;
+  for (int z = 0; z < grid; ++z) {
+    for (int x = 0; x < grid; ++x) {
+      vertices[current_v++] = (float)x / grid - 0.5f;
+      vertices[current_v++] = (float)z / grid - 0.5f;
+      // texture repeats n / 10 times on every level
+      vertices[current_v++] = (float)x * n / (10 * grid);
+      vertices[current_v++] = (float)z * n / (10 * grid);
     }
   }
   // Going through cells counter-clockwise
   current_v = 0;
-  for (int z = 0; z < n - 1; ++z) {
-    for (int x = 0; x < n - 1; ++x) {
-      indices[current_v++] = z * n + x;
-      indices[current_v++] = (z + 1) * n + x;
-      indices[current_v++] = (z + 1) * n + x + 1;
-      indices[current_v++] = z * n + x + 1;
-      indices[current_v++] = z * n + x;
-      indices[current_v++] = (z + 1) * n + x + 1;
+  for (int z = 0; z < grid - 1; ++z) {
+    for (int x = 0; x < grid - 1; ++x) {
+      indices[current_v++] = z * grid + x;
+      indices[current_v++] = (z + 1) * grid + x;
+      indices[current_v++] = (z + 1) * grid + x + 1;
+      indices[current_v++] = z * grid + x + 1;
+      indices[current_v++] = z * grid + x;
+      indices[current_v++] = (z + 1) * grid + x + 1;
     }
   }
+  // Copying mesh into the shared vertex & index buffers
+  bool result = g_arena.allocate(vertices, grid * grid, indices, (grid - 1) * (grid - 1) * 6, mesh);
+  delete[] vertices;
+  delete[] indices;
+  return result;
+}
+
+void setInstanceBase(GLuint base_instance) {
+  glBindBuffer(GL_ARRAY_BUFFER, g_model.instanceVbo);
+  GLsizeiptr offset = base_instance * sizeof(Instance);
+  // mat4 attribute takes 4 consecutive locations (a_model)
+  for (GLuint i = 0; i < 4; ++i)
+    glVertexAttribPointer(2 + i, 4, GL_FLOAT, GL_FALSE, sizeof(Instance), (const GLvoid *)(offset + i * 4 * sizeof(GLfloat)));
+  // a_params
+  glVertexAttribPointer(6, 4, GL_FLOAT, GL_FALSE, sizeof(Instance), (const GLvoid *)(offset + offsetof(Instance, params)));
+}
+
+bool createModel() {
+  // Arena large enough for every level of detail
+  GLsizei vertexCount = 0, indexCount = 0;
+  for (int l = 0; l < lod_count; ++l) {
+    vertexCount += lod_sizes[l] * lod_sizes[l];
+    indexCount += (lod_sizes[l] - 1) * (lod_sizes[l] - 1) * 6;
+  }
+  if (!g_arena.create(vertexCount, indexCount, 4 * sizeof(GLfloat)) || !g_batch.create()) return false;
+  for (int l = 0; l < lod_count; ++l)
+    if (!createGrid(lod_sizes[l], g_model.lods[l])) return false;
+
   // Generates 1 Vertex Array Object and stores it in Model object's vao field
   glGenVertexArrays(1, &g_model.vao);
   // Activates VAO
   glBindVertexArray(g_model.vao);
-  // Generates 1 Vertex Buffer Object and stores it in Model object's vbo field
-  glGenBuffers(1, &g_model.vbo);
-  // Activates VBO
-  glBindBuffer(GL_ARRAY_BUFFER, g_model.vbo);
-  // Copying vbo data to active vertex buffer
-  glBufferData(GL_ARRAY_BUFFER, n * n * 4 * sizeof(GLfloat), vertices,
-               GL_STATIC_DRAW);
-  delete[] vertices;
-  // Generates 1 Index Buffer Object and stores it in Model object's ibo field
-  glGenBuffers(1, &g_model.ibo);
-  // Activates IBO
-  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, g_model.ibo);
-  // Copying ibo data to active index buffer
-  glBufferData(GL_ELEMENT_ARRAY_BUFFER, (n - 1) * (n - 1) * 6 * sizeof(GLuint),
-               indices, GL_STATIC_DRAW);
-  delete[] indices;
-
-  g_model.indexCount = (n - 1) * (n - 1) * 6;
+  // Arena buffers hold all meshes
+  glBindBuffer(GL_ARRAY_BUFFER, g_arena.vbo());
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, g_arena.ibo());
   // Allows using data buffer for attribute 0 (a_vertex)
   glEnableVertexAttribArray(0);
   glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(GLfloat), (const GLvoid *)0);
@@ -225,57 +365,185 @@ bool createModel() {
   glEnableVertexAttribArray(1);
   glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(GLfloat), (const GLvoid *)(2 * sizeof(GLfloat)));
 
-  return g_model.vbo != 0 && g_model.ibo != 0 && g_model.vao != 0;
+  // Generates instance buffer, filled later by createInstances
+  glGenBuffers(1, &g_model.instanceVbo);
+  for (GLuint i = 2; i <= 6; ++i) {
+    glEnableVertexAttribArray(i);
+    glVertexAttribDivisor(i, 1);
+  }
+  setInstanceBase(0);
+
+  return g_model.vao != 0 && g_model.instanceVbo != 0;
+}
+
+// regions of a map pair, map i mixed with map i + 1 (or their baked blend)
+void setInstanceRegions(Instance &instance, int pair) {
+  bool baked = (g_features & SV_PREMIXED) != 0;
+  instance.params[2] = (float)(baked ? g_bakedRegions[pair] : g_mapRegions[pair]);
+  instance.params[3] = (float)g_mapRegions[(pair + 1) % textures_count];
+}
+
+bool createInstances(int count) {
+  std::vector<Instance> instances(count);
+  std::vector<int> lods(count, 0);
+  if (count == 1) {
+    // single surface in the origin
+    Mat4x4 I;
+    memcpy(instances[0].model, I.ptr(), sizeof(instances[0].model));
+    instances[0].params[0] = surface_a;
+    instances[0].params[1] = surface_b;
+    setInstanceRegions(instances[0], 0);
+  } else {
+    // parameter sweep laid out on a square grid that fits into a unit square
+    int cols = (int)ceilf(sqrtf((float)count));
+    float cell = 1.f / cols;
+    for (int i = 0; i < count; ++i) {
+      int row = i / cols, col = i % cols;
+      float x = (col + 0.5f) * cell - 0.5f, y = (row + 0.5f) * cell - 0.5f;
+      auto T = Mat4x4::get_translation_mat(Vec3(x, y, 0.f));
+      auto S = Mat4x4::get_scaling_mat(Vec3(cell * 0.9f, cell * 0.9f, cell * 0.9f));
+      auto M = T * S;
+      memcpy(instances[i].model, M.ptr(), sizeof(instances[i].model));
+      instances[i].params[0] = 0.5f + (float)col / cols;
+      instances[i].params[1] = 0.5f + (float)row / cols;
+      // neighbours alternate the map order, all through the same binding
+      setInstanceRegions(instances[i], i % textures_count);
+      // surfaces around the center are drawn in full detail, coarser further away
+      lods[i] = std::min(lod_count - 1, (int)(2.f * sqrtf(x * x + y * y) * lod_count));
+    }
+  }
+  // Sorting instances by level, so every level is one baseInstance range
+  std::vector<Instance> sorted;
+  sorted.reserve(count);
+  for (int l = 0; l < lod_count; ++l) {
+    g_model.lodBaseInstance[l] = (GLuint)sorted.size();
+    for (int i = 0; i < count; ++i)
+      if (lods[i] == l) sorted.push_back(instances[i]);
+    g_model.lodInstances[l] = (GLuint)sorted.size() - g_model.lodBaseInstance[l];
+  }
+  glBindBuffer(GL_ARRAY_BUFFER, g_model.instanceVbo);
+  glBufferData(GL_ARRAY_BUFFER, count * sizeof(Instance), sorted.data(), GL_STATIC_DRAW);
+  g_model.instanceCount = count;
+  return true;
 }
 
-bool createTextures(const std::string *filenames) {
-  // Creates texture object
-  glGenTextures(textures_count, g_textures);
-  std::vector<unsigned char> png;
-  std::vector<unsigned char> image;
-  GLuint texW, texH;
+void unmapTextureFiles() {
+  for (int i = 0; i < textures_count; ++i) lodepng_unmap_file(g_pngFiles[i], g_pngSizes[i]);
+  std::fill(g_pngFiles, g_pngFiles + textures_count, nullptr);
+}
+
+// Maps the texture files and the built atlas from the cache, on a miss
+// the atlas is laid out from the file headers, the files go to the decoder
+// pool and finishTextures() builds it
+bool loadTextures(const std::string *filenames) {
+  // Everything the atlas is made of: file contents, names & the bake options
+  unsigned long long sources = TextureCache::hash(&g_bake, sizeof(g_bake));
+  sources = TextureCache::hash(&material[2], sizeof(material[2]), sources);
   for (int i = 0; i < textures_count; ++i) {
-    // Activate texture object
-    glBindTexture(GL_TEXTURE_2D, g_textures[i]);
-
-    // Load PNG file from disk to memory first, then decode to raw pixels in memory
-    GLuint error = lodepng::load_file(png, filenames[i]);
-    if (!error) error = lodepng::decode(image, texW, texH, png);
-    if (error) { 
-	  std::cout << "decoder error" << error << ": " << lodepng_error_text(error) << std::endl;
-  	  return 0;
+    GLuint error = lodepng_map_file(&g_pngFiles[i], &g_pngSizes[i], filenames[i].c_str());
+    if (error) {
+      std::cout << "decoder error" << error << ": " << lodepng_error_text(error) << std::endl;
+      unmapTextureFiles();
+      return 0;
+    }
+    sources = TextureCache::hash(filenames[i].data(), filenames[i].size(), sources);
+    sources = TextureCache::hash(g_pngFiles[i], g_pngSizes[i], sources);
+  }
+  g_textureSources = sources;
+
+  // Warm start maps the built atlas, no PNG is decoded
+  if (g_atlas.load(sources)) {
+    unmapTextureFiles();
+    bool baked = g_atlas.regions() == 2 * textures_count;
+    for (int i = 0; i < textures_count; ++i) {
+      g_mapRegions[i] = i;
+      g_bakedRegions[i] = baked ? textures_count + i : -1;
     }
-    png.clear();
-    // Set texture parameters
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    // Anisotropic filtering
-    if (glewIsSupported("GL_EXT_texture_filter_anisotropic")) {
-	  GLfloat fLargest;
-	  glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT, &fLargest);
-	  glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAX_ANISOTROPY_EXT, fLargest);
+    if (baked) g_features |= SV_PREMIXED;
+    return true;
+  }
+
+  // Sizes are all the layout needs, full-size maps are decoded straight
+  // into the atlas staging memory
+  unsigned widths[textures_count], heights[textures_count];
+  for (int i = 0; i < textures_count; ++i) {
+    lodepng::State state;
+    GLuint error = lodepng_inspect(&widths[i], &heights[i], &state, g_pngFiles[i], g_pngSizes[i]);
+    if (error) {
+      std::cout << "decoder error" << error << ": " << lodepng_error_text(error) << std::endl;
+      unmapTextureFiles();
+      return 0;
     }
-    // Load texture into VRAM
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, texW, texH, 0, GL_RGBA, GL_UNSIGNED_BYTE, image.data());
-    image.clear();
-    // Generate MIP
-    glGenerateMipmap(GL_TEXTURE_2D);
+    g_mapRegions[i] = g_atlas.add(nullptr, widths[i], heights[i]);
   }
-  mapLocs[0] = glGetUniformLocation(g_shaderProgram, "u_map1");
-  mapLocs[1] = glGetUniformLocation(g_shaderProgram, "u_map2");
-  return 1;
+  // Mix factor is static, blending once saves a fetch per fragment
+  bool bake = g_bake;
+  for (int i = 0; i < textures_count; ++i) {
+    int j = (i + 1) % textures_count;
+    bake = bake && widths[i] == widths[j] && heights[i] == heights[j];
+  }
+  for (int i = 0; i < textures_count; ++i) g_bakedRegions[i] = bake ? g_atlas.add(nullptr, widths[i], heights[i]) : -1;
+  if (bake) g_features |= SV_PREMIXED;
+  if (!g_atlas.reserve()) {
+    unmapTextureFiles();
+    return 0;
+  }
+  unsigned char *targets[textures_count];
+  for (int i = 0; i < textures_count; ++i) targets[i] = g_atlas.staging(g_mapRegions[i]);
+  g_decoder.start(g_pngFiles, g_pngSizes, textures_count, 0, true, targets);
+  return true;
 }
 
-bool init() {
+bool finishTextures() {
+  if (g_atlas.regionBuffer() != 0) return true;
+  // Decoding ran on the pool while the model was set up, each map is
+  // uploaded as soon as it is done while the others still decode
+  bool decoded = true;
+  for (int i; (i = g_decoder.next()) >= 0;) {
+    const DecodedImage &image = g_decoder.image(i);
+    if (image.error) {
+      std::cout << "decoder error" << image.error << ": " << lodepng_error_text(image.error) << std::endl;
+      decoded = false;
+    } else {
+      g_atlas.stream(g_mapRegions[i], image.data);
+    }
+  }
+  g_decoder.wait();
+  unmapTextureFiles();
+  if (!decoded) return 0;
+
+  // Blended maps go where the atlas wants their pixels, else into memory of their own
+  std::vector<unsigned char> mixed[textures_count];
+  for (int i = 0; i < textures_count; ++i) {
+    if (g_bakedRegions[i] < 0) continue;
+    const DecodedImage &a = g_decoder.image(i), &b = g_decoder.image((i + 1) % textures_count);
+    size_t size = (size_t)a.width * a.height * 4;
+    unsigned char *pixels = g_atlas.staging(g_bakedRegions[i]);
+    if (pixels == nullptr) {
+      mixed[i].resize(size);
+      pixels = mixed[i].data();
+    }
+    mixImages(a.data, b.data, pixels, size, material[2]);
+    g_atlas.stream(g_bakedRegions[i], pixels);
+  }
+
+  // Mips are filtered from the streamed maps, the cache keeps the atlas for the next launch
+  bool built = g_atlas.build(g_textureSources);
+  for (int i = 0; i < textures_count; ++i) std::vector<unsigned char>().swap(g_decoder.image(i).pixels);
+  return built;
+}
+
+bool init(int instances) {
   // Set initial color of color buffer to white.
   glClearColor(0.0, 0.0, 0.0, 0.0);
   glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
   glEnable(GL_DEPTH_TEST);
 
-  return createShaderProgram() && createModel() && createTextures(png_paths);
+  // PNGs decode on worker threads while the model is built, the
+  // textures come before the shaders as baking decides the variants
+  return loadTextures(png_paths) && createModel() && finishTextures() && createShaderProgram() &&
+         g_uniforms.create(ubo_segment_size) && createInstances(instances);
 }
   
 void reshape(GLFWwindow *window, int width, int height) {
@@ -283,14 +551,43 @@ void reshape(GLFWwindow *window, int width, int height) {
   aspect_ratio = (float)width / (float)height;
 }
 
+// Executes sorted queue, draws sharing the state are batched into one
+// indirect submission, program & texture changes flush the batch first
+class SurfaceDrawer : public RenderQueueHandler
+{
+public:
+  void setPass(unsigned) { g_batch.submit(setInstanceBase); g_batch.clear(); }
+  void setProgram(unsigned program) {
+    g_batch.submit(setInstanceBase);
+    g_batch.clear();
+    // key field holds the variant features
+    g_state.useProgram(g_variants.program(program));
+  }
+  void setTextures(unsigned) {
+    g_batch.submit(setInstanceBase);
+    g_batch.clear();
+    // every map lives in the atlas, regions are picked per instance
+    g_state.bindTexture(0, GL_TEXTURE_2D_ARRAY, g_atlas.texture());
+    g_state.bindTexture(1, GL_TEXTURE_2D_ARRAY, g_atlas.packedTexture());
+  }
+  // meshes share the arena, no flush needed
+  void setMesh(unsigned mesh) { m_mesh = mesh; }
+  void draw(uint32_t payload) {
+    g_batch.add(g_model.lods[m_mesh], g_model.lodInstances[payload], g_model.lodBaseInstance[payload]);
+  }
+
+private:
+  unsigned m_mesh;
+};
+
+SurfaceDrawer g_drawer;
+
 void draw(Mat4x4 &T, Vec3 &v) {
   // Clears color and depth buffer.
+  g_state.clearColor(0.117f, 0.117f, 0.176f, 1.f);
   glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-  glClearColor(0.117f, 0.117f, 0.176f, 1.f);
-  // Activates shader program
-  glUseProgram(g_shaderProgram);
   // Activates vao
-  glBindVertexArray(g_model.vao);
+  g_state.bindVertexArray(g_model.vao);
 
   // X-Rotation & Y-rotation
   auto Rx = Mat4x4::get_rotation_mat(Vec3(1.f, 0.f, 0.f), - PI / 1.75f);
@@ -306,19 +603,140 @@ void draw(Mat4x4 &T, Vec3 &v) {
   // Building MVP matrix 
   auto MV = T * S * Ry * Rx;
   auto MVP = P * MV;
-  
-  // Sending to the shader
-  glUniformMatrix4fv(g_uMV, 1, GL_FALSE, MV.ptr());
-  glUniformMatrix4fv(g_uMVP, 1, GL_FALSE, MVP.ptr());
-  
-  // Sending texture to the pipeline
-  for (GLuint i = 0; i < textures_count; ++i) {
-    glActiveTexture(GL_TEXTURE0 + i);
-    glBindTexture(GL_TEXTURE_2D, g_textures[i]);
-    glUniform1i(mapLocs[i], i);
+  auto N = MV.inverse().transpose();
+
+  // Writing frame & object blocks into the uniform ring
+  g_uniforms.beginFrame();
+  FrameUniforms frame;
+  memcpy(frame.proj, P.ptr(), sizeof(frame.proj));
+  memcpy(frame.light_pos, light_pos, sizeof(frame.light_pos));
+  memcpy(frame.light_color, light_color, sizeof(frame.light_color));
+  memcpy(frame.eye_pos, eye_pos, sizeof(frame.eye_pos));
+  GLintptr frameOffset = g_uniforms.push(&frame, sizeof(frame));
+
+  ObjectUniforms object;
+  memcpy(object.mv, MV.ptr(), sizeof(object.mv));
+  memcpy(object.mvp, MVP.ptr(), sizeof(object.mvp));
+  memcpy(object.normal, N.ptr(), sizeof(object.normal));
+  memcpy(object.base_color, base_color, sizeof(object.base_color));
+  memcpy(object.material, material, sizeof(object.material));
+  GLintptr objectOffset = g_uniforms.push(&object, sizeof(object));
+  if (frameOffset < 0 || objectOffset < 0) {
+    // Segment too small for the blocks, there is nothing valid to bind
+    g_uniforms.endFrame();
+    return;
+  }
+
+  // Sending to the shader, one upload per frame
+  g_uniforms.flush();
+  g_state.bindBufferRange(GL_UNIFORM_BUFFER, UBO_FRAME_BINDING, g_uniforms.buffer(), frameOffset, sizeof(FrameUniforms));
+  g_state.bindBufferRange(GL_UNIFORM_BUFFER, UBO_OBJECT_BINDING, g_uniforms.buffer(), objectOffset, sizeof(ObjectUniforms));
+  // static region table, bound once and skipped afterwards
+  g_state.bindBufferRange(GL_UNIFORM_BUFFER, UBO_REGIONS_BINDING, g_atlas.regionBuffer(), 0, ATLAS_MAX_REGIONS * sizeof(AtlasRegion));
+
+  // Submitting one item per level of detail, payload is the level,
+  // variants still compiling are drawn with the base one
+  pollVariants();
+  g_queue.clear();
+  for (int l = 0; l < lod_count; ++l) {
+    if (g_model.lodInstances[l] == 0) continue;
+    unsigned variant = g_variants.select(lodFeatures(l));
+    g_queue.submit(RenderQueue::makeKey(0, variant, 0, l, 0.f), l);
   }
-  // Draw call itself (sending to the pipeline)
-  glDrawElements(GL_TRIANGLES, g_model.indexCount, GL_UNSIGNED_INT, NULL);
+  g_queue.sort();
+
+  // Draw call itself (sending to the pipeline), state changes only where keys differ
+  g_batch.clear();
+  g_queue.execute(g_drawer);
+  g_batch.submit(setInstanceBase);
+  g_uniforms.endFrame();
+}
+
+void benchmark(Mat4x4 &T, Vec3 &v) {
+  // Frame time must not be capped by vsync
+  glfwSwapInterval(0);
+  // every variant is measured, not the base standing in for it
+  pollVariants(true);
+  std::cout << "instances\tframe ms\tMtriangles/s\tGL calls issued\tGL calls skipped" << std::endl;
+  for (int count : bench_counts) {
+    createInstances(count);
+    // Warm up (buffer upload, shader compilation on first use)
+    draw(T, v);
+    glfwSwapBuffers(g_window);
+    glFinish();
+
+    g_state.resetStats();
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < bench_frames; ++i) {
+      draw(T, v);
+      glfwSwapBuffers(g_window);
+      glfwPollEvents();
+    }
+    glFinish();
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    double frame_ms = elapsed.count() / bench_frames;
+    double triangles = 0;
+    for (int l = 0; l < lod_count; ++l)
+      triangles += (double)g_model.lodInstances[l] * g_model.lods[l].indexCount / 3;
+    std::cout << count << "\t" << frame_ms << "\t" << triangles / frame_ms / 1000.0 << "\t"
+              << g_state.stats().issued / bench_frames << "\t" << g_state.stats().skipped / bench_frames << std::endl;
+  }
+}
+
+void benchmarkFill(Mat4x4 &T, Vec3 &v) {
+  if (!(g_features & SV_PREMIXED)) {
+    std::cout << "Textures are not baked, nothing to compare" << std::endl;
+    return;
+  }
+  // Offscreen target, the window is too small to be fill-rate bound
+  GLuint fbo, color, depth;
+  glGenFramebuffers(1, &fbo);
+  glGenRenderbuffers(1, &color);
+  glGenRenderbuffers(1, &depth);
+  glBindRenderbuffer(GL_RENDERBUFFER, color);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, fill_width, fill_height);
+  glBindRenderbuffer(GL_RENDERBUFFER, depth);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, fill_width, fill_height);
+  glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, color);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depth);
+  glViewport(0, 0, fill_width, fill_height);
+  aspect_ratio = (float)fill_width / fill_height;
+  // Surface zoomed in to cover the whole target
+  scaling_ratio = 4.f;
+  glfwSwapInterval(0);
+
+  unsigned premixed = g_features;
+  unsigned separate = g_features & ~SV_PREMIXED;
+  std::vector<unsigned> features(1, separate);
+  createVariants(features);
+  pollVariants(true);
+  g_state.invalidate();
+
+  // numbers are only comparable on the same renderer
+  std::cout << "Renderer: " << glGetString(GL_VENDOR) << ", " << glGetString(GL_RENDERER) << std::endl;
+  std::cout << "textures\tframe ms\tMpixels/s" << std::endl;
+  const char *names[2] = {"two maps", "premixed"};
+  unsigned modes[2] = {separate, premixed};
+  for (int m = 0; m < 2; ++m) {
+    g_features = modes[m];
+    // instances point at the maps or at their baked blend
+    createInstances(g_model.instanceCount);
+    // Warm up
+    draw(T, v);
+    glFinish();
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < fill_frames; ++i) draw(T, v);
+    glFinish();
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    double frame_ms = elapsed.count() / fill_frames;
+    std::cout << names[m] << "\t" << frame_ms << "\t" << (double)fill_width * fill_height / frame_ms / 1000.0 << std::endl;
+  }
+
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  glDeleteFramebuffers(1, &fbo);
+  glDeleteRenderbuffers(1, &color);
+  glDeleteRenderbuffers(1, &depth);
 }
 
 void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods) {      
@@ -381,16 +799,46 @@ void tearDownOpenGL() {
 }
 
 void cleanup() {
-  if (g_shaderProgram != 0) glDeleteProgram(g_shaderProgram);
-  if (g_model.vbo != 0) glDeleteBuffers(1, &g_model.vbo);
-  if (g_model.ibo != 0) glDeleteBuffers(1, &g_model.ibo);
+  g_variants.destroy();
+  g_uniforms.destroy();
+  g_arena.destroy();
+  g_batch.destroy();
   if (g_model.vao != 0) glDeleteVertexArrays(1, &g_model.vao);
-  glDeleteTextures(textures_count, g_textures);
+  if (g_model.instanceVbo != 0) glDeleteBuffers(1, &g_model.instanceVbo);
+  g_atlas.destroy();
 }
 
 
-int main() {
-  
+int main(int argc, char **argv) {
+  // --instances N renders a sweep of N surfaces, --bench measures frame time
+  int instances = 1;
+  bool bench = false, benchFill = false;
+  bool compress = false;
+  BlockFormat format = BLOCK_BC7;
+  int level = BLOCK_LEVELS - 1;
+  MipFilter filter = MIP_KAISER;
+  bool srgb = true;
+  for (int i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], "--instances") == 0 && i + 1 < argc) instances = atoi(argv[++i]);
+    else if (strcmp(argv[i], "--bench") == 0) bench = true;
+    else if (strcmp(argv[i], "--bench-fill") == 0) benchFill = true;
+    else if (strcmp(argv[i], "--no-bake") == 0) g_bake = false;
+    else if (strcmp(argv[i], "--no-textures") == 0) g_features &= ~SV_TEXTURES;
+    else if (strcmp(argv[i], "--no-specular") == 0) g_features &= ~SV_SPECULAR;
+    else if (strcmp(argv[i], "--facets") == 0) g_features |= SV_FACET_NORMALS;
+    else if (strcmp(argv[i], "--gouraud") == 0) g_features |= SV_GOURAUD;
+    else if (strcmp(argv[i], "--compress") == 0 && i + 1 < argc) compress = parseBlockFormat(argv[++i], format);
+    else if (strcmp(argv[i], "--compress-level") == 0 && i + 1 < argc) level = atoi(argv[++i]);
+    else if (strcmp(argv[i], "--mip-filter") == 0 && i + 1 < argc) parseMipFilter(argv[++i], filter);
+    else if (strcmp(argv[i], "--linear-mips") == 0) srgb = false;
+  }
+  // --compress bc1|bc3|bc7 block compresses textures, --compress-level 0..2 trades encode time for quality
+  if (compress) g_atlas.setCompression(format, std::max(0, std::min(BLOCK_LEVELS - 1, level)));
+  // --mip-filter box|kaiser|lanczos picks the downsampling filter, --linear-mips averages sRGB values as they are
+  g_atlas.setMipFilter(filter, srgb);
+  g_atlas.setCache(&g_textureCache);
+  if (instances < 1) instances = 1;
+
   Mat4x4 T = Mat4x4::get_translation_mat(Vec3(0.f,0.f,-5.f));
   Vec3 v(1.f, 1.f, 1.f);
 
@@ -398,9 +846,19 @@ int main() {
   if (!initOpenGL()) return -1;
 
   // Initialize graphical resources.
-  bool isIninialised = init();
-
-  if (isIninialised) {
+  auto start = std::chrono::steady_clock::now();
+  bool isIninialised = init(instances);
+  glFinish();
+  std::chrono::duration<double, std::milli> startup = std::chrono::steady_clock::now() - start;
+  std::cout << "Startup took " << startup.count() << " ms" << std::endl;
+  // Loading touched bindings behind the state cache
+  g_state.invalidate();
+
+  if (isIninialised && bench) {
+    benchmark(T, v);
+  } else if (isIninialised && benchFill) {
+    benchmarkFill(T, v);
+  } else if (isIninialised) {
     // Main loop until window closed or escape pressed.
     while (glfwWindowShouldClose(g_window) == 0) {
 